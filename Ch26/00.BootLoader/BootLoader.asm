@@ -15,6 +15,11 @@ jmp 0x07C0:START
 TOTALSECTORCOUNT: dw 0 
 KERNEL32SECTORCOUNT: dw 0
 
+; 1 to start in VBE graphic mode, 0 to stay in text mode. it is at 0x7C09.
+; 01.Kernel32 switches the mode and clears this flag if the switch fails,
+; so 02.Kernel64 knows which mode is used
+STARTGRAPHICMODE: db 0x01
+
 ; code section
 START:
 
@@ -22,18 +27,24 @@ START:
     mov ax, 0x07C0
     mov ds, ax
 
+    ; BIOS set dl to a drive that has this bootlader program. it is saved
+    ; before rdtsc, which changes edx
+    mov byte [BOOTDRIVE], dl
+
+    ; save time stamp counter at 0x7F20 (ds:0x0320) as the first stamp of
+    ; boot timeline. 01.Kernel32 saves the next one when loading is done
+    rdtsc
+    mov dword [0x0320], eax
+    mov dword [0x0324], edx
+
     ; use es for accessing video memory
     mov ax, 0xB800
     mov es, ax
 
     ; set regs for a stack from 0x0000:0000 to 0x0000:FFFF (64KB)
-    mov ax, 0x0000
+    xor ax, ax
     mov ss, ax
     mov sp, 0xFFFE ; 0xFFFE is not mistake! this is for alignment
-    mov bp, 0xFFFE
-
-    ; BIOS set dl to a drive that has this bootlader program
-    mov byte [BOOTDRIVE], dl
 
     ; print message by using BIOS service. Some computers requires using BIOS
     ; services before using video memory address. Otherwise, nothing is printed
@@ -42,48 +53,35 @@ START:
     call print
 
 
-    ;; start of .CLEARSCREENLOOP
-    mov si, 0 ; video memory addr index
-
-; clear all screen and change text color to green
-; and print start message to the top of screen
-.CLEARSCREENLOOP:
-
-    mov byte [es:si], 0x00 ; delete all letters in screen
-    mov byte [es:si+1], 0x0A ; black background/ green color
-
-    add si, 2
-
-    cmp si, 80 * 25 * 2 ; 80 columns, 25 rows, 2 bytes 
-    jl .CLEARSCREENLOOP
-
-    mov si, 0
-    mov di, 0
+    ; clear all screen and change text color to green
+    ; (0x00: no letter, 0x0A: black background/ green color)
+    ; string instructions below move si and di forward
+    cld
+    xor di, di
+    mov ax, 0x0A00
+    mov cx, 80 * 25 ; 80 columns, 25 rows
+    rep stosw
 
     ; print welcome message
-    push MESSAGE1     ; addr of message
-    push 0            ; y coordinate
-    push 0            ; x coordinate
+    mov si, MESSAGE1
+    xor di, di               ; y = 0, x = 0
     call PRINTMESSAGE
-    add sp, 6         ; according to cdecl coordinate, remove params from stack
 
     ; print message for loading OS on the second line
-    push IMAGELOADINGMESSAGE
-    push 1
-    push 0
+    mov si, IMAGELOADINGMESSAGE
+    mov di, 1 * 160 + 0 * 2  ; y = 1, x = 0
     call PRINTMESSAGE
-    add sp, 6
 
 ; Before loading OS, reset disk by using BIOS I/O service
 RESETDISK:
     ; call BIOS reset function
-    mov ax, 0 ; service num: 0 (reset)
+    xor ax, ax ; service num: 0 (reset)
     mov dl, byte [BOOTDRIVE] ; drive num: (floppy1=0x0, hdd1=0x80)
     int 0x13
 
     jc HANDLEDISKERROR
 
-; read drive maximum CHS
+; read drive maximum CHS. it is used when BIOS does not support LBA
 READDISKPARAMTER:
     mov ah, 0x08
     mov dl, byte [BOOTDRIVE]
@@ -93,149 +91,187 @@ READDISKPARAMTER:
     mov byte [LASTHEAD], dh
     mov al, cl
     and al, 0x3F
-
     mov byte [LASTSECTOR], al
-    mov byte [LASTTRACK], ch
 
+; check if BIOS supports extended read (int 0x13, AH=0x42)
+CHECKLBA:
+    mov ah, 0x41
+    mov bx, 0x55AA
+    mov dl, byte [BOOTDRIVE]
+    int 0x13
+    jc .NOLBA
+
+    ; BIOS swaps the signature and sets bit 0 of cx when disk address packet
+    ; functions are available
+    cmp bx, 0xAA55
+    jne .NOLBA
+    test cl, 0x01
+    jz .NOLBA
+
+    mov byte [USELBA], 0x01
+
+.NOLBA:
 
     ;; start of READDATA
 
     ; 0x10000 is start addr of OS in memory
     ; regs for reading data: dest_addr
-    ; es:bx address to load the data
+    ; es:0000 address to load the data
     mov si, 0x1000
     mov es, si
-    mov bx, 0x0000
 
     ; reg for reading data: count
+    ; ImageMaker always writes 01.Kernel32, so it is not 0
     mov di, word [TOTALSECTORCOUNT]
 
+; read as many sectors as possible per BIOS call
 READDATA:
-    ; check if there is no more sectors to read
-    cmp di, 0
-    je READEND
+    ; sectors to the next 64KB boundary of memory. floppy DMA can not cross
+    ; it. es moves by whole sectors, so offset of es in 64KB is n * 512 and
+    ; ax = ~(n * 512) >> 9 = 127 - n. sectors to the boundary is 128 - n
+    mov ax, es
+    shl ax, 4
+    not ax
+    shr ax, 9
+
+    ; BIOS reads up to 127 sectors at once, so 128 - n is not made when n
+    ; is 0. ah is 0 here
+    cmp al, 127
+    je .CHECKREMAININGCOUNT
+    inc ax
+
+.CHECKREMAININGCOUNT:
+    cmp ax, di
+    jbe .CHECKMODE
+    mov ax, di
+
+.CHECKMODE:
+    cmp byte [USELBA], 0x00
+    je READCHS
+
+    ; extended read with disk address packet at ds:si
+    mov word [DAPSECTORCOUNT], ax
+    mov word [DAPSEGMENT], es
+    push ax
+    mov si, DISKADDRESSPACKET
+    mov ah, 0x42
+    mov dl, byte [BOOTDRIVE]
+    int 0x13
+
+    jc HANDLEDISKERROR
 
-    sub di, 0x01
+    pop ax
+
+    ; next LBA is after the sectors just read. image has less than 65536
+    ; sectors, so upper word of LBA is always 0
+    add word [DAPLBA], ax
+    jmp READNEXT
+
+; print error message and run infinte loop
+; it is here so every jump to it is a short jump
+HANDLEDISKERROR:
+    ; print error message at (1, 20)
+    mov si, DISKERRORMESSAGE
+    mov di, 1 * 160 + 20 * 2
+    call PRINTMESSAGE
+
+    jmp $
+
+; CHS read for old BIOS. sectors are read up to the end of track
+READCHS:
+    mov bl, byte [LASTSECTOR]
+    sub bl, byte [SECTORNUMBER]
+    inc bl
+    cmp al, bl
+    jbe .READTRACK
+    mov al, bl
+
+.READTRACK:
+    ; BIOS does not return the count on some computers. keep it on stack
+    push ax
 
     ; call BIOS I/O service
+    ; SECTORNUMBER and TRACKNUMBER are next to each other, so are BOOTDRIVE
+    ; and HEADNUMBER
     mov ah, 0x02                ; service number (read sector)
-    mov al, 0x01                ; number of sectors to read
-    mov ch, byte [TRACKNUMBER]
-    mov cl, byte [SECTORNUMBER]
-    mov dh, byte [HEADNUMBER]
-    mov dl, byte [BOOTDRIVE]    ; drive to read (0x0=Floppy1, 0x80=HDD1)
+                                ; al is number of sectors to read
+    mov cx, word [SECTORNUMBER] ; cl: sector, ch: track
+    mov dx, word [BOOTDRIVE]    ; dl: drive to read (0x0=Floppy1,
+                                ;     0x80=HDD1), dh: head
+    xor bx, bx
     int 0x13                    ; interrupt to execute service
 
-    jc HANDLEDISKERROR    
-
-    ; set next dest_addr: after 512 byte from prev dest
-    add si, 0x0020
-    mov es, si
+    jc HANDLEDISKERROR
 
-    mov al, byte [SECTORNUMBER]
-    add al, 0x01
-    mov byte [SECTORNUMBER], al
+    pop ax
 
-    cmp al, byte [LASTSECTOR]
-    jbe READDATA
+    ; move to the next sector, head and track
+    add byte [SECTORNUMBER], al
+    mov bl, byte [LASTSECTOR]
+    cmp byte [SECTORNUMBER], bl
+    jbe READNEXT
 
-    add byte [HEADNUMBER], 0x01
     mov byte [SECTORNUMBER], 0x01
+    inc byte [HEADNUMBER]
 
+    mov bl, byte [LASTHEAD]
+    cmp byte [HEADNUMBER], bl
+    jbe READNEXT
 
-    mov al, byte [LASTHEAD]
-    cmp byte [HEADNUMBER], al
-    ja .ADDTRACK
-    jmp READDATA
-
-.ADDTRACK:
     mov byte [HEADNUMBER], 0x00
-    add byte [TRACKNUMBER], 0x01
-    jmp READDATA
+    inc byte [TRACKNUMBER]
+
+; ax is number of sectors just read
+READNEXT:
+    sub di, ax
+
+    ; set next dest_addr: 512 bytes (0x20 paragraphs) per sector
+    shl ax, 5
+    mov si, es
+    add si, ax
+    mov es, si
+
+    ; check if there is no more sectors to read
+    test di, di
+    jnz READDATA
 
 READEND:
 
     ; print loading complete message at (1,20)
-    push LOADINGCOMPLETEMESSAGE
-    push 1
-    push 20
+    mov si, LOADINGCOMPLETEMESSAGE
+    mov di, 1 * 160 + 20 * 2
     call PRINTMESSAGE
-    add sp, 6
 
     ;; start of executing loaded OS
     jmp 0x1000:0x0000
 
-;; From here, functions are defined except HANDLEDISKERROR
+;; From here, functions are defined
 
-; print error message and run infinte loop
-HANDLEDISKERROR:
-    ; print error message at (1, 20)
-    push DISKERRORMESSAGE
-    push 1
-    push 20
-    call PRINTMESSAGE
-
-    jmp $
-
-; function signature in C: PrintMessage(iX, iY, pcString)
-; follow cdecl calling convention
+; print a string to video memory
+; params are passed by registers to keep boot loader in one sector
+;   si: address of string which ends with 0
+;   di: offset of video memory, y * 160 + x * 2
+; si, di, ax and es are changed. callers do not use es after it
 PRINTMESSAGE:
-    ; set env for current function: new stack, empty regs
-    ; all values will be restored at the end
-    push bp
-    mov bp, sp
-
-    push es
-    push si
-    push di
-    push ax
-    push cx
-    push dx
-    ; end of setting env
-
     ; seg for video memory address
     mov ax, 0xB800
     mov es, ax
 
-    ; calcuate video address for x and y coordinates
-    ; y coordinate
-    mov ax, word [bp+6] ; short iY
-    mov si, 160         ; 80 * 2 (row * char size of text mode)
-    mul si              ; iY * 160
-    mov di, ax
-
-    ; x coordinate
-    mov ax, word [bp+4] ; short iX
-    mov si, 2           ; 2 (char size of text mode)
-    mul si              ; iX * 2
-    add di, ax          ; di == iY * 160 + iX * 2
-
-    mov si, word [bp+8] ; char *pcString
-
 .MESSAGELOOP:
-    mov cl, byte [si]
+    lodsb
 
     ; if string ends with 0, then get out of the loop
     ; I defined every string to ends with 0
-    cmp cl, 0
-    je .MESSAGEEND
-
-    mov byte [es:di], cl
+    or al, al
+    jz .MESSAGEEND
 
-    add si, 1
-    add di, 2
+    ; write letter and skip its attribute
+    stosb
+    inc di
 
     jmp .MESSAGELOOP
 
 .MESSAGEEND:
-    ; pop in the reverse order of push because stack is Last-In, First-out
-    pop dx
-    pop cx
-    pop ax
-    pop di
-    pop si
-    pop es
-    pop bp
     ret ; go back to calling address
 
 ; print message by using BIOS service instead of video address
@@ -266,14 +302,32 @@ LOADINGCOMPLETEMESSAGE: db 'Complete~!!', 0
 
 ; disk related variables
 ; vars for reading data: src_addr
+; SECTORNUMBER and TRACKNUMBER are read into cx at once
 SECTORNUMBER: db 0x02 ; os image starts from 0x02 sector
-HEADNUMBER: db 0x00
 TRACKNUMBER: db 0x00
 
+; BOOTDRIVE and HEADNUMBER are read into dx at once
 BOOTDRIVE: db 0x00
+HEADNUMBER: db 0x00
+
 LASTSECTOR: db 0x00
 LASTHEAD: db 0x00
-LASTTRACK: db 0x00
+
+; 1 if BIOS supports extended read
+USELBA: db 0x00
+
+; disk address packet of extended read
+DISKADDRESSPACKET:
+    db 0x10         ; size of packet
+    db 0x00         ; reserved
+DAPSECTORCOUNT:
+    dw 0x0000       ; number of sectors to read
+    dw 0x0000       ; offset of buffer
+DAPSEGMENT:
+    dw 0x0000       ; segment of buffer
+DAPLBA:
+    dd 0x00000001   ; os image starts from LBA 1 (CHS sector 2)
+    dd 0x00000000
 
 ;; Some BIOS requires USB to have valid partition entry information
 ;; in MBR. I tested that a 2015 samsumg laptop does not require this info
@@ -0,0 +1,32 @@
+/*
+ * BootTime.h contains addresses of boot timeline that stages before
+ * 02.Kernel64 fill.
+ *
+ * Each stage saves time stamp counter (8 bytes) when it starts. Boot loader
+ * saves the first one and 16-bit code of EntryPoint.s saves the second one,
+ * so time of reading the image with BIOS is known. 02.Kernel64 copies them
+ * into its own timeline at boot.
+ */
+
+#ifndef __BOOTTIME_H__
+#define __BOOTTIME_H__
+
+#include "Types.h"
+
+
+// BootLoader.asm and EntryPoint.s use the same address
+#define BOOTTIME_TIMELINEADDRESS        0x7F20
+
+// index of each stamp
+#define BOOTTIME_STAMP_BOOTLOADER       0   // boot loader starts
+#define BOOTTIME_STAMP_REALMODE         1   // image is loaded, EntryPoint.s
+#define BOOTTIME_STAMP_PROTECTEDMODE    2   // C kernel starts
+#define BOOTTIME_STAMP_LOADKERNEL64     3   // inflating or copying Kernel64
+#define BOOTTIME_STAMP_SWITCHIA32E      4   // switching to IA-32e mode
+#define BOOTTIME_STAMPCOUNT             5
+
+// address of a stamp
+#define BOOTTIME_STAMPADDRESS(x)        \
+    ((void *) (BOOTTIME_TIMELINEADDRESS + (x) * 8))
+
+#endif /* __BOOTTIME_H__ */
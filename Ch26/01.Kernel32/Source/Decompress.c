@@ -0,0 +1,105 @@
+#include "Decompress.h"
+
+// inflate LZ4 block
+// params:
+//   pbSource: compressed block
+//   dwSourceSize: size of compressed block
+//   pbDestination: address to inflate to
+//   dwDestinationSize: size of destination
+// return:
+//   number of bytes inflated. 0 if the block is broken or does not fit in
+//   destination
+DWORD kDecompressLZ4Block(
+    const BYTE *pbSource,
+    DWORD dwSourceSize,
+    BYTE *pbDestination,
+    DWORD dwDestinationSize
+) {
+    const BYTE *pbSourceEnd = pbSource + dwSourceSize;
+    BYTE *pbOutput = pbDestination;
+    BYTE *pbOutputEnd = pbDestination + dwDestinationSize;
+    const BYTE *pbMatch;
+    BYTE bToken;
+    BYTE bLength;
+    DWORD dwLength;
+    DWORD dwOffset;
+
+    while (pbSource < pbSourceEnd) {
+        bToken = *pbSource++;
+
+        // literals
+        dwLength = bToken >> 4;
+        if (dwLength == 15) {
+            do {
+                if (pbSource >= pbSourceEnd) {
+                    return 0;
+                }
+                bLength = *pbSource++;
+                dwLength += bLength;
+            } while (bLength == 255);
+        }
+
+        if ((dwLength > (DWORD) (pbSourceEnd - pbSource)) ||
+            (dwLength > (DWORD) (pbOutputEnd - pbOutput))) {
+            return 0;
+        }
+
+        // literals never overlap output, so 4 bytes are copied at once
+        for (; dwLength >= 4; dwLength -= 4) {
+            *(DWORD *) pbOutput = *(const DWORD *) pbSource;
+            pbOutput += 4;
+            pbSource += 4;
+        }
+        for (; dwLength > 0; dwLength--) {
+            *pbOutput++ = *pbSource++;
+        }
+
+        // the last sequence has no match
+        if (pbSource >= pbSourceEnd) {
+            break;
+        }
+
+        // match
+        if (pbSourceEnd - pbSource < 2) {
+            return 0;
+        }
+        dwOffset = pbSource[0] | (pbSource[1] << 8);
+        pbSource += 2;
+        if ((dwOffset == 0) || (dwOffset > (DWORD) (pbOutput - pbDestination))) {
+            return 0;
+        }
+
+        dwLength = bToken & 0x0F;
+        if (dwLength == 15) {
+            do {
+                if (pbSource >= pbSourceEnd) {
+                    return 0;
+                }
+                bLength = *pbSource++;
+                dwLength += bLength;
+            } while (bLength == 255);
+        }
+        dwLength += 4;
+
+        if (dwLength > (DWORD) (pbOutputEnd - pbOutput)) {
+            return 0;
+        }
+
+        // match can overlap bytes being written when offset is small, e.g.
+        // offset 1 repeats a byte, so 4 bytes are copied at once only when
+        // they are apart enough
+        pbMatch = pbOutput - dwOffset;
+        if (dwOffset >= 4) {
+            for (; dwLength >= 4; dwLength -= 4) {
+                *(DWORD *) pbOutput = *(const DWORD *) pbMatch;
+                pbOutput += 4;
+                pbMatch += 4;
+            }
+        }
+        for (; dwLength > 0; dwLength--) {
+            *pbOutput++ = *pbMatch++;
+        }
+    }
+
+    return (DWORD) (pbOutput - pbDestination);
+}
@@ -0,0 +1,79 @@
+/*
+ * Decompress.h contains decompressor of IA-32e mode kernel image.
+ *
+ * ImageMaker compresses Kernel64.bin into LZ4 block format and puts a
+ * header in front of it, so the boot loader reads fewer sectors. A block
+ * is a series of sequences, and each sequence is
+ *
+ *   token | literal length... | literals | offset (2 bytes) | match length...
+ *
+ * upper 4 bits of token are literal length and lower 4 bits are match
+ * length - 4. 15 means that more length bytes follow until a byte is not
+ * 255. The last sequence has only literals. There is no entropy coding, so
+ * the image is inflated by copying bytes only.
+ *
+ * If the header is not found, the image is not compressed and it is copied
+ * as it is.
+ */
+
+#ifndef __DECOMPRESS_H__
+#define __DECOMPRESS_H__
+
+#include "Types.h"
+
+
+// "LZ4K" in little endian. ImageMaker writes the same value
+#define KERNEL64_COMPRESSEDSIGNATURE    0x4B345A4C
+
+// 02.Kernel64 reads this to report how the image was loaded
+#define KERNEL64_IMAGEINFOADDRESS       0x7F10
+
+// IA-32e mode kernel must fit in [2MB, 6MB)
+#define KERNEL64_STARTADDRESS           0x200000
+#define KERNEL64_MAXSIZE                0x400000
+
+
+#pragma pack(push, 1)
+
+// header in front of compressed Kernel64.bin
+typedef struct kKernel64HeaderStruct {
+    DWORD dwSignature;
+    DWORD dwCompressedSize;
+    DWORD dwUncompressedSize;
+    DWORD dwReserved;
+} KERNEL64HEADER;
+
+
+// result of loading Kernel64 that is left for 02.Kernel64
+typedef struct kKernel64ImageInfoStruct {
+    // True if the image was compressed
+    DWORD dwCompressed;
+
+    // bytes that boot loader read and bytes of kernel at 2MB
+    DWORD dwImageSize;
+    DWORD dwKernelSize;
+
+    // time stamp counter cycles to inflate or copy the image
+    DWORD dwLoadCycles;
+} KERNEL64IMAGEINFO;
+
+#pragma pack(pop)
+
+
+// inflate LZ4 block
+// params:
+//   pbSource: compressed block
+//   dwSourceSize: size of compressed block
+//   pbDestination: address to inflate to
+//   dwDestinationSize: size of destination
+// return:
+//   number of bytes inflated. 0 if the block is broken or does not fit in
+//   destination
+DWORD kDecompressLZ4Block(
+    const BYTE *pbSource,
+    DWORD dwSourceSize,
+    BYTE *pbDestination,
+    DWORD dwDestinationSize
+);
+
+#endif /* __DECOMPRESS_H__ */
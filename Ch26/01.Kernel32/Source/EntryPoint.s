@@ -4,6 +4,15 @@
 SECTION .text
 
 START:
+    ;; boot timeline
+    ;; boot loader finished loading the image. save time stamp counter
+    ;; at 0x7F28, next to the stamp that boot loader saved at 0x7F20
+    mov ax, 0x0000
+    mov es, ax
+    rdtsc
+    mov dword [es:0x7F28], eax
+    mov dword [es:0x7F2C], edx
+
     ;; get memory map
     ;; memory entry count (DWORD) at 0x20000
     ;; memory netries (QWORD+QWORD+dWORD) at 0x20004
@@ -18,6 +27,50 @@ START:
     ;; end of calling E820 BIOS service
 
 
+    ;; VBE graphic mode
+    ;; mode info block (256 bytes) at 0x7E00, right after boot loader
+    ;; far pointer of 8x16 font in VGA BIOS (offset, segment) at 0x7F00
+    mov ax, 0x0000
+    mov es, ax
+
+    ; get pointer of 8x16 font before mode is changed
+    ; es:bp is set to the font by BIOS
+    push es
+    mov ax, 0x1130 ; 0x1130: get font information
+    mov bh, 0x06   ; 0x06: 8x16 font
+    int 0x10
+    mov ax, es
+    pop es
+    mov word [es:0x7F00], bp
+    mov word [es:0x7F02], ax
+
+    ; get mode info block
+    mov ax, 0x4F01 ; 0x4F01: return VBE mode information
+    mov cx, 0x117  ; 1024 x 768, 16 bits (R5:G6:B5) color
+    mov di, 0x7E00
+    int 0x10
+    cmp ax, 0x004F ; al=0x4F: function is supported, ah=0x00: success
+    jne .VBEERROR
+
+    ; boot loader asks for text mode
+    cmp byte [es:0x7C09], 0x00
+    je .VBEEND
+
+    mov ax, 0x4F02 ; 0x4F02: set VBE mode
+    mov bx, 0x4117 ; mode 0x117 with linear frame buffer (bit 14)
+    int 0x10
+    cmp ax, 0x004F
+    je .VBEEND
+
+    .VBEERROR:
+        ; tell 02.Kernel64 that screen is still in text mode
+        mov byte [es:0x7C09], 0x00
+
+    .VBEEND:
+
+    ;; end of VBE graphic mode
+
+
     mov ax, 0x1000
     mov ds, ax
     mov es, ax
@@ -43,7 +96,8 @@ START:
         lgdt [GDTR]
         
             ; PG=0, CD=1, NW=0, AM=0, WP=0, NE=0, ET=1, EM=0, MP=1, PE=1
-            ; CD means cache disable
+            ; CD means cache disable. Main.c enables cache after memory
+            ; checks, which must read RAM instead of cache
             ; PE is protection enable    
             ; EM, ET, MP, PE are FPU-related fields and they are set
             ; although their feature is not used in IA-32 mode. they will
@@ -1,14 +1,19 @@
 #include "Types.h"
 #include "Page.h"
 #include "ModeSwitch.h"
+#include "Decompress.h"
+#include "BootTime.h"
 
 
 void kPrintString(int iX, int iY, const char *pcString);
 BOOL kInitializeKernel64Area(void);
 BOOL kIsMemoryEnough(void);
-void kCopyKernel64ImageTo2Mbyte(void);
+BOOL kCopyKernel64ImageTo2Mbyte(void);
 
 void Main(void) {
+    // 16-bit stage ends here. E820, VBE and A20 took time after loading
+    kSaveTSC(BOOTTIME_STAMPADDRESS(BOOTTIME_STAMP_PROTECTEDMODE));
+
 	kPrintString(0, 3, "C Language Kernel Started~!!!...............[Pass]");
 
     // Check if computer has enough RAM.
@@ -73,9 +78,18 @@ void Main(void) {
     }
 
     // copy IA-32e mode kernel in somewhere under address 1MiB
-    // to 0x200000 (2Mbyte)
+    // to 0x200000 (2Mbyte). compressed kernel is inflated there.
+    // memory checks are done, so cache is enabled for the copy
     kPrintString(0, 9, "Copy IA-32e Kernel To 2M Address............[    ]");
-    kCopyKernel64ImageTo2Mbyte();
+    kEnableCache();
+    kSaveTSC(BOOTTIME_STAMPADDRESS(BOOTTIME_STAMP_LOADKERNEL64));
+    if (!kCopyKernel64ImageTo2Mbyte()) {
+        kPrintString(45, 9, "Fail");
+        kPrintString(0, 10, "IA-32e Kernel Image Is Broken~!!");
+
+        // stop processing
+        while (1);
+    }
     kPrintString(45, 9, "Pass");
 
     // switch to long mode. 
@@ -83,6 +97,7 @@ void Main(void) {
     // implementation, current stack is not counted on anymore. 64 bit kernel
     // will not be able to go back to parent function calling it.
     kPrintString(0, 9, "Switch To IA-32e Mode");
+    kSaveTSC(BOOTTIME_STAMPADDRESS(BOOTTIME_STAMP_SWITCHIA32E));
     kSwitchAndExecute64bitKernel();
 
     // this code will never be executed
@@ -156,10 +171,16 @@ BOOL kIsMemoryEnough(void) {
 
 // Copy IA-32e mode kernel somewhere under address 1MB
 // to 0x20000 (2Mbyte)
-void kCopyKernel64ImageTo2Mbyte(void) {
+// return:
+//   True on success. False if compressed image can not be inflated
+// info:
+//   how the image was loaded is left at KERNEL64_IMAGEINFOADDRESS
+BOOL kCopyKernel64ImageTo2Mbyte(void) {
     WORD wKernel32SectorCount, wTotalKernelSectorCount;
     DWORD * pdwSourceAddress, *pdwDestinationAddress;
-    int i;
+    KERNEL64HEADER *pstHeader;
+    KERNEL64IMAGEINFO *pstImageInfo;
+    DWORD dwStartTSC;
     int iKernel64ByteCount;
 
     // count of overall sectors except bootloader is at
@@ -169,13 +190,45 @@ void kCopyKernel64ImageTo2Mbyte(void) {
     wKernel32SectorCount = *((WORD *) 0x7c07);
 
     pdwSourceAddress = (DWORD *) (0x10000 + (wKernel32SectorCount * 512));
-    pdwDestinationAddress = (DWORD *) 0x200000;
+    pdwDestinationAddress = (DWORD *) KERNEL64_STARTADDRESS;
 
     iKernel64ByteCount = 512 * (wTotalKernelSectorCount - wKernel32SectorCount);
-    for (i = 0; i < iKernel64ByteCount / 4; i++) {
-    	// copy 4 bytes at once
-    	*pdwDestinationAddress = *pdwSourceAddress;
-    	pdwDestinationAddress++;
-    	pdwSourceAddress++;
+
+    pstImageInfo = (KERNEL64IMAGEINFO *) KERNEL64_IMAGEINFOADDRESS;
+    pstImageInfo->dwImageSize = iKernel64ByteCount;
+    dwStartTSC = kReadTSC();
+
+    // ImageMaker puts a header in front of compressed image
+    pstHeader = (KERNEL64HEADER *) pdwSourceAddress;
+    if (pstHeader->dwSignature == KERNEL64_COMPRESSEDSIGNATURE) {
+        pstImageInfo->dwCompressed = TRUE;
+        pstImageInfo->dwImageSize =
+            sizeof(KERNEL64HEADER) + pstHeader->dwCompressedSize;
+
+        if ((pstImageInfo->dwImageSize > iKernel64ByteCount) ||
+            (pstHeader->dwUncompressedSize > KERNEL64_MAXSIZE)) {
+            return FALSE;
+        }
+
+        pstImageInfo->dwKernelSize = kDecompressLZ4Block(
+            (BYTE *) (pstHeader + 1),
+            pstHeader->dwCompressedSize,
+            (BYTE *) pdwDestinationAddress,
+            pstHeader->dwUncompressedSize
+        );
+        pstImageInfo->dwLoadCycles = kReadTSC() - dwStartTSC;
+        return (pstImageInfo->dwKernelSize == pstHeader->dwUncompressedSize);
     }
-}
\ No newline at end of file
+
+    // rep movsd copies the whole image in one instruction instead of
+    // a loop of loads and stores
+    kCopyMemoryByDword(
+        pdwDestinationAddress,
+        pdwSourceAddress,
+        iKernel64ByteCount / 4
+    );
+    pstImageInfo->dwCompressed = FALSE;
+    pstImageInfo->dwKernelSize = iKernel64ByteCount;
+    pstImageInfo->dwLoadCycles = kReadTSC() - dwStartTSC;
+    return TRUE;
+}
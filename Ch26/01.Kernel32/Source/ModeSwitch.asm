@@ -1,7 +1,8 @@
 [BITS 32]
 
 ; disclose following functions to C language code
-global kReadCPUID, kSwitchAndExecute64bitKernel
+global kReadCPUID, kSwitchAndExecute64bitKernel, kCopyMemoryByDword
+global kReadTSC, kSaveTSC, kEnableCache
 
 SECTION .text
 
@@ -46,6 +47,78 @@ kReadCPUID:
 
     ret
 
+; copy memory 4 bytes at a time with string instruction
+; PARAM: void *pvDestination, const void *pvSource, DWORD dwCount
+; dwCount is number of dwords, not bytes
+kCopyMemoryByDword:
+    push ebp
+    mov ebp, esp
+    ; saving previously used registers before using them
+    push ecx
+    push esi
+    push edi
+
+    mov edi, dword [ebp + 8]
+    mov esi, dword [ebp + 12]
+    mov ecx, dword [ebp + 16]
+
+    ; copy ecx dwords from ds:esi to es:edi forward
+    cld
+    rep movsd
+
+    pop edi
+    pop esi
+    pop ecx
+    pop ebp
+
+    ret
+
+; read lower 32 bits of time stamp counter
+; return: eax
+kReadTSC:
+    push edx
+
+    ; rdtsc returns upper 32 bits to edx and lower 32 bits to eax
+    rdtsc
+
+    pop edx
+    ret
+
+; save 64 bits time stamp counter
+; PARAM: void *pvAddress
+kSaveTSC:
+    push ebp
+    mov ebp, esp
+    push eax
+    push edx
+    push esi
+
+    rdtsc
+
+    mov esi, dword [ebp + 8]
+    mov dword [esi], eax
+    mov dword [esi + 4], edx
+
+    pop esi
+    pop edx
+    pop eax
+    pop ebp
+
+    ret
+
+; enable cache by clearing CD (bit 30) and NW (bit 29) of CR0
+; EntryPoint.s disables cache, so memory checks read back RAM instead of
+; cache. cache is enabled after them for copying Kernel64
+kEnableCache:
+    push eax
+
+    mov eax, cr0
+    and eax, 0x9FFFFFFF
+    mov cr0, eax
+
+    pop eax
+    ret
+
 ; switch protected mode to long mode and run code at x200000 (2 MiB)
 ; this function modifies CR0, CR3, CR4, and IA32_EFER so cpu switches to IA-32e
 ; with cache and paging enabled. The Cache is write-through cache mode, and
@@ -19,6 +19,35 @@ void kReadCPUID(
     DWORD *pdwEDX
 );
 
+// copy memory 4 bytes at a time with rep movsd
+// params:
+//   pvDestination: address to copy to
+//   pvSource: address to copy from
+//   dwCount: number of dwords to copy
+void kCopyMemoryByDword(
+    void *pvDestination,
+    const void *pvSource,
+    DWORD dwCount
+);
+
+// read lower 32 bits of time stamp counter
+// return:
+//   counter. difference of two values is right if it is less than 2^32
+DWORD kReadTSC(void);
+
+// save 64 bits time stamp counter
+// params:
+//   pvAddress: address to save 8 bytes counter
+// info:
+//   QWORD is 32 bits in this kernel, so the counter is saved to memory
+void kSaveTSC(void *pvAddress);
+
+// enable cache that EntryPoint.s disabled
+// info:
+//   memory checks must be done before, because they need to read RAM
+//   instead of cache
+void kEnableCache(void);
+
 // switch protected mode to long mode
 // this function modifies CR0, CR3, CR4, and IA32_EFER so cpu switches to IA-32e
 // with cache and paging enabled. The Cache is write-through cache mode, and
@@ -4,7 +4,7 @@ SECTION .text
 
 ; I/O port related functions
 global kInPortByte, kOutPortByte, kInPortWord, kOutPortWord
-global kInPortDword, kOutPortDword
+global kInPortDword, kOutPortDword, kInPortWordString, kOutPortWordString
 
 ; GDT, IDT, and TSS related functions
 global kLoadGDTR, kLoadTR, kLoadIDTR
@@ -22,11 +22,18 @@ global kSwitchContext
 global kHlt
 
 ; MUTEX related functions
-global kTestAndSet
+global kTestAndSet, kAtomicFetchAndAdd
 
 ;FPU related functions
 global kInitializeFPU, kSaveFPUContext, kLoadFPUContext, kSetTS, kClearTS
 
+; control register, MSR and CPUID related functions
+global kReadCR0, kWriteCR0, kReadCR2, kReadCR3, kWriteCR3, kReadCR4, kWriteCR4
+global kInvalidatePage, kReadMSR, kWriteMSR, kReadCPUID
+
+; SSE related functions
+global kFillMemorySSE, kCopyMemorySSE
+
 
 ;; I/O port related functions
 
@@ -132,6 +139,43 @@ kOutPortDword:
     ret
 
 
+; function that reads words from port to memory with rep insw
+; this function follows IA-32e mode function convention
+; params:
+;   port address (word): I/O port address to read data
+;   buffer: address to save data
+;   count: number of words to read
+kInPortWordString:
+    push rdx
+
+    mov rcx, rdx ; count
+    mov rdx, rdi ; port address
+    mov rdi, rsi ; buffer
+    cld
+    rep insw
+
+    pop rdx
+    ret
+
+
+; function that writes words from memory to port with rep outsw
+; this function follows IA-32e mode function convention
+; params:
+;   port address (word): I/O port address to write data
+;   buffer: address of data to write
+;   count: number of words to write
+kOutPortWordString:
+    push rdx
+
+    mov rcx, rdx ; count
+    mov rdx, rdi ; port address
+    cld
+    rep outsw
+
+    pop rdx
+    ret
+
+
 ;; GDT, IDT, and TSS related functions
 
 ; function that loads GDTR address to register
@@ -194,9 +238,22 @@ kReadTSC:
 ;; context switch related macros and functions
 
 
-; macro that stores registers to task CONTEXT array
-; it is required to set CONTEXT array as stack
-; and push SS, RSP, RFLAGS, CS, RIP first before
+; macro that restores a segment selector popped from stack
+; loading a segment selector is slow because processor reads and checks
+; the descriptor in GDT, so the selector is loaded only if it changes
+; rax and rbx are used as temp registers. They must be restored later
+%macro KRESTORESEGMENT 1
+    pop rax
+    mov bx, %1
+    cmp ax, bx
+    je %%SameSelector
+    mov %1, ax
+%%SameSelector:
+%endmacro
+
+
+; macro that stores registers to task CONTEXT on stack
+; it is required to push SS, RSP, RFLAGS, CS, RIP first before
 ; using this macro
 ; you can see similar macro in ISR.asm
 %macro KSAVECONTEXT 0
@@ -225,18 +282,14 @@ kReadTSC:
 %endmacro
 
 
-; macro that restore registers to task CONTEXT array
-; it is required to set CONTEXT array as stack
-; and the array shoud have registers pushed by
-; KSAVECONTEXT macro
+; macro that restore registers from task CONTEXT on stack
+; rsp must point to registers pushed by KSAVECONTEXT macro
 ; you can see similar macro in ISR.asm
 %macro KLOADCONTEXT 0
-    pop gs
-    pop fs
-    pop rax
-    mov es, ax
-    pop rax
-    mov ds, ax
+    KRESTORESEGMENT gs
+    KRESTORESEGMENT fs
+    KRESTORESEGMENT es
+    KRESTORESEGMENT ds
     
     pop r15
     pop r14
@@ -256,66 +309,61 @@ kReadTSC:
 %endmacro
 
 
-; save current task context to task data structure
-; and load next task context to run
+; save current task context on its own stack and load next task context
+; from next task's stack
 ; params:
-;   pstCurrentContext: pointer where current context will be stored
-;   pstNextContext: pointer to context to load
+;   ppstCurrentContext: pointer where address of current context will be
+;                       stored
+;   pstNextContext: address of context to load
 ; info:
 ;   this looks like a function. However, it works slight different way.
-;   this code must be called, but it never returns. and it preserves
-;   registers instead of pushing to stack, so it can store the registers
-;   of the task
+;   this code must be called, but it never returns. It builds the same
+;   context that interrupt handler builds on the stack, so a task switched
+;   out by this function can be switched in by timer interrupt handler and
+;   vice versa. Switching tasks only exchanges stack pointers
 kSwitchContext:
     push rbp
     mov rbp, rsp    ; use rbp as a base to point return address
 
     pushfq      ; cmp can modify RFLAGS, so push it before cmp
     cmp rdi, 0
-    je .LoadContext ; if pstCurrentContet is empty
+    je .LoadContext ; if ppstCurrentContext is empty
     popfq
 
 
-    ;; save current task context
+    ;; push SS, RSP, RFLAGS, CS, RIP like processor does when interrupt
+    ;; happens
 
     push rax    ; rax reigster is used as temp variable
-    
+
     mov ax, ss
-    mov qword [rdi + (23 * 8)], rax
+    push rax
 
-    ; save rsp of caller before calling this func
+    ; rsp of caller before calling this func
     ; 16 is rbp + return addr in stack
-    mov rax, rbp
-    add rax, 16
-    mov qword [rdi + (22 * 8)], rax
+    lea rax, [rbp + 16]
+    push rax
 
-    ; save rflags
     pushfq
-    pop rax
-    mov qword [rdi + (21 * 8)], rax
 
-    ; save cs
     mov ax, cs
-    mov qword [rdi + (20 * 8)], rax
+    push rax
 
-    ; save instruct pointer that points after this func
+    ; instruct pointer that points after this func
     mov rax, qword [rbp + 8]
-    mov qword [rdi + (19 * 8)], rax
-
+    push rax
 
-    ;; prepare before calling KSAVECONTEXT
-    ;; In other words, leave all registers like before calling func
 
-    pop rax
-    pop rbp
+    ;; leave all registers like before calling func and save them
 
-    ; change rsp that points to current context
-    add rdi, (19 * 8)
-    mov rsp, rdi
-    sub rdi, (19 * 8)
+    mov rax, qword [rbp - 8]
+    mov rbp, qword [rbp]
 
     KSAVECONTEXT
 
+    ; current context is at the top of the stack
+    mov qword [rdi], rsp
+
 .LoadContext:
     ; set rsp to points next context
     mov rsp, rsi
@@ -363,6 +411,20 @@ kTestAndSet:
         ret
 
 
+; add a value to destination memory atomically
+; params:
+;   pqwDestination: pointer to a value to change
+;   qwValue: a value to add
+; return:
+;   the value in destination memory before adding
+kAtomicFetchAndAdd:
+    mov rax, rsi ; move second parameter (qwValue) to rax
+
+    ; exchange rax and [rdi] and store their sum to [rdi]
+    lock xadd qword [rdi], rax
+    ret
+
+
 ;; FPU related functions
 
 ; initialize registers in FPU device
@@ -414,4 +476,178 @@ kSetTS:
 ;   the bit
 kClearTS:
     clts    ; instruction that clears ts bit
-    ret
\ No newline at end of file
+    ret
+
+
+;; control register, MSR and CPUID related functions
+
+; return value of CR0
+kReadCR0:
+    mov rax, cr0
+    ret
+
+; write value to CR0
+; params:
+;   qwValue: value to write
+kWriteCR0:
+    mov cr0, rdi
+    ret
+
+; return value of CR2 which has address that caused page fault
+kReadCR2:
+    mov rax, cr2
+    ret
+
+; return value of CR3 which has address of PML4 table
+kReadCR3:
+    mov rax, cr3
+    ret
+
+; write value to CR3
+; info:
+;   writing CR3 flushes all TLB entries except global pages
+; params:
+;   qwValue: value to write
+kWriteCR3:
+    mov cr3, rdi
+    ret
+
+; return value of CR4
+kReadCR4:
+    mov rax, cr4
+    ret
+
+; write value to CR4
+; params:
+;   qwValue: value to write
+kWriteCR4:
+    mov cr4, rdi
+    ret
+
+; invalidate TLB entry of page that has the address
+; params:
+;   qwAddress: virtual address in the page
+kInvalidatePage:
+    invlpg [rdi]
+    ret
+
+; read model specific register
+; params:
+;   dwMSR: address of MSR
+; return:
+;   64 bits value of the MSR
+kReadMSR:
+    push rcx
+    push rdx
+
+    mov rcx, rdi
+    rdmsr       ; return value at EDX:EAX (high:low)
+
+    shl rdx, 32
+    mov eax, eax    ; clear high 32 bits of rax
+    or rax, rdx
+
+    pop rdx
+    pop rcx
+    ret
+
+; write model specific register
+; params:
+;   dwMSR: address of MSR
+;   qwValue: value to write
+kWriteMSR:
+    push rax
+    push rcx
+    push rdx
+
+    mov rcx, rdi
+    mov rax, rsi    ; low 32 bits
+    mov rdx, rsi
+    shr rdx, 32     ; high 32 bits
+    wrmsr
+
+    pop rdx
+    pop rcx
+    pop rax
+    ret
+
+; execute CPUID instruction
+; params:
+;   dwEAX: information to look up
+;   pdwEAX, pdwEBX, pdwECX, pdwEDX: address where registers returned by
+;                                   CPUID instruction will reside
+kReadCPUID:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push r10
+    push r11
+
+    ; rdx and rcx are used by cpuid, so keep the pointers in other registers
+    mov r10, rdx
+    mov r11, rcx
+
+    mov eax, edi
+    cpuid
+
+    mov dword [rsi], eax
+    mov dword [r10], ebx
+    mov dword [r11], ecx
+    mov dword [r8], edx
+
+    pop r11
+    pop r10
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    ret
+
+
+;; SSE related functions
+
+; fill memory with 8 bytes pattern 16 bytes at a time
+; params:
+;   pvDestination: address aligned on 16 bytes
+;   qwPattern: 8 bytes pattern to repeat
+;   qwSize: size to fill. multiple of 16
+kFillMemorySSE:
+    ; copy pattern to both halves of xmm0
+    movq xmm0, rsi
+    punpcklqdq xmm0, xmm0
+
+    shr rdx, 4 ; number of 16 bytes blocks
+    jz .END
+
+.LOOP:
+    movdqa [rdi], xmm0
+    add rdi, 16
+    dec rdx
+    jnz .LOOP
+
+.END:
+    ret
+
+
+; copy memory 16 bytes at a time
+; params:
+;   pvDestination: destination address
+;   pvSource: source address
+;   qwSize: size to copy. multiple of 16
+; info:
+;   addresses do not need to be aligned
+kCopyMemorySSE:
+    shr rdx, 4 ; number of 16 bytes blocks
+    jz .END
+
+.LOOP:
+    movdqu xmm0, [rsi]
+    movdqu [rdi], xmm0
+    add rsi, 16
+    add rdi, 16
+    dec rdx
+    jnz .LOOP
+
+.END:
+    ret
@@ -50,6 +50,22 @@ DWORD kInPortDword(WORD wPort);
 void kOutPortDword(WORD wPort, DWORD dwData);
 
 
+// function that reads words from port to memory at once (rep insw)
+// param:
+//   port address (word): I/O port address to read data
+//   pvBuffer: address to save data
+//   qwCount: number of words to read
+void kInPortWordString(WORD wPort, void *pvBuffer, QWORD qwCount);
+
+
+// function that writes words from memory to port at once (rep outsw)
+// param:
+//   port address (word): I/O port address to write data
+//   pvBuffer: address of data to write
+//   qwCount: number of words to write
+void kOutPortWordString(WORD wPort, const void *pvBuffer, QWORD qwCount);
+
+
 /* GDT, IDT, and TSS related functions */
 
 // function that loads GDTR address to register
@@ -92,17 +108,19 @@ QWORD kReadTSC(void);
 
 /* context switch related functions */
 
-// save current task context to task data structure
-// and load next task context to run
+// save current task context on its own stack and load next task context
+// from next task's stack
 // params:
-//   pstCurrentContext: pointer where current context will be stored
-//   pstNextContext: pointer to context to load
+//   ppstCurrentContext: pointer where address of current context will be
+//                       stored
+//   pstNextContext: address of context to load
 // info:
 //   this looks like a function. However, it works slight different way.
-//   this code must be called, but it never returns. and it preserves
-//   registers instead of pushing to stack, so it can store the registers
-//   of the task
-void kSwitchContext(CONTEXT *pstCurrentContext, CONTEXT *pstNextContext);
+//   this code must be called, but it never returns. It builds the same
+//   context that interrupt handler builds on the stack, so a task switched
+//   out by this function can be switched in by timer interrupt handler and
+//   vice versa. Switching tasks only exchanges stack pointers
+void kSwitchContext(CONTEXT **ppstCurrentContext, CONTEXT *pstNextContext);
 
 
 /* Processor Halt related functions */
@@ -122,6 +140,15 @@ void kHlt(void);
 BOOL kTestAndSet(volatile BYTE *pbDestination, BYTE bCompare, BYTE bSource);
 
 
+// add a value to destination memory atomically
+// params:
+//   pqwDestination: pointer to a value to change
+//   qwValue: a value to add
+// return:
+//   the value in destination memory before adding
+QWORD kAtomicFetchAndAdd(volatile QWORD *pqwDestination, QWORD qwValue);
+
+
 /* FPU related functions */
 
 // initialize registers in FPU device
@@ -163,4 +190,102 @@ void kSetTS(void);
 void kClearTS(void);
 
 
+
+/* control register, MSR and CPUID related functions */
+
+// return value of CR0
+QWORD kReadCR0(void);
+
+
+// write value to CR0
+// params:
+//   qwValue: value to write
+void kWriteCR0(QWORD qwValue);
+
+
+// return value of CR2 which has address that caused page fault
+QWORD kReadCR2(void);
+
+
+// return value of CR3 which has address of PML4 table
+QWORD kReadCR3(void);
+
+
+// write value to CR3
+// params:
+//   qwValue: value to write
+// info:
+//   writing CR3 flushes all TLB entries except global pages
+void kWriteCR3(QWORD qwValue);
+
+
+// return value of CR4
+QWORD kReadCR4(void);
+
+
+// write value to CR4
+// params:
+//   qwValue: value to write
+void kWriteCR4(QWORD qwValue);
+
+
+// invalidate TLB entry of page that has the address
+// params:
+//   qwAddress: virtual address in the page
+void kInvalidatePage(QWORD qwAddress);
+
+
+// read model specific register
+// params:
+//   dwMSR: address of MSR
+// return:
+//   64 bits value of the MSR
+QWORD kReadMSR(DWORD dwMSR);
+
+
+// write model specific register
+// params:
+//   dwMSR: address of MSR
+//   qwValue: value to write
+void kWriteMSR(DWORD dwMSR, QWORD qwValue);
+
+
+// execute CPUID instruction
+// params:
+//   dwEAX: information to look up
+//   pdwEAX: address where EAX returned by CPUID instruction will resides
+//   pdwEBX: address where EBX returned by CPUID instruction will resides
+//   pdwECX: address where ECX returned by CPUID instruction will resides
+//   pdwEDX: address where EDX returned by CPUID instruction will resides 
+void kReadCPUID(
+    DWORD dwEAX,
+    DWORD *pdwEAX,
+    DWORD *pdwEBX,
+    DWORD *pdwECX,
+    DWORD *pdwEDX
+);
+
+
+
+/* SSE related functions */
+
+// fill memory with 8 bytes pattern 16 bytes at a time
+// params:
+//   pvDestination: address aligned on 16 bytes
+//   qwPattern: 8 bytes pattern to repeat
+//   qwSize: size to fill. multiple of 16
+// info:
+//   it uses xmm0, so FPU context of the task is used
+void kFillMemorySSE(void *pvDestination, QWORD qwPattern, QWORD qwSize);
+
+
+// copy memory 16 bytes at a time
+// params:
+//   pvDestination: destination address
+//   pvSource: source address
+//   qwSize: size to copy. multiple of 16
+// info:
+//   addresses do not need to be aligned
+void kCopyMemorySSE(void *pvDestination, const void *pvSource, QWORD qwSize);
+
 #endif /* __ASSEMBLYUTILITY_H__ */
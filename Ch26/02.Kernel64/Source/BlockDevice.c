@@ -0,0 +1,654 @@
+#include "BlockDevice.h"
+#include "Utility.h"
+#include "Task.h"
+#include "DynamicMemory.h"
+
+static BLOCKDEVICEMANAGER gs_stBlockDeviceManager;
+
+
+// initialize block device registry
+// info:
+//   it must be called before drivers register devices
+void kInitializeBlockDeviceManager(void) {
+    kMemSet(&gs_stBlockDeviceManager, 0, sizeof(gs_stBlockDeviceManager));
+    kInitializeMutex(&(gs_stBlockDeviceManager.stMutex));
+}
+
+
+// register a drive as a block device
+// params:
+//   pcName: name of device. up to BLOCKDEVICE_MAXNAMELENGTH characters
+//   bPrimary: select primary controller or secondary controller
+//   bMaster: select master or slave drive
+//   qwTotalSectorCount: number of sectors of drive
+//   pfReadInformation, pfReadSector, pfWriteSector: driver functions
+// return:
+//   True on success. False if name is too long or there is no free slot
+// info:
+//   device that has the same name is replaced
+BOOL kRegisterBlockDevice(
+    const char *pcName,
+    BOOL bPrimary,
+    BOOL bMaster,
+    QWORD qwTotalSectorCount,
+    fReadHDDInformation pfReadInformation,
+    fReadHDDSector pfReadSector,
+    fWriteHDDSector pfWriteSector
+) {
+    BLOCKDEVICE *pstDevice;
+    int iLength;
+    int i;
+
+    iLength = kStrLen(pcName);
+    if ((iLength == 0) || (iLength > BLOCKDEVICE_MAXNAMELENGTH)) {
+        return FALSE;
+    }
+
+    kLock(&(gs_stBlockDeviceManager.stMutex));
+
+    // the same name or the first free slot
+    pstDevice = kFindBlockDevice(pcName);
+    for (i = 0; (pstDevice == NULL) && (i < BLOCKDEVICE_MAXCOUNT); i++) {
+        if (gs_stBlockDeviceManager.vstDevice[i].vcName[0] == '\0') {
+            pstDevice = &(gs_stBlockDeviceManager.vstDevice[i]);
+        }
+    }
+
+    if (pstDevice == NULL) {
+        kUnlock(&(gs_stBlockDeviceManager.stMutex));
+        return FALSE;
+    }
+
+    // queue of a new slot is empty. queue of replaced device is kept
+    if (pstDevice->vcName[0] == '\0') {
+        kMemSet(&(pstDevice->stQueue), 0, sizeof(BLOCKQUEUE));
+    }
+
+    kMemCpy(pstDevice->vcName, pcName, iLength + 1);
+    pstDevice->bPrimary = bPrimary;
+    pstDevice->bMaster = bMaster;
+    pstDevice->qwTotalSectorCount = qwTotalSectorCount;
+    pstDevice->pfReadInformation = pfReadInformation;
+    pstDevice->pfReadSector = pfReadSector;
+    pstDevice->pfWriteSector = pfWriteSector;
+
+    kUnlock(&(gs_stBlockDeviceManager.stMutex));
+    return TRUE;
+}
+
+
+// find a block device by name
+// params:
+//   pcName: name of device
+// return:
+//   device. NULL if it is not registered
+BLOCKDEVICE *kFindBlockDevice(const char *pcName) {
+    BLOCKDEVICE *pstDevice;
+    int iLength;
+    int i;
+
+    iLength = kStrLen(pcName);
+    if ((iLength == 0) || (iLength > BLOCKDEVICE_MAXNAMELENGTH)) {
+        return NULL;
+    }
+
+    for (i = 0; i < BLOCKDEVICE_MAXCOUNT; i++) {
+        pstDevice = &(gs_stBlockDeviceManager.vstDevice[i]);
+        if (kMemCmp(pstDevice->vcName, pcName, iLength + 1) == 0) {
+            return pstDevice;
+        }
+    }
+    return NULL;
+}
+
+
+// get a block device by index of registry
+// params:
+//   iIndex: 0 ~ BLOCKDEVICE_MAXCOUNT - 1
+// return:
+//   device. NULL if the slot is free
+BLOCKDEVICE *kGetBlockDevice(int iIndex) {
+    if (
+        (iIndex < 0) || (iIndex >= BLOCKDEVICE_MAXCOUNT) ||
+        (gs_stBlockDeviceManager.vstDevice[iIndex].vcName[0] == '\0')
+    ) {
+        return NULL;
+    }
+    return &(gs_stBlockDeviceManager.vstDevice[iIndex]);
+}
+
+
+// create dispatch task of every registered device
+// info:
+//   it must be called after scheduler is initialized. requests are served
+//   by callers until then
+void kStartBlockDeviceTask(void) {
+    int i;
+
+    for (i = 0; i < BLOCKDEVICE_MAXCOUNT; i++) {
+        if (kGetBlockDevice(i) == NULL) {
+            continue;
+        }
+
+        // I/O of tasks waits for it, so it runs with high priority
+        kCreateTask(
+            TASK_FLAGS_HIGH | TASK_FLAGS_SYSTEM | TASK_FLAGS_THREAD,
+            0,
+            0,
+            (QWORD) kBlockDeviceDispatchTask
+        );
+    }
+}
+
+
+// task that drains dispatch queue of a device
+// info:
+//   each task takes a device that no other task serves
+void kBlockDeviceDispatchTask(void) {
+    BLOCKDEVICE *pstDevice = NULL;
+    BLOCKQUEUE *pstQueue;
+    BLOCKREQUEST *pstRun;
+    int iSectorCount;
+    BOOL bPreviousFlag;
+    int i;
+
+
+    /* take a device */
+
+    kLock(&(gs_stBlockDeviceManager.stMutex));
+    for (i = 0; i < BLOCKDEVICE_MAXCOUNT; i++) {
+        if (
+            (kGetBlockDevice(i) != NULL) &&
+            (gs_stBlockDeviceManager.vstDevice[i].stQueue.bStarted == FALSE)
+        ) {
+            pstDevice = &(gs_stBlockDeviceManager.vstDevice[i]);
+            break;
+        }
+    }
+
+    if (pstDevice == NULL) {
+        kUnlock(&(gs_stBlockDeviceManager.stMutex));
+        return;
+    }
+
+    // requests are not merged if there is no memory
+    pstQueue = &(pstDevice->stQueue);
+    pstQueue->pcMergeBuffer =
+        (char *) kAllocateMemory(BLOCKQUEUE_MAXMERGESECTORCOUNT * 512);
+    pstQueue->bStarted = TRUE;
+    kUnlock(&(gs_stBlockDeviceManager.stMutex));
+
+
+    /* serve requests */
+
+    while (TRUE) {
+        // queue is checked and task is blocked while system data is
+        // locked, so a request that comes between them is not missed
+        bPreviousFlag = kLockForSystemData();
+        while (pstQueue->pstHeader == NULL) {
+            kBlockTask(pstQueue, TASK_WAITFOREVER);
+        }
+        pstRun = kRemoveBlockRequestRun(pstQueue, &iSectorCount);
+        kUnlockForSystemData(bPreviousFlag);
+
+        kDispatchBlockRequestRun(pstDevice, pstRun, iSectorCount);
+    }
+}
+
+
+// submit a request to dispatch queue of a device
+// params:
+//   pstDevice: device
+//   pstRequest: request. bWrite, qwLBA, iSectorCount, pcBuffer and
+//               pfCallback must be set
+// return:
+//   True if the request is queued or already served. Otherwise False
+// info:
+//   request must be kept until it completes. A request that has a callback
+//   belongs to the callback when it completes, so it must not be waited
+//   for with kWaitBlockRequest
+BOOL kSubmitBlockRequest(BLOCKDEVICE *pstDevice, BLOCKREQUEST *pstRequest) {
+    BLOCKQUEUE *pstQueue;
+    BOOL bPreviousFlag;
+
+    if ((pstDevice == NULL) || (pstRequest->iSectorCount <= 0)) {
+        return FALSE;
+    }
+
+    pstRequest->pstNext = NULL;
+    pstRequest->bStatus = BLOCKREQUEST_STATUS_PENDING;
+    pstRequest->iTransferredCount = 0;
+
+    // caller serves the request until dispatch task starts
+    pstQueue = &(pstDevice->stQueue);
+    if (pstQueue->bStarted == FALSE) {
+        kDispatchBlockRequestRun(
+            pstDevice,
+            pstRequest,
+            pstRequest->iSectorCount
+        );
+        return TRUE;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstRequest->qwSequence = pstQueue->qwRequestCount++;
+    pstRequest->qwDeadlineTickCount = kGetTickCount() + (
+        pstRequest->bWrite ?
+            BLOCKQUEUE_WRITEDEADLINE : BLOCKQUEUE_READDEADLINE
+    );
+    kInsertBlockRequest(pstQueue, pstRequest);
+    kWakeUpTasks(pstQueue);
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// wait until a request completes
+// params:
+//   pstRequest: submitted request
+// return:
+//   number of sectors transferred
+int kWaitBlockRequest(BLOCKREQUEST *pstRequest) {
+    BOOL bPreviousFlag;
+
+    bPreviousFlag = kLockForSystemData();
+    while (pstRequest->bStatus == BLOCKREQUEST_STATUS_PENDING) {
+        kBlockTask(pstRequest, TASK_WAITFOREVER);
+    }
+    kUnlockForSystemData(bPreviousFlag);
+
+    return pstRequest->iTransferredCount;
+}
+
+
+// read sectors from a block device
+// params:
+//   pstDevice: device to read
+//   qwLBA: first sector
+//   iSectorCount: number of sectors
+//   pcBuffer: buffer to save data
+// return:
+//   number of sectors actually read
+// info:
+//   request goes through dispatch queue and caller waits for it
+int kReadBlockDevice(
+    const BLOCKDEVICE *pstDevice,
+    QWORD qwLBA,
+    int iSectorCount,
+    char *pcBuffer
+) {
+    BLOCKREQUEST stRequest;
+
+    stRequest.bWrite = FALSE;
+    stRequest.qwLBA = qwLBA;
+    stRequest.iSectorCount = iSectorCount;
+    stRequest.pcBuffer = pcBuffer;
+    stRequest.pfCallback = NULL;
+    stRequest.pvCallbackParameter = NULL;
+
+    if (kSubmitBlockRequest((BLOCKDEVICE *) pstDevice, &stRequest) == FALSE) {
+        return 0;
+    }
+    return kWaitBlockRequest(&stRequest);
+}
+
+
+// write sectors to a block device
+// params:
+//   pstDevice: device to write
+//   qwLBA: first sector
+//   iSectorCount: number of sectors
+//   pcBuffer: data to write
+// return:
+//   number of sectors actually written
+// info:
+//   request goes through dispatch queue and caller waits for it
+int kWriteBlockDevice(
+    const BLOCKDEVICE *pstDevice,
+    QWORD qwLBA,
+    int iSectorCount,
+    char *pcBuffer
+) {
+    BLOCKREQUEST stRequest;
+
+    stRequest.bWrite = TRUE;
+    stRequest.qwLBA = qwLBA;
+    stRequest.iSectorCount = iSectorCount;
+    stRequest.pcBuffer = pcBuffer;
+    stRequest.pfCallback = NULL;
+    stRequest.pvCallbackParameter = NULL;
+
+    if (kSubmitBlockRequest((BLOCKDEVICE *) pstDevice, &stRequest) == FALSE) {
+        return 0;
+    }
+    return kWaitBlockRequest(&stRequest);
+}
+
+
+// read disk information of a block device
+// params:
+//   pstDevice: device
+//   pstHDDInformation: buffer to save information
+// return:
+//   True on success. Otherwise False
+BOOL kReadBlockDeviceInformation(
+    const BLOCKDEVICE *pstDevice,
+    HDDINFORMATION *pstHDDInformation
+) {
+    if (pstDevice == NULL) {
+        return FALSE;
+    }
+
+    return pstDevice->pfReadInformation(
+        pstDevice->bPrimary,
+        pstDevice->bMaster,
+        pstHDDInformation
+    );
+}
+
+
+// add a request to dispatch queue in LBA order
+// params:
+//   pstQueue: queue
+//   pstRequest: request to add
+// info:
+//   system data must be locked
+static void kInsertBlockRequest(
+    BLOCKQUEUE *pstQueue,
+    BLOCKREQUEST *pstRequest
+) {
+    BLOCKREQUEST *pstPrevious = NULL;
+    BLOCKREQUEST *pstCurrent;
+
+    // after requests of the same LBA, so they keep submission order
+    pstCurrent = pstQueue->pstHeader;
+    while ((pstCurrent != NULL) && (pstCurrent->qwLBA <= pstRequest->qwLBA)) {
+        pstPrevious = pstCurrent;
+        pstCurrent = pstCurrent->pstNext;
+    }
+
+    pstRequest->pstNext = pstCurrent;
+    if (pstPrevious == NULL) {
+        pstQueue->pstHeader = pstRequest;
+    }
+    else {
+        pstPrevious->pstNext = pstRequest;
+    }
+    pstQueue->iRequestCount++;
+}
+
+
+// check if an earlier request that conflicts with a request is pending
+// params:
+//   pstQueue: queue
+//   pstRequest: request in queue
+// return:
+//   True if the request must wait. Otherwise False
+// info:
+//   system data must be locked
+static BOOL kIsBlockRequestBlocked(
+    const BLOCKQUEUE *pstQueue,
+    const BLOCKREQUEST *pstRequest
+) {
+    const BLOCKREQUEST *pstCurrent;
+
+    // queue is in LBA order, so requests after the end can not overlap
+    for (
+        pstCurrent = pstQueue->pstHeader;
+        (pstCurrent != NULL) &&
+        (pstCurrent->qwLBA < pstRequest->qwLBA + pstRequest->iSectorCount);
+        pstCurrent = pstCurrent->pstNext
+    ) {
+        if (
+            (pstCurrent->qwSequence < pstRequest->qwSequence) &&
+            (pstCurrent->bWrite || pstRequest->bWrite) &&
+            (pstRequest->qwLBA <
+                pstCurrent->qwLBA + pstCurrent->iSectorCount)
+        ) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+// choose the next requests to dispatch and take them out of queue
+// params:
+//   pstQueue: queue that is not empty
+//   piSectorCount: total number of sectors of requests
+// return:
+//   the first request. requests are linked by pstNext and they are next
+//   to each other on disk
+// info:
+//   system data must be locked
+static BLOCKREQUEST *kRemoveBlockRequestRun(
+    BLOCKQUEUE *pstQueue,
+    int *piSectorCount
+) {
+    BLOCKREQUEST *pstCurrent;
+    BLOCKREQUEST *pstPrevious;
+    BLOCKREQUEST *pstFirst = NULL;
+    BLOCKREQUEST *pstFirstPrevious = NULL;
+    BLOCKREQUEST *pstLast;
+    BLOCKREQUEST *pstNext;
+    QWORD qwTickCount;
+    int iSectorCount;
+
+
+    /* the oldest request whose deadline passed */
+
+    qwTickCount = kGetTickCount();
+    for (
+        pstPrevious = NULL, pstCurrent = pstQueue->pstHeader;
+        pstCurrent != NULL;
+        pstPrevious = pstCurrent, pstCurrent = pstCurrent->pstNext
+    ) {
+        if (
+            (pstCurrent->qwDeadlineTickCount <= qwTickCount) &&
+            ((pstFirst == NULL) || (pstCurrent->qwDeadlineTickCount <
+                pstFirst->qwDeadlineTickCount)) &&
+            (kIsBlockRequestBlocked(pstQueue, pstCurrent) == FALSE)
+        ) {
+            pstFirst = pstCurrent;
+            pstFirstPrevious = pstPrevious;
+        }
+    }
+
+    if (pstFirst != NULL) {
+        pstQueue->qwDeadlineCount++;
+    }
+
+
+    /* elevator order. the first request from head, or the lowest one */
+
+    for (
+        pstPrevious = NULL, pstCurrent = pstQueue->pstHeader;
+        (pstFirst == NULL) && (pstCurrent != NULL);
+        pstPrevious = pstCurrent, pstCurrent = pstCurrent->pstNext
+    ) {
+        if (
+            (pstCurrent->qwLBA >= pstQueue->qwHeadLBA) &&
+            (kIsBlockRequestBlocked(pstQueue, pstCurrent) == FALSE)
+        ) {
+            pstFirst = pstCurrent;
+            pstFirstPrevious = pstPrevious;
+        }
+    }
+
+    for (
+        pstPrevious = NULL, pstCurrent = pstQueue->pstHeader;
+        (pstFirst == NULL) && (pstCurrent != NULL);
+        pstPrevious = pstCurrent, pstCurrent = pstCurrent->pstNext
+    ) {
+        // the earliest request is never blocked
+        if (kIsBlockRequestBlocked(pstQueue, pstCurrent) == FALSE) {
+            pstFirst = pstCurrent;
+            pstFirstPrevious = pstPrevious;
+        }
+    }
+
+
+    /* merge following requests that continue on disk */
+
+    pstLast = pstFirst;
+    iSectorCount = pstFirst->iSectorCount;
+    while (pstQueue->pcMergeBuffer != NULL) {
+        pstNext = pstLast->pstNext;
+        if (
+            (pstNext == NULL) ||
+            (pstNext->bWrite != pstFirst->bWrite) ||
+            (pstNext->qwLBA != pstLast->qwLBA + pstLast->iSectorCount) ||
+            (iSectorCount + pstNext->iSectorCount >
+                BLOCKQUEUE_MAXMERGESECTORCOUNT) ||
+            (kIsBlockRequestBlocked(pstQueue, pstNext) == TRUE)
+        ) {
+            break;
+        }
+
+        pstLast = pstNext;
+        iSectorCount += pstNext->iSectorCount;
+        pstQueue->qwMergedCount++;
+    }
+
+
+    /* take requests out of queue */
+
+    if (pstFirstPrevious == NULL) {
+        pstQueue->pstHeader = pstLast->pstNext;
+    }
+    else {
+        pstFirstPrevious->pstNext = pstLast->pstNext;
+    }
+    pstLast->pstNext = NULL;
+
+    for (pstCurrent = pstFirst; pstCurrent != NULL;
+            pstCurrent = pstCurrent->pstNext) {
+        pstQueue->iRequestCount--;
+    }
+
+    pstQueue->qwHeadLBA = pstLast->qwLBA + pstLast->iSectorCount;
+    pstQueue->qwDispatchCount++;
+
+    *piSectorCount = iSectorCount;
+    return pstFirst;
+}
+
+
+// send requests to driver as one command and complete them
+// params:
+//   pstDevice: device
+//   pstRun: requests that kRemoveBlockRequestRun returned
+//   iSectorCount: total number of sectors of requests
+static void kDispatchBlockRequestRun(
+    BLOCKDEVICE *pstDevice,
+    BLOCKREQUEST *pstRun,
+    int iSectorCount
+) {
+    BLOCKREQUEST *pstCurrent;
+    BLOCKREQUEST *pstNext;
+    char *pcBuffer;
+    int iTransferredCount;
+    int iOffset;
+    int iCount;
+
+    // a single request uses its own buffer
+    if (pstRun->pstNext == NULL) {
+        pcBuffer = pstRun->pcBuffer;
+    }
+    else {
+        pcBuffer = pstDevice->stQueue.pcMergeBuffer;
+    }
+
+
+    /* one command for every request */
+
+    if (pstRun->bWrite == TRUE) {
+        if (pcBuffer != pstRun->pcBuffer) {
+            iOffset = 0;
+            for (pstCurrent = pstRun; pstCurrent != NULL;
+                    pstCurrent = pstCurrent->pstNext) {
+                kMemCpy(
+                    pcBuffer + (iOffset * 512),
+                    pstCurrent->pcBuffer,
+                    pstCurrent->iSectorCount * 512
+                );
+                iOffset += pstCurrent->iSectorCount;
+            }
+        }
+
+        iTransferredCount = pstDevice->pfWriteSector(
+            pstDevice->bPrimary,
+            pstDevice->bMaster,
+            pstRun->qwLBA,
+            iSectorCount,
+            pcBuffer
+        );
+    }
+    else {
+        iTransferredCount = pstDevice->pfReadSector(
+            pstDevice->bPrimary,
+            pstDevice->bMaster,
+            pstRun->qwLBA,
+            iSectorCount,
+            pcBuffer
+        );
+    }
+
+
+    /* split result. a request after a failed sector fails */
+
+    iOffset = 0;
+    for (pstCurrent = pstRun; pstCurrent != NULL; pstCurrent = pstNext) {
+        // request can be gone after it completes
+        pstNext = pstCurrent->pstNext;
+
+        iCount = MIN(iTransferredCount - iOffset, pstCurrent->iSectorCount);
+        iCount = MAX(iCount, 0);
+        if (
+            (pstCurrent->bWrite == FALSE) &&
+            (pcBuffer != pstCurrent->pcBuffer)
+        ) {
+            kMemCpy(
+                pstCurrent->pcBuffer,
+                pcBuffer + (iOffset * 512),
+                iCount * 512
+            );
+        }
+        iOffset += pstCurrent->iSectorCount;
+
+        kCompleteBlockRequest(pstCurrent, iCount);
+    }
+}
+
+
+// set result of a request, wake up waiting tasks and call callback
+// params:
+//   pstRequest: completed request
+//   iTransferredCount: number of sectors transferred
+static void kCompleteBlockRequest(
+    BLOCKREQUEST *pstRequest,
+    int iTransferredCount
+) {
+    fBlockRequestCallback pfCallback;
+    BOOL bPreviousFlag;
+
+    // a waiting task can release the request as soon as status is set
+    pfCallback = pstRequest->pfCallback;
+
+    bPreviousFlag = kLockForSystemData();
+    pstRequest->iTransferredCount = iTransferredCount;
+    if (iTransferredCount == pstRequest->iSectorCount) {
+        pstRequest->bStatus = BLOCKREQUEST_STATUS_DONE;
+    }
+    else {
+        pstRequest->bStatus = BLOCKREQUEST_STATUS_ERROR;
+    }
+    kWakeUpTasks(pstRequest);
+    kUnlockForSystemData(bPreviousFlag);
+
+    if (pfCallback != NULL) {
+        pfCallback(pstRequest);
+    }
+}
@@ -0,0 +1,365 @@
+/*
+ * BlockDevice.h contains registry of block devices.
+ *
+ * A driver registers each drive it finds with a name, its size and functions
+ * that read and write sectors. File system does not call the hard disk
+ * driver directly. It looks up a device by name and reads and writes
+ * sectors through the device, so a volume can be mounted on any drive.
+ *
+ * Hard disk driver registers drives of ATA channels as below
+ *
+ *   hda: primary master     hdb: primary slave
+ *   hdc: secondary master   hdd: secondary slave
+ *
+ * Each device has a dispatch queue and a task that drains it. Requests are
+ * kept in LBA order and the task serves them like an elevator that moves
+ * toward higher LBA and comes back to the lowest one (C-LOOK). A request
+ * that waits longer than its deadline goes first, so a request far from
+ * the others is not starved. Requests that are next to each other in the
+ * same direction are merged into one command through a merge buffer.
+ *
+ * Requests are dispatched out of order, so a request is not dispatched
+ * while an earlier request that overlaps it is pending and one of them is
+ * a write. Data that is written is read back the same way.
+ *
+ * Until the dispatch task of a device starts, requests are served by the
+ * caller right away. File system is mounted this way during boot.
+ */
+
+#ifndef __BLOCKDEVICE_H__
+#define __BLOCKDEVICE_H__
+
+#include "Types.h"
+#include "Synchronization.h"
+#include "HardDisk.h"
+#include "Task.h"
+
+
+/* block device related constants */
+
+#define BLOCKDEVICE_MAXCOUNT        4
+#define BLOCKDEVICE_MAXNAMELENGTH   7
+
+
+/* request queue related constants */
+
+// requests are merged up to this many sectors
+#define BLOCKQUEUE_MAXMERGESECTORCOUNT  HDD_MAXBULKSECTORCOUNT
+
+// time that a request waits before it goes ahead of elevator order.
+// reads are shorter, because a task usually waits for them
+#define BLOCKQUEUE_READDEADLINE         50      // ms
+#define BLOCKQUEUE_WRITEDEADLINE        500     // ms
+
+
+/* request status */
+
+#define BLOCKREQUEST_STATUS_PENDING     0
+#define BLOCKREQUEST_STATUS_DONE        1
+#define BLOCKREQUEST_STATUS_ERROR       2
+
+
+// function pointer types related to hard disk control
+typedef BOOL (* fReadHDDInformation) (
+    BOOL bPrimary,
+    BOOL bMaster,
+    HDDINFORMATION *pstHDDInformation
+);
+
+typedef int (* fReadHDDSector) (
+    BOOL bPrimary,
+    BOOL bMaster,
+    QWORD qwLBA,
+    int iSectorCount,
+    char *pcBuffer
+);
+
+typedef int (* fWriteHDDSector) (
+    BOOL bPrimary,
+    BOOL bMaster,
+    QWORD qwLBA,
+    int iSectorCount,
+    char *pcBuffer
+);
+
+
+#pragma pack(push, 1)
+
+struct kBlockRequestStruct;
+
+// function that dispatch task calls when a request completes
+typedef void (* fBlockRequestCallback) (
+    struct kBlockRequestStruct *pstRequest
+);
+
+
+// a read or write of sectors. caller owns the memory of request
+typedef struct kBlockRequestStruct {
+    // next request of dispatch queue in LBA order
+    struct kBlockRequestStruct *pstNext;
+
+    BOOL bWrite;
+    QWORD qwLBA;
+    int iSectorCount;
+    char *pcBuffer;
+
+    // called by dispatch task when the request completes. NULL if not used
+    fBlockRequestCallback pfCallback;
+    void *pvCallbackParameter;
+
+    /* set by block layer */
+
+    // submission order and tick count that the request must be dispatched by
+    QWORD qwSequence;
+    QWORD qwDeadlineTickCount;
+
+    // BLOCKREQUEST_STATUS_XXX and number of sectors transferred
+    volatile BYTE bStatus;
+    int iTransferredCount;
+} BLOCKREQUEST;
+
+
+// dispatch queue of a device
+typedef struct kBlockQueueStruct {
+    // pending requests in LBA order. protected by system data lock
+    BLOCKREQUEST *pstHeader;
+    int iRequestCount;
+
+    // end of the last dispatched command. elevator goes up from here
+    QWORD qwHeadLBA;
+
+    // True while dispatch task serves the queue
+    volatile BOOL bStarted;
+
+    // requests are merged through this buffer
+    char *pcMergeBuffer;
+
+    // statistics. qwRequestCount is also sequence of the next request
+    QWORD qwRequestCount;
+    QWORD qwDispatchCount;
+    QWORD qwMergedCount;
+    QWORD qwDeadlineCount;
+} BLOCKQUEUE;
+
+
+typedef struct kBlockDeviceStruct {
+    // empty string if the slot is free
+    char vcName[BLOCKDEVICE_MAXNAMELENGTH + 1];
+
+    // drive of ATA channel
+    BOOL bPrimary;
+    BOOL bMaster;
+
+    QWORD qwTotalSectorCount;
+
+    // driver functions. bPrimary and bMaster above are passed
+    fReadHDDInformation pfReadInformation;
+    fReadHDDSector pfReadSector;
+    fWriteHDDSector pfWriteSector;
+
+    BLOCKQUEUE stQueue;
+} BLOCKDEVICE;
+
+
+typedef struct kBlockDeviceManagerStruct {
+    // protects device slots while drivers register devices
+    MUTEX stMutex;
+
+    BLOCKDEVICE vstDevice[BLOCKDEVICE_MAXCOUNT];
+} BLOCKDEVICEMANAGER;
+
+#pragma pack(pop)
+
+
+/* block device related functions */
+
+// initialize block device registry
+// info:
+//   it must be called before drivers register devices
+void kInitializeBlockDeviceManager(void);
+
+
+// register a drive as a block device
+// params:
+//   pcName: name of device. up to BLOCKDEVICE_MAXNAMELENGTH characters
+//   bPrimary: select primary controller or secondary controller
+//   bMaster: select master or slave drive
+//   qwTotalSectorCount: number of sectors of drive
+//   pfReadInformation, pfReadSector, pfWriteSector: driver functions
+// return:
+//   True on success. False if name is too long or there is no free slot
+// info:
+//   device that has the same name is replaced
+BOOL kRegisterBlockDevice(
+    const char *pcName,
+    BOOL bPrimary,
+    BOOL bMaster,
+    QWORD qwTotalSectorCount,
+    fReadHDDInformation pfReadInformation,
+    fReadHDDSector pfReadSector,
+    fWriteHDDSector pfWriteSector
+);
+
+
+// find a block device by name
+// params:
+//   pcName: name of device
+// return:
+//   device. NULL if it is not registered
+BLOCKDEVICE *kFindBlockDevice(const char *pcName);
+
+
+// get a block device by index of registry
+// params:
+//   iIndex: 0 ~ BLOCKDEVICE_MAXCOUNT - 1
+// return:
+//   device. NULL if the slot is free
+BLOCKDEVICE *kGetBlockDevice(int iIndex);
+
+
+// create dispatch task of every registered device
+// info:
+//   it must be called after scheduler is initialized. requests are served
+//   by callers until then
+void kStartBlockDeviceTask(void);
+
+
+// task that drains dispatch queue of a device
+// info:
+//   each task takes a device that no other task serves
+void kBlockDeviceDispatchTask(void);
+
+
+// submit a request to dispatch queue of a device
+// params:
+//   pstDevice: device
+//   pstRequest: request. bWrite, qwLBA, iSectorCount, pcBuffer and
+//               pfCallback must be set
+// return:
+//   True if the request is queued or already served. Otherwise False
+// info:
+//   request must be kept until it completes. A request that has a callback
+//   belongs to the callback when it completes, so it must not be waited
+//   for with kWaitBlockRequest
+BOOL kSubmitBlockRequest(BLOCKDEVICE *pstDevice, BLOCKREQUEST *pstRequest);
+
+
+// wait until a request completes
+// params:
+//   pstRequest: submitted request
+// return:
+//   number of sectors transferred
+int kWaitBlockRequest(BLOCKREQUEST *pstRequest);
+
+
+// read sectors from a block device
+// params:
+//   pstDevice: device to read
+//   qwLBA: first sector
+//   iSectorCount: number of sectors
+//   pcBuffer: buffer to save data
+// return:
+//   number of sectors actually read
+// info:
+//   request goes through dispatch queue and caller waits for it
+int kReadBlockDevice(
+    const BLOCKDEVICE *pstDevice,
+    QWORD qwLBA,
+    int iSectorCount,
+    char *pcBuffer
+);
+
+
+// write sectors to a block device
+// params:
+//   pstDevice: device to write
+//   qwLBA: first sector
+//   iSectorCount: number of sectors
+//   pcBuffer: data to write
+// return:
+//   number of sectors actually written
+// info:
+//   request goes through dispatch queue and caller waits for it
+int kWriteBlockDevice(
+    const BLOCKDEVICE *pstDevice,
+    QWORD qwLBA,
+    int iSectorCount,
+    char *pcBuffer
+);
+
+
+// read disk information of a block device
+// params:
+//   pstDevice: device
+//   pstHDDInformation: buffer to save information
+// return:
+//   True on success. Otherwise False
+BOOL kReadBlockDeviceInformation(
+    const BLOCKDEVICE *pstDevice,
+    HDDINFORMATION *pstHDDInformation
+);
+
+
+// add a request to dispatch queue in LBA order
+// params:
+//   pstQueue: queue
+//   pstRequest: request to add
+// info:
+//   system data must be locked
+static void kInsertBlockRequest(
+    BLOCKQUEUE *pstQueue,
+    BLOCKREQUEST *pstRequest
+);
+
+
+// check if an earlier request that conflicts with a request is pending
+// params:
+//   pstQueue: queue
+//   pstRequest: request in queue
+// return:
+//   True if the request must wait. Otherwise False
+// info:
+//   system data must be locked
+static BOOL kIsBlockRequestBlocked(
+    const BLOCKQUEUE *pstQueue,
+    const BLOCKREQUEST *pstRequest
+);
+
+
+// choose the next requests to dispatch and take them out of queue
+// params:
+//   pstQueue: queue that is not empty
+//   piSectorCount: total number of sectors of requests
+// return:
+//   the first request. requests are linked by pstNext and they are next
+//   to each other on disk
+// info:
+//   system data must be locked
+static BLOCKREQUEST *kRemoveBlockRequestRun(
+    BLOCKQUEUE *pstQueue,
+    int *piSectorCount
+);
+
+
+// send requests to driver as one command and complete them
+// params:
+//   pstDevice: device
+//   pstRun: requests that kRemoveBlockRequestRun returned
+//   iSectorCount: total number of sectors of requests
+static void kDispatchBlockRequestRun(
+    BLOCKDEVICE *pstDevice,
+    BLOCKREQUEST *pstRun,
+    int iSectorCount
+);
+
+
+// set result of a request, wake up waiting tasks and call callback
+// params:
+//   pstRequest: completed request
+//   iTransferredCount: number of sectors transferred
+static void kCompleteBlockRequest(
+    BLOCKREQUEST *pstRequest,
+    int iTransferredCount
+);
+
+#endif /* __BLOCKDEVICE_H__ */
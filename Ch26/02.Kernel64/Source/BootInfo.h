@@ -0,0 +1,51 @@
+/*
+ * BootInfo.h contains information that 01.Kernel32 leaves about how it
+ * loaded this kernel.
+ *
+ * ImageMaker may compress Kernel64.bin. 01.Kernel32 inflates or copies it
+ * to 2MB and saves sizes and time stamp counter cycles it took, so the
+ * effect of compression can be seen after boot.
+ *
+ * Boot loader and 01.Kernel32 also save time stamp counter when each of
+ * their stages starts. BootTime.c adds them in front of boot timeline.
+ */
+
+#ifndef __BOOTINFO_H__
+#define __BOOTINFO_H__
+
+#include "Types.h"
+
+
+// KERNEL64_IMAGEINFOADDRESS of 01.Kernel32/Source/Decompress.h
+#define BOOTINFO_KERNEL64IMAGEINFOADDRESS   0x7F10
+
+// BOOTTIME_TIMELINEADDRESS of 01.Kernel32/Source/BootTime.h. QWORD stamps
+#define BOOTINFO_TIMELINEADDRESS            0x7F20
+
+// index of each stamp
+#define BOOTINFO_STAMP_BOOTLOADER       0   // boot loader starts
+#define BOOTINFO_STAMP_REALMODE         1   // image is loaded, EntryPoint.s
+#define BOOTINFO_STAMP_PROTECTEDMODE    2   // C kernel of 01.Kernel32 starts
+#define BOOTINFO_STAMP_LOADKERNEL64     3   // inflating or copying Kernel64
+#define BOOTINFO_STAMP_SWITCHIA32E      4   // switching to IA-32e mode
+#define BOOTINFO_STAMPCOUNT             5
+
+
+#pragma pack(push, 1)
+
+// same layout as KERNEL64IMAGEINFO of 01.Kernel32. 32 bits fields only
+typedef struct kKernel64ImageInfoStruct {
+    // True if the image was compressed
+    DWORD dwCompressed;
+
+    // bytes that boot loader read and bytes of kernel at 2MB
+    DWORD dwImageSize;
+    DWORD dwKernelSize;
+
+    // time stamp counter cycles to inflate or copy the image
+    DWORD dwLoadCycles;
+} KERNEL64IMAGEINFO;
+
+#pragma pack(pop)
+
+#endif /* __BOOTINFO_H__ */
@@ -0,0 +1,147 @@
+#include "BootTime.h"
+#include "BootInfo.h"
+#include "AssemblyUtility.h"
+#include "Utility.h"
+#include "Console.h"
+
+static BOOTTIMELINE gs_stBootTimeline;
+
+// name of stages before 02.Kernel64. index is BOOTINFO_STAMP_XXX
+static const char *gs_vpcPreKernelStageName[BOOTINFO_STAMPCOUNT] = {
+    "Boot Loader, Read Image With BIOS",
+    "Kernel32 Real Mode, E820/VBE/A20",
+    "Kernel32 Memory Check, Page Tables",
+    "Inflate Or Copy Kernel64",
+    "Switch To IA-32e Mode"
+};
+
+
+// initialize boot timeline with stamps of boot loader and 01.Kernel32
+// info:
+//   it must be called first in Main, and it records the first stage of
+//   02.Kernel64
+void kInitializeBootTime(void) {
+    QWORD *pqwStamp;
+    QWORD qwLastTSC;
+    int i;
+
+    kMemSet(&gs_stBootTimeline, 0, sizeof(gs_stBootTimeline));
+
+    // stamps are skipped if a stage did not save one, e.g. image is
+    // booted by another loader and memory has garbage
+    pqwStamp = (QWORD *) BOOTINFO_TIMELINEADDRESS;
+    qwLastTSC = 0;
+    for (i = 0; i < BOOTINFO_STAMPCOUNT; i++) {
+        if ((pqwStamp[i] == 0) || (pqwStamp[i] < qwLastTSC) ||
+            (pqwStamp[i] > kReadTSC())) {
+            continue;
+        }
+
+        gs_stBootTimeline.vstStage[gs_stBootTimeline.iStageCount].qwTSC =
+            pqwStamp[i];
+        gs_stBootTimeline.vstStage[gs_stBootTimeline.iStageCount].pcName =
+            gs_vpcPreKernelStageName[i];
+        gs_stBootTimeline.iStageCount++;
+        qwLastTSC = pqwStamp[i];
+    }
+
+    kRecordBootStage("Kernel64 Console, Log, Serial Port");
+}
+
+
+// record the start of a boot stage
+// params:
+//   pcName: name of stage. it must be a string that is not freed
+// info:
+//   it is not protected by a lock because only Main records stages
+void kRecordBootStage(const char *pcName) {
+    BOOTSTAGE *pstStage;
+
+    if (gs_stBootTimeline.iStageCount >= BOOTTIME_MAXSTAGECOUNT) {
+        return;
+    }
+
+    pstStage = &(gs_stBootTimeline.vstStage[gs_stBootTimeline.iStageCount]);
+    pstStage->qwTSC = kReadTSC();
+    pstStage->pcName = pcName;
+    gs_stBootTimeline.iStageCount++;
+}
+
+
+// print each stage and its time in microseconds
+// info:
+//   the last stage is the end of booting, so its time is not printed
+void kPrintBootTime(void) {
+    BOOTSTAGE *pstStage;
+    QWORD qwFirstTSC;
+    int iCursorX, iCursorY;
+    int i;
+
+    if (gs_stBootTimeline.iStageCount < 2) {
+        kPrintf("Boot timeline is not recorded\n");
+        return;
+    }
+
+    kPrintf("TSC = %d Cycles/ms\n", kGetTSCCyclesPerMillisecond());
+    kPrintf("Stage                                   Start(us)   Time(us)\n");
+
+    qwFirstTSC = gs_stBootTimeline.vstStage[0].qwTSC;
+    for (i = 0; i < gs_stBootTimeline.iStageCount - 1; i++) {
+        pstStage = &(gs_stBootTimeline.vstStage[i]);
+
+        kPrintf("%s", pstStage->pcName);
+        kGetCursor(&iCursorX, &iCursorY);
+        kSetCursor(40, iCursorY);
+        kPrintf("%d", kCyclesToMicrosecond(pstStage->qwTSC - qwFirstTSC));
+        kSetCursor(52, iCursorY);
+        kPrintf("%d\n",
+            kCyclesToMicrosecond((pstStage + 1)->qwTSC - pstStage->qwTSC));
+    }
+
+    pstStage = &(gs_stBootTimeline.vstStage[i]);
+    kPrintf("Total From %s To %s = %d us\n",
+        gs_stBootTimeline.vstStage[0].pcName, pstStage->pcName,
+        kCyclesToMicrosecond(pstStage->qwTSC - qwFirstTSC));
+}
+
+
+// get cycles of time stamp counter per millisecond
+// return:
+//   cycles per millisecond
+// info:
+//   PIT interrupt must be enabled. it waits for BOOTTIME_CALIBRATIONTIME
+//   only when it is called the first time
+static QWORD kGetTSCCyclesPerMillisecond(void) {
+    QWORD qwStartTickCount;
+    QWORD qwStartTSC;
+
+    if (gs_stBootTimeline.qwCyclesPerMillisecond != 0) {
+        return gs_stBootTimeline.qwCyclesPerMillisecond;
+    }
+
+    // start at the edge of a tick, so the error is less than a tick
+    qwStartTickCount = kGetTickCount();
+    while (kGetTickCount() == qwStartTickCount) {
+        ;
+    }
+    qwStartTickCount = kGetTickCount();
+    qwStartTSC = kReadTSC();
+
+    while (kGetTickCount() - qwStartTickCount < BOOTTIME_CALIBRATIONTIME) {
+        ;
+    }
+
+    gs_stBootTimeline.qwCyclesPerMillisecond =
+        (kReadTSC() - qwStartTSC) / (kGetTickCount() - qwStartTickCount);
+    return gs_stBootTimeline.qwCyclesPerMillisecond;
+}
+
+
+// convert time stamp counter cycles to microseconds
+// params:
+//   qwCycles: cycles
+// return:
+//   microseconds
+static QWORD kCyclesToMicrosecond(QWORD qwCycles) {
+    return qwCycles * 1000 / kGetTSCCyclesPerMillisecond();
+}
@@ -0,0 +1,84 @@
+/*
+ * BootTime.h contains boot timeline recorder.
+ *
+ * Main calls kRecordBootStage before each initialization step, and it
+ * saves time stamp counter with the name of the step. A stage lasts until
+ * the next stage starts. Stamps that boot loader and 01.Kernel32 left are
+ * added in front, so the timeline starts from the boot loader.
+ *
+ * Time stamp counter frequency is measured with PIT ticks the first time
+ * the timeline is printed, so recording does not slow down booting.
+ */
+
+#ifndef __BOOTTIME_H__
+#define __BOOTTIME_H__
+
+#include "Types.h"
+
+
+// max number of stages including stages before 02.Kernel64
+#define BOOTTIME_MAXSTAGECOUNT      32
+
+// time to count cycles of time stamp counter
+#define BOOTTIME_CALIBRATIONTIME    100 // ms
+
+
+#pragma pack(push, 1)
+
+typedef struct kBootStageStruct {
+    // time stamp counter when stage starts
+    QWORD qwTSC;
+
+    const char *pcName;
+} BOOTSTAGE;
+
+
+typedef struct kBootTimelineStruct {
+    BOOTSTAGE vstStage[BOOTTIME_MAXSTAGECOUNT];
+    int iStageCount;
+
+    // cycles of time stamp counter per millisecond. 0 until it is measured
+    QWORD qwCyclesPerMillisecond;
+} BOOTTIMELINE;
+
+#pragma pack(pop)
+
+
+// initialize boot timeline with stamps of boot loader and 01.Kernel32
+// info:
+//   it must be called first in Main, and it records the first stage of
+//   02.Kernel64
+void kInitializeBootTime(void);
+
+
+// record the start of a boot stage
+// params:
+//   pcName: name of stage. it must be a string that is not freed
+// info:
+//   it is not protected by a lock because only Main records stages
+void kRecordBootStage(const char *pcName);
+
+
+// print each stage and its time in microseconds
+// info:
+//   the last stage is the end of booting, so its time is not printed
+void kPrintBootTime(void);
+
+
+// get cycles of time stamp counter per millisecond
+// return:
+//   cycles per millisecond
+// info:
+//   PIT interrupt must be enabled. it waits for BOOTTIME_CALIBRATIONTIME
+//   only when it is called the first time
+static QWORD kGetTSCCyclesPerMillisecond(void);
+
+
+// convert time stamp counter cycles to microseconds
+// params:
+//   qwCycles: cycles
+// return:
+//   microseconds
+static QWORD kCyclesToMicrosecond(QWORD qwCycles);
+
+#endif /* __BOOTTIME_H__ */
@@ -4,9 +4,24 @@
 #include "Keyboard.h"
 #include "Utility.h"
 #include "AssemblyUtility.h"
+#include "SerialPort.h"
+#include "Synchronization.h"
+#include "VBE.h"
+#include "Graphics.h"
+#include "Window.h"
 
 CONSOLEMANAGER gs_stConsoleManager = {0, };
 
+// colors of text mode attribute in graphic mode
+static const COLOR gs_vstConsolePalette[16] = {
+    RGB(0, 0, 0),       RGB(0, 0, 170),     RGB(0, 170, 0),
+    RGB(0, 170, 170),   RGB(170, 0, 0),     RGB(170, 0, 170),
+    RGB(170, 85, 0),    RGB(170, 170, 170), RGB(85, 85, 85),
+    RGB(85, 85, 255),   RGB(85, 255, 85),   RGB(85, 255, 255),
+    RGB(255, 85, 85),   RGB(255, 85, 255),  RGB(255, 255, 85),
+    RGB(255, 255, 255)
+};
+
 
 // function that initializes console
 // params:
@@ -14,6 +29,25 @@ CONSOLEMANAGER gs_stConsoleManager = {0, };
 //   iY: y of initial cursor location
 void kInitializeConsole(int iX, int iY) {
     kMemSet(&gs_stConsoleManager, 0, sizeof(gs_stConsoleManager));
+    gs_stConsoleManager.qwWindowID = WINDOW_INVALIDID;
+
+    // keep messages that boot loader and 01.Kernel32 printed
+    if (kIsGraphicMode() == FALSE) {
+        kMemCpy(
+            gs_stConsoleManager.vstScreen,
+            (void *) CONSOLE_VIDEOMEMORYADDRESS,
+            sizeof(gs_stConsoleManager.vstScreen)
+        );
+    }
+    // video memory of text mode is not shown in graphic mode
+    else {
+        for (int i = 0; i < CONSOLE_WIDTH * CONSOLE_HEIGHT; i++) {
+            gs_stConsoleManager.vstScreen[i].bCharacter = ' ';
+            gs_stConsoleManager.vstScreen[i].bAttribute =
+                CONSOLE_DEFAULTTEXTCOLOR;
+        }
+        gs_stConsoleManager.dwDirtyRowBitmap = CONSOLE_ALLROWSDIRTY;
+    }
     kSetCursor(iX, iY);
 }
 
@@ -22,19 +56,15 @@ void kInitializeConsole(int iX, int iY) {
 // params:
 //   iX: x of cursor location
 //   iY: y of cursor location
+// info:
+//   hardware cursor is moved by the next kFlushConsole
 void kSetCursor(int iX, int iY) {
     // linear address of cursor loc
     int iLinearValue = iY * CONSOLE_WIDTH + iX;
 
-    // choose where to put the cursor upper byte 
-    kOutPortByte(VGA_PORT_INDEX, VGA_INDEX_UPPERCURSOR);
-    kOutPortByte(VGA_PORT_DATA, iLinearValue >> 8);
-
-    // choose where to put the cursor lower byte
-    kOutPortByte(VGA_PORT_INDEX, VGA_INDEX_LOWERCURSOR);
-    kOutPortByte(VGA_PORT_DATA, iLinearValue & 0xFF);
-
+    // VGA ports are written by kFlushConsole
     gs_stConsoleManager.iCurrentPrintOffset = iLinearValue;
+    gs_stConsoleManager.bCursorDirty = TRUE;
 }
 
 
@@ -64,6 +94,9 @@ void kGetCursor(int *piX, int *piY) {
 //  overall length of string should be less than 1024 bytes
 //  otherwise, unpredictable result that harms the system can
 //  happens
+//
+//  text is shown on the next timer tick. if interrupt is disabled, there is
+//  no tick, so console is flushed right away
 void kPrintf(const char *pcFormatString, ...) {
     va_list ap;
     char vcBuffer[1024];
@@ -76,12 +109,19 @@ void kPrintf(const char *pcFormatString, ...) {
 
     // print to console
     iNextPrintOffset = kConsolePrintString(vcBuffer);
+    if (gs_stConsoleManager.bSerialConsole == TRUE) {
+        kSendSerialString(vcBuffer);
+    }
 
     // update cursor location so cursor is after text
     kSetCursor(
         iNextPrintOffset % CONSOLE_WIDTH,
         iNextPrintOffset / CONSOLE_WIDTH
     );
+
+    if ((kReadRFLAGS() & CONSOLE_RFLAGS_IF) == 0) {
+        kFlushConsole();
+    }
 }
 
 
@@ -95,10 +135,16 @@ void kPrintf(const char *pcFormatString, ...) {
 //   if \t is included, offset is multiply of 4
 //   if sentence does not fit in screen, one line goes up
 int kConsolePrintString(const char *pcBuffer) {
-    CHARACTER *pstScreen = (CHARACTER *) CONSOLE_VIDEOMEMORYADDRESS;
+    CHARACTER *pstScreen = gs_stConsoleManager.vstScreen;
     int iPrintOffset = gs_stConsoleManager.iCurrentPrintOffset;
     int iLength = kStrLen(pcBuffer);
 
+    // new output moves the view back to the bottom
+    if (gs_stConsoleManager.iViewOffset != 0) {
+        gs_stConsoleManager.iViewOffset = 0;
+        gs_stConsoleManager.dwDirtyRowBitmap = CONSOLE_ALLROWSDIRTY;
+    }
+
     for (int i = 0; i < iLength; i++) {
         if (pcBuffer[i] == '\n') {
             iPrintOffset += CONSOLE_WIDTH - (iPrintOffset % CONSOLE_WIDTH);
@@ -109,23 +155,13 @@ int kConsolePrintString(const char *pcBuffer) {
         else {
             pstScreen[iPrintOffset].bCharacter = pcBuffer[i];
             pstScreen[iPrintOffset].bAttribute = CONSOLE_DEFAULTTEXTCOLOR;
+            gs_stConsoleManager.dwDirtyRowBitmap |=
+                1 << (iPrintOffset / CONSOLE_WIDTH);
             iPrintOffset += 1;
         }
 
-        int rowLength = CONSOLE_WIDTH * sizeof(CHARACTER);
         if (iPrintOffset >= CONSOLE_HEIGHT * CONSOLE_WIDTH) {
-            kMemCpy(
-                (void *) CONSOLE_VIDEOMEMORYADDRESS,
-                (void *) CONSOLE_VIDEOMEMORYADDRESS + rowLength,
-                (CONSOLE_HEIGHT - 1) * rowLength
-            );
-            
-            int lastLine = (CONSOLE_HEIGHT - 1) * CONSOLE_WIDTH;
-            for (int j = lastLine; j < CONSOLE_HEIGHT * CONSOLE_WIDTH; j++) {
-                pstScreen[j].bCharacter = ' ';
-                pstScreen[j].bAttribute = CONSOLE_DEFAULTTEXTCOLOR;
-            }
-
+            kScrollShadowScreen();
             iPrintOffset = (CONSOLE_HEIGHT - 1) * CONSOLE_WIDTH;
         }
     }
@@ -133,14 +169,88 @@ int kConsolePrintString(const char *pcBuffer) {
 }
 
 
+// move a line to scrollback ring buffer and scroll shadow screen one line up
+static void kScrollShadowScreen(void) {
+    CHARACTER *pstScreen = gs_stConsoleManager.vstScreen;
+    int iRowLength = CONSOLE_WIDTH * sizeof(CHARACTER);
+    int iLastLine = (CONSOLE_HEIGHT - 1) * CONSOLE_WIDTH;
+
+    // the oldest line is overwritten when ring buffer is full
+    kMemCpy(
+        gs_stConsoleManager.vvstScrollBack[gs_stConsoleManager.iScrollBackHead],
+        pstScreen,
+        iRowLength
+    );
+    gs_stConsoleManager.iScrollBackHead =
+        (gs_stConsoleManager.iScrollBackHead + 1) % CONSOLE_SCROLLBACKLINECOUNT;
+    if (gs_stConsoleManager.iScrollBackCount < CONSOLE_SCROLLBACKLINECOUNT) {
+        gs_stConsoleManager.iScrollBackCount++;
+    }
+
+    // shadow screen is in cached RAM, so this is much cheaper than moving
+    // video memory. kMemCpy copies forward, so overlapping is fine
+    kMemCpy(pstScreen, pstScreen + CONSOLE_WIDTH, iLastLine * sizeof(CHARACTER));
+    for (int j = iLastLine; j < CONSOLE_HEIGHT * CONSOLE_WIDTH; j++) {
+        pstScreen[j].bCharacter = ' ';
+        pstScreen[j].bAttribute = CONSOLE_DEFAULTTEXTCOLOR;
+    }
+
+    gs_stConsoleManager.dwDirtyRowBitmap = CONSOLE_ALLROWSDIRTY;
+}
+
+
+// get a key from an event of console window
+// params:
+//   pstEvent: event from console window
+//   pbKey: buffer to save ascii code
+// return:
+//   True if the event is a key. Otherwise False
+// info:
+//   wheel events scroll the view
+static BOOL kGetChFromEvent(const EVENT *pstEvent, BYTE *pbKey) {
+    if (pstEvent->qwType == EVENT_KEY_DOWN) {
+        *pbKey = pstEvent->stKeyEvent.bASCIICode;
+        return TRUE;
+    }
+
+    // wheel toward user shows newer lines
+    if (pstEvent->qwType == EVENT_MOUSE_WHEEL) {
+        kScrollConsoleView(
+            -pstEvent->stMouseEvent.iZMovement * WINDOW_WHEELSCROLLLINES
+        );
+        kFlushConsole();
+    }
+    return FALSE;
+}
+
+
+// convert a byte from COM1 to a key
+// params:
+//   bData: byte that terminal sent
+// return:
+//   ascii code
+static BYTE kGetChFromSerialData(BYTE bData) {
+    // terminals send \r for enter and DEL for backspace
+    if (bData == '\r') {
+        return KEY_ENTER;
+    }
+    if (bData == 0x7F) {
+        return KEY_BACKSPACE;
+    }
+    return bData;
+}
+
+
 // clear all screen
 void kClearScreen(void) {
-    CHARACTER *pstScreen = (CHARACTER *) CONSOLE_VIDEOMEMORYADDRESS;
+    CHARACTER *pstScreen = gs_stConsoleManager.vstScreen;
 
     for (int i = 0; i < CONSOLE_WIDTH * CONSOLE_HEIGHT; i++) {
         pstScreen[i].bCharacter = ' ';
         pstScreen[i].bAttribute = CONSOLE_DEFAULTTEXTCOLOR;
     }
+    gs_stConsoleManager.iViewOffset = 0;
+    gs_stConsoleManager.dwDirtyRowBitmap = CONSOLE_ALLROWSDIRTY;
     kSetCursor(0, 0);
 }
 
@@ -148,18 +258,129 @@ void kClearScreen(void) {
 // implementation of getch()
 // return:
 //   byte size ascii code
+// info:
+//   if serial console is enabled, data from COM1 is returned too
+//
+//   task is blocked until a key comes, so waiting does not take
+//   processor time
 BYTE kGetCh(void) {
+    BYTE bKey;
+
+    while (kGetChWithTimeout(&bKey, TASK_WAITFOREVER) == FALSE) {
+        ;
+    }
+    return bKey;
+}
+
+
+// getch() with time limit
+// params:
+//   pbKey: buffer to save ascii code
+//   qwMillisecond: time to wait. TASK_WAITFOREVER waits until a key comes
+// return:
+//   True if a key is received. False if time is over
+BOOL kGetChWithTimeout(BYTE *pbKey, QWORD qwMillisecond) {
     KEYDATA stData;
+    EVENT stEvent;
+    QWORD qwStartTickCount;
+    QWORD qwElapsedTime;
+    QWORD qwWaitTime;
+
+    qwStartTickCount = kGetTickCount();
+
+    // show prompt before waiting for user
+    kFlushConsole();
     while (TRUE) {
-        if (kGetKeyFromKeyQueue(&stData)) {
+        if (kGetChs(pbKey, 1) == 1) {
+            return TRUE;
+        }
+
+        qwWaitTime = qwMillisecond;
+        if (qwMillisecond != TASK_WAITFOREVER) {
+            qwElapsedTime = kGetTickCount() - qwStartTickCount;
+            if (qwElapsedTime >= qwMillisecond) {
+                return FALSE;
+            }
+            qwWaitTime = qwMillisecond - qwElapsedTime;
+        }
+
+        // only keyboard and window manager wake up this task
+        if ((gs_stConsoleManager.bSerialConsole == TRUE) &&
+            (qwWaitTime > CONSOLE_SERIALPOLLINTERVAL)) {
+            qwWaitTime = CONSOLE_SERIALPOLLINTERVAL;
+        }
+
+        // window manager takes keys and sends them to the active window
+        if (gs_stConsoleManager.qwWindowID != WINDOW_INVALIDID) {
+            if ((kWaitEventFromWindowQueue(
+                    gs_stConsoleManager.qwWindowID, &stEvent, qwWaitTime)
+                    == TRUE) &&
+                (kGetChFromEvent(&stEvent, pbKey) == TRUE)) {
+                return TRUE;
+            }
+        }
+        else if (kWaitForKeyFromKeyQueue(&stData, qwWaitTime) == TRUE) {
             if (stData.bFlags & KEY_FLAGS_DOWN) {
-                return stData.bASCIICode;
+                *pbKey = stData.bASCIICode;
+                return TRUE;
             }
-        } 
+        }
     }
 }
 
 
+// get keys that are already typed without waiting
+// params:
+//   pbBuffer: buffer to save ascii codes
+//   iMaxCount: size of buffer
+// return:
+//   number of keys that are saved. 0 if nothing is typed
+int kGetChs(BYTE *pbBuffer, int iMaxCount) {
+    KEYDATA vstData[CONSOLE_KEYBATCHCOUNT];
+    EVENT stEvent;
+    BYTE bData;
+    int iCount = 0;
+    int iKeyCount;
+    int i;
+
+    // window manager takes keys and sends them to the active window
+    if (gs_stConsoleManager.qwWindowID != WINDOW_INVALIDID) {
+        while ((iCount < iMaxCount) &&
+               (kReceiveEventFromWindowQueue(
+                    gs_stConsoleManager.qwWindowID, &stEvent) == TRUE)) {
+            if (kGetChFromEvent(&stEvent, pbBuffer + iCount) == TRUE) {
+                iCount++;
+            }
+        }
+    }
+    else {
+        // key up data are dropped, so keys are taken until buffer is full
+        while (iCount < iMaxCount) {
+            iKeyCount = kGetKeysFromKeyQueue(
+                vstData,
+                MIN(iMaxCount - iCount, CONSOLE_KEYBATCHCOUNT)
+            );
+            if (iKeyCount == 0) {
+                break;
+            }
+
+            for (i = 0; i < iKeyCount; i++) {
+                if (vstData[i].bFlags & KEY_FLAGS_DOWN) {
+                    pbBuffer[iCount++] = vstData[i].bASCIICode;
+                }
+            }
+        }
+    }
+
+    if (gs_stConsoleManager.bSerialConsole == TRUE) {
+        while ((iCount < iMaxCount) && (kReceiveSerialData(&bData, 1) == 1)) {
+            pbBuffer[iCount++] = kGetChFromSerialData(bData);
+        }
+    }
+    return iCount;
+}
+
+
 // write string to specific addr which is used for text mode, so you can
 // see string in screen.
 // iX: row where string will be
@@ -172,13 +393,299 @@ BYTE kGetCh(void) {
 // There is no protection for memory overflow. This means if your string
 // overflows iX, the string can be written to Kernel area in worst case
 void kPrintStringXY(int iX, int iY, const char *pcString) {
-    CHARACTER *pstScreen = (CHARACTER *) CONSOLE_VIDEOMEMORYADDRESS;
+    CHARACTER *pstScreen = gs_stConsoleManager.vstScreen;
+    int iOffset = iY * CONSOLE_WIDTH + iX;
     int i;
 
-    pstScreen += iY * 80 + iX;
+    pstScreen += iOffset;
 
     for (i = 0; pcString[i] != 0; i++) {
         pstScreen[i].bCharacter = pcString[i];
         pstScreen[i].bAttribute = CONSOLE_DEFAULTTEXTCOLOR;
     }
+
+    // mark every row that the string covers
+    for (int j = iOffset / CONSOLE_WIDTH;
+         (j <= (iOffset + i - 1) / CONSOLE_WIDTH) && (j < CONSOLE_HEIGHT);
+         j++) {
+        gs_stConsoleManager.dwDirtyRowBitmap |= 1 << j;
+    }
+}
+
+
+// copy dirty rows of shadow screen to video memory and move hardware cursor
+// info:
+//   called by timer interrupt handler every tick and by functions that
+//   need the screen up to date right away. in graphic mode, rows are drawn
+//   to console window instead
+void kFlushConsole(void) {
+    CHARACTER *pstVideoMemory = (CHARACTER *) CONSOLE_VIDEOMEMORYADDRESS;
+    DWORD dwDirtyRowBitmap;
+    int iCursorOffset;
+
+    if (kIsGraphicMode() == TRUE) {
+        kDrawConsoleToGraphicsBuffer();
+        return;
+    }
+
+    // take dirty rows first. rows that are changed while copying are
+    // marked again and copied by the next flush
+    dwDirtyRowBitmap = gs_stConsoleManager.dwDirtyRowBitmap;
+    gs_stConsoleManager.dwDirtyRowBitmap = 0;
+
+    for (int i = 0; (i < CONSOLE_HEIGHT) && (dwDirtyRowBitmap != 0); i++) {
+        if ((dwDirtyRowBitmap & (1 << i)) == 0) {
+            continue;
+        }
+        dwDirtyRowBitmap &= ~(1 << i);
+
+        kCopyConsoleRow(pstVideoMemory + i * CONSOLE_WIDTH, kGetConsoleViewRow(i));
+    }
+
+    if (gs_stConsoleManager.bCursorDirty == FALSE) {
+        return;
+    }
+    gs_stConsoleManager.bCursorDirty = FALSE;
+
+    iCursorOffset = kGetConsoleViewCursorOffset();
+
+    // choose where to put the cursor upper byte
+    kOutPortByte(VGA_PORT_INDEX, VGA_INDEX_UPPERCURSOR);
+    kOutPortByte(VGA_PORT_DATA, iCursorOffset >> 8);
+
+    // choose where to put the cursor lower byte
+    kOutPortByte(VGA_PORT_INDEX, VGA_INDEX_LOWERCURSOR);
+    kOutPortByte(VGA_PORT_DATA, iCursorOffset & 0xFF);
+}
+
+
+// create a window for console and move console output and keys to it
+// return:
+//   True on success. Otherwise False
+// info:
+//   window manager must be initialized
+BOOL kCreateConsoleWindow(void) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    QWORD qwWindowID;
+    int iWidth, iHeight;
+
+    pstScreenBuffer = kGetScreenBuffer();
+    iWidth = CONSOLE_WIDTH * VBE_FONTWIDTH + WINDOW_BORDERWIDTH * 2;
+    iHeight = CONSOLE_HEIGHT * VBE_FONTHEIGHT + WINDOW_TITLEBARHEIGHT +
+        WINDOW_BORDERWIDTH;
+
+    // at the center of screen
+    qwWindowID = kCreateWindow(
+        (pstScreenBuffer->iWidth - iWidth) / 2,
+        (pstScreenBuffer->iHeight - iHeight) / 2,
+        iWidth,
+        iHeight,
+        WINDOW_FLAGS_DEFAULT,
+        "Console Shell"
+    );
+    if (qwWindowID == WINDOW_INVALIDID) {
+        return FALSE;
+    }
+
+    // the whole console is drawn again in the window
+    gs_stConsoleManager.qwWindowID = qwWindowID;
+    gs_stConsoleManager.dwDirtyRowBitmap = CONSOLE_ALLROWSDIRTY;
+    gs_stConsoleManager.bCursorDirty = TRUE;
+    return TRUE;
+}
+
+
+// draw dirty rows of shadow screen and cursor in graphic mode
+// info:
+//   each character is drawn with 8x16 font in console window, or at the top
+//   left of screen before console window is created
+static void kDrawConsoleToGraphicsBuffer(void) {
+    const GRAPHICSBUFFER *pstBuffer;
+    CHARACTER *pstRow;
+    DWORD dwDirtyRowBitmap;
+    int iCursorOffset;
+    int iOriginX, iOriginY;
+    int iX, iY;
+    RECT stRowArea;
+    BOOL bPreviousFlag;
+
+    // rows stay dirty until back buffer is ready
+    if (kGetGraphicsManager()->bInitialized == FALSE) {
+        return;
+    }
+
+    if (gs_stConsoleManager.qwWindowID != WINDOW_INVALIDID) {
+        pstBuffer = kGetWindowBuffer(gs_stConsoleManager.qwWindowID);
+        kGetWindowClientArea(gs_stConsoleManager.qwWindowID, &stRowArea);
+        iOriginX = stRowArea.iX1;
+        iOriginY = stRowArea.iY1;
+    }
+    else {
+        pstBuffer = kGetScreenBuffer();
+        iOriginX = 0;
+        iOriginY = 0;
+    }
+
+    // window manager task and kGetCh can flush at the same time
+    bPreviousFlag = kLockForSystemData();
+    dwDirtyRowBitmap = gs_stConsoleManager.dwDirtyRowBitmap;
+    gs_stConsoleManager.dwDirtyRowBitmap = 0;
+
+    // cursor is drawn with its row, so old and new rows of cursor are drawn
+    iCursorOffset = kGetConsoleViewCursorOffset();
+    if (gs_stConsoleManager.bCursorDirty == TRUE) {
+        gs_stConsoleManager.bCursorDirty = FALSE;
+
+        if (gs_stConsoleManager.iShownCursorOffset <
+                CONSOLE_WIDTH * CONSOLE_HEIGHT) {
+            dwDirtyRowBitmap |=
+                1 << (gs_stConsoleManager.iShownCursorOffset / CONSOLE_WIDTH);
+        }
+        if (iCursorOffset < CONSOLE_WIDTH * CONSOLE_HEIGHT) {
+            dwDirtyRowBitmap |= 1 << (iCursorOffset / CONSOLE_WIDTH);
+        }
+        gs_stConsoleManager.iShownCursorOffset = iCursorOffset;
+    }
+    kUnlockForSystemData(bPreviousFlag);
+
+    for (int i = 0; (i < CONSOLE_HEIGHT) && (dwDirtyRowBitmap != 0); i++) {
+        if ((dwDirtyRowBitmap & (1 << i)) == 0) {
+            continue;
+        }
+        dwDirtyRowBitmap &= ~(1 << i);
+
+        pstRow = kGetConsoleViewRow(i);
+        iY = iOriginY + i * VBE_FONTHEIGHT;
+        for (int j = 0; j < CONSOLE_WIDTH; j++) {
+            // lower 4 bits are text color and next 3 bits are background
+            kDrawText(
+                pstBuffer,
+                iOriginX + j * VBE_FONTWIDTH,
+                iY,
+                gs_vstConsolePalette[pstRow[j].bAttribute & 0x0F],
+                gs_vstConsolePalette[(pstRow[j].bAttribute >> 4) & 0x07],
+                (const char *) &(pstRow[j].bCharacter),
+                1
+            );
+        }
+
+        // cursor is an underline like text mode
+        if (i == iCursorOffset / CONSOLE_WIDTH) {
+            iX = iOriginX + (iCursorOffset % CONSOLE_WIDTH) * VBE_FONTWIDTH;
+            kDrawRect(
+                pstBuffer,
+                iX,
+                iY + VBE_FONTHEIGHT - 2,
+                iX + VBE_FONTWIDTH - 1,
+                iY + VBE_FONTHEIGHT - 1,
+                gs_vstConsolePalette[CONSOLE_DEFAULTTEXTCOLOR & 0x0F],
+                TRUE
+            );
+        }
+
+        kSetRect(
+            &stRowArea,
+            iOriginX,
+            iY,
+            iOriginX + CONSOLE_WIDTH * VBE_FONTWIDTH - 1,
+            iY + VBE_FONTHEIGHT - 1
+        );
+        if (gs_stConsoleManager.qwWindowID != WINDOW_INVALIDID) {
+            kUpdateWindowArea(gs_stConsoleManager.qwWindowID, &stRowArea);
+        }
+        else {
+            kAddDirtyRect(&stRowArea);
+        }
+    }
+}
+
+
+// get row which is shown at a row of screen
+// params:
+//   iRow: row of screen
+// return:
+//   row of shadow screen or scrollback ring buffer
+static CHARACTER *kGetConsoleViewRow(int iRow) {
+    int iLineIndex;
+
+    // when view is scrolled back, upper rows come from ring buffer
+    iLineIndex = iRow - gs_stConsoleManager.iViewOffset;
+    if (iLineIndex >= 0) {
+        return gs_stConsoleManager.vstScreen + iLineIndex * CONSOLE_WIDTH;
+    }
+
+    iLineIndex += gs_stConsoleManager.iScrollBackHead +
+        CONSOLE_SCROLLBACKLINECOUNT;
+    return gs_stConsoleManager.vvstScrollBack[
+        iLineIndex % CONSOLE_SCROLLBACKLINECOUNT
+    ];
+}
+
+
+// get location of cursor on screen considering scrolled view
+// return:
+//   linear offset of cursor. CONSOLE_WIDTH * CONSOLE_HEIGHT if cursor is
+//   not on screen
+static int kGetConsoleViewCursorOffset(void) {
+    int iCursorOffset;
+
+    // cursor goes off screen and disappears when its line is scrolled out
+    iCursorOffset = gs_stConsoleManager.iCurrentPrintOffset +
+        gs_stConsoleManager.iViewOffset * CONSOLE_WIDTH;
+    if (iCursorOffset >= CONSOLE_WIDTH * CONSOLE_HEIGHT) {
+        iCursorOffset = CONSOLE_WIDTH * CONSOLE_HEIGHT;
+    }
+    return iCursorOffset;
+}
+
+
+// copy a row of characters to video memory 8 bytes at a time
+// params:
+//   pstDestination: row in video memory
+//   pstSource: row to copy
+static void kCopyConsoleRow(CHARACTER *pstDestination, const CHARACTER *pstSource) {
+    QWORD *pqwDestination = (QWORD *) pstDestination;
+    const QWORD *pqwSource = (const QWORD *) pstSource;
+
+    for (int i = 0; i < (CONSOLE_WIDTH * sizeof(CHARACTER)) / 8; i++) {
+        pqwDestination[i] = pqwSource[i];
+    }
+}
+
+
+// scroll the view through lines which scrolled off the top of screen
+// params:
+//   iLineCount: number of lines to move. positive value shows older lines
+// info:
+//   the next output moves the view back to the bottom
+void kScrollConsoleView(int iLineCount) {
+    int iViewOffset = gs_stConsoleManager.iViewOffset + iLineCount;
+
+    iViewOffset = MAX(iViewOffset, 0);
+    iViewOffset = MIN(iViewOffset, gs_stConsoleManager.iScrollBackCount);
+    if (iViewOffset == gs_stConsoleManager.iViewOffset) {
+        return;
+    }
+
+    gs_stConsoleManager.iViewOffset = iViewOffset;
+    gs_stConsoleManager.dwDirtyRowBitmap = CONSOLE_ALLROWSDIRTY;
+    gs_stConsoleManager.bCursorDirty = TRUE;
+}
+
+
+// use COM1 as console together with screen
+// params:
+//   bEnable: True to send kPrintf output to COM1 and read keys from COM1
+// info:
+//   COM1 must be initialized by kInitializeSerialPort
+void kSetSerialConsole(BOOL bEnable) {
+    gs_stConsoleManager.bSerialConsole = bEnable;
+}
+
+
+// check whether COM1 is used as console
+// return:
+//   True if serial console is enabled. Otherwise False
+BOOL kIsSerialConsoleEnabled(void) {
+    return gs_stConsoleManager.bSerialConsole;
 }
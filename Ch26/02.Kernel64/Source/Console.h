@@ -2,6 +2,7 @@
 #define __CONSOLE_H__
 
 #include "Types.h"
+#include "Window.h"
 
 /* Video controller related constants */
 
@@ -53,13 +54,61 @@
 #define VGA_INDEX_LOWERCURSOR       0x0F
 
 
+/* shadow screen related constants */
+
+// number of lines which are kept after they scroll off the top of screen
+#define CONSOLE_SCROLLBACKLINECOUNT 100
+
+// bits of dirty row bitmap. one bit per row of screen
+#define CONSOLE_ALLROWSDIRTY        ((1 << CONSOLE_HEIGHT) - 1)
+
+// IF bit of RFLAGS
+#define CONSOLE_RFLAGS_IF           0x0200
+
+
+/* key input related constants */
+
+// COM1 does not wake up reader, so it is checked at least this often while
+// serial console is enabled
+#define CONSOLE_SERIALPOLLINTERVAL  10  // ms
+
+// number of keys that are taken from keyboard queue at once
+#define CONSOLE_KEYBATCHCOUNT       16
+
 
 #pragma pack(push, 1)
 
 
+// all output is written to shadow screen in RAM first. kFlushConsole copies
+// changed rows to video memory and programs hardware cursor once per flush
 typedef struct kConsoleManagerStruct {
     // cursor location
     int iCurrentPrintOffset;
+
+    // shadow screen. the same layout as video memory
+    CHARACTER vstScreen[CONSOLE_WIDTH * CONSOLE_HEIGHT];
+
+    // bit n is set when row n of shadow screen differs from video memory
+    volatile DWORD dwDirtyRowBitmap;
+    volatile BOOL bCursorDirty;
+
+    // ring buffer of lines which scrolled off the top of screen
+    CHARACTER vvstScrollBack[CONSOLE_SCROLLBACKLINECOUNT][CONSOLE_WIDTH];
+    int iScrollBackHead;    // index where the next line is saved
+    int iScrollBackCount;
+
+    // number of lines that the view is scrolled back. 0 shows shadow screen
+    int iViewOffset;
+
+    // True if COM1 is used as console too
+    BOOL bSerialConsole;
+
+    // cursor location drawn at the last flush in graphic mode
+    int iShownCursorOffset;
+
+    // window that console draws on and receives keys from in graphic mode.
+    // WINDOW_INVALIDID until window manager starts
+    QWORD qwWindowID;
 } CONSOLEMANAGER;
 
 #pragma pack(pop)
@@ -78,6 +127,8 @@ void kInitializeConsole(int iX, int iY);
 // params:
 //   iX: x of cursor location
 //   iY: y of cursor location
+// info:
+//   hardware cursor is moved by the next kFlushConsole
 void kSetCursor(int iX, int iY);
 
 
@@ -104,6 +155,9 @@ void kGetCursor(int *piX, int *piY);
 //  overall length of string should be less than 1024 bytes
 //  otherwise, unpredictable result that harms the system can
 //  happens
+//
+//  text is shown on the next timer tick. if interrupt is disabled, there is
+//  no tick, so console is flushed right away
 void kPrintf(const char* pcFormatString, ...);
 
 
@@ -126,9 +180,32 @@ void kClearScreen(void);
 // implementation of getch()
 // return:
 //   byte size ascii code
+// info:
+//   if serial console is enabled, data from COM1 is returned too
+//
+//   task is blocked until a key comes, so waiting does not take
+//   processor time
 BYTE kGetCh(void);
 
 
+// getch() with time limit
+// params:
+//   pbKey: buffer to save ascii code
+//   qwMillisecond: time to wait. TASK_WAITFOREVER waits until a key comes
+// return:
+//   True if a key is received. False if time is over
+BOOL kGetChWithTimeout(BYTE *pbKey, QWORD qwMillisecond);
+
+
+// get keys that are already typed without waiting
+// params:
+//   pbBuffer: buffer to save ascii codes
+//   iMaxCount: size of buffer
+// return:
+//   number of keys that are saved. 0 if nothing is typed
+int kGetChs(BYTE *pbBuffer, int iMaxCount);
+
+
 // write string to specific addr which is used for text mode, so you can
 // see string in screen.
 // iX: row where string will be
@@ -142,4 +219,94 @@ BYTE kGetCh(void);
 // overflows iX, the string can be written to Kernel area in worst case
 void kPrintStringXY(int iX, int iY, const char* pcString);
 
+
+// copy dirty rows of shadow screen to video memory and move hardware cursor
+// info:
+//   called by timer interrupt handler every tick and by functions that
+//   need the screen up to date right away. in graphic mode, rows are drawn
+//   to console window instead
+void kFlushConsole(void);
+
+
+// create a window for console and move console output and keys to it
+// return:
+//   True on success. Otherwise False
+// info:
+//   window manager must be initialized
+BOOL kCreateConsoleWindow(void);
+
+
+// scroll the view through lines which scrolled off the top of screen
+// params:
+//   iLineCount: number of lines to move. positive value shows older lines
+// info:
+//   the next output moves the view back to the bottom
+void kScrollConsoleView(int iLineCount);
+
+
+// use COM1 as console together with screen
+// params:
+//   bEnable: True to send kPrintf output to COM1 and read keys from COM1
+// info:
+//   COM1 must be initialized by kInitializeSerialPort
+void kSetSerialConsole(BOOL bEnable);
+
+
+// check whether COM1 is used as console
+// return:
+//   True if serial console is enabled. Otherwise False
+BOOL kIsSerialConsoleEnabled(void);
+
+
+// move a line to scrollback ring buffer and scroll shadow screen one line up
+static void kScrollShadowScreen(void);
+
+
+// get a key from an event of console window
+// params:
+//   pstEvent: event from console window
+//   pbKey: buffer to save ascii code
+// return:
+//   True if the event is a key. Otherwise False
+// info:
+//   wheel events scroll the view
+static BOOL kGetChFromEvent(const EVENT *pstEvent, BYTE *pbKey);
+
+
+// convert a byte from COM1 to a key
+// params:
+//   bData: byte that terminal sent
+// return:
+//   ascii code
+static BYTE kGetChFromSerialData(BYTE bData);
+
+
+// draw dirty rows of shadow screen and cursor in graphic mode
+// info:
+//   each character is drawn with 8x16 font in console window, or at the top
+//   left of screen before console window is created
+static void kDrawConsoleToGraphicsBuffer(void);
+
+
+// get row which is shown at a row of screen
+// params:
+//   iRow: row of screen
+// return:
+//   row of shadow screen or scrollback ring buffer
+static CHARACTER *kGetConsoleViewRow(int iRow);
+
+
+// get location of cursor on screen considering scrolled view
+// return:
+//   linear offset of cursor. CONSOLE_WIDTH * CONSOLE_HEIGHT if cursor is
+//   not on screen
+static int kGetConsoleViewCursorOffset(void);
+
+
+// copy a row of characters to video memory 8 bytes at a time
+// params:
+//   pstDestination: row in video memory
+//   pstSource: row to copy
+static void kCopyConsoleRow(CHARACTER *pstDestination, const CHARACTER *pstSource);
+
 #endif /*__CONSOLE_H__*/
\ No newline at end of file
@@ -10,9 +10,15 @@
 #include "List.h"
 #include "Synchronization.h"
 #include "DynamicMemory.h"
+#include "PageFrame.h"
 #include "HardDisk.h"
+#include "BlockDevice.h"
 #include "FileSystem.h"
 #include "PCI.h"
+#include "Log.h"
+#include "SerialPort.h"
+#include "Window.h"
+#include "BootTime.h"
 
 SHELLCOMMANDENTRY gs_vstCommandTable[] = {
     {
@@ -60,6 +66,11 @@ SHELLCOMMANDENTRY gs_vstCommandTable[] = {
         "Measure Processor Speed",
         kMeasureProcessorSpeed
     },
+    {
+        "boottime",
+        "Show Time Of Each Boot Stage",
+        kShowBootTime
+    },
     {
         "date",
         "Show Date And Time",
@@ -142,12 +153,17 @@ SHELLCOMMANDENTRY gs_vstCommandTable[] = {
     },
     {
         "mounthdd",
-        "Mount HDD",
+        "Mount HDD, ex) mounthdd or mounthdd hdc",
         kMountHDD
     },
+    {
+        "blockdevice",
+        "Show Block Devices",
+        kShowBlockDevice
+    },
     {
         "formathdd",
-        "Format HDD",
+        "Format HDD, ex) formathdd or formathdd lazy",
         kFormatHDD
     },
     {
@@ -155,20 +171,40 @@ SHELLCOMMANDENTRY gs_vstCommandTable[] = {
         "Show File System Information",
         kShowFileSystemInformation
     },
+    {
+        "readahead",
+        "Show File Data Cache And Readahead Window Of Opened Files",
+        kShowReadAheadInformation
+    },
+    {
+        "sync",
+        "Write Modified File Data Back To HDD",
+        kSyncFileSystem
+    },
     {
         "createfile",
-        "Create File, ex) createfile a.txt",
-        kCreateFileInRootDirectory
+        "Create File, ex) createfile /dir/a.txt",
+        kCreateFileInDirectory
     },
     {
         "deletefile",
-        "Delete File, ex) deletefile a.txt",
-        kDeleteFileInRootDirectory
+        "Delete File, ex) deletefile /dir/a.txt",
+        kDeleteFileInDirectory
+    },
+    {
+        "mkdir",
+        "Make Directory, ex) mkdir /dir",
+        kMakeDirectoryInDirectory
+    },
+    {
+        "rmdir",
+        "Remove Empty Directory, ex) rmdir /dir",
+        kRemoveDirectoryInDirectory
     },
     {
         "dir",
-        "Show Directory",
-        kShowRootDirectory
+        "Show Directory, ex) dir or dir /dir",
+        kShowDirectory
     },
     {
         "writefile",
@@ -209,6 +245,51 @@ SHELLCOMMANDENTRY gs_vstCommandTable[] = {
         "list scheduler queue ex) listsq ready(name) 1(priority)",
         kShowSchedulerList
     },
+    {
+        "switchbench",
+        "Measure Context Switch Cycles, ex) switchbench 100000(count)",
+        kSwitchBench
+    },
+    {
+        "pageframeinfo",
+        "Show Free Page Frames Of Each Zone And Order",
+        kShowPageFrameInformation
+    },
+    {
+        "memtrack",
+        "Enable Or Disable Allocation Tracking, ex) memtrack on(on/off)",
+        kAllocationTracking
+    },
+    {
+        "memtop",
+        "Show Top Memory Consumers By Caller, ex) memtop 10(count)",
+        kShowTopMemoryConsumer
+    },
+    {
+        "memfrag",
+        "Show Fragmentation Of Buddy Levels And Page Frame Zones",
+        kShowMemoryFragmentation
+    },
+    {
+        "memleak",
+        "Show Allocations Of Ended Tasks",
+        kShowLeakedMemory
+    },
+    {
+        "dmesg",
+        "Show Kernel Log, ex) dmesg 3(max level, 0:error ~ 3:debug)",
+        kShowKernelLog
+    },
+    {
+        "serial",
+        "Use COM1 As Console Or Show Its State, ex) serial on 115200(baud)/off",
+        kSerialConsole
+    },
+    {
+        "testwindow",
+        "Create Windows That Show Keys, ex) testwindow 4(count)",
+        kCreateTestWindow
+    },
     {
         "readHDDRegs",
         "read registers of primary HDD and secondary HDD",
@@ -234,6 +315,11 @@ void kStartConsoleShell(void) {
 
     // key from keyboard queue
     BYTE bKey;
+
+    // keys typed ahead which are not processed yet
+    BYTE vbTypeAheadKey[CONSOLESHELL_MAXTYPEAHEADCOUNT];
+    int iTypeAheadCount = 0;
+    int iTypeAheadIndex = 0;
     
     // console cursor loc
     int iCursorX, iCursorY;
@@ -242,9 +328,17 @@ void kStartConsoleShell(void) {
     kPrintf(CONSOLESHELL_PROMPTMESSAGE);
 
     while (TRUE) {
-        // wait until key is received
-        // no timeout
-        bKey = kGetCh();
+        // wait until key is received and take every key typed with it.
+        // keys left after enter are processed when the command returns
+        if (iTypeAheadIndex >= iTypeAheadCount) {
+            vbTypeAheadKey[0] = kGetCh();
+            iTypeAheadCount = 1 + kGetChs(
+                vbTypeAheadKey + 1,
+                CONSOLESHELL_MAXTYPEAHEADCOUNT - 1
+            );
+            iTypeAheadIndex = 0;
+        }
+        bKey = vbTypeAheadKey[iTypeAheadIndex++];
 
         // backspace: delete prev text
         if (bKey == KEY_BACKSPACE) {
@@ -252,6 +346,10 @@ void kStartConsoleShell(void) {
                 kGetCursor(&iCursorX, &iCursorY);
                 kPrintStringXY(iCursorX - 1, iCursorY, " ");
                 kSetCursor(iCursorX - 1, iCursorY);
+                // terminal on COM1 erases the character by itself
+                if (kIsSerialConsoleEnabled() == TRUE) {
+                    kSendSerialString("\b \b");
+                }
                 iCommandBufferIndex--;
             }
         }
@@ -268,6 +366,13 @@ void kStartConsoleShell(void) {
             kMemSet(vcCommandBuffer, '\0', CONSOLESHELL_MAXCOMMANDBUFFERCOUNT);
             iCommandBufferIndex = 0;
         }
+        // page up, page down: scroll through lines that scrolled off
+        else if (bKey == KEY_PAGEUP) {
+            kScrollConsoleView(CONSOLE_HEIGHT / 2);
+        }
+        else if (bKey == KEY_PAGEDOWN) {
+            kScrollConsoleView(-(CONSOLE_HEIGHT / 2));
+        }
         // ignore shift, caps lock, num lock, and scroll lock
         else if (
             (bKey == KEY_LSHIFT) || \
@@ -615,6 +720,16 @@ static void kMeasureProcessorSpeed(const char *pcParmeterBuffer) {
 }
 
 
+// print boot timeline from boot loader to shell
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   it takes 100ms to measure time stamp counter the first time
+static void kShowBootTime(const char *pcParameterBuffer) {
+    kPrintBootTime();
+}
+
+
 // print date and time stored in RTC controller
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
@@ -1321,7 +1436,13 @@ static void kTestSequentialAllocation(const char *pcParameterBuffer) {
 
     printCurrentInfo();
 
-    for (i = 0; i < pstMemory->iMaxLevelCount; i++) {
+    // bigger blocks are large objects that are not in buddy block pool
+    for (
+        i = 0;
+        (i < pstMemory->iMaxLevelCount) &&
+            ((DYNAMICMEMORY_MIN_SIZE << i) <= DYNAMICMEMORY_LARGE_SIZE);
+        i++
+    ) {
         kPrintf("Block List [%d] Test Start\n", i);
         kPrintf(
             "Memory size to allocate: [%d] KB\n",
@@ -1565,11 +1686,23 @@ static void kShowHDDInformation(const char *pcParameterBuffer) {
     kPrintf("Cylinder Count:\t %d\n", stHDD.wNumberOfCylinder);
     kPrintf("Sector Count:\t %d\n", stHDD.wNumberOfSectorPerCylinder);
 
-    // total sector number of HDD
+    // sectors per interrupt of READ/WRITE MULTIPLE
     kPrintf(
-        "Total Sector:\t %d Sector, %dMB\n",
-        stHDD.dwTotalSectors,
-        stHDD.dwTotalSectors / 2 / 1024  
+        "Multiple Sector:\t max %d, current %d\n",
+        stHDD.wMaxMultipleSectorCount & 0xFF,
+        (stHDD.wMultipleSectorSetting & HDD_MULTIPLESETTING_VALID) ?
+            (stHDD.wMultipleSectorSetting & 0xFF) : 1
+    );
+
+    // total sector number of HDD. 48-bit LBA can access more sectors
+    kPrintf(
+        "Total Sector:\t %q Sector, %qMB\n",
+        kGetHDDTotalSectorCount(&stHDD),
+        kGetHDDTotalSectorCount(&stHDD) / 2 / 1024
+    );
+    kPrintf(
+        "48-bit LBA:\t %s\n",
+        (stHDD.wCommandSetSupport2 & HDD_COMMANDSET2_LBA48) ? "Yes" : "No"
     );
 
 }
@@ -1592,7 +1725,7 @@ static void kReadSector(const char *pcParameterBuffer) {
 
     char vcLBA[50];
     char vcSectorCount[50];
-    DWORD dwLBA;
+    QWORD qwLBA;
     int iSectorCount;
 
     char *pcBuffer;
@@ -1618,7 +1751,7 @@ static void kReadSector(const char *pcParameterBuffer) {
     bPrimary = kAToI(vcPrimary, 10);
     bMaster = kAToI(vcMaster, 10);
 
-    dwLBA = kAToI(vcLBA, 10);
+    qwLBA = kAToI(vcLBA, 10);
     iSectorCount = kAToI(vcSectorCount, 10);
 
 
@@ -1626,10 +1759,10 @@ static void kReadSector(const char *pcParameterBuffer) {
 
     pcBuffer = kAllocateMemory(iSectorCount * 512);
     if (
-        kReadHDDSector(bPrimary, bMaster, dwLBA, iSectorCount, pcBuffer)
+        kReadHDDSector(bPrimary, bMaster, qwLBA, iSectorCount, pcBuffer)
         == iSectorCount
     ) {
-        kPrintf("LBA [%d], [%d] Sector Read Success~!!", dwLBA, iSectorCount);
+        kPrintf("LBA [%q], [%d] Sector Read Success~!!", qwLBA, iSectorCount);
 
         // read every 512 bytes (1 sector) and print
         for (j = 0; j < iSectorCount; j++) {
@@ -1648,7 +1781,7 @@ static void kReadSector(const char *pcParameterBuffer) {
 
                 // print sector and offset at the left of line
                 if ((i % 16) == 0) {
-                    kPrintf("\n[LBA:%d, Offset:%d]\t| ",dwLBA + j, i);
+                    kPrintf("\n[LBA:%q, Offset:%d]\t| ",qwLBA + j, i);
                 }
 
                 // print data in hex in the format of "XX"
@@ -1686,7 +1819,7 @@ static void kWriteSector(const char *pcParameterBuffer) {
     PARAMETERLIST stList;
     char vcLBA[50];
     char vcSectorCount[50];
-    DWORD dwLBA;
+    QWORD qwLBA;
     int iSectorCount;
     char vcPrimary[10];
     char vcMaster[10];
@@ -1717,7 +1850,7 @@ static void kWriteSector(const char *pcParameterBuffer) {
     bPrimary = kAToI(vcPrimary, 10);
     bMaster = kAToI(vcMaster, 10);
 
-    dwLBA = kAToI(vcLBA, 10);
+    qwLBA = kAToI(vcLBA, 10);
     iSectorCount = kAToI(vcSectorCount, 10);
 
 
@@ -1729,7 +1862,7 @@ static void kWriteSector(const char *pcParameterBuffer) {
     // prepare for data to write    
     for (j = 0; j < iSectorCount; j++) {
         for (i = 0; i < 512; i+=8) {
-            *(DWORD *) &(pcBuffer[j*512 + i]) = dwLBA + j;
+            *(DWORD *) &(pcBuffer[j*512 + i]) = qwLBA + j;
             *(DWORD *) &(pcBuffer[j*512 + i + 4]) = s_dwWriteCount;
         }
     }
@@ -1739,7 +1872,7 @@ static void kWriteSector(const char *pcParameterBuffer) {
         kWriteHDDSector(
             bPrimary,
             bMaster,
-            dwLBA,
+            qwLBA,
             iSectorCount,
             pcBuffer
         ) != iSectorCount
@@ -1749,7 +1882,7 @@ static void kWriteSector(const char *pcParameterBuffer) {
          return;
     }
 
-    kPrintf("LBA [%d], [%d] Sector Write Succuss~!!", dwLBA, iSectorCount);
+    kPrintf("LBA [%q], [%d] Sector Write Succuss~!!", qwLBA, iSectorCount);
 
     // print buffer to console
     for (j = 0; j < iSectorCount; j++) {
@@ -1768,7 +1901,7 @@ static void kWriteSector(const char *pcParameterBuffer) {
 
             // print sector and offset at the left of line
             if ((i % 16) == 0) {
-                kPrintf("\n[LBA:%d, Offset:%d]\t| ",dwLBA + j, i);
+                kPrintf("\n[LBA:%q, Offset:%d]\t| ",qwLBA + j, i);
             }
 
             // print data in hex in the format of "XX"
@@ -1788,13 +1921,26 @@ static void kWriteSector(const char *pcParameterBuffer) {
 }
 
 
-// mount primary slave hdd to file system
+// mount hdd to file system
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
-// info:
-//   kMountHDD does have any parameters
+//     block device name. the current device is mounted again if it is
+//     omitted
 static void kMountHDD(const char *pcParameterBuffer) {
-    if (kMount() == FALSE) {
+    char vcDeviceName[100];
+    PARAMETERLIST stList;
+    BOOL bResult;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+
+    if (kGetNextParameter(&stList, vcDeviceName) == 0) {
+        bResult = kMount();
+    }
+    else {
+        bResult = kMountBlockDevice(vcDeviceName);
+    }
+
+    if (bResult == FALSE) {
         kPrintf("HDD Mount Fail\n");
         return;
     }
@@ -1802,13 +1948,56 @@ static void kMountHDD(const char *pcParameterBuffer) {
 }
 
 
-// format primary slave hdd to the MINT filesystem
+// show block devices that drivers registered
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
-// info:
-//   kFormatHDD does have any parameters
+static void kShowBlockDevice(const char *pcParameterBuffer) {
+    BLOCKDEVICE *pstDevice;
+    int i;
+
+    kPrintf("Name  Channel    Drive   Size\n");
+    for (i = 0; i < BLOCKDEVICE_MAXCOUNT; i++) {
+        pstDevice = kGetBlockDevice(i);
+        if (pstDevice == NULL) {
+            continue;
+        }
+
+        kPrintf(
+            "%s   %s  %s  %q MB\n",
+            pstDevice->vcName,
+            pstDevice->bPrimary ? "Primary  " : "Secondary",
+            pstDevice->bMaster ? "Master" : "Slave ",
+            pstDevice->qwTotalSectorCount / 2 / 1024
+        );
+        kPrintf(
+            "      Queue: %d Pending, %q Requests, %q Dispatches, "
+            "%q Merged, %q Deadline\n",
+            pstDevice->stQueue.iRequestCount,
+            pstDevice->stQueue.qwRequestCount,
+            pstDevice->stQueue.qwDispatchCount,
+            pstDevice->stQueue.qwMergedCount,
+            pstDevice->stQueue.qwDeadlineCount
+        );
+    }
+}
+
+
+// format mounted hdd to the MINT filesystem
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+//     lazy: zero cluster link sectors on first use instead of now
 static void kFormatHDD(const char *pcParameterBuffer) {
-    if (kFormat() == FALSE) {
+    char vcParameter[100];
+    PARAMETERLIST stList;
+    BOOL bLazy;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    bLazy = (
+        (kGetNextParameter(&stList, vcParameter) == 4) &&
+        (kMemCmp(vcParameter, "lazy", 4) == 0)
+    );
+
+    if (kFormat(bLazy) == FALSE) {
         kPrintf("HDD Format Fail\n");
         return;
     }
@@ -1832,6 +2021,11 @@ static void kShowFileSystemInformation(const char *pcParameterBuffer) {
         "Mounted:\t\t\t\t\t %d\n",
         stManager.bMounted
     );
+    kPrintf(
+        "Block Device:\t\t\t\t %s\n",
+        (stManager.pstBlockDevice != NULL) ?
+            stManager.pstBlockDevice->vcName : "None"
+    );
     kPrintf(
         "Reserved SectorCount: \t\t\t %d Sector\n",
         stManager.dwReservedSectorCount
@@ -1848,19 +2042,112 @@ static void kShowFileSystemInformation(const char *pcParameterBuffer) {
         "Data Cluster Count:\t\t\t %d Cluster\n",
         stManager.dwTotalClusterCount
     );
+    kPrintf(
+        "Zeroed Cluster Link Sector Count:\t %d/%d Sector\n",
+        stManager.dwInitializedClusterLinkSectorCount,
+        stManager.dwClusterLinkAreaSize
+    );
+    kPrintf(
+        "Journal:\t\t\t\t %s, Sequence %d\n",
+        (stManager.bJournal == TRUE) ? "On" : "Off",
+        stManager.dwJournalSequence
+    );
+
+    // metadata updates per commit shows how well they are grouped
+    kPrintf(
+        "Journal Commit:\t\t\t\t %q Updates, %q Commits, %q Sectors\n",
+        stManager.qwMetadataUpdateCount,
+        stManager.qwJournalCommitCount,
+        stManager.qwJournalSectorCount
+    );
+    kPrintf(
+        "Journal Replay:\t\t\t\t %q\n",
+        stManager.qwJournalReplayCount
+    );
 }
 
 
-// create a empty file in root directory
+// show hit rate of file data cache and readahead window of opened files
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+static void kShowReadAheadInformation(const char *pcParameterBuffer) {
+    FILESYSTEMMANAGER stManager;
+    FILEHANDLE *pstFileHandle;
+    QWORD qwAccessCount;
+    int i;
+
+    kGetFileSystemInformation(&stManager);
+
+    qwAccessCount = stManager.qwDataCacheHitCount +
+        stManager.qwDataCacheMissCount;
+    kPrintf(
+        "Data Cache: %d Clusters, %q Hit, %q Miss (Hit Rate %d%%)\n",
+        FILESYSTEM_DATACACHE_COUNT,
+        stManager.qwDataCacheHitCount,
+        stManager.qwDataCacheMissCount,
+        (qwAccessCount == 0) ?
+            0 : (int) (stManager.qwDataCacheHitCount * 100 / qwAccessCount)
+    );
+    kPrintf(
+        "Readahead: %q Clusters, %q Used (%d%%), %q Waited For\n",
+        stManager.qwReadAheadCount,
+        stManager.qwReadAheadHitCount,
+        (stManager.qwReadAheadCount == 0) ?
+            0 : (int) (stManager.qwReadAheadHitCount * 100 /
+                stManager.qwReadAheadCount),
+        stManager.qwReadAheadWaitCount
+    );
+    kPrintf(
+        "Write Back: %d Dirty Clusters, %q Written, %q Flushes\n",
+        stManager.iDirtyClusterCount,
+        stManager.qwWriteBackCount,
+        stManager.qwFlushCount
+    );
+
+    if (stManager.pstHandlePool == NULL) {
+        return;
+    }
+
+    kPrintf("Name                    Offset      Window  Read Ahead To\n");
+    for (i = 0; i < FILESYSTEM_HANDLE_MAXCOUNT; i++) {
+        if (stManager.pstHandlePool[i].bType != FILESYSTEM_TYPE_FILE) {
+            continue;
+        }
+
+        pstFileHandle = &(stManager.pstHandlePool[i].stFileHandle);
+        kPrintf(
+            "%s\t%d\t    %d\t    %d Cluster\n",
+            pstFileHandle->vcFileName,
+            pstFileHandle->dwCurrentOffset,
+            pstFileHandle->dwReadAheadWindow,
+            pstFileHandle->dwReadAheadEndOffset
+        );
+    }
+}
+
+
+// write modified file data back to HDD
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+static void kSyncFileSystem(const char *pcParameterBuffer) {
+    if (kSync() == FALSE) {
+        kPrintf("Sync Fail\n");
+        return;
+    }
+    kPrintf("Sync Success\n");
+}
+
+
+// create a empty file in a directory
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
 // info:
 //   params:
-//     filename: name of file to create
-//       limit: up to 23 chars is allowed
-static void kCreateFileInRootDirectory(const char *pcParameterBuffer) {
+//     path: path of file to create. directory must exist
+//       limit: up to 128 chars and each name up to 23 chars
+static void kCreateFileInDirectory(const char *pcParameterBuffer) {
     PARAMETERLIST stList;
-    char vcFileName[50];
+    char vcFileName[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
     int iLength;
     FILE *pstFile;
 
@@ -1869,10 +2156,10 @@ static void kCreateFileInRootDirectory(const char *pcParameterBuffer) {
     vcFileName[iLength] = '\0';
 
     if (
-        (iLength > FILESYSTEM_MAXFILENAMELENGTH - 1) ||
+        (iLength > FILESYSTEM_MAXPATHLENGTH) ||
         (iLength == 0)
     ) {
-        kPrintf("Too Long or Too Short File Name\n");
+        kPrintf("Too Long or Too Short Path\n");
         return;
     }
 
@@ -1888,16 +2175,16 @@ static void kCreateFileInRootDirectory(const char *pcParameterBuffer) {
 }
 
 
-// delete file in root directory
+// delete file in a directory
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
 // info:
 //   params:
-//     filename: name of file to delete
-//       limit: up to 23 chars is allowed
-static void kDeleteFileInRootDirectory(const char *pcParameterBuffer) {
+//     path: path of file to delete
+//       limit: up to 128 chars and each name up to 23 chars
+static void kDeleteFileInDirectory(const char *pcParameterBuffer) {
     PARAMETERLIST stList;
-    char vcFileName[50];
+    char vcFileName[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
     int iLength;
 
     kInitializeParameter(&stList, pcParameterBuffer);
@@ -1905,10 +2192,10 @@ static void kDeleteFileInRootDirectory(const char *pcParameterBuffer) {
     vcFileName[iLength] = '\0';
 
     if (
-        (iLength > FILESYSTEM_MAXFILENAMELENGTH - 1) ||
+        (iLength > FILESYSTEM_MAXPATHLENGTH) ||
         (iLength == 0)
     ) {
-        kPrintf("Too Long or Too Short File Name\n");
+        kPrintf("Too Long or Too Short Path\n");
         return;
     }
 
@@ -1921,12 +2208,80 @@ static void kDeleteFileInRootDirectory(const char *pcParameterBuffer) {
 }
 
 
-// list files in the root directory
+// create a directory
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
 // info:
-//   kShowRootDirectory does have any parameters
-static void kShowRootDirectory(const char *pcParameterBuffer) {
+//   params:
+//     path: path of directory to create. parent directory must exist
+//       limit: up to 128 chars and each name up to 23 chars
+static void kMakeDirectoryInDirectory(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcPath[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
+    int iLength;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    iLength = kGetNextParameter(&stList, vcPath);
+
+    if (
+        (iLength > FILESYSTEM_MAXPATHLENGTH) ||
+        (iLength == 0)
+    ) {
+        kPrintf("Too Long or Too Short Path\n");
+        return;
+    }
+
+    if (mkdir(vcPath) != 0) {
+        kPrintf("Directory Creation Fail\n");
+        return;
+    }
+
+    kPrintf("Directory Creation Success\n");
+}
+
+
+// remove an empty directory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     path: path of directory to remove
+//       limit: up to 128 chars and each name up to 23 chars
+static void kRemoveDirectoryInDirectory(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcPath[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
+    int iLength;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    iLength = kGetNextParameter(&stList, vcPath);
+
+    if (
+        (iLength > FILESYSTEM_MAXPATHLENGTH) ||
+        (iLength == 0)
+    ) {
+        kPrintf("Too Long or Too Short Path\n");
+        return;
+    }
+
+    if (rmdir(vcPath) != 0) {
+        kPrintf("Directory not Found, not Empty or Opened\n");
+        return;
+    }
+
+    kPrintf("Directory Remove Success\n");
+}
+
+
+// list files in a directory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     path: path of directory to show. root directory if it is omitted
+static void kShowDirectory(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcPath[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
+
     DIR *pstDirectory;
     DIRECTORYENTRY *pstEntry;
 
@@ -1940,16 +2295,23 @@ static void kShowRootDirectory(const char *pcParameterBuffer) {
 
     FILESYSTEMMANAGER stManager;
 
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcPath) == 0) {
+        vcPath[0] = '/';
+        vcPath[1] = '\0';
+    }
+
     kGetFileSystemInformation(&stManager);
 
-    pstDirectory = opendir("/");
+    pstDirectory = opendir(vcPath);
     if (pstDirectory == NULL) {
-        kPrintf("Root Directory Open Fail\n");
+        kPrintf("%s Directory Open Fail\n", vcPath);
         return;
     }
 
     dwTotalByte = 0;
     dwUsedClusterCount = 0;
+    iTotalCount = 0;
 
     while (TRUE) {
         pstEntry = readdir(pstDirectory);
@@ -1957,6 +2319,13 @@ static void kShowRootDirectory(const char *pcParameterBuffer) {
             break;
 
         iTotalCount++;
+
+        // root node of a directory is one cluster until it is split
+        if (pstEntry->dwAttribute & FILESYSTEM_ATTRIBUTE_DIRECTORY) {
+            dwUsedClusterCount++;
+            continue;
+        }
+
         dwTotalByte += pstEntry->dwFileSize;
 
         if (pstEntry->dwFileSize <= FILESYSTEM_CLUSTERSIZE)
@@ -1985,11 +2354,16 @@ static void kShowRootDirectory(const char *pcParameterBuffer) {
         );
 
         // insert file length
-        kSPrintf(
-            vcTempValue,
-            "%d Byte",
-            pstEntry->dwFileSize
-        );
+        if (pstEntry->dwAttribute & FILESYSTEM_ATTRIBUTE_DIRECTORY) {
+            kSPrintf(vcTempValue, "<DIR>");
+        }
+        else {
+            kSPrintf(
+                vcTempValue,
+                "%d Byte",
+                pstEntry->dwFileSize
+            );
+        }
         kMemCpy(vcBuffer + 30, vcTempValue, kStrLen(vcTempValue));
 
         // insert file start cluster index
@@ -2050,7 +2424,7 @@ static void kShowRootDirectory(const char *pcParameterBuffer) {
 //   file is opened with 'w', so the file contents are always erased.
 static void kWriteDataToFile(const char *pcParameterBuffer) {
     PARAMETERLIST stList;
-    char vcFileName[50];
+    char vcFileName[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
     int iLength;
     FILE *fp;
     int iEnterCount;
@@ -2061,10 +2435,10 @@ static void kWriteDataToFile(const char *pcParameterBuffer) {
     vcFileName[iLength] = '\0';
 
     if (
-        (iLength > FILESYSTEM_MAXFILENAMELENGTH - 1) ||
+        (iLength > FILESYSTEM_MAXPATHLENGTH) ||
         (iLength == 0)
     ) {
-        kPrintf("Too Long or Too Short File Name\n");
+        kPrintf("Too Long or Too Short Path\n");
         return;
     }
 
@@ -2103,7 +2477,7 @@ static void kWriteDataToFile(const char *pcParameterBuffer) {
 
 static void kReadDataFromFile(const char *pcParameterBuffer) {
     PARAMETERLIST stList;
-    char vcFileName[50];
+    char vcFileName[CONSOLESHELL_MAXCOMMANDBUFFERCOUNT];
     int iLength;
     FILE *fp;
     int iEnterCount;
@@ -2114,10 +2488,10 @@ static void kReadDataFromFile(const char *pcParameterBuffer) {
     vcFileName[iLength] = '\0';
 
     if (
-        (iLength > FILESYSTEM_MAXFILENAMELENGTH - 1) ||
+        (iLength > FILESYSTEM_MAXPATHLENGTH) ||
         (iLength == 0)
     ) {
-        kPrintf("Too Long or Too Short File Name\n");
+        kPrintf("Too Long or Too Short Path\n");
         return;
     }
 
@@ -2611,6 +2985,682 @@ static void kShowSchedulerList(const char *pcParameterBuffer) {
 }
 
 
+static CONTEXT *gs_pstSwitchBenchShellContext;
+static CONTEXT *gs_pstSwitchBenchPartnerContext;
+
+// partner of switchbench. it gives CPU back to the shell forever
+// info:
+//   this is not a task. it runs on its own stack as a part of the shell
+//   task, so scheduler is not involved in the measurement
+static void kSwitchBenchPartner(void) {
+    while (TRUE) {
+        kSwitchContext(
+            &gs_pstSwitchBenchPartnerContext,
+            gs_pstSwitchBenchShellContext
+        );
+    }
+}
+
+
+// measure how many cycles a context switch takes by switching between
+// shell and a partner context
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     count: number of round trips. default is 100000
+static void kSwitchBench(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcCount[30];
+    long lCount;
+    long i;
+    TCB stPartner;
+    void *pvStack;
+    QWORD qwStartTSC;
+    QWORD qwElapsedTSC;
+    BOOL bPreviousFlag;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcCount) == 0) {
+        lCount = 100000;
+    }
+    else {
+        lCount = kAToI(vcCount, 10);
+    }
+
+    if (lCount <= 0) {
+        kPrintf("ex) switchbench 100000(count)\n");
+        return;
+    }
+
+    pvStack = kAllocateMemory(TASK_STACKSIZE);
+    if (pvStack == NULL) {
+        kPrintf("Stack Allocation Fail\n");
+        return;
+    }
+
+    // build initial context of partner in the same way as a new task
+    kSetUpTask(
+        &stPartner,
+        0,
+        (QWORD) kSwitchBenchPartner,
+        pvStack,
+        TASK_STACKSIZE
+    );
+    gs_pstSwitchBenchPartnerContext = stPartner.pstContext;
+
+    // timer interrupt must not be counted. partner keeps interrupt disabled
+    gs_pstSwitchBenchPartnerContext->vqRegister[TASK_RFLAGSOFFSET] &= ~0x200;
+    bPreviousFlag = kLockForSystemData();
+
+    qwStartTSC = kReadTSC();
+    for (i = 0; i < lCount; i++) {
+        kSwitchContext(
+            &gs_pstSwitchBenchShellContext,
+            gs_pstSwitchBenchPartnerContext
+        );
+    }
+    qwElapsedTSC = kReadTSC() - qwStartTSC;
+
+    kUnlockForSystemData(bPreviousFlag);
+    kFreeMemory(pvStack);
+
+    // each round trip has two switches
+    kPrintf(
+        "%d Switches, Total [0x%Q] Cycles, %d Cycles Per Switch\n",
+        lCount * 2,
+        qwElapsedTSC,
+        qwElapsedTSC / (lCount * 2)
+    );
+}
+
+
+// show free and total page frames of each zone and number of free blocks
+// of each order
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   kShowPageFrameInformation does have any parameters
+static void kShowPageFrameInformation(const char *pcParameterBuffer) {
+    const char *vpcZoneName[PAGEFRAME_ZONECOUNT] = {"DMA", "DMA32", "NORMAL"};
+    PAGEFRAMEMANAGER *pstManager;
+    PAGEFRAMEZONE *pstZone;
+    int i;
+    int j;
+
+    pstManager = kGetPageFrameManager();
+
+    kPrintf("============ Page Frame Information ============\n");
+    kPrintf(
+        "Frame Count: [%d], Meta Size: [%d] KB\n",
+        pstManager->qwFrameCount,
+        pstManager->qwMetaDataSize / 1024
+    );
+
+    for (i = 0; i < PAGEFRAME_ZONECOUNT; i++) {
+        pstZone = &(pstManager->vstZone[i]);
+        kPrintf(
+            "[%s] Free: [%d] MB / Total: [%d] MB\n",
+            vpcZoneName[i],
+            pstZone->qwFreeFrameCount * PAGEFRAME_SIZE / 1024 / 1024,
+            pstZone->qwTotalFrameCount * PAGEFRAME_SIZE / 1024 / 1024
+        );
+
+        // number of free blocks of order 0, 1, 2, ...
+        kPrintf("    ");
+        for (j = 0; j < PAGEFRAME_MAXORDER; j++) {
+            kPrintf("%d ", kGetListCount(&(pstZone->vstFreeList[j])));
+        }
+        kPrintf("\n");
+    }
+}
+
+
+// enable or disable allocation tracking of dynamic memory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     switch: on or off. if it is omitted, state of tracking is shown
+static void kAllocationTracking(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcSwitch[30];
+    DYNAMICMEMORY *pstMemory;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcSwitch) == 0) {
+        pstMemory = kGetDynamicMemoryManager();
+        kPrintf(
+            "Tracking: [%s], Records: [%d], Dropped: [%d]\n",
+            pstMemory->bTrackingEnabled ? "On" : "Off",
+            pstMemory->iRecordCount,
+            pstMemory->qwDroppedRecordCount
+        );
+        return;
+    }
+
+    if (kMemCmp("on", vcSwitch, 3) == 0) {
+        if (kEnableAllocationTracking(TRUE) == FALSE) {
+            kPrintf("Record Table Allocation Fail\n");
+            return;
+        }
+        kPrintf("Allocation Tracking Enabled\n");
+    }
+    else if (kMemCmp("off", vcSwitch, 4) == 0) {
+        kEnableAllocationTracking(FALSE);
+        kPrintf("Allocation Tracking Disabled\n");
+    }
+    else {
+        kPrintf("ex) memtrack on(on/off)\n");
+    }
+}
+
+
+// show callers that hold the most dynamic memory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     count: number of callers to show. default is 10
+static void kShowTopMemoryConsumer(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcCount[30];
+    int iCount;
+    DYNAMICMEMORY *pstMemory;
+    ALLOCATIONRECORD *pstRecord;
+    QWORD vqwCallerAddress[64];
+    QWORD vqwTotalSize[64];
+    QWORD vqwAllocationCount[64];
+    QWORD qwOtherSize;
+    int iCallerCount;
+    int iMaxIndex;
+    int i;
+    int j;
+    BOOL bPreviousFlag;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcCount) == 0) {
+        iCount = 10;
+    }
+    else {
+        iCount = kAToI(vcCount, 10);
+    }
+
+    pstMemory = kGetDynamicMemoryManager();
+    if (pstMemory->bTrackingEnabled == FALSE) {
+        kPrintf("Allocation Tracking Is Disabled. ex) memtrack on\n");
+        return;
+    }
+
+
+    /* sum sizes of outstanding allocations by caller */
+
+    iCallerCount = 0;
+    qwOtherSize = 0;
+
+    bPreviousFlag = kLockForSystemData();
+    for (i = 0; i < DYNAMICMEMORY_RECORD_MAXCOUNT; i++) {
+        if (pstMemory->pstRecordTable == NULL) {
+            break;
+        }
+        pstRecord = pstMemory->pstRecordTable + i;
+        if (pstRecord->qwAddress == 0) {
+            continue;
+        }
+
+        for (j = 0; j < iCallerCount; j++) {
+            if (vqwCallerAddress[j] == pstRecord->qwCallerAddress) {
+                break;
+            }
+        }
+
+        // too many callers. they are shown as a sum
+        if (j == 64) {
+            qwOtherSize += pstRecord->qwSize;
+            continue;
+        }
+
+        if (j == iCallerCount) {
+            vqwCallerAddress[j] = pstRecord->qwCallerAddress;
+            vqwTotalSize[j] = 0;
+            vqwAllocationCount[j] = 0;
+            iCallerCount++;
+        }
+        vqwTotalSize[j] += pstRecord->qwSize;
+        vqwAllocationCount[j]++;
+    }
+    kUnlockForSystemData(bPreviousFlag);
+
+
+    /* print callers in order of size */
+
+    kPrintf("============ Top Memory Consumers ============\n");
+    for (i = 0; (i < iCount) && (i < iCallerCount); i++) {
+        iMaxIndex = i;
+        for (j = i + 1; j < iCallerCount; j++) {
+            if (vqwTotalSize[j] > vqwTotalSize[iMaxIndex]) {
+                iMaxIndex = j;
+            }
+        }
+
+        kPrintf(
+            "Caller [0x%Q] Size [%d] bytes, Count [%d]\n",
+            vqwCallerAddress[iMaxIndex],
+            vqwTotalSize[iMaxIndex],
+            vqwAllocationCount[iMaxIndex]
+        );
+
+        vqwCallerAddress[iMaxIndex] = vqwCallerAddress[i];
+        vqwTotalSize[iMaxIndex] = vqwTotalSize[i];
+        vqwAllocationCount[iMaxIndex] = vqwAllocationCount[i];
+    }
+
+    if (qwOtherSize > 0) {
+        kPrintf("Other Callers Size [%d] bytes\n", qwOtherSize);
+    }
+}
+
+
+// show free blocks of each buddy level and page frame zone and how much
+// free memory is fragmented
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   kShowMemoryFragmentation does have any parameters
+static void kShowMemoryFragmentation(const char *pcParameterBuffer) {
+    const char *vpcZoneName[PAGEFRAME_ZONECOUNT] = {"DMA", "DMA32", "NORMAL"};
+    DYNAMICMEMORY *pstMemory;
+    PAGEFRAMEMANAGER *pstPageFrameManager;
+    PAGEFRAMEZONE *pstZone;
+    QWORD qwFreeSize;
+    QWORD qwLargestSize;
+    QWORD qwBlockCount;
+    int i;
+    int j;
+
+    pstMemory = kGetDynamicMemoryManager();
+    pstPageFrameManager = kGetPageFrameManager();
+
+    // fragmentation is part of free memory that is not in the largest block
+
+
+    /* buddy block pool */
+
+    kPrintf("============ Memory Fragmentation ============\n");
+    kPrintf("Buddy Pool Free Blocks Of Each Level: ");
+
+    qwFreeSize = 0;
+    qwLargestSize = 0;
+    for (i = 0; i < pstMemory->iMaxLevelCount; i++) {
+        qwBlockCount = pstMemory->pstBitmapOfLevel[i].qwExistBitCount;
+        kPrintf("%d ", qwBlockCount);
+
+        qwFreeSize += qwBlockCount * (DYNAMICMEMORY_MIN_SIZE << i);
+        if (qwBlockCount > 0) {
+            qwLargestSize = DYNAMICMEMORY_MIN_SIZE << i;
+        }
+    }
+    kPrintf("\n");
+    kPrintf(
+        "    Free [%d] KB, Largest [%d] KB, Fragmentation [%d]%%\n",
+        qwFreeSize / 1024,
+        qwLargestSize / 1024,
+        (qwFreeSize > 0) ? (qwFreeSize - qwLargestSize) * 100 / qwFreeSize : 0
+    );
+
+
+    /* page frame zones */
+
+    for (i = 0; i < PAGEFRAME_ZONECOUNT; i++) {
+        pstZone = &(pstPageFrameManager->vstZone[i]);
+
+        qwFreeSize = pstZone->qwFreeFrameCount * PAGEFRAME_SIZE;
+        qwLargestSize = 0;
+        for (j = PAGEFRAME_MAXORDER - 1; j >= 0; j--) {
+            if (kGetListCount(&(pstZone->vstFreeList[j])) > 0) {
+                qwLargestSize = (QWORD) PAGEFRAME_SIZE << j;
+                break;
+            }
+        }
+
+        kPrintf(
+            "[%s] Free [%d] KB, Largest [%d] KB, Fragmentation [%d]%%\n",
+            vpcZoneName[i],
+            qwFreeSize / 1024,
+            qwLargestSize / 1024,
+            (qwFreeSize > 0) ? (qwFreeSize - qwLargestSize) * 100 / qwFreeSize : 0
+        );
+    }
+}
+
+
+// show allocations whose task has ended
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   kShowLeakedMemory does have any parameters
+static void kShowLeakedMemory(const char *pcParameterBuffer) {
+    DYNAMICMEMORY *pstMemory;
+    ALLOCATIONRECORD stRecord;
+    QWORD qwLeakedSize;
+    int iLeakedCount;
+    int iCursorX, iCursorY;
+    int i;
+    BOOL bPreviousFlag;
+
+    pstMemory = kGetDynamicMemoryManager();
+    if (pstMemory->bTrackingEnabled == FALSE) {
+        kPrintf("Allocation Tracking Is Disabled. ex) memtrack on\n");
+        return;
+    }
+
+    kPrintf("============ Allocations Of Ended Tasks ============\n");
+
+    qwLeakedSize = 0;
+    iLeakedCount = 0;
+    for (i = 0; i < DYNAMICMEMORY_RECORD_MAXCOUNT; i++) {
+        // copy record, so that screen is not printed while system is locked
+        bPreviousFlag = kLockForSystemData();
+        if (pstMemory->pstRecordTable == NULL) {
+            kUnlockForSystemData(bPreviousFlag);
+            break;
+        }
+        stRecord = pstMemory->pstRecordTable[i];
+        kUnlockForSystemData(bPreviousFlag);
+
+        if ((stRecord.qwAddress == 0) || kIsTaskExist(stRecord.qwTaskID)) {
+            continue;
+        }
+
+        kPrintf(
+            "Task [0x%q] Address [0x%Q] Size [%d] Caller [0x%Q] TSC [0x%Q]\n",
+            stRecord.qwTaskID,
+            stRecord.qwAddress,
+            stRecord.qwSize,
+            stRecord.qwCallerAddress,
+            stRecord.qwTSC
+        );
+        qwLeakedSize += stRecord.qwSize;
+        iLeakedCount++;
+
+        if ((iLeakedCount % 20) == 0) {
+            kGetCursor(&iCursorX, &iCursorY);
+            kPrintf("Press any key to continue... ('q' is exit) : ");
+            if (kGetCh() == 'q') {
+                kPrintf("\n");
+                return;
+            }
+            kSetCursor(iCursorX, iCursorY);
+            kPrintf("                                               ");
+            kSetCursor(iCursorX, iCursorY);
+        }
+    }
+
+    kPrintf(
+        "Total [%d] Allocations, [%d] bytes\n",
+        iLeakedCount,
+        qwLeakedSize
+    );
+}
+
+
+// show records in kernel log ring buffer from the oldest one
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   records whose level is higher than the parameter are not shown
+static void kShowKernelLog(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcLevel[30];
+    int iMaxLevel;
+    LOGMANAGER *pstLogManager;
+    LOGRECORD stRecord;
+    QWORD qwSequence;
+    QWORD qwWriteSequence;
+    int iPrintCount;
+    int iCursorX, iCursorY;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcLevel) == 0) {
+        iMaxLevel = LOG_LEVEL_DEBUG;
+    }
+    else {
+        iMaxLevel = kAToI(vcLevel, 10);
+    }
+
+    pstLogManager = kGetLogManager();
+
+    // records before this are overwritten
+    qwWriteSequence = pstLogManager->qwWriteSequence;
+    if (qwWriteSequence > LOG_RECORDCOUNT) {
+        qwSequence = qwWriteSequence - LOG_RECORDCOUNT;
+    }
+    else {
+        qwSequence = 0;
+    }
+
+    iPrintCount = 0;
+    for (; qwSequence < qwWriteSequence; qwSequence++) {
+        // skip records which are being written or overwritten while printing
+        if (kReadLogRecord(qwSequence, &stRecord) == FALSE) {
+            continue;
+        }
+        if (stRecord.bLevel > iMaxLevel) {
+            continue;
+        }
+
+        kPrintLogRecord(&stRecord);
+        iPrintCount++;
+
+        if ((iPrintCount % 20) == 0) {
+            kGetCursor(&iCursorX, &iCursorY);
+            kPrintf("Press any key to continue... ('q' is exit) : ");
+            if (kGetCh() == 'q') {
+                kPrintf("\n");
+                return;
+            }
+            kSetCursor(iCursorX, iCursorY);
+            kPrintf("                                               ");
+            kSetCursor(iCursorX, iCursorY);
+        }
+    }
+
+    kPrintf(
+        "Total [%d] Records, [%d] Records Dropped Before Printed\n",
+        iPrintCount,
+        pstLogManager->qwDroppedCount
+    );
+}
+
+
+// enable or disable COM1 console and change baud rate
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   without parameter, state of COM1 is shown
+static void kSerialConsole(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcSwitch[30];
+    char vcBaudRate[30];
+    DWORD dwBaudRate;
+    SERIALMANAGER *pstSerialManager;
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcSwitch) == 0) {
+        pstSerialManager = kGetSerialManager();
+        kPrintf(
+            "COM1 [%s], Console [%s], Baud Rate [%d]\n",
+            kIsSerialPortInitialized() ? "Initialized" : "Not Initialized",
+            kIsSerialConsoleEnabled() ? "On" : "Off",
+            pstSerialManager->dwBaudRate
+        );
+        kPrintf(
+            "Sent [%d] Bytes, Received [%d] Bytes, Dropped [%d] Bytes\n",
+            pstSerialManager->qwTransmitCount,
+            pstSerialManager->qwReceiveCount,
+            pstSerialManager->qwReceiveDropCount
+        );
+        return;
+    }
+
+    if (kMemCmp("off", vcSwitch, 4) == 0) {
+        kSetSerialConsole(FALSE);
+        kPrintf("Serial Console Is Disabled\n");
+        return;
+    }
+
+    if (kMemCmp("on", vcSwitch, 3) != 0) {
+        kPrintf("ex) serial on 115200(baud)/off\n");
+        return;
+    }
+
+    if (kGetNextParameter(&stList, vcBaudRate) == 0) {
+        dwBaudRate = SERIAL_DEFAULTBAUDRATE;
+    }
+    else {
+        dwBaudRate = kAToI(vcBaudRate, 10);
+    }
+
+    if (kInitializeSerialPort(dwBaudRate) == FALSE) {
+        kPrintf("COM1 Initialize Fail. Baud Rate Must Divide 115200\n");
+        return;
+    }
+    kSetSerialConsole(TRUE);
+    kPrintf("Serial Console Is Enabled, Baud Rate [%d]\n", dwBaudRate);
+}
+
+
+// create tasks that have a window
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   F12 brings the bottom window to the top
+static void kCreateTestWindow(const char *pcParameterBuffer) {
+    PARAMETERLIST stList;
+    char vcCount[30];
+    int iCount;
+    int i;
+
+    if (kGetWindowManager()->bInitialized == FALSE) {
+        kPrintf("Window Manager Is Not Running\n");
+        return;
+    }
+
+    kInitializeParameter(&stList, pcParameterBuffer);
+    if (kGetNextParameter(&stList, vcCount) == 0) {
+        iCount = 1;
+    }
+    else {
+        iCount = kAToI(vcCount, 10);
+    }
+
+    for (i = 0; i < iCount; i++) {
+        if (kCreateTask(
+                TASK_FLAGS_LOW | TASK_FLAGS_THREAD,
+                0,
+                0,
+                (QWORD) kTestWindowTask) == NULL) {
+            break;
+        }
+    }
+    kPrintf("[%d] Windows Are Created. Press F12 To Switch Window\n", i);
+}
+
+
+// task that creates a window and shows keys that it receives
+// info:
+//   ESC closes the window and ends the task
+static void kTestWindowTask(void) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    const GRAPHICSBUFFER *pstBuffer;
+    QWORD qwWindowID;
+    RECT stClientArea;
+    RECT stLineArea;
+    EVENT stEvent;
+    char vcText[40];
+    int iOffset;
+    int iX, iY;
+
+    // windows of different tasks are placed in a stair shape
+    pstScreenBuffer = kGetScreenBuffer();
+    iOffset = GETTCBOFFSET(kGetRunningTask()->stLink.qwID);
+    qwWindowID = kCreateWindow(
+        (iOffset * 40) % (pstScreenBuffer->iWidth - 320),
+        (iOffset * 30) % (pstScreenBuffer->iHeight - 100),
+        320,
+        100,
+        WINDOW_FLAGS_DEFAULT,
+        "Test Window"
+    );
+    if (qwWindowID == WINDOW_INVALIDID) {
+        return;
+    }
+
+    pstBuffer = kGetWindowBuffer(qwWindowID);
+    kGetWindowClientArea(qwWindowID, &stClientArea);
+    iX = stClientArea.iX1 + 10;
+    iY = stClientArea.iY1 + 10;
+    kDrawText(
+        pstBuffer,
+        iX,
+        iY,
+        RGB(0, 0, 0),
+        WINDOW_COLOR_BACKGROUND,
+        "Press ESC To Close",
+        18
+    );
+    kUpdateWindowArea(qwWindowID, &stClientArea);
+
+    // only the line of key is drawn again
+    kSetRect(
+        &stLineArea,
+        stClientArea.iX1,
+        iY + 24,
+        stClientArea.iX2,
+        iY + 24 + 16 - 1
+    );
+    while (TRUE) {
+        if (kWaitEventFromWindowQueue(
+                qwWindowID, &stEvent, TASK_WAITFOREVER) == FALSE) {
+            return;
+        }
+
+        if (stEvent.qwType == EVENT_KEY_DOWN) {
+            if (stEvent.stKeyEvent.bASCIICode == KEY_ESC) {
+                kDeleteWindow(qwWindowID);
+                return;
+            }
+            kSPrintf(
+                vcText,
+                "Key [%c] Scan Code [0x%X]   ",
+                stEvent.stKeyEvent.bASCIICode,
+                stEvent.stKeyEvent.bScanCode
+            );
+        }
+        else if (stEvent.qwType == EVENT_WINDOW_SELECT) {
+            kSPrintf(vcText, "Window Is Selected        ");
+        }
+        else if (stEvent.qwType == EVENT_WINDOW_DESELECT) {
+            kSPrintf(vcText, "Window Is Deselected      ");
+        }
+        else {
+            continue;
+        }
+
+        kDrawText(
+            pstBuffer,
+            iX,
+            stLineArea.iY1,
+            RGB(0, 0, 255),
+            WINDOW_COLOR_BACKGROUND,
+            vcText,
+            kStrLen(vcText)
+        );
+        kUpdateWindowArea(qwWindowID, &stLineArea);
+    }
+}
+
+
 static void kReadHDDRegisters(const char *pcParameterBuffer) {
     WORD wPortBase = HDD_PORT_PRIMARYBASE;
 
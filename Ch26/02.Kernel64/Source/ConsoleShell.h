@@ -14,6 +14,9 @@
 #define CONSOLESHELL_MAXCOMMANDBUFFERCOUNT  300
 #define CONSOLESHELL_PROMPTMESSAGE          "MINT64>"
 
+// number of typed-ahead keys that shell takes at once
+#define CONSOLESHELL_MAXTYPEAHEADCOUNT      64
+
 
 typedef void (*CommandFunction) (const char* pcParameter);
 
@@ -155,6 +158,14 @@ static void kReadTimeStampCounter(const char *pcParameterBuffer);
 static void kMeasureProcessorSpeed(const char *pcParameterBuffer);
 
 
+// print boot timeline from boot loader to shell
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   it takes 100ms to measure time stamp counter the first time
+static void kShowBootTime(const char *pcParameterBuffer);
+
+
 // print date and time stored in RTC controller
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
@@ -303,19 +314,24 @@ static void kReadSector(const char *pcParameterBuffer);
 static void kWriteSector(const char *pcParameterBuffer);
 
 
-// mount primary slave hdd to file system
+// mount hdd to file system
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
-// info:
-//   kMountHDD does have any parameters
+//     block device name. the current device is mounted again if it is
+//     omitted
 static void kMountHDD(const char *pcParameterBuffer);
 
 
-// format primary slave hdd to the MINT filesystem
+// show block devices that drivers registered
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
-// info:
-//   kFormatHDD does have any parameters
+static void kShowBlockDevice(const char *pcParameterBuffer);
+
+
+// format mounted hdd to the MINT filesystem
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+//     lazy: zero cluster link sectors on first use instead of now
 static void kFormatHDD(const char *pcParameterBuffer);
 
 
@@ -327,32 +343,65 @@ static void kFormatHDD(const char *pcParameterBuffer);
 static void kShowFileSystemInformation(const char *pcParameterBuffer);
 
 
-// create a empty file in root directory
+// show hit rate of file data cache and readahead window of opened files
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+static void kShowReadAheadInformation(const char *pcParameterBuffer);
+
+
+// write modified file data back to HDD
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+static void kSyncFileSystem(const char *pcParameterBuffer);
+
+
+// create a empty file in a directory
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
 // info:
 //   params:
-//     filename: name of file to create
-//       limit: up to 23 chars is allowed
-static void kCreateFileInRootDirectory(const char *pcParameterBuffer);
+//     path: path of file to create. directory must exist
+//       limit: up to 128 chars and each name up to 23 chars
+static void kCreateFileInDirectory(const char *pcParameterBuffer);
 
 
-// delete file in root directory
+// delete file in a directory
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
 // info:
 //   params:
-//     filename: name of file to delete
-//       limit: up to 23 chars is allowed
-static void kDeleteFileInRootDirectory(const char *pcParameterBuffer);
+//     path: path of file to delete
+//       limit: up to 128 chars and each name up to 23 chars
+static void kDeleteFileInDirectory(const char *pcParameterBuffer);
 
 
-// list files in the root directory
+// create a directory
 // params:
 //   pcCommandBuffer: parameters passed to command by shell
 // info:
-//   kShowRootDirectory does have any parameters
-static void kShowRootDirectory(const char *pcParameterBuffer);
+//   params:
+//     path: path of directory to create. parent directory must exist
+//       limit: up to 128 chars and each name up to 23 chars
+static void kMakeDirectoryInDirectory(const char *pcParameterBuffer);
+
+
+// remove an empty directory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     path: path of directory to remove
+//       limit: up to 128 chars and each name up to 23 chars
+static void kRemoveDirectoryInDirectory(const char *pcParameterBuffer);
+
+
+// list files in a directory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     path: path of directory to show. root directory if it is omitted
+static void kShowDirectory(const char *pcParameterBuffer);
 
 
 // write input from user to a file until three enter keys are pressed in a row
@@ -426,6 +475,90 @@ static void banner(const char *pcParameterBuffer);
 static void kShowSchedulerList(const char *pcParameterBuffer);
 
 
+// measure how many cycles a context switch takes by switching between
+// shell and a partner context
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     count: number of round trips. default is 100000
+static void kSwitchBench(const char *pcParameterBuffer);
+
+
+// show free and total page frames of each zone and number of free blocks
+// of each order
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   kShowPageFrameInformation does have any parameters
+static void kShowPageFrameInformation(const char *pcParameterBuffer);
+
+
+// enable or disable allocation tracking of dynamic memory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     switch: on or off. if it is omitted, state of tracking is shown
+static void kAllocationTracking(const char *pcParameterBuffer);
+
+
+// show callers that hold the most dynamic memory
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   params:
+//     count: number of callers to show. default is 10
+static void kShowTopMemoryConsumer(const char *pcParameterBuffer);
+
+
+// show free blocks of each buddy level and page frame zone and how much
+// free memory is fragmented
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   kShowMemoryFragmentation does have any parameters
+static void kShowMemoryFragmentation(const char *pcParameterBuffer);
+
+
+// show allocations whose task has ended
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   kShowLeakedMemory does have any parameters
+static void kShowLeakedMemory(const char *pcParameterBuffer);
+
+
+// show records in kernel log ring buffer from the oldest one
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   records whose level is higher than the parameter are not shown
+static void kShowKernelLog(const char *pcParameterBuffer);
+
+
+// enable or disable COM1 console and change baud rate
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   without parameter, state of COM1 is shown
+static void kSerialConsole(const char *pcParameterBuffer);
+
+
+// create tasks that have a window
+// params:
+//   pcCommandBuffer: parameters passed to command by shell
+// info:
+//   F12 brings the bottom window to the top
+static void kCreateTestWindow(const char *pcParameterBuffer);
+
+
+// task that creates a window and shows keys that it receives
+// info:
+//   ESC closes the window and ends the task
+static void kTestWindowTask(void);
+
+
 static void kReadHDDRegisters(const char *pcParameterBuffer);
 
 static void kWriteToHDDReg(const char *pcParameterBuffer);
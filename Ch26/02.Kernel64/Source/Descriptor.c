@@ -375,11 +375,14 @@ void kInitializeIDTTables(void) {
     * In MINT64OS, there are referenced from 32 to 47 gate descriptors
     */
 
+    // timer handler does not use IST. It saves context of current task
+    // on the task's own stack, so scheduler can switch tasks by
+    // exchanging stack pointers only
     kSetIDTEntry(
         &(pstEntry[32]),
         kISRTimer,
         0x08,
-        IDT_FLAGS_IST1,
+        IDT_FLAGS_NOIST,
         IDT_FLAGS_KERNEL,
         IDT_TYPE_INTERRUPT
     );
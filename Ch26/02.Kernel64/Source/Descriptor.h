@@ -142,6 +142,9 @@
 
 #define IDT_FLAGS_IST1          1 // first index of IST. MINT64OS has only one
 
+// no IST. handler runs on the stack of the interrupted task
+#define IDT_FLAGS_NOIST         0
+
 
 /*
  * IDT gate descriptor flags for MINT64OS
@@ -3,13 +3,18 @@
 #include "Task.h"
 #include "Synchronization.h"
 #include "Console.h"
+#include "PageFrame.h"
+#include "AssemblyUtility.h"
 
 static DYNAMICMEMORY gs_stDynamicMemory;
 
 
 // initialize dynamic memory area including meta data about buddy blocks
+// info:
+//   page frame allocator must be initialized first
 void kInitializeDynamicMemory(void) {
     QWORD qwDynamicMemorySize;
+    QWORD qwPoolAddress;
     int i;
     int j;
 
@@ -20,8 +25,23 @@ void kInitializeDynamicMemory(void) {
     
     /* initialize layout of dynamic memory */
 
-    // get available memory size for dynamic memory allocation
-    qwDynamicMemorySize = kCalculateDynamicMemorySize();
+    kMemSet(&gs_stDynamicMemory, 0, sizeof(gs_stDynamicMemory));
+
+    // get buddy block pool from page frame allocator.
+    // if there is no block of DYNAMICMEMORY_POOL_ORDER, try smaller block
+    qwPoolAddress = NULL;
+    for (i = DYNAMICMEMORY_POOL_ORDER; i >= 0; i--) {
+        qwPoolAddress = (QWORD) kAllocatePageFrames(i, PAGEFRAME_ZONE_NORMAL);
+        if (qwPoolAddress != NULL) {
+            break;
+        }
+    }
+
+    // every request will be served by page frame allocator
+    if (qwPoolAddress == NULL) {
+        return;
+    }
+    qwDynamicMemorySize = (QWORD) PAGEFRAME_SIZE << i;
 
     // get required number of minimum size blocks for meta data
     iMetaBlockCount = kCalculateMetaBlockCount(qwDynamicMemorySize);
@@ -41,10 +61,12 @@ void kInitializeDynamicMemory(void) {
     }
     gs_stDynamicMemory.iMaxLevelCount = i;
 
-    // start address of pbAllocatedBlockListIndex is the first part of dynamic
-    // memory part
-    gs_stDynamicMemory.pbAllocatedBlockListIndex = 
-        (BYTE *) DYNAMICMEMORY_START_ADDRESS;
+    // meta data is at the end of pool. buddy blocks start at the pool that
+    // is aligned on its size, so each block is aligned on its own size
+    gs_stDynamicMemory.qwMetaDataSize = iMetaBlockCount * DYNAMICMEMORY_MIN_SIZE;
+    gs_stDynamicMemory.pbAllocatedBlockListIndex = (BYTE *) (
+        qwPoolAddress + qwDynamicMemorySize - gs_stDynamicMemory.qwMetaDataSize
+    );
     
     // initialize the array with 0xFF
     for (i = 0; i < gs_stDynamicMemory.iBlockCountOfSmallestBlock; i++) {
@@ -53,7 +75,7 @@ void kInitializeDynamicMemory(void) {
 
     // start address of metadata for bitmap binary tree
     gs_stDynamicMemory.pstBitmapOfLevel = (BITMAP *) (
-        DYNAMICMEMORY_START_ADDRESS +
+        gs_stDynamicMemory.pbAllocatedBlockListIndex +
         sizeof(BYTE) * gs_stDynamicMemory.iBlockCountOfSmallestBlock
     );
 
@@ -96,36 +118,15 @@ void kInitializeDynamicMemory(void) {
         }
     }
 
-    gs_stDynamicMemory.qwStartAddress = (
-        DYNAMICMEMORY_START_ADDRESS + iMetaBlockCount * DYNAMICMEMORY_MIN_SIZE
-    );
+    gs_stDynamicMemory.qwStartAddress = qwPoolAddress;
     gs_stDynamicMemory.qwEndAddress = (
-        kCalculateDynamicMemorySize() + DYNAMICMEMORY_START_ADDRESS
+        (QWORD) gs_stDynamicMemory.pbAllocatedBlockListIndex
     );
     gs_stDynamicMemory.qwUsedSize = 0;
 
 }
 
 
-// calculate total size of dynamic memory area
-// return:
-//   total size of dynamic memory area
-// info:
-//   currently, MINT64OS supports up to 2 GB
-static QWORD kCalculateDynamicMemorySize(void) {
-    QWORD qwRAMSize;
-
-    // Because part of memory addresses above 3GB is used for video memory
-    // The available ram is not consecutive. So, until this split problem is
-    // resolved, only 2 GB will be available.
-    qwRAMSize = (kGetTotalRAMSize() * 1024 * 1024);
-    if (qwRAMSize > (QWORD) 2 * 1024 * 1024 * 1024) {
-        qwRAMSize = (QWORD) 2 * 1024 * 1024 * 1024;
-    }
-    return qwRAMSize - DYNAMICMEMORY_START_ADDRESS;
-}
-
-
 // calculate necessary amount of blocks for meta data
 // params:
 //   qwDynamicRAMSize: total ram size for dynamic memory area
@@ -175,16 +176,44 @@ static int kCalculateMetaBlockCount(QWORD qwDynamicRAMSize) {
 // return:
 //   memory address of requested size
 void *kAllocateMemory(QWORD qwSize) {
+    void *pvAddress;
+
+    pvAddress = kAllocateMemoryWithoutRecord(qwSize);
+
+    // only this check is added when tracking is disabled
+    if (gs_stDynamicMemory.bTrackingEnabled && (pvAddress != NULL)) {
+        kAddAllocationRecord(
+            (QWORD) pvAddress,
+            qwSize,
+            (QWORD) __builtin_return_address(0)
+        );
+    }
+    return pvAddress;
+}
+
+
+// allocate memory without adding allocation record
+// params:
+//   qwSize: requested memory size
+// return:
+//   memory address of requested size
+static void *kAllocateMemoryWithoutRecord(QWORD qwSize) {
     QWORD qwAlignedSize;
     QWORD qwRelativeAddress;
     long lOffset;
     int iSizeArrayOffset;
     int iIndexOfBlockList;
 
+    // large object is a run of page frames
+    if (qwSize > DYNAMICMEMORY_LARGE_SIZE) {
+        return kAllocateLargeMemory(qwSize);
+    }
+
     // get size of buddy block in which qwSize fits
+    // if qwSize is bigger than the biggest buddy block, use page frames
     qwAlignedSize = kGetBuddyBlockSize(qwSize);
     if (qwAlignedSize == 0) {
-        return NULL;
+        return kAllocateMemoryFromPageFrame(qwSize);
     }
 
     // if requested memory size is bigger than straightly
@@ -194,14 +223,14 @@ void *kAllocateMemory(QWORD qwSize) {
         gs_stDynamicMemory.qwUsedSize +
         qwAlignedSize) > gs_stDynamicMemory.qwEndAddress     
     ) {
-        return NULL;
+        return kAllocateMemoryFromPageFrame(qwSize);
     }
 
     // block index of total number of blocks at the level that
     // qwAlignedSize block exist
     lOffset = kAllocationBuddyBlock(qwAlignedSize);
     if (lOffset == -1) {
-        return NULL;
+        return kAllocateMemoryFromPageFrame(qwSize);
     }
 
     // get binary tree level at which block of qwAlignedSize exist
@@ -219,6 +248,291 @@ void *kAllocateMemory(QWORD qwSize) {
 }
 
 
+// allocate memory from page frame allocator when buddy block pool cannot
+// serve the request
+// params:
+//   qwSize: requested memory size
+// return:
+//   memory address of requested size. it is aligned on its block size
+static void *kAllocateMemoryFromPageFrame(QWORD qwSize) {
+    void *pvAddress;
+    int iOrder;
+    BOOL bPreviousInterruptFlag;
+
+    iOrder = kGetPageFrameOrder(qwSize);
+    if (iOrder == -1) {
+        return NULL;
+    }
+
+    pvAddress = kAllocatePageFrames(iOrder, PAGEFRAME_ZONE_NORMAL);
+    if (pvAddress == NULL) {
+        return NULL;
+    }
+
+    bPreviousInterruptFlag = kLockForSystemData();
+    gs_stDynamicMemory.qwPageFrameUsedSize += (QWORD) PAGEFRAME_SIZE << iOrder;
+    kUnlockForSystemData(bPreviousInterruptFlag);
+
+    return pvAddress;
+}
+
+
+// allocate large object as a run of page frames
+// params:
+//   qwSize: requested memory size
+// return:
+//   memory address of requested size. it is aligned on 4KB
+static void *kAllocateLargeMemory(QWORD qwSize) {
+    void *pvAddress;
+    QWORD qwFrameCount;
+    BOOL bPreviousInterruptFlag;
+
+    qwFrameCount = (qwSize + PAGEFRAME_SIZE - 1) / PAGEFRAME_SIZE;
+    pvAddress = kAllocatePageFrameRun(qwFrameCount, PAGEFRAME_ZONE_NORMAL);
+    if (pvAddress == NULL) {
+        return NULL;
+    }
+
+    bPreviousInterruptFlag = kLockForSystemData();
+    gs_stDynamicMemory.qwPageFrameUsedSize += qwFrameCount * PAGEFRAME_SIZE;
+    kUnlockForSystemData(bPreviousInterruptFlag);
+
+    return pvAddress;
+}
+
+
+// allocate memory aligned on qwAlignment
+// params:
+//   qwSize: requested memory size
+//   qwAlignment: alignment. it must be power of two
+// return:
+//   memory address of requested size
+// info:
+//   memory is freed by kFreeMemory
+void *kAllocateAlignedMemory(QWORD qwSize, QWORD qwAlignment) {
+    QWORD qwAlignedSize;
+    void *pvAddress;
+
+    if ((qwAlignment == 0) || (qwAlignment & (qwAlignment - 1))) {
+        return NULL;
+    }
+
+    qwAlignedSize = MAX(qwSize, qwAlignment);
+
+    // runs of page frames are aligned on 4KB
+    if ((qwSize > DYNAMICMEMORY_LARGE_SIZE) && (qwAlignment <= PAGEFRAME_SIZE)) {
+        pvAddress = kAllocateLargeMemory(qwSize);
+    }
+    // buddy blocks and blocks of page frames are aligned on their size
+    else if (qwAlignedSize <= DYNAMICMEMORY_LARGE_SIZE) {
+        pvAddress = kAllocateMemoryWithoutRecord(qwAlignedSize);
+    }
+    else {
+        pvAddress = kAllocateMemoryFromPageFrame(qwAlignedSize);
+    }
+
+    if (gs_stDynamicMemory.bTrackingEnabled && (pvAddress != NULL)) {
+        kAddAllocationRecord(
+            (QWORD) pvAddress,
+            qwSize,
+            (QWORD) __builtin_return_address(0)
+        );
+    }
+    return pvAddress;
+}
+
+
+// change size of allocated memory
+// params:
+//   pvAddress: allocated memory address. if NULL, memory is allocated
+//   qwSize: new memory size
+// return:
+//   memory address of new size. it can be different from pvAddress.
+//   on failure, NULL is returned and pvAddress is still valid
+// info:
+//   memory grows in place if free buddy blocks or page frames right after
+//   it can be merged. Otherwise it is moved
+void *kReallocateMemory(void *pvAddress, QWORD qwSize) {
+    QWORD qwCurrentSize;
+    QWORD qwAlignedSize;
+    QWORD qwRelativeAddress;
+    QWORD qwFrameCount;
+    void *pvNewAddress;
+    int iBlockListIndex;
+    BOOL bPreviousInterruptFlag;
+
+    if (pvAddress == NULL) {
+        pvNewAddress = kAllocateMemoryWithoutRecord(qwSize);
+        if (gs_stDynamicMemory.bTrackingEnabled && (pvNewAddress != NULL)) {
+            kAddAllocationRecord(
+                (QWORD) pvNewAddress,
+                qwSize,
+                (QWORD) __builtin_return_address(0)
+            );
+        }
+        return pvNewAddress;
+    }
+
+    qwCurrentSize = kGetAllocatedMemorySize(pvAddress);
+    if (qwCurrentSize == 0) {
+        return NULL;
+    }
+    if (qwSize <= qwCurrentSize) {
+        pvNewAddress = pvAddress;
+        goto RECORD;
+    }
+
+
+    /* grow in place */
+
+    // buddy block merges free buddies at upper levels. large object is not
+    // kept in the pool
+    if (
+        ((QWORD) pvAddress >= gs_stDynamicMemory.qwStartAddress) &&
+        ((QWORD) pvAddress < gs_stDynamicMemory.qwEndAddress)
+    ) {
+        qwAlignedSize = kGetBuddyBlockSize(qwSize);
+        if ((qwAlignedSize != 0) && (qwSize <= DYNAMICMEMORY_LARGE_SIZE)) {
+            qwRelativeAddress = (
+                (QWORD) pvAddress - gs_stDynamicMemory.qwStartAddress
+            );
+            iBlockListIndex = gs_stDynamicMemory.pbAllocatedBlockListIndex[
+                qwRelativeAddress / DYNAMICMEMORY_MIN_SIZE
+            ];
+            if (
+                kGrowBuddyBlock(
+                    qwRelativeAddress,
+                    iBlockListIndex,
+                    kGetBlockListIndexOfMatchSize(qwAlignedSize)
+                ) == TRUE
+            ) {
+                pvNewAddress = pvAddress;
+                goto RECORD;
+            }
+        }
+    }
+    // page frames take free frames right after them
+    else {
+        qwFrameCount = (qwSize + PAGEFRAME_SIZE - 1) / PAGEFRAME_SIZE;
+        if (kExtendPageFrames(pvAddress, qwFrameCount) == TRUE) {
+            bPreviousInterruptFlag = kLockForSystemData();
+            gs_stDynamicMemory.qwPageFrameUsedSize += (
+                qwFrameCount * PAGEFRAME_SIZE - qwCurrentSize
+            );
+            kUnlockForSystemData(bPreviousInterruptFlag);
+            pvNewAddress = pvAddress;
+            goto RECORD;
+        }
+    }
+
+
+    /* move */
+
+    pvNewAddress = kAllocateMemoryWithoutRecord(qwSize);
+    if (pvNewAddress == NULL) {
+        return NULL;
+    }
+    kMemCpy(pvNewAddress, pvAddress, qwCurrentSize);
+    kFreeMemoryWithoutRecord(pvAddress);
+
+RECORD:
+    // record of old address is replaced
+    if (gs_stDynamicMemory.bTrackingEnabled) {
+        kRemoveAllocationRecord((QWORD) pvAddress);
+        kAddAllocationRecord(
+            (QWORD) pvNewAddress,
+            qwSize,
+            (QWORD) __builtin_return_address(0)
+        );
+    }
+    return pvNewAddress;
+}
+
+
+// get size of allocated memory
+// params:
+//   pvAddress: allocated memory address
+// return:
+//   usable size of the memory. if pvAddress is not allocated, 0
+QWORD kGetAllocatedMemorySize(const void *pvAddress) {
+    QWORD qwRelativeAddress;
+    BYTE bBlockListIndex;
+
+    if (
+        ((QWORD) pvAddress < gs_stDynamicMemory.qwStartAddress) ||
+        ((QWORD) pvAddress >= gs_stDynamicMemory.qwEndAddress)
+    ) {
+        return kGetPageFrameBlockSize(pvAddress);
+    }
+
+    qwRelativeAddress = (QWORD) pvAddress - gs_stDynamicMemory.qwStartAddress;
+    bBlockListIndex = gs_stDynamicMemory.pbAllocatedBlockListIndex[
+        qwRelativeAddress / DYNAMICMEMORY_MIN_SIZE
+    ];
+    if (bBlockListIndex == 0xFF) {
+        return 0;
+    }
+    return (QWORD) DYNAMICMEMORY_MIN_SIZE << bBlockListIndex;
+}
+
+
+// grow allocated buddy block in place by merging free buddy blocks
+// params:
+//   qwRelativeAddress: address of block relative to buddy block pool
+//   iBlockListIndex: binary tree level of the block
+//   iTargetBlockListIndex: binary tree level after growing
+// return:
+//   True on success. Otherwise False and the block is not changed
+static BOOL kGrowBuddyBlock(
+    QWORD qwRelativeAddress,
+    int iBlockListIndex,
+    int iTargetBlockListIndex
+) {
+    int iOffset;
+    int i;
+    BOOL bPreviousInterruptFlag;
+
+    if (iTargetBlockListIndex >= gs_stDynamicMemory.iMaxLevelCount) {
+        return FALSE;
+    }
+
+    bPreviousInterruptFlag = kLockForSystemData();
+
+    // block must be left node and its sibling (right node) must be free at
+    // every level up to target level
+    for (i = iBlockListIndex; i < iTargetBlockListIndex; i++) {
+        iOffset = qwRelativeAddress / (DYNAMICMEMORY_MIN_SIZE << i);
+        if (
+            ((iOffset % 2) != 0) ||
+            ((iOffset + 1) >=
+                (gs_stDynamicMemory.iBlockCountOfSmallestBlock >> i)) ||
+            (kGetFlagInBitmap(i, iOffset + 1) == DYNAMICMEMORY_EMPTY)
+        ) {
+            kUnlockForSystemData(bPreviousInterruptFlag);
+            return FALSE;
+        }
+    }
+
+    // take siblings. parent nodes are already empty because the block was
+    // split from them
+    for (i = iBlockListIndex; i < iTargetBlockListIndex; i++) {
+        iOffset = qwRelativeAddress / (DYNAMICMEMORY_MIN_SIZE << i);
+        kSetFlagInBitmap(i, iOffset + 1, DYNAMICMEMORY_EMPTY);
+    }
+
+    gs_stDynamicMemory.pbAllocatedBlockListIndex[
+        qwRelativeAddress / DYNAMICMEMORY_MIN_SIZE
+    ] = (BYTE) iTargetBlockListIndex;
+    gs_stDynamicMemory.qwUsedSize += (
+        (DYNAMICMEMORY_MIN_SIZE << iTargetBlockListIndex) -
+        (DYNAMICMEMORY_MIN_SIZE << iBlockListIndex)
+    );
+
+    kUnlockForSystemData(bPreviousInterruptFlag);
+    return TRUE;
+}
+
+
 // get size of buddy block in which qwSize fits
 // params:
 //   qwSize: requested memory size
@@ -390,17 +704,52 @@ static void kSetFlagInBitmap(int iBlockListIndex, int iOffset, BYTE bFlag) {
 // return:
 //   True on success. Otherwise False
 BOOL kFreeMemory(void *pvAddress) {
+    if (kFreeMemoryWithoutRecord(pvAddress) == FALSE) {
+        return FALSE;
+    }
+
+    if (gs_stDynamicMemory.bTrackingEnabled) {
+        kRemoveAllocationRecord((QWORD) pvAddress);
+    }
+    return TRUE;
+}
+
+
+// free allocated memory without removing allocation record
+// params:
+//   pvAddress: allocated memory address
+// return:
+//   True on success. Otherwise False
+static BOOL kFreeMemoryWithoutRecord(void *pvAddress) {
     QWORD qwRelativeAddress;
     BYTE *pbAllocatedBlockListIndex;
     int iSizeArrayOffset;
     QWORD qwBlockSize;
     int iBlockListIndex;
     int iBitmapOffset;
+    QWORD qwPageFrameSize;
+    BOOL bPreviousInterruptFlag;
 
     if (pvAddress == NULL) {
         return FALSE;
     }
 
+    // memory outside buddy block pool came from page frame allocator
+    if (
+        ((QWORD) pvAddress < gs_stDynamicMemory.qwStartAddress) ||
+        ((QWORD) pvAddress >= gs_stDynamicMemory.qwEndAddress)
+    ) {
+        qwPageFrameSize = kGetPageFrameBlockSize(pvAddress);
+        if (kFreePageFrames(pvAddress) == FALSE) {
+            return FALSE;
+        }
+
+        bPreviousInterruptFlag = kLockForSystemData();
+        gs_stDynamicMemory.qwPageFrameUsedSize -= qwPageFrameSize;
+        kUnlockForSystemData(bPreviousInterruptFlag);
+        return TRUE;
+    }
+
     qwRelativeAddress = ((QWORD) pvAddress) - gs_stDynamicMemory.qwStartAddress;
     iSizeArrayOffset = qwRelativeAddress / DYNAMICMEMORY_MIN_SIZE;
     pbAllocatedBlockListIndex = gs_stDynamicMemory.pbAllocatedBlockListIndex;
@@ -503,18 +852,37 @@ static BYTE kGetFlagInBitmap(int iBlockListIndex, int iOffset) {
 //   pqwDynamicMemoryTotalSize: address to save size of dynamic memory
 //   pqwMetaDataSize: address to save size of metadata about dynamic memory
 //   pqwUsedMemorySize: address to save currently used memory size
+// info:
+//   dynamic memory is every page frame including buddy block pool, so
+//   total size is not contiguous
 void kGetDynamicMemoryInformation(
     QWORD *pqwDynamicMemoryStartAddress,
     QWORD *pqwDynamicMemoryTotalSize,
     QWORD *pqwMetaDataSize,
     QWORD *pqwUsedMemorySize
 ) {
-    *pqwDynamicMemoryStartAddress = DYNAMICMEMORY_START_ADDRESS;
-    *pqwDynamicMemoryTotalSize = kCalculateDynamicMemorySize();
-    *pqwMetaDataSize = kCalculateMetaBlockCount(
-        *pqwDynamicMemoryTotalSize * DYNAMICMEMORY_MIN_SIZE
+    PAGEFRAMEMANAGER *pstPageFrameManager;
+    QWORD qwTotalFrameCount;
+    int i;
+
+    pstPageFrameManager = kGetPageFrameManager();
+    qwTotalFrameCount = 0;
+    for (i = 0; i < PAGEFRAME_ZONECOUNT; i++) {
+        qwTotalFrameCount += pstPageFrameManager->vstZone[i].qwTotalFrameCount;
+    }
+
+    *pqwDynamicMemoryStartAddress = PAGEFRAME_START_ADDRESS;
+    *pqwDynamicMemoryTotalSize = qwTotalFrameCount * PAGEFRAME_SIZE;
+
+    // state array of page frames and meta data of buddy block pool
+    *pqwMetaDataSize = (
+        pstPageFrameManager->qwMetaDataSize +
+        gs_stDynamicMemory.qwMetaDataSize
+    );
+    *pqwUsedMemorySize = (
+        gs_stDynamicMemory.qwUsedSize +
+        gs_stDynamicMemory.qwPageFrameUsedSize
     );
-    *pqwUsedMemorySize = gs_stDynamicMemory.qwUsedSize;
 }
 
 
@@ -524,3 +892,188 @@ void kGetDynamicMemoryInformation(
 DYNAMICMEMORY *kGetDynamicMemoryManager(void) {
     return &gs_stDynamicMemory;
 }
+
+
+/* allocation tracking related functions */
+
+// enable or disable allocation tracking
+// params:
+//   bEnable: True to enable
+// return:
+//   True on success. Otherwise False
+// info:
+//   when tracking is enabled, caller, task ID, size and time stamp counter
+//   of each allocation are saved in record table. disabling drops every
+//   record
+BOOL kEnableAllocationTracking(BOOL bEnable) {
+    ALLOCATIONRECORD *pstRecordTable;
+    QWORD qwTableSize;
+    BOOL bPreviousInterruptFlag;
+
+    qwTableSize = sizeof(ALLOCATIONRECORD) * DYNAMICMEMORY_RECORD_MAXCOUNT;
+
+    if (bEnable == TRUE) {
+        if (gs_stDynamicMemory.bTrackingEnabled == TRUE) {
+            return TRUE;
+        }
+
+        // record table is not tracked itself
+        pstRecordTable = kAllocatePageFrameRun(
+            (qwTableSize + PAGEFRAME_SIZE - 1) / PAGEFRAME_SIZE,
+            PAGEFRAME_ZONE_NORMAL
+        );
+        if (pstRecordTable == NULL) {
+            return FALSE;
+        }
+        kMemSet(pstRecordTable, 0, qwTableSize);
+
+        bPreviousInterruptFlag = kLockForSystemData();
+        gs_stDynamicMemory.pstRecordTable = pstRecordTable;
+        gs_stDynamicMemory.iRecordCount = 0;
+        gs_stDynamicMemory.qwDroppedRecordCount = 0;
+        gs_stDynamicMemory.bTrackingEnabled = TRUE;
+        kUnlockForSystemData(bPreviousInterruptFlag);
+        return TRUE;
+    }
+
+    bPreviousInterruptFlag = kLockForSystemData();
+    pstRecordTable = gs_stDynamicMemory.pstRecordTable;
+    gs_stDynamicMemory.bTrackingEnabled = FALSE;
+    gs_stDynamicMemory.pstRecordTable = NULL;
+    gs_stDynamicMemory.iRecordCount = 0;
+    kUnlockForSystemData(bPreviousInterruptFlag);
+
+    if (pstRecordTable != NULL) {
+        kFreePageFrames(pstRecordTable);
+    }
+    return TRUE;
+}
+
+
+// add or update allocation record
+// params:
+//   qwAddress: allocated memory address
+//   qwSize: requested size
+//   qwCallerAddress: return address of allocation function
+static void kAddAllocationRecord(
+    QWORD qwAddress,
+    QWORD qwSize,
+    QWORD qwCallerAddress
+) {
+    ALLOCATIONRECORD *pstRecord;
+    TCB *pstTask;
+    BOOL bPreviousInterruptFlag;
+    int i;
+
+    bPreviousInterruptFlag = kLockForSystemData();
+
+    // tracking can be disabled by another task
+    if (gs_stDynamicMemory.pstRecordTable == NULL) {
+        kUnlockForSystemData(bPreviousInterruptFlag);
+        return;
+    }
+
+    for (
+        i = kGetAllocationRecordHash(qwAddress);
+        ;
+        i = (i + 1) % DYNAMICMEMORY_RECORD_MAXCOUNT
+    ) {
+        pstRecord = gs_stDynamicMemory.pstRecordTable + i;
+        if (pstRecord->qwAddress == qwAddress) {
+            break;
+        }
+
+        if (pstRecord->qwAddress == 0) {
+            if (gs_stDynamicMemory.iRecordCount >= DYNAMICMEMORY_RECORD_LIMIT) {
+                gs_stDynamicMemory.qwDroppedRecordCount++;
+                kUnlockForSystemData(bPreviousInterruptFlag);
+                return;
+            }
+            gs_stDynamicMemory.iRecordCount++;
+            break;
+        }
+    }
+
+    pstTask = kGetRunningTask();
+
+    pstRecord->qwAddress = qwAddress;
+    pstRecord->qwSize = qwSize;
+    pstRecord->qwCallerAddress = qwCallerAddress;
+    pstRecord->qwTaskID = (pstTask != NULL) ? pstTask->stLink.qwID : 0;
+    pstRecord->qwTSC = kReadTSC();
+
+    kUnlockForSystemData(bPreviousInterruptFlag);
+}
+
+
+// remove allocation record
+// params:
+//   qwAddress: freed memory address
+// info:
+//   memory allocated before tracking was enabled does not have record
+static void kRemoveAllocationRecord(QWORD qwAddress) {
+    ALLOCATIONRECORD *pstRecordTable;
+    BOOL bPreviousInterruptFlag;
+    int iEmptyIndex;
+    int iHashIndex;
+    int i;
+
+    bPreviousInterruptFlag = kLockForSystemData();
+
+    pstRecordTable = gs_stDynamicMemory.pstRecordTable;
+    if (pstRecordTable == NULL) {
+        kUnlockForSystemData(bPreviousInterruptFlag);
+        return;
+    }
+
+    for (
+        i = kGetAllocationRecordHash(qwAddress);
+        pstRecordTable[i].qwAddress != qwAddress;
+        i = (i + 1) % DYNAMICMEMORY_RECORD_MAXCOUNT
+    ) {
+        if (pstRecordTable[i].qwAddress == 0) {
+            kUnlockForSystemData(bPreviousInterruptFlag);
+            return;
+        }
+    }
+
+    // move following records of the same probe sequence back, so that
+    // search does not stop at the empty slot
+    iEmptyIndex = i;
+    for (
+        i = (i + 1) % DYNAMICMEMORY_RECORD_MAXCOUNT;
+        pstRecordTable[i].qwAddress != 0;
+        i = (i + 1) % DYNAMICMEMORY_RECORD_MAXCOUNT
+    ) {
+        iHashIndex = kGetAllocationRecordHash(pstRecordTable[i].qwAddress);
+
+        // record can move only if its hash index is not between empty slot
+        // and itself
+        if (
+            ((iEmptyIndex < i) &&
+                ((iHashIndex <= iEmptyIndex) || (iHashIndex > i))) ||
+            ((iEmptyIndex > i) &&
+                ((iHashIndex <= iEmptyIndex) && (iHashIndex > i)))
+        ) {
+            pstRecordTable[iEmptyIndex] = pstRecordTable[i];
+            iEmptyIndex = i;
+        }
+    }
+    pstRecordTable[iEmptyIndex].qwAddress = 0;
+    gs_stDynamicMemory.iRecordCount--;
+
+    kUnlockForSystemData(bPreviousInterruptFlag);
+}
+
+
+// get index of record table where search for qwAddress starts
+// params:
+//   qwAddress: allocated memory address
+// return:
+//   index of record table
+static int kGetAllocationRecordHash(QWORD qwAddress) {
+    // allocated memory is aligned on 1KB at least
+    return (int) (
+        ((qwAddress >> 10) * 0x9E3779B1) % DYNAMICMEMORY_RECORD_MAXCOUNT
+    );
+}
@@ -4,11 +4,14 @@
 #include "Types.h"
 #include "Task.h"
 
-// dynamic address is aligned on 1MB boundaries
-#define DYNAMICMEMORY_START_ADDRESS ( \
-    (TASK_STACKPOOLADDRESS + (TASK_STACKSIZE * TASK_MAXCOUNT) + 0xFFFFF) & \
-    0xFFFFFFFFFFF00000 \
-)
+// buddy block pool is allocated from page frame allocator.
+// order of the pool is 12, so 2^12 page frames (16MB)
+// requests that do not fit in the pool are served by page frames directly
+#define DYNAMICMEMORY_POOL_ORDER 12
+
+// requests bigger than this size are large objects. they are allocated
+// as runs of page frames, so they are not rounded up to power of two
+#define DYNAMICMEMORY_LARGE_SIZE    0x10000 // 64KB
 
 // minimum size of buddy block
 #define DYNAMICMEMORY_MIN_SIZE  (1 * 1024) // 1KB
@@ -21,6 +24,12 @@
 // flag for a used block
 #define DYNAMICMEMORY_EMPTY 0x00
 
+// allocation tracking
+// records are kept in hash table with linear probing. table is filled
+// up to 3/4 and records beyond it are dropped
+#define DYNAMICMEMORY_RECORD_MAXCOUNT   8192
+#define DYNAMICMEMORY_RECORD_LIMIT      (DYNAMICMEMORY_RECORD_MAXCOUNT / 4 * 3)
+
 #pragma pack(push, 1)
 
 // Binary Tree structure is used to implement Buddy Block algorithm and
@@ -31,12 +40,26 @@ typedef struct kBitmapStruct {
     QWORD qwExistBitCount;
 } BITMAP;
 
+// information about an allocation saved while tracking is enabled
+typedef struct kAllocationRecordStruct {
+    QWORD qwAddress;    // 0 means empty slot
+    QWORD qwSize;       // requested size
+    QWORD qwCallerAddress;
+    QWORD qwTaskID;
+    QWORD qwTSC;        // time stamp counter at allocation
+} ALLOCATIONRECORD;
+
 // kDynamicMemoryManagerStruct manages binary tree which is meta data
 // for buddy block pool
 typedef struct kDynamicMemoryManagerStruct {
     int iMaxLevelCount; // level of binary tree
     int iBlockCountOfSmallestBlock; // total number of binary tree leaves
-    QWORD qwUsedSize;   // size of used memory
+    QWORD qwUsedSize;   // size of used memory in buddy block pool
+
+    // size of memory allocated from page frame allocator directly
+    QWORD qwPageFrameUsedSize;
+
+    QWORD qwMetaDataSize;   // size of meta data at the end of pool
 
     QWORD qwStartAddress;   // start address of buddy block pool
     QWORD qwEndAddress; // end address of buddy block pool
@@ -52,6 +75,12 @@ typedef struct kDynamicMemoryManagerStruct {
     // blocks
     BYTE *pbAllocatedBlockListIndex;
     BITMAP *pstBitmapOfLevel;   // bitmap binary tree
+
+    // allocation tracking. disabled by default
+    BOOL bTrackingEnabled;
+    ALLOCATIONRECORD *pstRecordTable;
+    int iRecordCount;
+    QWORD qwDroppedRecordCount;
 } DYNAMICMEMORY;
 
 #pragma pack(pop)
@@ -60,6 +89,8 @@ typedef struct kDynamicMemoryManagerStruct {
 /* dynamic memory related functions */
 
 // initialize dynamic memory area including meta data about buddy blocks
+// info:
+//   page frame allocator must be initialized first
 void kInitializeDynamicMemory(void);
 
 
@@ -71,6 +102,30 @@ void kInitializeDynamicMemory(void);
 void *kAllocateMemory(QWORD qwSize);
 
 
+// allocate memory aligned on qwAlignment
+// params:
+//   qwSize: requested memory size
+//   qwAlignment: alignment. it must be power of two
+// return:
+//   memory address of requested size
+// info:
+//   memory is freed by kFreeMemory
+void *kAllocateAlignedMemory(QWORD qwSize, QWORD qwAlignment);
+
+
+// change size of allocated memory
+// params:
+//   pvAddress: allocated memory address. if NULL, memory is allocated
+//   qwSize: new memory size
+// return:
+//   memory address of new size. it can be different from pvAddress.
+//   on failure, NULL is returned and pvAddress is still valid
+// info:
+//   memory grows in place if free buddy blocks or page frames right after
+//   it can be merged. Otherwise it is moved
+void *kReallocateMemory(void *pvAddress, QWORD qwSize);
+
+
 // free allocated memory
 // params:
 //   pvAddress: allocated memory address
@@ -79,12 +134,23 @@ void *kAllocateMemory(QWORD qwSize);
 BOOL kFreeMemory(void *pvAddress);
 
 
+// get size of allocated memory
+// params:
+//   pvAddress: allocated memory address
+// return:
+//   usable size of the memory. if pvAddress is not allocated, 0
+QWORD kGetAllocatedMemorySize(const void *pvAddress);
+
+
 // get information about dynamic memory
 // params:
 //   pqwDynamicMemoryStartAddress: address to save dynamic memory start address
 //   pqwDynamicMemoryTotalSize: address to save size of dynamic memory
 //   pqwMetaDataSize: address to save size of metadata about dynamic memory
 //   pqwUsedMemorySize: address to save currently used memory size
+// info:
+//   dynamic memory is every page frame including buddy block pool, so
+//   total size is not contiguous
 void kGetDynamicMemoryInformation(
     QWORD *pqwDynamicMemoryStartAddress,
     QWORD *pqwDynamicMemoryTotalSize,
@@ -99,12 +165,63 @@ void kGetDynamicMemoryInformation(
 DYNAMICMEMORY *kGetDynamicMemoryManager(void);
 
 
-// calculate total size of dynamic memory area
+// enable or disable allocation tracking
+// params:
+//   bEnable: True to enable
 // return:
-//   total size of dynamic memory area
+//   True on success. Otherwise False
 // info:
-//   currently, MINT64OS supports up to 3 GB
-static QWORD kCalculateDynamicMemorySize(void);
+//   when tracking is enabled, caller, task ID, size and time stamp counter
+//   of each allocation are saved in record table. disabling drops every
+//   record
+BOOL kEnableAllocationTracking(BOOL bEnable);
+
+
+// allocate memory without adding allocation record
+// params:
+//   qwSize: requested memory size
+// return:
+//   memory address of requested size
+static void *kAllocateMemoryWithoutRecord(QWORD qwSize);
+
+
+// free allocated memory without removing allocation record
+// params:
+//   pvAddress: allocated memory address
+// return:
+//   True on success. Otherwise False
+static BOOL kFreeMemoryWithoutRecord(void *pvAddress);
+
+
+// allocate memory from page frame allocator when buddy block pool cannot
+// serve the request
+// params:
+//   qwSize: requested memory size
+// return:
+//   memory address of requested size. it is aligned on its block size
+static void *kAllocateMemoryFromPageFrame(QWORD qwSize);
+
+
+// allocate large object as a run of page frames
+// params:
+//   qwSize: requested memory size
+// return:
+//   memory address of requested size. it is aligned on 4KB
+static void *kAllocateLargeMemory(QWORD qwSize);
+
+
+// grow allocated buddy block in place by merging free buddy blocks
+// params:
+//   qwRelativeAddress: address of block relative to buddy block pool
+//   iBlockListIndex: binary tree level of the block
+//   iTargetBlockListIndex: binary tree level after growing
+// return:
+//   True on success. Otherwise False and the block is not changed
+static BOOL kGrowBuddyBlock(
+    QWORD qwRelativeAddress,
+    int iBlockListIndex,
+    int iTargetBlockListIndex
+);
 
 
 // calculate necessary amount of blocks for meta data
@@ -180,4 +297,33 @@ static BOOL kFreeBuddyBlock(int iBlockListIndex, int iBlockOffset);
 static BYTE kGetFlagInBitmap(int iBlockListIndex, int iOffset);
 
 
+
+// add or update allocation record
+// params:
+//   qwAddress: allocated memory address
+//   qwSize: requested size
+//   qwCallerAddress: return address of allocation function
+static void kAddAllocationRecord(
+    QWORD qwAddress,
+    QWORD qwSize,
+    QWORD qwCallerAddress
+);
+
+
+// remove allocation record
+// params:
+//   qwAddress: freed memory address
+// info:
+//   memory allocated before tracking was enabled does not have record
+static void kRemoveAllocationRecord(QWORD qwAddress);
+
+
+// get index of record table where search for qwAddress starts
+// params:
+//   qwAddress: allocated memory address
+// return:
+//   index of record table
+static int kGetAllocationRecordHash(QWORD qwAddress);
+
+
 #endif /* __DYNAMICMEMORY_H__ */
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include "FileSystem.h"
 #include "HardDisk.h"
+#include "BlockDevice.h"
 #include "DynamicMemory.h"
 #include "Utility.h"
+#include "Log.h"
 
 // debug
 #include "Console.h"
@@ -14,26 +16,33 @@ static FILESYSTEMMANAGER gs_stFileSystemManager;
 // can have up to 512 clusters
 static BYTE gs_vbTempBuffer[FILESYSTEM_SECTORSPERCLUSTER * 512];
 
+// link sector that is kept in memory
+static BYTE gs_vbClusterLinkBuffer[512];
 
-// function pointer types related to hard disk control 
-
-fReadHDDInformation gs_pfReadHDDInformation = NULL;
-
-fReadHDDSector gs_fpReadHDDSector = NULL;
-
-fWriteHDDSector gs_pfWriteHDDSector = NULL;
+// directory nodes that B+tree functions work on. a node that is split has
+// one more entry than a cluster can have, so they are a bit larger
+static BYTE gs_vbDirectoryNodeBuffer[
+    FILESYSTEM_CLUSTERSIZE + sizeof(DIRECTORYENTRY)
+];
+static BYTE gs_vbDirectorySplitBuffer[
+    FILESYSTEM_CLUSTERSIZE + sizeof(DIRECTORYENTRY)
+];
 
 
 // initialize file system
 // return:
 //   True on success, False on failure
 // info:
-//   This function initialize HDD disk controller before initializing filesystem
+//   HDD must be initialized before initializing filesystem, so the drive
+//   is registered as FILESYSTEM_DEFAULTDEVICE
 //   
 //   possible failures:
-//     when HDD initialization failed
+//     when FILESYSTEM_DEFAULTDEVICE does not exist
 //     when mounting filesystem failed  
 BOOL kInitializeFileSystem(void) {
+    DATACACHEENTRY *pstEntry;
+    BYTE *pbDataCacheBuffer;
+    int i;
 
     kMemSet(
         &gs_stFileSystemManager,
@@ -43,28 +52,11 @@ BOOL kInitializeFileSystem(void) {
 
     kInitializeMutex(&(gs_stFileSystemManager.stMutex));
 
-    // If HDD initialization is successful, the global static function
-    // pointers are set to functions for the hard disk. 
-    if (kInitializeHDD() == TRUE) {
-        gs_pfReadHDDInformation = kReadHDDInformation;
-        gs_fpReadHDDSector = kReadHDDSector;
-        gs_pfWriteHDDSector = kWriteHDDSector;
-    }
-    else {
-        return FALSE;
-    }
-
-    // connect to filesystem in HDD if HDD has MINT filesystem
-    if (kMount() == FALSE) {
-        return FALSE;
-    }
-
     // allocate memory for file and dir handler pool
     gs_stFileSystemManager.pstHandlePool = 
         (FILE *) kAllocateMemory(FILESYSTEM_HANDLE_MAXCOUNT * sizeof(FILE));
 
     if (gs_stFileSystemManager.pstHandlePool == NULL) {
-        gs_stFileSystemManager.bMounted = FALSE;
         return FALSE;
     }
 
@@ -74,7 +66,118 @@ BOOL kInitializeFileSystem(void) {
         FILESYSTEM_HANDLE_MAXCOUNT * sizeof(FILE)
     );
 
+    // allocate memory for cluster maps of opened files
+    gs_stFileSystemManager.pstClusterMapPool = (CLUSTERMAP *) kAllocateMemory(
+        FILESYSTEM_CLUSTERMAP_MAXCOUNT * sizeof(CLUSTERMAP)
+    );
+
+    if (gs_stFileSystemManager.pstClusterMapPool == NULL) {
+        return FALSE;
+    }
+
+    kMemSet(
+        gs_stFileSystemManager.pstClusterMapPool,
+        0,
+        FILESYSTEM_CLUSTERMAP_MAXCOUNT * sizeof(CLUSTERMAP)
+    );
+
+    // allocate memory for file data cache. entries and their clusters are
+    // allocated at once
+    gs_stFileSystemManager.pstDataCache = (DATACACHEENTRY *) kAllocateMemory(
+        FILESYSTEM_DATACACHE_COUNT *
+            (sizeof(DATACACHEENTRY) + FILESYSTEM_CLUSTERSIZE)
+    );
+
+    if (gs_stFileSystemManager.pstDataCache == NULL) {
+        return FALSE;
+    }
+
+    pbDataCacheBuffer = (BYTE *) (
+        gs_stFileSystemManager.pstDataCache + FILESYSTEM_DATACACHE_COUNT
+    );
+    for (i = 0; i < FILESYSTEM_DATACACHE_COUNT; i++) {
+        pstEntry = gs_stFileSystemManager.pstDataCache + i;
+        pstEntry->dwClusterIndex = FILESYSTEM_LASTCLUSTER;
+        pstEntry->bReadAhead = FALSE;
+        pstEntry->bDirty = FALSE;
+        pstEntry->bMetadata = FALSE;
+        pstEntry->stRequest.bStatus = BLOCKREQUEST_STATUS_DONE;
+        pstEntry->pbBuffer = pbDataCacheBuffer + (i * FILESYSTEM_CLUSTERSIZE);
+    }
+    gs_stFileSystemManager.dwCachedClusterLinkSectorOffset =
+        FILESYSTEM_LASTCLUSTER;
+
+    // allocate memory for running transaction of journal and a buffer that
+    // has descriptor, metadata sectors and commit sector of a transaction
+    gs_stFileSystemManager.pbJournalLinkSectorBuffer = (BYTE *)
+        kAllocateMemory(FILESYSTEM_JOURNAL_MAXSECTORCOUNT * 512);
+    gs_stFileSystemManager.pbJournalBuffer = (BYTE *)
+        kAllocateMemory((
+            FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT +
+            FILESYSTEM_JOURNAL_MAXSECTORCOUNT + 1
+        ) * 512);
+
+    if (
+        (gs_stFileSystemManager.pbJournalLinkSectorBuffer == NULL) ||
+        (gs_stFileSystemManager.pbJournalBuffer == NULL)
+    ) {
+        return FALSE;
+    }
+
+    // connect to filesystem in HDD if HDD has MINT filesystem. pools are
+    // allocated first, so another drive can be mounted or formatted later
+    // even if it fails
+    return kMountBlockDevice(FILESYSTEM_DEFAULTDEVICE);
+}
+
+
+// mount file system on a block device
+// params:
+//   pcDeviceName: name of block device. ex) hdb
+// return:
+//   TRUE on success and FALSE on failure
+// info:
+//   device is selected even if it has no file system, so it can be
+//   formatted. it fails if a file or directory is open
+BOOL kMountBlockDevice(const char *pcDeviceName) {
+    BLOCKDEVICE *pstDevice;
+    int i;
+
+    pstDevice = kFindBlockDevice(pcDeviceName);
+    if ((pstDevice == NULL) || (gs_stFileSystemManager.pstHandlePool == NULL)) {
+        return FALSE;
+    }
+
+    kLock(&(gs_stFileSystemManager.stMutex));
+
+    // opened handles have clusters of the current device
+    for (i = 0; i < FILESYSTEM_HANDLE_MAXCOUNT; i++) {
+        if (
+            gs_stFileSystemManager.pstHandlePool[i].bType !=
+            FILESYSTEM_TYPE_FREE
+        ) {
+            kUnlock(&(gs_stFileSystemManager.stMutex));
+            return FALSE;
+        }
+    }
+
+    // kMount drops cached clusters. modified ones go to the old device
+    if (gs_stFileSystemManager.bMounted == TRUE) {
+        kFlushDataCache();
+    }
+
+    if (gs_stFileSystemManager.pstBlockDevice != pstDevice) {
+        gs_stFileSystemManager.pstBlockDevice = pstDevice;
+        gs_stFileSystemManager.bMounted = FALSE;
+    }
+
+    // mutex is recursive
+    if (kMount() == FALSE) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
 
+    kUnlock(&(gs_stFileSystemManager.stMutex));
     return TRUE;
 }
 
@@ -87,16 +190,23 @@ BOOL kInitializeFileSystem(void) {
 // return:
 //   TRUE on success and FALSE on failure
 // info:
-//   mount primary slave drive.
+//   mount block device that is selected by kMountBlockDevice.
 BOOL kMount(void) {
     MBR *pstMBR;
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
+    // cached clusters may be of another device or old file system
+    kInvalidateDataCache();
 
-    /* read MBR in primary master HDD */
 
-    if (gs_fpReadHDDSector(TRUE, FALSE, 0, 1, gs_vbTempBuffer) == FALSE) {
+    /* read MBR of block device */
+
+    if (
+        kReadBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice, 0, 1, gs_vbTempBuffer
+        ) == FALSE
+    ) {
         kUnlock(&(gs_stFileSystemManager.stMutex));
         return FALSE;
     }
@@ -106,7 +216,10 @@ BOOL kMount(void) {
 
     /* check if MBR has MINT filesystem signature */
 
-    if (pstMBR->dwSignature != FILESYSTEM_SIGNATURE) {
+    if (
+        (pstMBR->dwSignature != FILESYSTEM_SIGNATURE) &&
+        (pstMBR->dwSignature != FILESYSTEM_LAZYSIGNATURE)
+    ) {
         kUnlock(&(gs_stFileSystemManager.stMutex));
         return FALSE;
     }
@@ -135,62 +248,202 @@ BOOL kMount(void) {
     // total cluster size
     gs_stFileSystemManager.dwTotalClusterCount = pstMBR->dwTotalClusterCount;
 
+    // link sectors that are zeroed. every sector unless formatted lazily
+    if (pstMBR->dwSignature == FILESYSTEM_LAZYSIGNATURE) {
+        gs_stFileSystemManager.dwInitializedClusterLinkSectorCount = MIN(
+            pstMBR->dwInitializedClusterLinkSectorCount,
+            pstMBR->dwClusterLinkSectorCount
+        );
+    }
+    else {
+        gs_stFileSystemManager.dwInitializedClusterLinkSectorCount =
+            pstMBR->dwClusterLinkSectorCount;
+    }
+
+    // allocation starts from the first link sector again
+    gs_stFileSystemManager.dwLastAllocatedClusterLinkSectorOffset = 0;
+
+    // metadata of the last transaction may not be written to its place
+    if (kReplayJournal() == FALSE) {
+        gs_stFileSystemManager.bMounted = FALSE;
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
+
+    // file system formatted before directories became B+tree has entries
+    // in root directory cluster
+    if (
+        kReadDirectoryNode(
+            FILESYSTEM_ROOTDIRECTORYCLUSTER,
+            (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer
+        ) == FALSE
+    ) {
+        kLog(
+            LOG_LEVEL_WARNING,
+            "FileSystem: root directory is not a B+tree. format again"
+        );
+        gs_stFileSystemManager.bMounted = FALSE;
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
+
     kUnlock(&(gs_stFileSystemManager.stMutex));
     return TRUE;
 }
 
 
 // Create a file system on HDD
+// params:
+//   bLazy: TRUE to write only the first link sector and root directory.
+//          other link sectors are zeroed when they are written first time
 // return:
 //   TRUE on success, FALSE on failure
-BOOL kFormat(void) {
-    HDDINFORMATION *pstHDD;
+// info:
+//   areas are zeroed with HDD_MAXBULKSECTORCOUNT sectors per command, and
+//   the file system is mounted again after formatting. reserved area has
+//   an empty journal
+BOOL kFormat(BOOL bLazy) {
     MBR *pstMBR;
-    DWORD dwTotalSectorCount, dwRemainSectorCount;
+    QWORD qwTotalSectorCount, qwRemainSectorCount;
     DWORD dwMaxClusterCount, dwClusterCount;
     DWORD dwClusterLinkSectorCount;
-    DWORD i;
+    DWORD dwInitializedSectorCount;
+    BOOL bResult;
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
     
     /* Calculate the starting address and size of data area, link area  */
 
-    pstHDD = (HDDINFORMATION *) gs_vbTempBuffer;
-
-    if (gs_pfReadHDDInformation(TRUE, FALSE, pstHDD) == FALSE) {
+    if (gs_stFileSystemManager.pstBlockDevice == NULL) {
         kUnlock(&(gs_stFileSystemManager.stMutex));
         return FALSE;
     }
 
-    dwTotalSectorCount = pstHDD->dwTotalSectors;
+    qwTotalSectorCount =
+        gs_stFileSystemManager.pstBlockDevice->qwTotalSectorCount;
 
     // calculate total number of clusters on HDD
-    dwMaxClusterCount = dwTotalSectorCount / FILESYSTEM_SECTORSPERCLUSTER;
+    dwMaxClusterCount = MIN(
+        qwTotalSectorCount / FILESYSTEM_SECTORSPERCLUSTER,
+        FILESYSTEM_MAXCLUSTERCOUNT
+    );
 
 
     /** Intermediate process for data area calculation **/
 
     // Calculate the number of sectors in the link area corresponding to
     // the total number of clusterers on the disk. 
-    // each link is 4 bytes, so one sector has up to 128 links 
-    dwClusterLinkSectorCount = (dwMaxClusterCount + 127) / 128;
-
-    // data area to use = total sector - link area - MBR 
-    dwRemainSectorCount = dwTotalSectorCount - dwClusterLinkSectorCount - 1;
-    dwClusterCount = dwRemainSectorCount / FILESYSTEM_SECTORSPERCLUSTER;
+    // each link is 4 bytes, so one sector has up to 128 links. count is
+    // rounded up in QWORD, because it overflows near FILESYSTEM_MAXCLUSTERCOUNT
+    dwClusterLinkSectorCount = ((QWORD) dwMaxClusterCount + 127) / 128;
+
+    // data area to use = total sector - link area - MBR - reserved area
+    // reserved area has journal
+    qwRemainSectorCount = qwTotalSectorCount - dwClusterLinkSectorCount - 1 -
+        FILESYSTEM_JOURNAL_SECTORCOUNT;
+    dwClusterCount = MIN(
+        qwRemainSectorCount / FILESYSTEM_SECTORSPERCLUSTER,
+        FILESYSTEM_MAXCLUSTERCOUNT
+    );
 
     // link area to use
     // recalculate link area for the data rea
     // Because this calculation is approximate calculation, Every cluster is 
     // not used
-    dwClusterLinkSectorCount = (dwClusterCount + 127) / 128;
+    dwClusterLinkSectorCount = ((QWORD) dwClusterCount + 127) / 128;
+
+
+    /* initialize link area and first cluster which is reserved for root
+        directory
+    */
+
+    // In lazy mode, link sectors except the first one are zeroed on first
+    // write
+    if (bLazy == TRUE) {
+        dwInitializedSectorCount = 1;
+        bResult = TRUE;
+    }
+    else {
+        dwInitializedSectorCount = dwClusterLinkSectorCount;
+        bResult = kWriteZeroSector(
+            FILESYSTEM_JOURNAL_SECTORCOUNT + 1,
+            dwClusterLinkSectorCount
+        );
+    }
+
+    if (bResult == FALSE) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
+
+    // data area is located right after link area. root directory is an
+    // empty B+tree that has only its root node
+    kInitializeDirectoryNode(
+        (DIRECTORYNODE *) gs_vbTempBuffer,
+        FILESYSTEM_ROOTDIRECTORYCLUSTER
+    );
+
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            FILESYSTEM_JOURNAL_SECTORCOUNT + dwClusterLinkSectorCount + 1,
+            FILESYSTEM_SECTORSPERCLUSTER,
+            gs_vbTempBuffer
+        ) != FILESYSTEM_SECTORSPERCLUSTER
+    ) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
+
+    // Initialize the first link to the root directory. mark as assigned
+    kMemSet(gs_vbTempBuffer, 0, 512);
+    ((DWORD *) gs_vbTempBuffer)[0] = FILESYSTEM_LASTCLUSTER;
+
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            FILESYSTEM_JOURNAL_SECTORCOUNT + 1,
+            1,
+            gs_vbTempBuffer
+        ) == FALSE
+    ) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
+
+    // empty journal at the start of reserved area. descriptor is zeroed,
+    // so a transaction of old file system is not replayed
+    kMemSet(
+        gs_vbTempBuffer, 0, (1 + FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT) * 512
+    );
+    ((JOURNALHEADER *) gs_vbTempBuffer)->dwSignature =
+        FILESYSTEM_JOURNAL_HEADERSIGNATURE;
+
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            1,
+            1 + FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT,
+            gs_vbTempBuffer
+        ) == FALSE
+    ) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
 
 
     /* write the calculated information to MBR */
 
+    // MBR is written after the areas, so a half formatted disk is not
+    // mounted
+
     // read MBR
-    if (gs_fpReadHDDSector(TRUE, FALSE, 0, 1, gs_vbTempBuffer) == FALSE) {
+    if (
+        kReadBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice, 0, 1, gs_vbTempBuffer
+        ) == FALSE
+    ) {
         kUnlock(&(gs_stFileSystemManager.stMutex));
         return FALSE;
     }
@@ -199,44 +452,28 @@ BOOL kFormat(void) {
 
     // be careful, this will fail booting on acer laptop **
     kMemSet(pstMBR->vstPartition, 0, sizeof(pstMBR->vstPartition));
-    pstMBR->dwSignature = FILESYSTEM_SIGNATURE;
-    pstMBR->dwReservedSectorCount = 0;
+    pstMBR->dwSignature =
+        (dwInitializedSectorCount < dwClusterLinkSectorCount) ?
+            FILESYSTEM_LAZYSIGNATURE : FILESYSTEM_SIGNATURE;
+    pstMBR->dwReservedSectorCount = FILESYSTEM_JOURNAL_SECTORCOUNT;
     pstMBR->dwClusterLinkSectorCount = dwClusterLinkSectorCount;
     pstMBR->dwTotalClusterCount = dwClusterCount;
+    pstMBR->dwInitializedClusterLinkSectorCount = dwInitializedSectorCount;
 
     // write the modified MBR to HDD
-    if (gs_pfWriteHDDSector(TRUE, FALSE, 0, 1, gs_vbTempBuffer) == FALSE) {
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice, 0, 1, gs_vbTempBuffer
+        ) == FALSE
+    ) {
         kUnlock(&(gs_stFileSystemManager.stMutex));
         return FALSE;
     }
 
-
-    /* initialize link area and first cluster which is reserved for root
-        directory
-    */
-
-    kMemSet(gs_vbTempBuffer, 0, 512);
-
-    // initialize link area and first cluster in data area
-    // data area is located right after link area
-    for (
-        i = 0;
-        i < dwClusterLinkSectorCount + FILESYSTEM_SECTORSPERCLUSTER;
-        i++
-    ) {
-        // Initialize the first link to the root directory 
-        if (i == 0) {
-            // mark as assigned 
-            ((DWORD *) gs_vbTempBuffer)[0] = FILESYSTEM_LASTCLUSTER;
-        }
-        else {
-            ((DWORD *) gs_vbTempBuffer)[0] = FILESYSTEM_FREECLUSTER;
-        }
-
-        if (gs_pfWriteHDDSector(TRUE, FALSE, i+1, 1, gs_vbTempBuffer) == FALSE) {
-            kUnlock(&(gs_stFileSystemManager.stMutex));
-            return FALSE;
-        }
+    // information of old file system is not valid anymore
+    if (kMount() == FALSE) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
     }
 
     kUnlock(&(gs_stFileSystemManager.stMutex));
@@ -254,13 +491,81 @@ BOOL kGetHDDInformation(HDDINFORMATION *pstInformation) {
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
-    bResult = gs_pfReadHDDInformation(TRUE, FALSE, pstInformation);
+    bResult = kReadBlockDeviceInformation(
+        gs_stFileSystemManager.pstBlockDevice,
+        pstInformation
+    );
+
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+    return bResult;
+}
+
+
+// write modified data of every file and directories back to disk
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   data that was written before it returns is on disk when it succeeds
+BOOL kSync(void) {
+    BOOL bResult;
+
+    kLock(&(gs_stFileSystemManager.stMutex));
+
+    if (gs_stFileSystemManager.bMounted == FALSE) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return FALSE;
+    }
+
+    bResult = kFlushDataCache();
 
     kUnlock(&(gs_stFileSystemManager.stMutex));
     return bResult;
 }
 
 
+// task that writes dirty clusters back to disk
+// info:
+//   it wakes up every FILESYSTEM_FLUSHINTERVAL ms, or right away when
+//   FILESYSTEM_DIRTYHIGHCOUNT clusters are dirty, and writes every dirty
+//   cluster if the oldest one is older than FILESYSTEM_DIRTYEXPIRETIME ms.
+//   running transaction of journal is committed at the same time
+void kFileSystemFlushTask(void) {
+    BOOL bPreviousFlag;
+
+    while (TRUE) {
+        // wake-up that is missed is handled at the next interval
+        bPreviousFlag = kLockForSystemData();
+        kBlockTask(
+            &(gs_stFileSystemManager.iDirtyClusterCount),
+            FILESYSTEM_FLUSHINTERVAL
+        );
+        kUnlockForSystemData(bPreviousFlag);
+
+        kLock(&(gs_stFileSystemManager.stMutex));
+
+        if (
+            (gs_stFileSystemManager.bMounted == TRUE) &&
+            (
+                (gs_stFileSystemManager.iDirtyClusterCount > 0) ||
+                (gs_stFileSystemManager.iJournalLinkSectorCount > 0)
+            ) &&
+            (
+                (gs_stFileSystemManager.iDirtyClusterCount >=
+                    FILESYSTEM_DIRTYHIGHCOUNT) ||
+                (kGetJournalSectorCount() >=
+                    FILESYSTEM_JOURNAL_MAXSECTORCOUNT / 2) ||
+                (kGetTickCount() - gs_stFileSystemManager.qwDirtyTickCount >=
+                    FILESYSTEM_DIRTYEXPIRETIME)
+            )
+        ) {
+            kFlushDataCache();
+        }
+
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+    }
+}
+
+
 // Read a sector at an offset in the cluster link table
 // params:
 //   dwOffset: Offset to read from cluster link table
@@ -268,13 +573,41 @@ BOOL kGetHDDInformation(HDDINFORMATION *pstInformation) {
 // return:
 //   TRUE on success, FALSE on failure
 static BOOL kReadClusterLinkTable(DWORD dwOffset, BYTE *pbBuffer) {
-    return gs_fpReadHDDSector(
-        TRUE,
-        FALSE,
-        dwOffset + gs_stFileSystemManager.dwClusterLinkAreaStartAddress,
-        1,
-        pbBuffer
-    );
+    BYTE *pbSector;
+
+    // sectors that are not zeroed yet have free links only
+    if (dwOffset >= gs_stFileSystemManager.dwInitializedClusterLinkSectorCount) {
+        kMemSet(pbBuffer, 0, 512);
+        return TRUE;
+    }
+
+    // sector in running transaction is newer than the one on disk
+    pbSector = kFindJournalLinkSector(dwOffset);
+    if (pbSector != NULL) {
+        kMemCpy(pbBuffer, pbSector, 512);
+        return TRUE;
+    }
+
+    // links of 128 clusters are in the same sector, so following a file
+    // reads the sector once
+    if (dwOffset != gs_stFileSystemManager.dwCachedClusterLinkSectorOffset) {
+        if (
+            kReadBlockDevice(
+                gs_stFileSystemManager.pstBlockDevice,
+                dwOffset + gs_stFileSystemManager.dwClusterLinkAreaStartAddress,
+                1,
+                gs_vbClusterLinkBuffer
+            ) == FALSE
+        ) {
+            gs_stFileSystemManager.dwCachedClusterLinkSectorOffset =
+                FILESYSTEM_LASTCLUSTER;
+            return FALSE;
+        }
+        gs_stFileSystemManager.dwCachedClusterLinkSectorOffset = dwOffset;
+    }
+
+    kMemCpy(pbBuffer, gs_vbClusterLinkBuffer, 512);
+    return TRUE;
 }
 
 
@@ -284,359 +617,2054 @@ static BOOL kReadClusterLinkTable(DWORD dwOffset, BYTE *pbBuffer) {
 //   pbBuffer: A pointer to a variable that will be written to link area
 // return:
 //   TRUE on success, FALSE on failure
+// info:
+//   link sectors before dwOffset that are not zeroed yet are zeroed first.
+//   with journal, the sector is kept in running transaction and written to
+//   its place when the transaction is committed
 static BOOL kWriteClusterLinkTable(DWORD dwOffset, BYTE *pbBuffer) {
-    return gs_pfWriteHDDSector(
-        TRUE,
-        FALSE,
-        dwOffset + gs_stFileSystemManager.dwClusterLinkAreaStartAddress,
-        1,
-        pbBuffer
-    );
-}
-
+    DWORD dwInitializedSectorCount;
 
-// Read one cluster at an offset in the data area
-// params:
-//   dwOffset: Offset to read from data area
-//   pbBuffer: A pointer to a variable that will hold the data
-// return:
-//   TRUE on success, and FALSE on failure
-static BOOL kReadCluster(DWORD dwOffset, BYTE *pbBuffer) {
-    return gs_fpReadHDDSector(
-        TRUE,
-        FALSE,
-        (dwOffset * FILESYSTEM_SECTORSPERCLUSTER) +
-            gs_stFileSystemManager.dwDataAreaStartAddress,
-        FILESYSTEM_SECTORSPERCLUSTER,
-        pbBuffer
-    );
-}
+    dwInitializedSectorCount =
+        gs_stFileSystemManager.dwInitializedClusterLinkSectorCount;
 
+    if (gs_stFileSystemManager.bJournal == TRUE) {
+        // MBR is not journaled. the sector itself is zeroed too, so it has
+        // free links until the transaction is written to its place
+        if (dwOffset >= dwInitializedSectorCount) {
+            if (
+                kWriteZeroSector(
+                    dwInitializedSectorCount +
+                        gs_stFileSystemManager.dwClusterLinkAreaStartAddress,
+                    dwOffset - dwInitializedSectorCount + 1
+                ) == FALSE
+            )
+                return FALSE;
 
-// Write one cluster to the offset of the data area
-// params:
-//   dwOffset: Offset to write to data area
-//   pbBuffer: A pointer to a variable that will be written to data area
-// return:
-//   TRUE on success, and FALSE on failure
-static BOOL kWriteCluster(DWORD dwOffset, BYTE *pbBuffer) {
-    return gs_pfWriteHDDSector(
-        TRUE,
-        FALSE,
-        (dwOffset * FILESYSTEM_SECTORSPERCLUSTER) +
-            gs_stFileSystemManager.dwDataAreaStartAddress,
-        FILESYSTEM_SECTORSPERCLUSTER,
-        pbBuffer
-    );
-}
+            if (kUpdateInitializedClusterLinkSectorCount(dwOffset + 1) == FALSE)
+                return FALSE;
+        }
 
+        if (kAddJournalLinkSector(dwOffset, pbBuffer) == FALSE)
+            return FALSE;
 
-// Search for an empty cluster in the Cluster Links table area
-// return:
-//   index to empty cluster in data area
-static DWORD kFindFreeCluster(void) {
-    DWORD dwLinkCountInSector;
-    DWORD dwLastSectorOffset;
-    DWORD dwCurrentSectorOffset;
+        if (dwOffset == gs_stFileSystemManager.dwCachedClusterLinkSectorOffset)
+            kMemCpy(gs_vbClusterLinkBuffer, pbBuffer, 512);
+
+        return TRUE;
+    }
+
+    // sectors between zeroed ones and this one must be read as free links
+    if (dwOffset > dwInitializedSectorCount) {
+        if (
+            kWriteZeroSector(
+                dwInitializedSectorCount +
+                    gs_stFileSystemManager.dwClusterLinkAreaStartAddress,
+                dwOffset - dwInitializedSectorCount
+            ) == FALSE
+        )
+            return FALSE;
+    }
+
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            dwOffset + gs_stFileSystemManager.dwClusterLinkAreaStartAddress,
+            1,
+            pbBuffer
+        ) == FALSE
+    )
+        return FALSE;
+
+    if (dwOffset == gs_stFileSystemManager.dwCachedClusterLinkSectorOffset)
+        kMemCpy(gs_vbClusterLinkBuffer, pbBuffer, 512);
+
+    if (dwOffset >= dwInitializedSectorCount)
+        return kUpdateInitializedClusterLinkSectorCount(dwOffset + 1);
+
+    return TRUE;
+}
+
+
+// write 0 to sectors with HDD_MAXBULKSECTORCOUNT sectors per command
+// params:
+//   dwLBA: first sector to write
+//   dwSectorCount: number of sectors to write
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kWriteZeroSector(DWORD dwLBA, DWORD dwSectorCount) {
+    BYTE *pbBuffer;
+    int iSectorCount;
+
+    pbBuffer = (BYTE *) kAllocateMemory(HDD_MAXBULKSECTORCOUNT * 512);
+    if (pbBuffer == NULL)
+        return FALSE;
+
+    kMemSet(pbBuffer, 0, HDD_MAXBULKSECTORCOUNT * 512);
+
+    while (dwSectorCount > 0) {
+        iSectorCount = MIN(dwSectorCount, HDD_MAXBULKSECTORCOUNT);
+
+        if (
+            kWriteBlockDevice(
+                gs_stFileSystemManager.pstBlockDevice,
+                dwLBA,
+                iSectorCount,
+                pbBuffer
+            ) != iSectorCount
+        ) {
+            kFreeMemory(pbBuffer);
+            return FALSE;
+        }
+
+        dwLBA += iSectorCount;
+        dwSectorCount -= iSectorCount;
+    }
+
+    kFreeMemory(pbBuffer);
+    return TRUE;
+}
+
+
+// save the number of zeroed link sectors to MBR
+// params:
+//   dwSectorCount: number of link sectors that are zeroed
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   MBR gets FILESYSTEM_SIGNATURE when every link sector is zeroed
+static BOOL kUpdateInitializedClusterLinkSectorCount(DWORD dwSectorCount) {
+    BYTE vbBuffer[512];
+    MBR *pstMBR;
+
+    gs_stFileSystemManager.dwInitializedClusterLinkSectorCount = dwSectorCount;
+
+    // gs_vbTempBuffer may have link sector of caller
+    if (
+        kReadBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice, 0, 1, vbBuffer
+        ) == FALSE
+    )
+        return FALSE;
+
+    pstMBR = (MBR *) vbBuffer;
+    pstMBR->dwInitializedClusterLinkSectorCount = dwSectorCount;
+    if (dwSectorCount >= gs_stFileSystemManager.dwClusterLinkAreaSize)
+        pstMBR->dwSignature = FILESYSTEM_SIGNATURE;
+
+    return kWriteBlockDevice(
+        gs_stFileSystemManager.pstBlockDevice, 0, 1, vbBuffer
+    );
+}
+
+
+// Read one cluster at an offset in the data area
+// params:
+//   dwOffset: Offset to read from data area
+//   pbBuffer: A pointer to a variable that will hold the data
+// return:
+//   TRUE on success, and FALSE on failure
+// info:
+//   cluster is copied from file data cache. it is read from disk if it is
+//   not cached
+static BOOL kReadCluster(DWORD dwOffset, BYTE *pbBuffer) {
+    DATACACHEENTRY *pstEntry;
+
+    pstEntry = kGetCachedCluster(dwOffset, TRUE);
+    if (pstEntry == NULL)
+        return FALSE;
+
+    kMemCpy(pbBuffer, pstEntry->pbBuffer, FILESYSTEM_CLUSTERSIZE);
+    return TRUE;
+}
+
+
+// Write one cluster to the offset of the data area
+// params:
+//   dwOffset: Offset to write to data area
+//   pbBuffer: A pointer to a variable that will be written to data area
+// return:
+//   TRUE on success, and FALSE on failure
+// info:
+//   cluster is copied to file data cache and written back to disk later by
+//   flush task, kFlushFile or kSync
+static BOOL kWriteCluster(DWORD dwOffset, BYTE *pbBuffer) {
+    DATACACHEENTRY *pstEntry;
+
+    // whole cluster is overwritten, so it is not read
+    pstEntry = kGetCachedCluster(dwOffset, FALSE);
+    if (pstEntry == NULL)
+        return FALSE;
+
+    kMemCpy(pstEntry->pbBuffer, pbBuffer, FILESYSTEM_CLUSTERSIZE);
+    kMarkDataCacheEntryDirty(pstEntry, FALSE);
+    return TRUE;
+}
+
+
+// get the first sector of a cluster
+// params:
+//   dwClusterIndex: index to a cluster in data area
+// return:
+//   LBA of the cluster in block device
+static QWORD kGetClusterLBA(DWORD dwClusterIndex) {
+    return ((QWORD) dwClusterIndex * FILESYSTEM_SECTORSPERCLUSTER) +
+        gs_stFileSystemManager.dwDataAreaStartAddress;
+}
+
+
+// forget every cluster in file data cache, cached link sector and running
+// transaction of journal
+// info:
+//   it waits for clusters that are being read ahead. dirty clusters and
+//   link sectors are dropped, so they must be flushed first if they are
+//   needed
+static void kInvalidateDataCache(void) {
+    DATACACHEENTRY *pstEntry;
+    int i;
+
+    gs_stFileSystemManager.dwCachedClusterLinkSectorOffset =
+        FILESYSTEM_LASTCLUSTER;
+
+    for (i = 0; i < FILESYSTEM_DATACACHE_COUNT; i++) {
+        pstEntry = gs_stFileSystemManager.pstDataCache + i;
+
+        // dispatch task writes to the buffer until the request completes
+        if (
+            (pstEntry->dwClusterIndex != FILESYSTEM_LASTCLUSTER) &&
+            (pstEntry->stRequest.bStatus == BLOCKREQUEST_STATUS_PENDING)
+        ) {
+            kWaitBlockRequest(&(pstEntry->stRequest));
+        }
+
+        pstEntry->dwClusterIndex = FILESYSTEM_LASTCLUSTER;
+        pstEntry->bReadAhead = FALSE;
+        pstEntry->bDirty = FALSE;
+        pstEntry->bMetadata = FALSE;
+        pstEntry->stRequest.bStatus = BLOCKREQUEST_STATUS_DONE;
+    }
+
+    gs_stFileSystemManager.iDirtyClusterCount = 0;
+    gs_stFileSystemManager.iDirtyMetadataClusterCount = 0;
+    gs_stFileSystemManager.iJournalLinkSectorCount = 0;
+}
+
+
+// find a cluster in file data cache
+// params:
+//   dwClusterIndex: index to a cluster in data area
+// return:
+//   entry of the cluster. NULL if it is not cached
+static DATACACHEENTRY *kFindDataCacheEntry(DWORD dwClusterIndex) {
+    int i;
+
+    for (i = 0; i < FILESYSTEM_DATACACHE_COUNT; i++) {
+        if (
+            gs_stFileSystemManager.pstDataCache[i].dwClusterIndex ==
+            dwClusterIndex
+        ) {
+            return gs_stFileSystemManager.pstDataCache + i;
+        }
+    }
+    return NULL;
+}
+
+
+// get an entry of file data cache for a cluster
+// params:
+//   dwClusterIndex: index to a cluster in data area
+// return:
+//   free entry or the least recently used one. NULL if a dirty entry can
+//   not be written back
+// info:
+//   clean entries are replaced before dirty ones. A dirty entry is written
+//   back before it is replaced, and if every entry is being read ahead, it
+//   waits for one. returned entry has no data and its request is done.
+//   dirty directory node is not replaced when file system has journal
+static DATACACHEENTRY *kAllocateDataCacheEntry(DWORD dwClusterIndex) {
+    DATACACHEENTRY *pstEntry;
+    DATACACHEENTRY *pstVictim;
+    DATACACHEENTRY *pstDirtyVictim;
+    DATACACHEENTRY *pstPendingVictim;
+    int i;
+
+    pstVictim = NULL;
+    pstDirtyVictim = NULL;
+    pstPendingVictim = NULL;
+    for (i = 0; i < FILESYSTEM_DATACACHE_COUNT; i++) {
+        pstEntry = gs_stFileSystemManager.pstDataCache + i;
+
+        if (pstEntry->dwClusterIndex == FILESYSTEM_LASTCLUSTER) {
+            pstVictim = pstEntry;
+            break;
+        }
+
+        if (pstEntry->stRequest.bStatus == BLOCKREQUEST_STATUS_PENDING) {
+            if (pstPendingVictim == NULL) {
+                pstPendingVictim = pstEntry;
+            }
+        }
+        else if (pstEntry->bDirty == TRUE) {
+            // with journal, directory node is written only after it is
+            // committed together with links
+            if (
+                (pstEntry->bMetadata == TRUE) &&
+                (gs_stFileSystemManager.bJournal == TRUE)
+            ) {
+                continue;
+            }
+
+            if (
+                (pstDirtyVictim == NULL) ||
+                (pstEntry->qwAccessTime < pstDirtyVictim->qwAccessTime)
+            ) {
+                pstDirtyVictim = pstEntry;
+            }
+        }
+        else if (
+            (pstVictim == NULL) ||
+            (pstEntry->qwAccessTime < pstVictim->qwAccessTime)
+        ) {
+            pstVictim = pstEntry;
+        }
+    }
+
+    if ((pstVictim == NULL) && (pstDirtyVictim != NULL)) {
+        // writer is faster than flush task. it writes the cluster itself
+        if (
+            kWriteBlockDevice(
+                gs_stFileSystemManager.pstBlockDevice,
+                kGetClusterLBA(pstDirtyVictim->dwClusterIndex),
+                FILESYSTEM_SECTORSPERCLUSTER,
+                (char *) pstDirtyVictim->pbBuffer
+            ) != FILESYSTEM_SECTORSPERCLUSTER
+        )
+            return NULL;
+
+        pstDirtyVictim->bDirty = FALSE;
+        gs_stFileSystemManager.iDirtyClusterCount--;
+        if (pstDirtyVictim->bMetadata == TRUE)
+            gs_stFileSystemManager.iDirtyMetadataClusterCount--;
+        gs_stFileSystemManager.qwWriteBackCount++;
+        pstVictim = pstDirtyVictim;
+    }
+    else if (pstVictim == NULL) {
+        // there is always an entry, because cache is never empty
+        kWaitBlockRequest(&(pstPendingVictim->stRequest));
+        pstVictim = pstPendingVictim;
+    }
+
+    pstVictim->dwClusterIndex = dwClusterIndex;
+    pstVictim->qwAccessTime = gs_stFileSystemManager.qwDataCacheAccessTime++;
+    pstVictim->bReadAhead = FALSE;
+    pstVictim->bMetadata = FALSE;
+    pstVictim->stRequest.bStatus = BLOCKREQUEST_STATUS_DONE;
+    return pstVictim;
+}
+
+
+// get a cluster in file data cache
+// params:
+//   dwClusterIndex: index to a cluster in data area
+//   bRead: TRUE to read the cluster from disk if it is not cached. FALSE
+//          if caller overwrites whole cluster
+// return:
+//   entry of the cluster. NULL on failure
+// info:
+//   it waits if the cluster is being read ahead. entry is valid until the
+//   next file system function is called
+static DATACACHEENTRY *kGetCachedCluster(DWORD dwClusterIndex, BOOL bRead) {
+    DATACACHEENTRY *pstEntry;
+
+    pstEntry = kFindDataCacheEntry(dwClusterIndex);
+    if (pstEntry != NULL) {
+        // reader caught up with readahead
+        if (pstEntry->stRequest.bStatus == BLOCKREQUEST_STATUS_PENDING) {
+            gs_stFileSystemManager.qwReadAheadWaitCount++;
+            kWaitBlockRequest(&(pstEntry->stRequest));
+        }
+
+        if (pstEntry->stRequest.bStatus == BLOCKREQUEST_STATUS_DONE) {
+            if (pstEntry->bReadAhead == TRUE) {
+                pstEntry->bReadAhead = FALSE;
+                gs_stFileSystemManager.qwReadAheadHitCount++;
+            }
+
+            pstEntry->qwAccessTime =
+                gs_stFileSystemManager.qwDataCacheAccessTime++;
+            if (bRead == TRUE) {
+                gs_stFileSystemManager.qwDataCacheHitCount++;
+            }
+            return pstEntry;
+        }
+
+        // readahead failed. the cluster is read again
+        pstEntry->dwClusterIndex = FILESYSTEM_LASTCLUSTER;
+    }
+
+    pstEntry = kAllocateDataCacheEntry(dwClusterIndex);
+    if ((pstEntry == NULL) || (bRead == FALSE))
+        return pstEntry;
+
+    gs_stFileSystemManager.qwDataCacheMissCount++;
+    if (
+        kReadBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            kGetClusterLBA(dwClusterIndex),
+            FILESYSTEM_SECTORSPERCLUSTER,
+            (char *) pstEntry->pbBuffer
+        ) != FILESYSTEM_SECTORSPERCLUSTER
+    ) {
+        pstEntry->dwClusterIndex = FILESYSTEM_LASTCLUSTER;
+        return NULL;
+    }
+    return pstEntry;
+}
+
+
+// mark a cluster in file data cache as modified
+// params:
+//   pstEntry: entry of the cluster
+//   bMetadata: TRUE if the cluster is a directory node
+// info:
+//   flush task is woken up if too many clusters are dirty
+static void kMarkDataCacheEntryDirty(
+    DATACACHEENTRY *pstEntry,
+    BOOL bMetadata
+) {
+    BOOL bPreviousFlag;
+
+    // cluster of a removed directory can be reused as file data
+    if (pstEntry->bDirty == TRUE) {
+        if (pstEntry->bMetadata != bMetadata) {
+            gs_stFileSystemManager.iDirtyMetadataClusterCount +=
+                (bMetadata == TRUE) ? 1 : -1;
+            pstEntry->bMetadata = bMetadata;
+        }
+        return;
+    }
+
+    pstEntry->bDirty = TRUE;
+    pstEntry->bMetadata = bMetadata;
+    gs_stFileSystemManager.iDirtyClusterCount++;
+    if (bMetadata == TRUE)
+        gs_stFileSystemManager.iDirtyMetadataClusterCount++;
+
+    // the oldest dirty cluster or link sector decides when it is written back
+    if (
+        (gs_stFileSystemManager.iDirtyClusterCount == 1) &&
+        (gs_stFileSystemManager.iJournalLinkSectorCount == 0)
+    )
+        gs_stFileSystemManager.qwDirtyTickCount = kGetTickCount();
+
+    if (
+        gs_stFileSystemManager.iDirtyClusterCount ==
+        FILESYSTEM_DIRTYHIGHCOUNT
+    ) {
+        bPreviousFlag = kLockForSystemData();
+        kWakeUpTasks(&(gs_stFileSystemManager.iDirtyClusterCount));
+        kUnlockForSystemData(bPreviousFlag);
+    }
+}
+
+
+// write every dirty cluster in file data cache back to disk
+// return:
+//   TRUE on success, FALSE if a cluster can not be written
+// info:
+//   data clusters are written first and directory nodes are written after
+//   they complete, so directory entry never has size of data that is not
+//   on disk. with journal, directory nodes and link sectors are committed
+//   together after data clusters
+static BOOL kFlushDataCache(void) {
+    if (
+        (gs_stFileSystemManager.iDirtyClusterCount == 0) &&
+        (gs_stFileSystemManager.iJournalLinkSectorCount == 0)
+    )
+        return TRUE;
+
+    gs_stFileSystemManager.qwFlushCount++;
+
+    if (kWriteBackDataCache(FALSE) == FALSE)
+        return FALSE;
+
+    if (gs_stFileSystemManager.bJournal == TRUE)
+        return kCommitJournal();
+
+    return kWriteBackDataCache(TRUE);
+}
+
+
+// write dirty data clusters or directory nodes back to disk
+// params:
+//   bMetadata: TRUE to write directory nodes only. FALSE to write data
+//              clusters only
+// return:
+//   TRUE on success, FALSE if a cluster can not be written
+// info:
+//   clusters are submitted together, so block layer merges them.
+//   clusters that fail stay dirty
+static BOOL kWriteBackDataCache(BOOL bMetadata) {
+    DATACACHEENTRY *vpstSubmittedEntry[FILESYSTEM_DATACACHE_COUNT];
+    DATACACHEENTRY *pstEntry;
+    BLOCKREQUEST *pstRequest;
+    int iSubmittedCount;
+    BOOL bResult;
+    int i;
+
+    bResult = TRUE;
+
+
+    /* submit dirty clusters */
+
+    iSubmittedCount = 0;
+    for (i = 0; i < FILESYSTEM_DATACACHE_COUNT; i++) {
+        pstEntry = gs_stFileSystemManager.pstDataCache + i;
+        if ((pstEntry->bDirty == FALSE) || (pstEntry->bMetadata != bMetadata))
+            continue;
+
+        pstRequest = &(pstEntry->stRequest);
+        pstRequest->bWrite = TRUE;
+        pstRequest->qwLBA = kGetClusterLBA(pstEntry->dwClusterIndex);
+        pstRequest->iSectorCount = FILESYSTEM_SECTORSPERCLUSTER;
+        pstRequest->pcBuffer = (char *) pstEntry->pbBuffer;
+        pstRequest->pfCallback = NULL;
+        pstRequest->pvCallbackParameter = NULL;
+
+        if (
+            kSubmitBlockRequest(
+                gs_stFileSystemManager.pstBlockDevice,
+                pstRequest
+            ) == FALSE
+        ) {
+            bResult = FALSE;
+            break;
+        }
+        vpstSubmittedEntry[iSubmittedCount++] = pstEntry;
+    }
+
+
+    /* wait for them */
+
+    for (i = 0; i < iSubmittedCount; i++) {
+        pstEntry = vpstSubmittedEntry[i];
+
+        if (
+            kWaitBlockRequest(&(pstEntry->stRequest)) ==
+            FILESYSTEM_SECTORSPERCLUSTER
+        ) {
+            pstEntry->bDirty = FALSE;
+            gs_stFileSystemManager.iDirtyClusterCount--;
+            if (bMetadata == TRUE)
+                gs_stFileSystemManager.iDirtyMetadataClusterCount--;
+            gs_stFileSystemManager.qwWriteBackCount++;
+        }
+        else {
+            bResult = FALSE;
+        }
+
+        // data in memory is valid even if writing failed
+        pstEntry->stRequest.bStatus = BLOCKREQUEST_STATUS_DONE;
+    }
+
+    return bResult;
+}
+
+
+// keep a modified link sector in running transaction
+// params:
+//   dwOffset: Offset of the sector in cluster link table
+//   pbBuffer: data of the sector
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   transaction is committed first if it has no room for the sector
+static BOOL kAddJournalLinkSector(DWORD dwOffset, BYTE *pbBuffer) {
+    BYTE *pbSector;
+    BOOL bPreviousFlag;
+    int iIndex;
+
+    gs_stFileSystemManager.qwMetadataUpdateCount++;
+
+    pbSector = kFindJournalLinkSector(dwOffset);
+    if (pbSector != NULL) {
+        kMemCpy(pbSector, pbBuffer, 512);
+        return TRUE;
+    }
+
+    // an operation that changes too many links is split into commits
+    if (kReserveJournalSpace(1) == FALSE)
+        return FALSE;
+
+    iIndex = gs_stFileSystemManager.iJournalLinkSectorCount++;
+    gs_stFileSystemManager.vdwJournalLinkSectorOffset[iIndex] = dwOffset;
+    kMemCpy(
+        gs_stFileSystemManager.pbJournalLinkSectorBuffer + (iIndex * 512),
+        pbBuffer,
+        512
+    );
+
+    // the oldest change decides when it is committed
+    if (
+        (gs_stFileSystemManager.iJournalLinkSectorCount == 1) &&
+        (gs_stFileSystemManager.iDirtyClusterCount == 0)
+    )
+        gs_stFileSystemManager.qwDirtyTickCount = kGetTickCount();
+
+    // flush task commits it between operations before it is full
+    if (
+        kGetJournalSectorCount() == FILESYSTEM_JOURNAL_MAXSECTORCOUNT / 2
+    ) {
+        bPreviousFlag = kLockForSystemData();
+        kWakeUpTasks(&(gs_stFileSystemManager.iDirtyClusterCount));
+        kUnlockForSystemData(bPreviousFlag);
+    }
+    return TRUE;
+}
+
+
+// commit running transaction if it has no room for sectors
+// params:
+//   iSectorCount: number of metadata sectors that will be modified
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   an operation reserves sectors it may modify before it starts, so it is
+//   committed in one transaction
+static BOOL kReserveJournalSpace(int iSectorCount) {
+    if (gs_stFileSystemManager.bJournal == FALSE)
+        return TRUE;
+
+    if (
+        kGetJournalSectorCount() + iSectorCount <=
+        FILESYSTEM_JOURNAL_MAXSECTORCOUNT
+    )
+        return TRUE;
+
+    return kFlushDataCache();
+}
+
+
+// get number of metadata sectors in running transaction
+// return:
+//   link sectors and sectors of dirty directory nodes
+static int kGetJournalSectorCount(void) {
+    return gs_stFileSystemManager.iJournalLinkSectorCount +
+        (gs_stFileSystemManager.iDirtyMetadataClusterCount *
+            FILESYSTEM_SECTORSPERCLUSTER);
+}
+
+
+// find a link sector in running transaction
+// params:
+//   dwOffset: Offset of the sector in cluster link table
+// return:
+//   data of the sector. NULL if transaction does not have it
+static BYTE *kFindJournalLinkSector(DWORD dwOffset) {
+    int i;
+
+    for (i = 0; i < gs_stFileSystemManager.iJournalLinkSectorCount; i++) {
+        if (gs_stFileSystemManager.vdwJournalLinkSectorOffset[i] == dwOffset)
+            return gs_stFileSystemManager.pbJournalLinkSectorBuffer + (i * 512);
+    }
+    return NULL;
+}
+
+
+// write running transaction to journal and then metadata to its place
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   data clusters must be written before, so committed metadata never
+//   points to data that is not on disk. transaction is kept if it fails.
+//   it also fails if an LBA of metadata is not in the device, so replay
+//   never writes to a wrong sector
+static BOOL kCommitJournal(void) {
+    JOURNALDESCRIPTOR *pstDescriptor;
+    JOURNALCOMMIT *pstCommit;
+    DATACACHEENTRY *pstEntry;
+    BYTE *pbSector;
+    DWORD dwLinkAreaStartAddress;
+    DWORD dwSectorCount;
+    DWORD dwJournalLBA;
+    QWORD qwLBA;
+    QWORD qwTotalSectorCount;
+    int i;
+    int j;
+
+    if (kGetJournalSectorCount() == 0)
+        return TRUE;
+
+
+    /* build transaction. directory nodes and link sectors */
+
+    pstDescriptor =
+        (JOURNALDESCRIPTOR *) gs_stFileSystemManager.pbJournalBuffer;
+    kMemSet(pstDescriptor, 0, sizeof(JOURNALDESCRIPTOR));
+
+    pbSector = gs_stFileSystemManager.pbJournalBuffer +
+        sizeof(JOURNALDESCRIPTOR);
+    dwSectorCount = 0;
+    qwTotalSectorCount =
+        gs_stFileSystemManager.pstBlockDevice->qwTotalSectorCount;
+
+    for (i = 0; i < FILESYSTEM_DATACACHE_COUNT; i++) {
+        pstEntry = gs_stFileSystemManager.pstDataCache + i;
+        if ((pstEntry->bDirty == FALSE) || (pstEntry->bMetadata == FALSE))
+            continue;
+
+        qwLBA = kGetClusterLBA(pstEntry->dwClusterIndex);
+        if (qwLBA + FILESYSTEM_SECTORSPERCLUSTER > qwTotalSectorCount)
+            return FALSE;
+
+        for (j = 0; j < FILESYSTEM_SECTORSPERCLUSTER; j++) {
+            pstDescriptor->vqwLBA[dwSectorCount++] = qwLBA + j;
+        }
+        kMemCpy(pbSector, pstEntry->pbBuffer, FILESYSTEM_CLUSTERSIZE);
+        pbSector += FILESYSTEM_CLUSTERSIZE;
+    }
+
+    dwLinkAreaStartAddress =
+        gs_stFileSystemManager.dwClusterLinkAreaStartAddress;
+    for (i = 0; i < gs_stFileSystemManager.iJournalLinkSectorCount; i++) {
+        qwLBA = (QWORD) dwLinkAreaStartAddress +
+            gs_stFileSystemManager.vdwJournalLinkSectorOffset[i];
+        if (qwLBA >= qwTotalSectorCount)
+            return FALSE;
+
+        pstDescriptor->vqwLBA[dwSectorCount++] = qwLBA;
+    }
+    kMemCpy(
+        pbSector,
+        gs_stFileSystemManager.pbJournalLinkSectorBuffer,
+        gs_stFileSystemManager.iJournalLinkSectorCount * 512
+    );
+
+    pstDescriptor->dwSignature = FILESYSTEM_JOURNAL_DESCRIPTORSIGNATURE;
+    pstDescriptor->dwSequence = gs_stFileSystemManager.dwJournalSequence;
+    pstDescriptor->dwSectorCount = dwSectorCount;
+
+    pstCommit = (JOURNALCOMMIT *) (
+        gs_stFileSystemManager.pbJournalBuffer + sizeof(JOURNALDESCRIPTOR) +
+        (dwSectorCount * 512)
+    );
+    kMemSet(pstCommit, 0, 512);
+    pstCommit->dwSignature = FILESYSTEM_JOURNAL_COMMITSIGNATURE;
+    pstCommit->dwSequence = gs_stFileSystemManager.dwJournalSequence;
+    pstCommit->dwSectorCount = dwSectorCount;
+    pstCommit->dwChecksum = kCalculateJournalChecksum(
+        gs_stFileSystemManager.pbJournalBuffer,
+        FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT + dwSectorCount
+    );
+
+
+    /* write transaction to journal */
+
+    // descriptor and metadata sectors are one sequential write. commit
+    // sector is written after they are on disk, so a torn transaction is
+    // never committed
+    dwJournalLBA = gs_stFileSystemManager.dwReservedSectorCount -
+        FILESYSTEM_JOURNAL_SECTORCOUNT + 2;
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            dwJournalLBA,
+            FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT + dwSectorCount,
+            gs_stFileSystemManager.pbJournalBuffer
+        ) != FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT + dwSectorCount
+    )
+        return FALSE;
+
+    if (
+        kWriteBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            dwJournalLBA + FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT +
+                dwSectorCount,
+            1,
+            (char *) pstCommit
+        ) != 1
+    )
+        return FALSE;
+
+    gs_stFileSystemManager.qwJournalCommitCount++;
+    gs_stFileSystemManager.qwJournalSectorCount += dwSectorCount;
+
+
+    /* write metadata to its place (checkpoint) */
+
+    // replay at mount writes it again if this fails
+    if (kWriteBackDataCache(TRUE) == FALSE)
+        return FALSE;
+
+    pbSector = gs_stFileSystemManager.pbJournalLinkSectorBuffer;
+    for (i = 0; i < gs_stFileSystemManager.iJournalLinkSectorCount; i++) {
+        if (
+            kWriteBlockDevice(
+                gs_stFileSystemManager.pstBlockDevice,
+                dwLinkAreaStartAddress +
+                    gs_stFileSystemManager.vdwJournalLinkSectorOffset[i],
+                1,
+                pbSector + (i * 512)
+            ) != 1
+        )
+            return FALSE;
+    }
+    gs_stFileSystemManager.iJournalLinkSectorCount = 0;
+
+    // transaction does not need to be replayed anymore
+    if (
+        kWriteJournalHeader(gs_stFileSystemManager.dwJournalSequence + 1) ==
+        FALSE
+    )
+        return FALSE;
+
+    gs_stFileSystemManager.dwJournalSequence++;
+    return TRUE;
+}
+
+
+// write transaction in journal to its place if it is committed
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   it is called at mount. bJournal is set if the file system has journal
+static BOOL kReplayJournal(void) {
+    JOURNALHEADER *pstHeader;
+    JOURNALDESCRIPTOR *pstDescriptor;
+    JOURNALCOMMIT *pstCommit;
+    DWORD dwJournalLBA;
+    DWORD dwSectorCount;
+    DWORD i;
+
+    gs_stFileSystemManager.bJournal = FALSE;
+    gs_stFileSystemManager.iJournalLinkSectorCount = 0;
+
+    // file system that was formatted before journal was added
+    if (
+        gs_stFileSystemManager.dwReservedSectorCount <
+        FILESYSTEM_JOURNAL_SECTORCOUNT
+    )
+        return TRUE;
+
+    dwJournalLBA = gs_stFileSystemManager.dwReservedSectorCount -
+        FILESYSTEM_JOURNAL_SECTORCOUNT + 1;
+
+    pstHeader = (JOURNALHEADER *) gs_stFileSystemManager.pbJournalBuffer;
+    if (
+        kReadBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            dwJournalLBA,
+            1,
+            (char *) pstHeader
+        ) != 1
+    )
+        return FALSE;
+
+    if (pstHeader->dwSignature != FILESYSTEM_JOURNAL_HEADERSIGNATURE)
+        return TRUE;
+
+    gs_stFileSystemManager.bJournal = TRUE;
+    gs_stFileSystemManager.dwJournalSequence = pstHeader->dwSequence;
+
+
+    /* check if the last transaction is committed */
+
+    // descriptor, metadata sectors and commit sector at once
+    if (
+        kReadBlockDevice(
+            gs_stFileSystemManager.pstBlockDevice,
+            dwJournalLBA + 1,
+            FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT +
+                FILESYSTEM_JOURNAL_MAXSECTORCOUNT + 1,
+            gs_stFileSystemManager.pbJournalBuffer
+        ) != FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT +
+            FILESYSTEM_JOURNAL_MAXSECTORCOUNT + 1
+    )
+        return FALSE;
+
+    pstDescriptor =
+        (JOURNALDESCRIPTOR *) gs_stFileSystemManager.pbJournalBuffer;
+    dwSectorCount = pstDescriptor->dwSectorCount;
+    if (
+        (pstDescriptor->dwSignature !=
+            FILESYSTEM_JOURNAL_DESCRIPTORSIGNATURE) ||
+        (pstDescriptor->dwSequence !=
+            gs_stFileSystemManager.dwJournalSequence) ||
+        (dwSectorCount > FILESYSTEM_JOURNAL_MAXSECTORCOUNT)
+    )
+        return TRUE;
+
+    pstCommit = (JOURNALCOMMIT *) (
+        gs_stFileSystemManager.pbJournalBuffer + sizeof(JOURNALDESCRIPTOR) +
+        (dwSectorCount * 512)
+    );
+    if (
+        (pstCommit->dwSignature != FILESYSTEM_JOURNAL_COMMITSIGNATURE) ||
+        (pstCommit->dwSequence != pstDescriptor->dwSequence) ||
+        (pstCommit->dwSectorCount != dwSectorCount) ||
+        (pstCommit->dwChecksum != kCalculateJournalChecksum(
+            gs_stFileSystemManager.pbJournalBuffer,
+            FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT + dwSectorCount
+        ))
+    )
+        return TRUE;
+
+
+    /* write metadata to its place again */
+
+    for (i = 0; i < dwSectorCount; i++) {
+        if (
+            kWriteBlockDevice(
+                gs_stFileSystemManager.pstBlockDevice,
+                pstDescriptor->vqwLBA[i],
+                1,
+                gs_stFileSystemManager.pbJournalBuffer +
+                    sizeof(JOURNALDESCRIPTOR) + (i * 512)
+            ) != 1
+        )
+            return FALSE;
+    }
+
+    if (
+        kWriteJournalHeader(gs_stFileSystemManager.dwJournalSequence + 1) ==
+        FALSE
+    )
+        return FALSE;
+
+    gs_stFileSystemManager.dwJournalSequence++;
+    gs_stFileSystemManager.qwJournalReplayCount++;
+    kLog(
+        LOG_LEVEL_INFO,
+        "FileSystem: journal transaction %d replayed, %d sectors",
+        pstDescriptor->dwSequence,
+        dwSectorCount
+    );
+    return TRUE;
+}
+
+
+// write journal header that has the sequence of the next transaction
+// params:
+//   dwSequence: sequence to replay at mount
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kWriteJournalHeader(DWORD dwSequence) {
+    JOURNALHEADER stHeader;
+
+    kMemSet(&stHeader, 0, sizeof(stHeader));
+    stHeader.dwSignature = FILESYSTEM_JOURNAL_HEADERSIGNATURE;
+    stHeader.dwSequence = dwSequence;
+
+    return kWriteBlockDevice(
+        gs_stFileSystemManager.pstBlockDevice,
+        gs_stFileSystemManager.dwReservedSectorCount -
+            FILESYSTEM_JOURNAL_SECTORCOUNT + 1,
+        1,
+        (char *) &stHeader
+    ) == 1;
+}
+
+
+// calculate checksum of journal sectors
+// params:
+//   pbBuffer: sectors
+//   dwSectorCount: number of sectors
+// return:
+//   checksum
+static DWORD kCalculateJournalChecksum(
+    const BYTE *pbBuffer,
+    DWORD dwSectorCount
+) {
+    const DWORD *pdwData;
+    DWORD dwChecksum;
+    DWORD i;
+
+    // rotate before adding, so swapped words change the checksum
+    pdwData = (const DWORD *) pbBuffer;
+    dwChecksum = 0;
+    for (i = 0; i < dwSectorCount * 512 / sizeof(DWORD); i++) {
+        dwChecksum = ((dwChecksum << 1) | (dwChecksum >> 31)) + pdwData[i];
+    }
+    return dwChecksum;
+}
+
+
+// Search for an empty cluster in the Cluster Links table area
+// return:
+//   index to empty cluster in data area
+static DWORD kFindFreeCluster(void) {
+    DWORD dwLinkCountInSector;
+    DWORD dwLastSectorOffset;
+    DWORD dwCurrentSectorOffset;
 
     DWORD i, j;
 
-    // check if filesystem is mounted;
-    if (gs_stFileSystemManager.bMounted == FALSE) {
-        return FILESYSTEM_LASTCLUSTER;
+    // check if filesystem is mounted;
+    if (gs_stFileSystemManager.bMounted == FALSE) {
+        return FILESYSTEM_LASTCLUSTER;
+    }
+
+    dwLastSectorOffset =
+        gs_stFileSystemManager.dwLastAllocatedClusterLinkSectorOffset;
+
+    for (
+        i = 0;
+        i < gs_stFileSystemManager.dwClusterLinkAreaSize;
+        i++
+    ) {
+
+        // the cluster link area cannot always be used up. The number of
+        // available links in the last sector is calculated using the number of
+        // clusters in the data area. 
+        if (
+            (dwLastSectorOffset + i) ==
+            (gs_stFileSystemManager.dwClusterLinkAreaSize - 1)
+        ) {
+            dwLinkCountInSector =
+                gs_stFileSystemManager.dwTotalClusterCount % 128;
+        }
+        else {
+            dwLinkCountInSector = 128;
+        }
+
+        // sector offset of the cluster link table to read this time
+        // This is needed because
+        //   for loop loops from 0 or
+        //   all links of dwLastSectorOffset are used
+        dwCurrentSectorOffset = 
+            (dwLastSectorOffset + i) %
+            gs_stFileSystemManager.dwClusterLinkAreaSize;
+
+        if (
+            kReadClusterLinkTable(
+                dwCurrentSectorOffset,
+                gs_vbTempBuffer
+            ) == FALSE
+        ) {
+            return FILESYSTEM_LASTCLUSTER;
+        }
+
+
+        /* search for empty cluster in the current sector */
+
+        for (j = 0; j < dwLinkCountInSector; j++) {
+            if (((DWORD *)gs_vbTempBuffer)[j] == FILESYSTEM_FREECLUSTER) {
+                break;
+            }
+        }
+
+        // found offset of free link in current sector
+        if (j != dwLinkCountInSector) {
+
+            // save offset of the current sector in link area to file manager
+            gs_stFileSystemManager.dwLastAllocatedClusterLinkSectorOffset =
+                dwCurrentSectorOffset;
+            
+            // calculate index to empty cluster in data area
+            return (128 * dwCurrentSectorOffset) + j;
+        }
+    }
+
+    // means no empty cluster 
+    return FILESYSTEM_LASTCLUSTER;
+}
+
+
+// set value in cluster link corresponding to a cluster index
+// params:
+//   dwClusterIndex: index to a cluster in data area
+//   dwData: 
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kSetClusterLinkData(DWORD dwClusterIndex, DWORD dwData) {
+    DWORD dwSectorOffset;
+
+    // check if filesystem is mounted;
+    if (gs_stFileSystemManager.bMounted == FALSE) {
+        return FALSE;
+    }
+
+    /* find the index for link area from cluster index */
+
+    // find the sector offset corresponding to the cluster in the link area 
+    // each link is 4 bytes so each sector contains 128 links
+    dwSectorOffset = dwClusterIndex / 128;
+
+    if (dwSectorOffset >= gs_stFileSystemManager.dwClusterLinkAreaSize) {
+        return FALSE;
+    }
+
+    /* get link data */
+
+    if (kReadClusterLinkTable(dwSectorOffset, gs_vbTempBuffer) == FALSE) {
+        return FALSE;
+    }
+
+    /* set data */
+
+    ((DWORD *) gs_vbTempBuffer)[dwClusterIndex % 128] = dwData;
+
+    if (kWriteClusterLinkTable(dwSectorOffset, gs_vbTempBuffer) == FALSE) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+// get value in cluster link corresponding to a cluster index
+// params:
+//   dwClusterIndex: index to a cluster in data area
+//   pdwData: a pointer to a varaible that will contain the link data 
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kGetClusterLinkData(DWORD dwClusterIndex, DWORD *pdwData) {
+    DWORD dwSectorOffset;
+
+    // check if filesystem is mounted;
+    if (gs_stFileSystemManager.bMounted == FALSE) {
+        return FALSE;
+    }
+
+    /* find the index for link area from cluster index */
+
+    // find the sector offset corresponding to the cluster in the link area 
+    // each link is 4 bytes so each sector contains 128 links
+    dwSectorOffset = dwClusterIndex / 128;
+
+    if (dwSectorOffset >= gs_stFileSystemManager.dwClusterLinkAreaSize) {
+        return FALSE;
+    }
+
+    /* get link data */
+
+    if (kReadClusterLinkTable(dwSectorOffset, gs_vbTempBuffer) == FALSE) {
+        return FALSE;
+    }
+
+    *pdwData = ((DWORD *) gs_vbTempBuffer)[dwClusterIndex % 128];
+    return TRUE;
+}
+
+
+// calculate hash of file name. directory B+tree is keyed on it
+// params:
+//   pcFileName: file name
+// return:
+//   FNV-1a hash of the name
+static DWORD kHashFileName(const char *pcFileName) {
+    DWORD dwHash;
+    int i;
+
+    dwHash = 2166136261;
+    for (
+        i = 0;
+        (i < FILESYSTEM_MAXFILENAMELENGTH) && (pcFileName[i] != '\0');
+        i++
+    ) {
+        dwHash ^= (BYTE) pcFileName[i];
+        dwHash *= 16777619;
+    }
+    return dwHash;
+}
+
+
+// compare a key with key of a directory entry
+// params:
+//   dwHash: hash of pcFileName
+//   pcFileName: file name. bytes after the name must be 0
+//   pstEntry: directory entry
+// return:
+//   negative if the key is smaller, 0 if it is the same, positive if it is
+//   larger. keys are ordered by hash and then by name
+static int kCompareDirectoryKey(
+    DWORD dwHash,
+    const char *pcFileName,
+    const DIRECTORYENTRY *pstEntry
+) {
+    DWORD dwEntryHash;
+    int i;
+
+    dwEntryHash = kHashFileName(pstEntry->vcFileName);
+    if (dwHash != dwEntryHash)
+        return (dwHash < dwEntryHash) ? -1 : 1;
+
+    // kMemCmp compares signed characters, so it is not used for order
+    for (i = 0; i < FILESYSTEM_MAXFILENAMELENGTH; i++) {
+        if (pcFileName[i] != pstEntry->vcFileName[i]) {
+            return (int) ((BYTE) pcFileName[i]) -
+                (int) ((BYTE) pstEntry->vcFileName[i]);
+        }
+    }
+    return 0;
+}
+
+
+// read a directory node
+// params:
+//   dwClusterIndex: cluster of the node
+//   pstNode: buffer to save the node
+// return:
+//   TRUE on success, FALSE if it can not be read or it is not a node
+static BOOL kReadDirectoryNode(DWORD dwClusterIndex, DIRECTORYNODE *pstNode) {
+    if (kReadCluster(dwClusterIndex, (BYTE *) pstNode) == FALSE)
+        return FALSE;
+
+    if (pstNode->dwSignature != FILESYSTEM_DIRECTORYNODESIGNATURE)
+        return FALSE;
+
+    return TRUE;
+}
+
+
+// write a directory node
+// params:
+//   dwClusterIndex: cluster of the node
+//   pstNode: node to write
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   node is written to file data cache as metadata
+static BOOL kWriteDirectoryNode(
+    DWORD dwClusterIndex,
+    const DIRECTORYNODE *pstNode
+) {
+    DATACACHEENTRY *pstEntry;
+
+    // node that is already in running transaction takes no more room
+    pstEntry = kFindDataCacheEntry(dwClusterIndex);
+    if (
+        (pstEntry == NULL) ||
+        (pstEntry->bDirty == FALSE) ||
+        (pstEntry->bMetadata == FALSE)
+    ) {
+        if (kReserveJournalSpace(FILESYSTEM_SECTORSPERCLUSTER) == FALSE)
+            return FALSE;
     }
 
-    dwLastSectorOffset =
-        gs_stFileSystemManager.dwLastAllocatedClusterLinkSectorOffset;
+    // whole cluster is overwritten, so it is not read
+    pstEntry = kGetCachedCluster(dwClusterIndex, FALSE);
+    if (pstEntry == NULL)
+        return FALSE;
 
-    for (
-        i = 0;
-        i < gs_stFileSystemManager.dwClusterLinkAreaSize;
-        i++
-    ) {
+    kMemCpy(pstEntry->pbBuffer, pstNode, FILESYSTEM_CLUSTERSIZE);
+    kMarkDataCacheEntryDirty(pstEntry, TRUE);
+    gs_stFileSystemManager.qwMetadataUpdateCount++;
+    return TRUE;
+}
 
-        // the cluster link area cannot always be used up. The number of
-        // available links in the last sector is calculated using the number of
-        // clusters in the data area. 
-        if (
-            (dwLastSectorOffset + i) ==
-            (gs_stFileSystemManager.dwClusterLinkAreaSize - 1)
-        ) {
-            dwLinkCountInSector =
-                gs_stFileSystemManager.dwTotalClusterCount % 128;
+
+// make an empty leaf node that is root of a directory
+// params:
+//   pstNode: buffer of the node
+//   dwParentClusterIndex: root node of parent directory
+static void kInitializeDirectoryNode(
+    DIRECTORYNODE *pstNode,
+    DWORD dwParentClusterIndex
+) {
+    kMemSet(pstNode, 0, FILESYSTEM_CLUSTERSIZE);
+    pstNode->dwSignature = FILESYSTEM_DIRECTORYNODESIGNATURE;
+    pstNode->wLevel = 0;
+    pstNode->wCount = 0;
+    pstNode->dwNextClusterIndex = FILESYSTEM_LASTCLUSTER;
+    pstNode->dwEntryCount = 0;
+    pstNode->dwParentClusterIndex = dwParentClusterIndex;
+}
+
+
+// allocate a cluster for a directory node
+// params:
+//   pdwClusterIndex: allocated cluster
+// return:
+//   TRUE on success, FALSE if there is no free cluster
+static BOOL kAllocateDirectoryNode(DWORD *pdwClusterIndex) {
+    DWORD dwCluster;
+
+    dwCluster = kFindFreeCluster();
+    if (dwCluster == FILESYSTEM_LASTCLUSTER)
+        return FALSE;
+
+    if (kSetClusterLinkData(dwCluster, FILESYSTEM_LASTCLUSTER) == FALSE)
+        return FALSE;
+
+    *pdwClusterIndex = dwCluster;
+    return TRUE;
+}
+
+
+// find the leaf node that has a hash
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   dwHash: hash to look up
+//   pstNode: buffer to save the leaf node
+//   pstPath: nodes from root to the leaf
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kFindDirectoryLeaf(
+    DWORD dwDirectoryClusterIndex,
+    DWORD dwHash,
+    DIRECTORYNODE *pstNode,
+    DIRECTORYPATH *pstPath
+) {
+    DWORD dwClusterIndex;
+    int iLow;
+    int iHigh;
+    int iMiddle;
+
+    dwClusterIndex = dwDirectoryClusterIndex;
+    pstPath->iDepth = 0;
+
+    while (pstPath->iDepth < FILESYSTEM_DIRECTORYNODE_MAXDEPTH) {
+        if (kReadDirectoryNode(dwClusterIndex, pstNode) == FALSE)
+            return FALSE;
+
+        pstPath->vdwClusterIndex[pstPath->iDepth] = dwClusterIndex;
+        if (pstNode->wLevel == 0) {
+            pstPath->iDepth++;
+            return TRUE;
         }
-        else {
-            dwLinkCountInSector = 128;
+
+        // child after the last key that is not larger than the hash
+        iLow = 0;
+        iHigh = pstNode->wCount;
+        while (iLow < iHigh) {
+            iMiddle = (iLow + iHigh) / 2;
+            if (pstNode->vstIndex[iMiddle].dwHash <= dwHash)
+                iLow = iMiddle + 1;
+            else
+                iHigh = iMiddle;
         }
 
-        // sector offset of the cluster link table to read this time
-        // This is needed because
-        //   for loop loops from 0 or
-        //   all links of dwLastSectorOffset are used
-        dwCurrentSectorOffset = 
-            (dwLastSectorOffset + i) %
-            gs_stFileSystemManager.dwClusterLinkAreaSize;
+        pstPath->viChildIndex[pstPath->iDepth] = iLow;
+        if (iLow == 0)
+            dwClusterIndex = pstNode->dwFirstClusterIndex;
+        else
+            dwClusterIndex = pstNode->vstIndex[iLow - 1].dwClusterIndex;
+
+        pstPath->iDepth++;
+    }
+
+    // tree is broken
+    return FALSE;
+}
+
 
+// find position of a key in a leaf node
+// params:
+//   pstNode: leaf node
+//   dwHash: hash of pcFileName
+//   pcFileName: file name. bytes after the name must be 0
+// return:
+//   index of the first entry that is not smaller than the key
+static int kSearchDirectoryLeaf(
+    const DIRECTORYNODE *pstNode,
+    DWORD dwHash,
+    const char *pcFileName
+) {
+    int iLow;
+    int iHigh;
+    int iMiddle;
+
+    iLow = 0;
+    iHigh = pstNode->wCount;
+    while (iLow < iHigh) {
+        iMiddle = (iLow + iHigh) / 2;
         if (
-            kReadClusterLinkTable(
-                dwCurrentSectorOffset,
-                gs_vbTempBuffer
-            ) == FALSE
-        ) {
-            return FILESYSTEM_LASTCLUSTER;
-        }
+            kCompareDirectoryKey(
+                dwHash,
+                pcFileName,
+                pstNode->vstEntry + iMiddle
+            ) > 0
+        )
+            iLow = iMiddle + 1;
+        else
+            iHigh = iMiddle;
+    }
+    return iLow;
+}
 
 
-        /* search for empty cluster in the current sector */
+// split a node that has one more entry or key than it can have
+// params:
+//   pstNode: node to split. it keeps the left half
+//   pstRightNode: buffer that gets the right half
+//   pdwSeparatorHash: the smallest hash of the right half
+// return:
+//   TRUE on success, FALSE if every entry of leaf has the same hash
+// info:
+//   entries that have the same hash are kept in the same node
+static BOOL kSplitDirectoryNode(
+    DIRECTORYNODE *pstNode,
+    DIRECTORYNODE *pstRightNode,
+    DWORD *pdwSeparatorHash
+) {
+    int iCount;
+    int iMiddle;
+    int i;
 
-        for (j = 0; j < dwLinkCountInSector; j++) {
-            if (((DWORD *)gs_vbTempBuffer)[j] == FILESYSTEM_FREECLUSTER) {
-                break;
-            }
-        }
+    iCount = pstNode->wCount;
+    kInitializeDirectoryNode(pstRightNode, 0);
+    pstRightNode->wLevel = pstNode->wLevel;
 
-        // found offset of free link in current sector
-        if (j != dwLinkCountInSector) {
 
-            // save offset of the current sector in link area to file manager
-            gs_stFileSystemManager.dwLastAllocatedClusterLinkSectorOffset =
-                dwCurrentSectorOffset;
-            
-            // calculate index to empty cluster in data area
-            return (128 * dwCurrentSectorOffset) + j;
-        }
+    /* internal node. the middle key goes up to parent */
+
+    if (pstNode->wLevel != 0) {
+        iMiddle = iCount / 2;
+        *pdwSeparatorHash = pstNode->vstIndex[iMiddle].dwHash;
+
+        pstRightNode->dwFirstClusterIndex =
+            pstNode->vstIndex[iMiddle].dwClusterIndex;
+        kMemCpy(
+            pstRightNode->vstIndex,
+            pstNode->vstIndex + iMiddle + 1,
+            (iCount - iMiddle - 1) * sizeof(DIRECTORYINDEX)
+        );
+        pstRightNode->wCount = iCount - iMiddle - 1;
+        pstNode->wCount = iMiddle;
+        return TRUE;
     }
 
-    // means no empty cluster 
-    return FILESYSTEM_LASTCLUSTER;
+
+    /* leaf node. split at the boundary of hash closest to the middle */
+
+    for (i = 0; i < iCount; i++) {
+        iMiddle = (iCount / 2) + (((i % 2) == 0) ? (i / 2) : -(i / 2) - 1);
+        if ((iMiddle <= 0) || (iMiddle >= iCount))
+            continue;
+
+        if (
+            kHashFileName(pstNode->vstEntry[iMiddle - 1].vcFileName) !=
+            kHashFileName(pstNode->vstEntry[iMiddle].vcFileName)
+        )
+            break;
+    }
+
+    if (i == iCount)
+        return FALSE;
+
+    *pdwSeparatorHash =
+        kHashFileName(pstNode->vstEntry[iMiddle].vcFileName);
+    kMemCpy(
+        pstRightNode->vstEntry,
+        pstNode->vstEntry + iMiddle,
+        (iCount - iMiddle) * sizeof(DIRECTORYENTRY)
+    );
+    pstRightNode->wCount = iCount - iMiddle;
+    pstNode->wCount = iMiddle;
+    return TRUE;
 }
 
 
-// set value in cluster link corresponding to a cluster index
+// find an entry in a directory with a matching file name
 // params:
-//   dwClusterIndex: index to a cluster in data area
-//   dwData: 
+//   dwDirectoryClusterIndex: root node of directory
+//   pcFileName: filename to search. bytes after the name must be 0
+//   pstEntry: pointer to a variable that will contain the found entry
 // return:
-//   TRUE on success, FALSE on failure
-static BOOL kSetClusterLinkData(DWORD dwClusterIndex, DWORD dwData) {
-    DWORD dwSectorOffset;
+//   TRUE if it is found, FALSE otherwise
+static BOOL kFindDirectoryEntry(
+    DWORD dwDirectoryClusterIndex,
+    const char *pcFileName,
+    DIRECTORYENTRY *pstEntry
+) {
+    DIRECTORYNODE *pstNode;
+    DIRECTORYPATH stPath;
+    DWORD dwHash;
+    int iIndex;
 
     // check if filesystem is mounted;
     if (gs_stFileSystemManager.bMounted == FALSE) {
         return FALSE;
     }
 
-    /* find the index for link area from cluster index */
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    dwHash = kHashFileName(pcFileName);
 
-    // find the sector offset corresponding to the cluster in the link area 
-    // each link is 4 bytes so each sector contains 128 links
-    dwSectorOffset = dwClusterIndex / 128;
+    if (
+        kFindDirectoryLeaf(
+            dwDirectoryClusterIndex,
+            dwHash,
+            pstNode,
+            &stPath
+        ) == FALSE
+    )
+        return FALSE;
 
-    if (dwSectorOffset >= gs_stFileSystemManager.dwClusterLinkAreaSize) {
+    iIndex = kSearchDirectoryLeaf(pstNode, dwHash, pcFileName);
+    if (iIndex == pstNode->wCount)
+        return FALSE;
+    if (
+        kCompareDirectoryKey(
+            dwHash,
+            pcFileName,
+            pstNode->vstEntry + iIndex
+        ) != 0
+    )
         return FALSE;
-    }
 
-    /* get link data */
+    kMemCpy(pstEntry, pstNode->vstEntry + iIndex, sizeof(DIRECTORYENTRY));
+    return TRUE;
+}
 
-    if (kReadClusterLinkTable(dwSectorOffset, gs_vbTempBuffer) == FALSE) {
+
+// overwrite an entry in a directory that has the same name
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   pstEntry: entry to write
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kSetDirectoryEntryData(
+    DWORD dwDirectoryClusterIndex,
+    const DIRECTORYENTRY *pstEntry
+) {
+    DIRECTORYNODE *pstNode;
+    DIRECTORYPATH stPath;
+    DWORD dwHash;
+    int iIndex;
+
+    // check if filesystem is mounted;
+    if (gs_stFileSystemManager.bMounted == FALSE) {
         return FALSE;
     }
 
-    /* set data */
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    dwHash = kHashFileName(pstEntry->vcFileName);
 
-    ((DWORD *) gs_vbTempBuffer)[dwClusterIndex % 128] = dwData;
+    if (
+        kFindDirectoryLeaf(
+            dwDirectoryClusterIndex,
+            dwHash,
+            pstNode,
+            &stPath
+        ) == FALSE
+    )
+        return FALSE;
 
-    if (kWriteClusterLinkTable(dwSectorOffset, gs_vbTempBuffer) == FALSE) {
+    iIndex = kSearchDirectoryLeaf(pstNode, dwHash, pstEntry->vcFileName);
+    if (iIndex == pstNode->wCount)
+        return FALSE;
+    if (
+        kCompareDirectoryKey(
+            dwHash,
+            pstEntry->vcFileName,
+            pstNode->vstEntry + iIndex
+        ) != 0
+    )
         return FALSE;
-    }
 
-    return TRUE;
+    kMemCpy(pstNode->vstEntry + iIndex, pstEntry, sizeof(DIRECTORYENTRY));
+    return kWriteDirectoryNode(
+        stPath.vdwClusterIndex[stPath.iDepth - 1],
+        pstNode
+    );
 }
 
 
-// get value in cluster link corresponding to a cluster index
+// add an entry to a directory
 // params:
-//   dwClusterIndex: index to a cluster in data area
-//   pdwData: a pointer to a varaible that will contain the link data 
+//   dwDirectoryClusterIndex: root node of directory
+//   pstEntry: entry to add
 // return:
-//   TRUE on success, FALSE on failure
-static BOOL kGetClusterLinkData(DWORD dwClusterIndex, DWORD *pdwData) {
-    DWORD dwSectorOffset;
+//   TRUE on success, FALSE if the name exists or on failure
+// info:
+//   full nodes are split up to root. root node stays in its cluster and
+//   its entries move to new children, so directory entry of parent
+//   directory is not changed
+static BOOL kAddDirectoryEntry(
+    DWORD dwDirectoryClusterIndex,
+    const DIRECTORYENTRY *pstEntry
+) {
+    DIRECTORYNODE *pstNode;
+    DIRECTORYNODE *pstRightNode;
+    DIRECTORYPATH stPath;
+    DWORD dwHash;
+    DWORD dwSeparatorHash;
+    DWORD dwClusterIndex;
+    DWORD dwLeftClusterIndex;
+    DWORD dwRightClusterIndex;
+    DWORD dwEntryCount;
+    DWORD dwParentClusterIndex;
+    int iMaxCount;
+    int iLevel;
+    int iIndex;
+    int i;
 
     // check if filesystem is mounted;
     if (gs_stFileSystemManager.bMounted == FALSE) {
         return FALSE;
     }
 
-    /* find the index for link area from cluster index */
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    pstRightNode = (DIRECTORYNODE *) gs_vbDirectorySplitBuffer;
+    dwHash = kHashFileName(pstEntry->vcFileName);
 
-    // find the sector offset corresponding to the cluster in the link area 
-    // each link is 4 bytes so each sector contains 128 links
-    dwSectorOffset = dwClusterIndex / 128;
+    if (
+        kFindDirectoryLeaf(
+            dwDirectoryClusterIndex,
+            dwHash,
+            pstNode,
+            &stPath
+        ) == FALSE
+    )
+        return FALSE;
 
-    if (dwSectorOffset >= gs_stFileSystemManager.dwClusterLinkAreaSize) {
+    iIndex = kSearchDirectoryLeaf(pstNode, dwHash, pstEntry->vcFileName);
+    if (
+        (iIndex < pstNode->wCount) &&
+        (
+            kCompareDirectoryKey(
+                dwHash,
+                pstEntry->vcFileName,
+                pstNode->vstEntry + iIndex
+            ) == 0
+        )
+    )
+        return FALSE;
+
+    // every node of path and two new nodes per level may be written, and
+    // links of new nodes are changed. they are committed together
+    if (
+        kReserveJournalSpace(
+            MIN(
+                (stPath.iDepth + 1) * 2 * (FILESYSTEM_SECTORSPERCLUSTER + 1),
+                FILESYSTEM_JOURNAL_MAXSECTORCOUNT
+            )
+        ) == FALSE
+    )
         return FALSE;
+
+
+    /* insert the entry to leaf. node buffer has room for one more */
+
+    for (i = pstNode->wCount; i > iIndex; i--) {
+        kMemCpy(
+            pstNode->vstEntry + i,
+            pstNode->vstEntry + i - 1,
+            sizeof(DIRECTORYENTRY)
+        );
     }
+    kMemCpy(pstNode->vstEntry + iIndex, pstEntry, sizeof(DIRECTORYENTRY));
+    pstNode->wCount++;
 
-    /* get link data */
 
-    if (kReadClusterLinkTable(dwSectorOffset, gs_vbTempBuffer) == FALSE) {
-        return FALSE;
+    /* split full nodes from leaf up to root */
+
+    iLevel = stPath.iDepth - 1;
+    while (TRUE) {
+        dwClusterIndex = stPath.vdwClusterIndex[iLevel];
+        if (pstNode->wLevel == 0)
+            iMaxCount = FILESYSTEM_DIRECTORYNODE_MAXENTRYCOUNT;
+        else
+            iMaxCount = FILESYSTEM_DIRECTORYNODE_MAXINDEXCOUNT;
+
+        if (pstNode->wCount <= iMaxCount) {
+            if (kWriteDirectoryNode(dwClusterIndex, pstNode) == FALSE)
+                return FALSE;
+            break;
+        }
+
+        // root node stays in its cluster. both halves move to new nodes
+        // and root gets one more level
+        if (iLevel == 0) {
+            if (pstNode->wLevel + 2 > FILESYSTEM_DIRECTORYNODE_MAXDEPTH)
+                return FALSE;
+
+            dwEntryCount = pstNode->dwEntryCount;
+            dwParentClusterIndex = pstNode->dwParentClusterIndex;
+            if (
+                kSplitDirectoryNode(
+                    pstNode,
+                    pstRightNode,
+                    &dwSeparatorHash
+                ) == FALSE
+            )
+                return FALSE;
+
+            if (kAllocateDirectoryNode(&dwLeftClusterIndex) == FALSE)
+                return FALSE;
+            if (kAllocateDirectoryNode(&dwRightClusterIndex) == FALSE) {
+                kSetClusterLinkData(dwLeftClusterIndex, FILESYSTEM_FREECLUSTER);
+                return FALSE;
+            }
+
+            pstNode->dwEntryCount = 0;
+            pstNode->dwParentClusterIndex = 0;
+            if (pstNode->wLevel == 0)
+                pstNode->dwNextClusterIndex = dwRightClusterIndex;
+
+            if (
+                (kWriteDirectoryNode(dwRightClusterIndex, pstRightNode) ==
+                    FALSE) ||
+                (kWriteDirectoryNode(dwLeftClusterIndex, pstNode) == FALSE)
+            )
+                return FALSE;
+
+            iLevel = pstNode->wLevel + 1;
+            kInitializeDirectoryNode(pstNode, dwParentClusterIndex);
+            pstNode->wLevel = iLevel;
+            pstNode->wCount = 1;
+            pstNode->dwEntryCount = dwEntryCount;
+            pstNode->dwFirstClusterIndex = dwLeftClusterIndex;
+            pstNode->vstIndex[0].dwHash = dwSeparatorHash;
+            pstNode->vstIndex[0].dwClusterIndex = dwRightClusterIndex;
+
+            if (kWriteDirectoryNode(dwClusterIndex, pstNode) == FALSE)
+                return FALSE;
+            break;
+        }
+
+        if (
+            kSplitDirectoryNode(pstNode, pstRightNode, &dwSeparatorHash) ==
+            FALSE
+        )
+            return FALSE;
+
+        if (kAllocateDirectoryNode(&dwRightClusterIndex) == FALSE)
+            return FALSE;
+
+        // right half is linked after the node in leaf chain
+        if (pstNode->wLevel == 0) {
+            pstRightNode->dwNextClusterIndex = pstNode->dwNextClusterIndex;
+            pstNode->dwNextClusterIndex = dwRightClusterIndex;
+        }
+
+        if (
+            (kWriteDirectoryNode(dwRightClusterIndex, pstRightNode) ==
+                FALSE) ||
+            (kWriteDirectoryNode(dwClusterIndex, pstNode) == FALSE)
+        )
+            return FALSE;
+
+
+        /* insert key of the right half to parent after the node */
+
+        iLevel--;
+        if (
+            kReadDirectoryNode(stPath.vdwClusterIndex[iLevel], pstNode) ==
+            FALSE
+        )
+            return FALSE;
+
+        iIndex = stPath.viChildIndex[iLevel];
+        for (i = pstNode->wCount; i > iIndex; i--) {
+            pstNode->vstIndex[i].dwHash = pstNode->vstIndex[i - 1].dwHash;
+            pstNode->vstIndex[i].dwClusterIndex =
+                pstNode->vstIndex[i - 1].dwClusterIndex;
+        }
+        pstNode->vstIndex[iIndex].dwHash = dwSeparatorHash;
+        pstNode->vstIndex[iIndex].dwClusterIndex = dwRightClusterIndex;
+        pstNode->wCount++;
     }
 
-    *pdwData = ((DWORD *) gs_vbTempBuffer)[dwClusterIndex % 128];
-    return TRUE;
+    return kUpdateDirectoryEntryCount(dwDirectoryClusterIndex, 1);
 }
 
 
-// get idex to empty entry in root directory
+// remove an entry from a directory
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   pcFileName: name of entry. bytes after the name must be 0
 // return:
-//   index to free entry in root directory
-//   -1 on failure
-static int kFindFreeDirectoryEntry(void) {
-    DIRECTORYENTRY *pstEntry;
+//   TRUE on success, FALSE if the name does not exist or on failure
+// info:
+//   nodes are not merged. every node except root is freed when the
+//   directory becomes empty
+static BOOL kRemoveDirectoryEntry(
+    DWORD dwDirectoryClusterIndex,
+    const char *pcFileName
+) {
+    DIRECTORYNODE *pstNode;
+    DIRECTORYPATH stPath;
+    DWORD dwHash;
+    int iIndex;
     int i;
 
     // check if filesystem is mounted;
     if (gs_stFileSystemManager.bMounted == FALSE) {
-        return -1;
+        return FALSE;
     }
 
-    // read cluster containing root directory
-    if (kReadCluster(0, gs_vbTempBuffer) == FALSE) {
-        return -1;
-    }
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    dwHash = kHashFileName(pcFileName);
 
-    pstEntry = (DIRECTORYENTRY *) gs_vbTempBuffer;
+    if (
+        kFindDirectoryLeaf(
+            dwDirectoryClusterIndex,
+            dwHash,
+            pstNode,
+            &stPath
+        ) == FALSE
+    )
+        return FALSE;
 
+    iIndex = kSearchDirectoryLeaf(pstNode, dwHash, pcFileName);
+    if (iIndex == pstNode->wCount)
+        return FALSE;
+    if (
+        kCompareDirectoryKey(
+            dwHash,
+            pcFileName,
+            pstNode->vstEntry + iIndex
+        ) != 0
+    )
+        return FALSE;
 
-    /* search for free entry in root directory */
+    // leaf and root node are committed together
+    if (
+        kReserveJournalSpace(2 * (FILESYSTEM_SECTORSPERCLUSTER + 1)) ==
+        FALSE
+    )
+        return FALSE;
 
-    for (i = 0; i < FILESYSTEM_MAXDIRECTORYENTRYCOUNT; i++) {
-        if (pstEntry[i].dwStartClusterIndex == 0) {
-            return i;
-        }
+    for (i = iIndex; i < pstNode->wCount - 1; i++) {
+        kMemCpy(
+            pstNode->vstEntry + i,
+            pstNode->vstEntry + i + 1,
+            sizeof(DIRECTORYENTRY)
+        );
     }
+    pstNode->wCount--;
+    kMemSet(pstNode->vstEntry + pstNode->wCount, 0, sizeof(DIRECTORYENTRY));
 
-    return -1;
+    if (
+        kWriteDirectoryNode(
+            stPath.vdwClusterIndex[stPath.iDepth - 1],
+            pstNode
+        ) == FALSE
+    )
+        return FALSE;
+
+    return kUpdateDirectoryEntryCount(dwDirectoryClusterIndex, -1);
 }
 
 
-// write directory entry to index of root directory
+// change number of entries in root node of a directory
 // params:
-//   iIndex: Directory entry index to set in the root directory
-//   pstEntry: pointer containing data to write to straoge
+//   dwDirectoryClusterIndex: root node of directory
+//   iDelta: number of entries added. negative if they are removed
 // return:
 //   TRUE on success, FALSE on failure
-static BOOL kSetDirectoryEntryData(int iIndex, DIRECTORYENTRY *pstEntry) {
-    DIRECTORYENTRY *pstRootEntry;
+static BOOL kUpdateDirectoryEntryCount(
+    DWORD dwDirectoryClusterIndex,
+    int iDelta
+) {
+    DIRECTORYNODE *pstNode;
+    DIRECTORYNODE *pstOldRootNode;
+    int i;
 
-    // check if filesystem is mounted;
-    if (gs_stFileSystemManager.bMounted == FALSE) {
-        return FALSE;
-    }
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    pstOldRootNode = (DIRECTORYNODE *) gs_vbDirectorySplitBuffer;
 
-    // check if iIndex is in domain
-    if (iIndex < 0 || iIndex >= FILESYSTEM_MAXDIRECTORYENTRYCOUNT) {
+    if (kReadDirectoryNode(dwDirectoryClusterIndex, pstNode) == FALSE)
         return FALSE;
-    }
 
+    pstNode->dwEntryCount += iDelta;
+    if ((pstNode->dwEntryCount != 0) || (pstNode->wLevel == 0))
+        return kWriteDirectoryNode(dwDirectoryClusterIndex, pstNode);
 
-    /* read cluster containing directory */
 
-    if (kReadCluster(0, gs_vbTempBuffer) == FALSE) {
+    /* directory became empty. root becomes an empty leaf again */
+
+    kMemCpy(pstOldRootNode, pstNode, FILESYSTEM_CLUSTERSIZE);
+    kInitializeDirectoryNode(pstNode, pstOldRootNode->dwParentClusterIndex);
+    if (kWriteDirectoryNode(dwDirectoryClusterIndex, pstNode) == FALSE)
+        return FALSE;
+
+    if (kFreeDirectoryTree(pstOldRootNode->dwFirstClusterIndex) == FALSE)
         return FALSE;
+
+    for (i = 0; i < pstOldRootNode->wCount; i++) {
+        if (
+            kFreeDirectoryTree(pstOldRootNode->vstIndex[i].dwClusterIndex) ==
+            FALSE
+        )
+            return FALSE;
     }
+    return TRUE;
+}
+
 
+// free a node and every node under it
+// params:
+//   dwClusterIndex: cluster of the node
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kFreeDirectoryTree(DWORD dwClusterIndex) {
+    DIRECTORYNODE *pstNode;
+    DWORD vdwClusterIndex[FILESYSTEM_DIRECTORYNODE_MAXDEPTH];
+    int viNextChildIndex[FILESYSTEM_DIRECTORYNODE_MAXDEPTH];
+    int iTop;
+    int iChild;
 
-    /* set entry in  directory */
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
 
-    pstRootEntry = (DIRECTORYENTRY *) gs_vbTempBuffer;
 
-    kMemCpy(pstRootEntry + iIndex, pstEntry, sizeof(DIRECTORYENTRY));
+    /* free children before their parent. parent is read again for each
+       child, because node buffer is shared */
 
-    /* write to stroage */
+    iTop = 0;
+    vdwClusterIndex[0] = dwClusterIndex;
+    viNextChildIndex[0] = 0;
 
-    if (kWriteCluster(0, gs_vbTempBuffer) == FALSE) {
-        return FALSE;
-    }
+    while (iTop >= 0) {
+        if (kReadDirectoryNode(vdwClusterIndex[iTop], pstNode) == FALSE)
+            return FALSE;
 
+        iChild = viNextChildIndex[iTop];
+        if ((pstNode->wLevel != 0) && (iChild <= pstNode->wCount)) {
+            if (iTop + 1 >= FILESYSTEM_DIRECTORYNODE_MAXDEPTH)
+                return FALSE;
+
+            viNextChildIndex[iTop]++;
+            iTop++;
+            if (iChild == 0)
+                vdwClusterIndex[iTop] = pstNode->dwFirstClusterIndex;
+            else
+                vdwClusterIndex[iTop] =
+                    pstNode->vstIndex[iChild - 1].dwClusterIndex;
+            viNextChildIndex[iTop] = 0;
+            continue;
+        }
+
+        if (
+            kSetClusterLinkData(
+                vdwClusterIndex[iTop],
+                FILESYSTEM_FREECLUSTER
+            ) == FALSE
+        )
+            return FALSE;
+        iTop--;
+    }
     return TRUE;
 }
 
 
-// read directory entry at index of root directory
+// find a directory by path
 // params:
-//   iIndex: Directory entry index to read in the root directory
-//   pstEntry: pointer that will contain the data 
+//   pcPath: path from root directory. "." and ".." can be used
+//   iLength: length of path
+//   pdwClusterIndex: root node of the directory
 // return:
-//   TRUE on success, FALSE on failure
-static BOOL kGetDirectoryEntryData(int iIndex, DIRECTORYENTRY *pstEntry) {
-    DIRECTORYENTRY *pstRootEntry;
+//   TRUE on success, FALSE if a directory of path does not exist
+static BOOL kFindDirectory(
+    const char *pcPath,
+    int iLength,
+    DWORD *pdwClusterIndex
+) {
+    DIRECTORYENTRY stEntry;
+    char vcName[FILESYSTEM_MAXFILENAMELENGTH];
+    DWORD dwClusterIndex;
+    int iStart;
+    int iNameLength;
+    int i;
 
-    // check if filesystem is mounted;
-    if (gs_stFileSystemManager.bMounted == FALSE) {
+    if (iLength > FILESYSTEM_MAXPATHLENGTH)
         return FALSE;
-    }
 
-    // check if iIndex is in domain
-    if (iIndex < 0 || iIndex >= FILESYSTEM_MAXDIRECTORYENTRYCOUNT) {
-        return FALSE;
-    }
+    dwClusterIndex = FILESYSTEM_ROOTDIRECTORYCLUSTER;
+    i = 0;
+    while (i < iLength) {
+        // empty names between '/' are skipped
+        if (pcPath[i] == '/') {
+            i++;
+            continue;
+        }
+
+        iStart = i;
+        while ((i < iLength) && (pcPath[i] != '/'))
+            i++;
+        iNameLength = i - iStart;
 
+        if (iNameLength > FILESYSTEM_MAXFILENAMELENGTH - 1)
+            return FALSE;
 
-    /* read cluster containing directory */
+        if ((iNameLength == 1) && (pcPath[iStart] == '.'))
+            continue;
 
-    if (kReadCluster(0, gs_vbTempBuffer) == FALSE) {
-        return FALSE;
+        // root node knows its parent
+        if (
+            (iNameLength == 2) &&
+            (pcPath[iStart] == '.') &&
+            (pcPath[iStart + 1] == '.')
+        ) {
+            if (
+                kReadDirectoryNode(
+                    dwClusterIndex,
+                    (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer
+                ) == FALSE
+            )
+                return FALSE;
+
+            dwClusterIndex = ((DIRECTORYNODE *) gs_vbDirectoryNodeBuffer)->
+                dwParentClusterIndex;
+            continue;
+        }
+
+        kMemSet(vcName, 0, sizeof(vcName));
+        kMemCpy(vcName, pcPath + iStart, iNameLength);
+        if (kFindDirectoryEntry(dwClusterIndex, vcName, &stEntry) == FALSE)
+            return FALSE;
+        if ((stEntry.dwAttribute & FILESYSTEM_ATTRIBUTE_DIRECTORY) == 0)
+            return FALSE;
+
+        dwClusterIndex = stEntry.dwStartClusterIndex;
     }
 
-    pstRootEntry = (DIRECTORYENTRY *) gs_vbTempBuffer;
-    kMemCpy(pstEntry, pstRootEntry + iIndex, sizeof(DIRECTORYENTRY));
+    *pdwClusterIndex = dwClusterIndex;
     return TRUE;
 }
 
 
-
-// find an entry in the root directory with a matching file name
+// split a path into its directory and the last name
 // params:
-//   pcFileName: filename to search
-//   pstEntry: pointer to a variable that will contain the found entry
+//   pcPath: path from root directory
+//   pdwDirectoryClusterIndex: root node of directory of the last name
+//   pcFileName: buffer of FILESYSTEM_MAXFILENAMELENGTH bytes that gets the
+//               last name. bytes after the name are 0
 // return:
-//   index of found entry in root directory
-//   or -1 on failure 
-static int kFindDirectoryEntry(
-    const char *pcFileName,
-    DIRECTORYENTRY *pstEntry
+//   TRUE on success, FALSE if the directory does not exist or the name is
+//   not valid
+static BOOL kFindParentDirectory(
+    const char *pcPath,
+    DWORD *pdwDirectoryClusterIndex,
+    char *pcFileName
 ) {
-    DIRECTORYENTRY *pstRootEntry;
-    int i;
     int iLength;
+    int iStart;
+    int iNameLength;
 
-    // check if filesystem is mounted;
-    if (gs_stFileSystemManager.bMounted == FALSE) {
+    iLength = kStrLen(pcPath);
+    if (iLength > FILESYSTEM_MAXPATHLENGTH)
         return FALSE;
-    }
 
-    /* read cluster containing directory */
+    // "dir/" is the same as "dir"
+    while ((iLength > 0) && (pcPath[iLength - 1] == '/'))
+        iLength--;
 
-    if (kReadCluster(0, gs_vbTempBuffer) == FALSE) {
-        return FALSE;
-    }
+    iStart = iLength;
+    while ((iStart > 0) && (pcPath[iStart - 1] != '/'))
+        iStart--;
+    iNameLength = iLength - iStart;
 
-    iLength = kStrLen(pcFileName);
-    pstRootEntry = (DIRECTORYENTRY *) gs_vbTempBuffer;
+    if ((iNameLength == 0) || (iNameLength > FILESYSTEM_MAXFILENAMELENGTH - 1))
+        return FALSE;
 
+    // "." and ".." are not names of entries
+    if (
+        (pcPath[iStart] == '.') &&
+        (
+            (iNameLength == 1) ||
+            ((iNameLength == 2) && (pcPath[iStart + 1] == '.'))
+        )
+    )
+        return FALSE;
 
-    /* search for direcotry entry that contains the pcFileName */
+    if (kFindDirectory(pcPath, iStart, pdwDirectoryClusterIndex) == FALSE)
+        return FALSE;
 
-    for (i = 0; i < FILESYSTEM_MAXDIRECTORYENTRYCOUNT; i++) {
-        if (kMemCmp(pstRootEntry[i].vcFileName, pcFileName, iLength) == 0) {
-            kMemCpy(pstEntry, pstRootEntry + i, sizeof(DIRECTORYENTRY));
-            return i;
-        }
-    }
-    return -1;
+    kMemSet(pcFileName, 0, FILESYSTEM_MAXFILENAMELENGTH);
+    kMemCpy(pcFileName, pcPath + iStart, iNameLength);
+    return TRUE;
 }
 
 
@@ -689,18 +2717,18 @@ static void kFreeFileDirectoryHandle(FILE *pstFile) {
 }
 
 
-// create a file and fill it to root directory entry.
+// create a file and add its entry to a directory
 // params:
-//   pcFileName: name of a file to create
+//   dwDirectoryClusterIndex: root node of directory
+//   pcFileName: name of a file to create. bytes after the name must be 0
 //   pstEntry: pointer to a directory entry that will have the file info
-//   piDirectoryEntryIndex: index of the entry in the root directory
 // return:
 //   TRUE on success
 //   FALSE on failure
 static BOOL kCreateFile(
+    DWORD dwDirectoryClusterIndex,
     const char *pcFileName,
-    DIRECTORYENTRY *pstEntry,
-    int *piDirectoryEntryIndex
+    DIRECTORYENTRY *pstEntry
 ) {
     DWORD dwCluster;
 
@@ -712,22 +2740,16 @@ static BOOL kCreateFile(
     // set the cluster to used one
     if (kSetClusterLinkData(dwCluster, FILESYSTEM_LASTCLUSTER) == FALSE)
         return FALSE;
-    
-    // find an empty entry in the root directory.
-    *piDirectoryEntryIndex = kFindFreeDirectoryEntry();
-
-    if (*piDirectoryEntryIndex == -1)
-        goto ERROR;
-
 
 
     /* create a file */
 
-    kMemCpy(pstEntry->vcFileName, pcFileName, kStrLen(pcFileName) + 1);
+    kMemSet(pstEntry, 0, sizeof(DIRECTORYENTRY));
+    kMemCpy(pstEntry->vcFileName, pcFileName, FILESYSTEM_MAXFILENAMELENGTH);
     pstEntry->dwStartClusterIndex = dwCluster;
     pstEntry->dwFileSize = 0;
 
-    if (kSetDirectoryEntryData(*piDirectoryEntryIndex, pstEntry) == FALSE)
+    if (kAddDirectoryEntry(dwDirectoryClusterIndex, pstEntry) == FALSE)
         goto ERROR;
 
     return TRUE;
@@ -766,6 +2788,202 @@ static BOOL kFreeClusterUntilEnd(DWORD dwClusterIndex) {
 }
 
 
+// get cluster map of a file. the map is created if no handle opened the
+// file
+// params:
+//   dwStartClusterIndex: the cluster index where the file starts
+// return:
+//   cluster map on success
+//   NULL on failure
+static CLUSTERMAP *kGetClusterMap(DWORD dwStartClusterIndex) {
+    CLUSTERMAP *pstClusterMap;
+    CLUSTERMAP *pstFreeClusterMap;
+    int i;
+
+    pstClusterMap = gs_stFileSystemManager.pstClusterMapPool;
+    pstFreeClusterMap = NULL;
+
+    for (i = 0; i < FILESYSTEM_CLUSTERMAP_MAXCOUNT; i++) {
+        if (pstClusterMap[i].iReferenceCount == 0) {
+            if (pstFreeClusterMap == NULL) {
+                pstFreeClusterMap = pstClusterMap + i;
+            }
+            continue;
+        }
+
+        // another handle opened the file already
+        if (pstClusterMap[i].dwStartClusterIndex == dwStartClusterIndex) {
+            pstClusterMap[i].iReferenceCount++;
+            return pstClusterMap + i;
+        }
+    }
+
+    if (pstFreeClusterMap == NULL)
+        return NULL;
+
+
+    /* create a map that has the start cluster only */
+
+    pstFreeClusterMap->pdwClusterIndex = (DWORD *) kAllocateMemory(
+        FILESYSTEM_CLUSTERMAP_DEFAULTCOUNT * sizeof(DWORD)
+    );
+    if (pstFreeClusterMap->pdwClusterIndex == NULL)
+        return NULL;
+
+    pstFreeClusterMap->pdwClusterIndex[0] = dwStartClusterIndex;
+    pstFreeClusterMap->dwMappedCount = 1;
+    pstFreeClusterMap->dwMaxCount = FILESYSTEM_CLUSTERMAP_DEFAULTCOUNT;
+    pstFreeClusterMap->dwStartClusterIndex = dwStartClusterIndex;
+    pstFreeClusterMap->iReferenceCount = 1;
+    return pstFreeClusterMap;
+}
+
+
+// release cluster map that a handle used. the map is freed when no handle
+// uses it
+// params:
+//   pstClusterMap: cluster map to release
+static void kReleaseClusterMap(CLUSTERMAP *pstClusterMap) {
+    if (pstClusterMap == NULL)
+        return;
+
+    pstClusterMap->iReferenceCount--;
+    if (pstClusterMap->iReferenceCount > 0)
+        return;
+
+    kFreeMemory(pstClusterMap->pdwClusterIndex);
+    kMemSet(pstClusterMap, 0, sizeof(CLUSTERMAP));
+}
+
+
+// forget clusters after the first cluster of a file whose clusters are
+// freed
+// params:
+//   dwStartClusterIndex: the cluster index where the file starts
+// note:
+//   nothing happens if no handle opened the file
+static void kTruncateClusterMap(DWORD dwStartClusterIndex) {
+    CLUSTERMAP *pstClusterMap;
+    int i;
+
+    pstClusterMap = gs_stFileSystemManager.pstClusterMapPool;
+    for (i = 0; i < FILESYSTEM_CLUSTERMAP_MAXCOUNT; i++) {
+        if (
+            (pstClusterMap[i].iReferenceCount != 0) &&
+            (pstClusterMap[i].dwStartClusterIndex == dwStartClusterIndex)
+        ) {
+            pstClusterMap[i].dwMappedCount = 1;
+            return;
+        }
+    }
+}
+
+
+// add a cluster to the end of cluster map
+// params:
+//   pstClusterMap: cluster map
+//   dwClusterIndex: index of the next cluster of the last mapped cluster
+// return:
+//   TRUE on success
+//   FALSE if memory for the map can not be allocated
+static BOOL kAddClusterToMap(CLUSTERMAP *pstClusterMap, DWORD dwClusterIndex) {
+    DWORD *pdwNewClusterIndex;
+
+    // map is full. move it to a memory twice as large
+    if (pstClusterMap->dwMappedCount == pstClusterMap->dwMaxCount) {
+        pdwNewClusterIndex = (DWORD *) kAllocateMemory(
+            pstClusterMap->dwMaxCount * 2 * sizeof(DWORD)
+        );
+        if (pdwNewClusterIndex == NULL)
+            return FALSE;
+
+        kMemCpy(
+            pdwNewClusterIndex,
+            pstClusterMap->pdwClusterIndex,
+            pstClusterMap->dwMappedCount * sizeof(DWORD)
+        );
+        kFreeMemory(pstClusterMap->pdwClusterIndex);
+
+        pstClusterMap->pdwClusterIndex = pdwNewClusterIndex;
+        pstClusterMap->dwMaxCount *= 2;
+    }
+
+    pstClusterMap->pdwClusterIndex[pstClusterMap->dwMappedCount] =
+        dwClusterIndex;
+    pstClusterMap->dwMappedCount++;
+    return TRUE;
+}
+
+
+// find cluster at a cluster offset of a file
+// params:
+//   pstClusterMap: cluster map of the file
+//   dwClusterOffset: offset of cluster in the file (byte offset / cluster
+//                    size)
+//   pdwPreviousClusterIndex: cluster before the found cluster. it is the
+//                            start cluster when dwClusterOffset is 0
+//   pdwClusterIndex: found cluster. FILESYSTEM_LASTCLUSTER if the chain ends
+//                    right before dwClusterOffset
+// return:
+//   TRUE on success
+//   FALSE on failure
+// note:
+//   clusters in the map are found in memory. Otherwise links are followed
+//   from the last mapped cluster and added to the map
+static BOOL kGetClusterFromMap(
+    CLUSTERMAP *pstClusterMap,
+    DWORD dwClusterOffset,
+    DWORD *pdwPreviousClusterIndex,
+    DWORD *pdwClusterIndex
+) {
+    DWORD dwCurrentOffset;
+    DWORD dwPreviousClusterIndex;
+    DWORD dwCurrentClusterIndex;
+
+    if (dwClusterOffset < pstClusterMap->dwMappedCount) {
+        *pdwClusterIndex = pstClusterMap->pdwClusterIndex[dwClusterOffset];
+        *pdwPreviousClusterIndex = pstClusterMap->pdwClusterIndex[
+            (dwClusterOffset == 0) ? 0 : (dwClusterOffset - 1)
+        ];
+        return TRUE;
+    }
+
+
+    /* follow links from the last mapped cluster */
+
+    dwCurrentOffset = pstClusterMap->dwMappedCount - 1;
+    dwCurrentClusterIndex = pstClusterMap->pdwClusterIndex[dwCurrentOffset];
+
+    // dwClusterOffset is after the last mapped cluster, so the loop sets it
+    // at least once
+    dwPreviousClusterIndex = dwCurrentClusterIndex;
+
+    while (dwCurrentOffset < dwClusterOffset) {
+        dwPreviousClusterIndex = dwCurrentClusterIndex;
+
+        if (
+            kGetClusterLinkData(
+                dwPreviousClusterIndex,
+                &dwCurrentClusterIndex
+            ) == FALSE
+        )
+            return FALSE;
+
+        dwCurrentOffset++;
+        if (dwCurrentClusterIndex == FILESYSTEM_LASTCLUSTER)
+            break;
+
+        // if memory for the map runs out, the rest is followed without map
+        if (dwCurrentOffset == pstClusterMap->dwMappedCount)
+            kAddClusterToMap(pstClusterMap, dwCurrentClusterIndex);
+    }
+
+    *pdwPreviousClusterIndex = dwPreviousClusterIndex;
+    *pdwClusterIndex = dwCurrentClusterIndex;
+    return TRUE;
+}
+
+
 // flush meta data in FILE handle in memory to directory entry in storage
 // params:
 //   pstFileHandle: file handle
@@ -778,8 +2996,9 @@ static BOOL kUpdateDirectoryEntry(FILEHANDLE *pstFileHandle) {
     if (pstFileHandle == NULL)
         return FALSE;
     if (
-        kGetDirectoryEntryData(
-            pstFileHandle->iDirectoryEntryOffset,
+        kFindDirectoryEntry(
+            pstFileHandle->dwDirectoryClusterIndex,
+            pstFileHandle->vcFileName,
             &stEntry
         ) == FALSE
     )
@@ -788,21 +3007,134 @@ static BOOL kUpdateDirectoryEntry(FILEHANDLE *pstFileHandle) {
     stEntry.dwFileSize = pstFileHandle->dwFileSize;
     stEntry.dwStartClusterIndex = pstFileHandle->dwStartClusterIndex;
 
-    if (
-        kSetDirectoryEntryData(
-            pstFileHandle->iDirectoryEntryOffset,
-            &stEntry
-        ) == FALSE
-    )
-        return FALSE;
+    if (
+        kSetDirectoryEntryData(
+            pstFileHandle->dwDirectoryClusterIndex,
+            &stEntry
+        ) == FALSE
+    )
+        return FALSE;
+
+    return TRUE;
+}
+
+
+// detect sequential read of a file and read clusters ahead of it
+// params:
+//   pstFileHandle: file handle to read
+//   dwClusterOffset: cluster offset in the file that is read now
+// info:
+//   clusters are read asynchronously into file data cache. they are read
+//   in batches of half window, so block layer merges them
+static void kReadAhead(FILEHANDLE *pstFileHandle, DWORD dwClusterOffset) {
+    DATACACHEENTRY *pstEntry;
+    BLOCKREQUEST *pstRequest;
+    DWORD dwFileClusterCount;
+    DWORD dwEndOffset;
+    DWORD dwPreviousClusterIndex;
+    DWORD dwClusterIndex;
+    DWORD i;
+
+    // small reads stay in the same cluster
+    if (dwClusterOffset + 1 == pstFileHandle->dwReadAheadNextOffset)
+        return;
+
+
+    /* detect stream */
+
+    if (dwClusterOffset == pstFileHandle->dwReadAheadNextOffset) {
+        if (pstFileHandle->dwReadAheadWindow == 0) {
+            pstFileHandle->dwReadAheadWindow = FILESYSTEM_READAHEAD_MINWINDOW;
+        }
+        else {
+            pstFileHandle->dwReadAheadWindow = MIN(
+                pstFileHandle->dwReadAheadWindow * 2,
+                FILESYSTEM_READAHEAD_MAXWINDOW
+            );
+        }
+    }
+    else {
+        // random access. readahead starts again when a stream starts
+        pstFileHandle->dwReadAheadWindow = 0;
+        pstFileHandle->dwReadAheadEndOffset = dwClusterOffset + 1;
+    }
+    pstFileHandle->dwReadAheadNextOffset = dwClusterOffset + 1;
+
+    // clusters are read when reader passes half of window
+    if (
+        (pstFileHandle->dwReadAheadWindow == 0) ||
+        (pstFileHandle->dwReadAheadEndOffset >
+            dwClusterOffset + (pstFileHandle->dwReadAheadWindow / 2))
+    )
+        return;
+
+
+    /* read clusters in window */
+
+    dwFileClusterCount =
+        (pstFileHandle->dwFileSize + FILESYSTEM_CLUSTERSIZE - 1) /
+        FILESYSTEM_CLUSTERSIZE;
+    dwEndOffset = MIN(
+        dwClusterOffset + pstFileHandle->dwReadAheadWindow + 1,
+        dwFileClusterCount
+    );
+
+    for (
+        i = MAX(pstFileHandle->dwReadAheadEndOffset, dwClusterOffset + 1);
+        i < dwEndOffset;
+        i++
+    ) {
+        if (
+            kGetClusterFromMap(
+                pstFileHandle->pstClusterMap,
+                i,
+                &dwPreviousClusterIndex,
+                &dwClusterIndex
+            ) == FALSE
+        )
+            break;
+
+        if (dwClusterIndex == FILESYSTEM_LASTCLUSTER)
+            break;
+
+        if (kFindDataCacheEntry(dwClusterIndex) != NULL)
+            continue;
+
+        // cache is full of clusters that are being read
+        pstEntry = kAllocateDataCacheEntry(dwClusterIndex);
+        if (pstEntry == NULL)
+            break;
+
+        pstEntry->bReadAhead = TRUE;
+
+        pstRequest = &(pstEntry->stRequest);
+        pstRequest->bWrite = FALSE;
+        pstRequest->qwLBA = kGetClusterLBA(dwClusterIndex);
+        pstRequest->iSectorCount = FILESYSTEM_SECTORSPERCLUSTER;
+        pstRequest->pcBuffer = (char *) pstEntry->pbBuffer;
+        pstRequest->pfCallback = NULL;
+        pstRequest->pvCallbackParameter = NULL;
+
+        if (
+            kSubmitBlockRequest(
+                gs_stFileSystemManager.pstBlockDevice,
+                pstRequest
+            ) == FALSE
+        ) {
+            pstEntry->dwClusterIndex = FILESYSTEM_LASTCLUSTER;
+            break;
+        }
+
+        gs_stFileSystemManager.qwReadAheadCount++;
+    }
 
-    return TRUE;
+    pstFileHandle->dwReadAheadEndOffset = i;
 }
 
 
 // open a FILE handle
 // params:
-//   pcFileName: name of a file to open
+//   pcFileName: path of a file to open. ex) /dir/file
 //   pcMode: mode of the file to open
 //           r  : read only
 //           w  : write only
@@ -822,41 +3154,53 @@ static BOOL kUpdateDirectoryEntry(FILEHANDLE *pstFileHandle) {
 //    possible to all files  
 FILE *kOpenFile(const char *pcFileName, const char *pcMode) {
     DIRECTORYENTRY stEntry;
-    int iDirectoryEntryOffset;
-    int iFileNameLength;
+    DWORD dwDirectoryClusterIndex;
+    char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
     DWORD dwSecondCluster;
     FILE *pstFile;
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
 
-    /* check if pcFileName is less than the maximum file length */
-
-    iFileNameLength = kStrLen(pcFileName);
+    /* find directory of the file and check the name */
 
-    if (iFileNameLength > (sizeof(stEntry.vcFileName) - 1))
-        return NULL;
-    
-    if (iFileNameLength == 0)
-        return NULL;
+    if (
+        kFindParentDirectory(
+            pcFileName,
+            &dwDirectoryClusterIndex,
+            vcFileName
+        ) == FALSE
+    )
+        goto ERROR;
 
 
     /* check if file exists in the storage */
 
-    iDirectoryEntryOffset = kFindDirectoryEntry(pcFileName, &stEntry);
-
     // file does not exist
-    if (iDirectoryEntryOffset == -1) {
+    if (
+        kFindDirectoryEntry(
+            dwDirectoryClusterIndex,
+            vcFileName,
+            &stEntry
+        ) == FALSE
+    ) {
         // 'r' and 'r+' mode 
         if (pcMode[0] == 'r')
             goto ERROR;
 
         // 'w', 'w+', 'a', 'a+' mode: create new file
-        if (kCreateFile(pcFileName, &stEntry, &iDirectoryEntryOffset) == FALSE)
+        if (
+            kCreateFile(dwDirectoryClusterIndex, vcFileName, &stEntry) ==
+            FALSE
+        )
             goto ERROR;
         
     }
     else {
+        // directory is opened by kOpenDirectory
+        if ((stEntry.dwAttribute & FILESYSTEM_ATTRIBUTE_DIRECTORY) != 0)
+            goto ERROR;
+
         // 'w' and 'w+' mode
         if (pcMode[0] == 'w') {
             // get the next cluster index to be freed until the end
@@ -871,6 +3215,9 @@ FILE *kOpenFile(const char *pcFileName, const char *pcMode) {
             if (kFreeClusterUntilEnd(dwSecondCluster) == FALSE)
                 goto ERROR;
 
+            // other handles of the file must not use freed clusters
+            kTruncateClusterMap(stEntry.dwStartClusterIndex);
+
             // set the start index as the last cluster of the file
             if (
                 kSetClusterLinkData(
@@ -884,7 +3231,7 @@ FILE *kOpenFile(const char *pcFileName, const char *pcMode) {
             stEntry.dwFileSize = 0;
             if (
                 kSetDirectoryEntryData(
-                    iDirectoryEntryOffset,
+                    dwDirectoryClusterIndex,
                     &stEntry
                 ) == FALSE
             )
@@ -899,12 +3246,27 @@ FILE *kOpenFile(const char *pcFileName, const char *pcMode) {
         goto ERROR;
     
     pstFile->bType = FILESYSTEM_TYPE_FILE;
-    pstFile->stFileHandle.iDirectoryEntryOffset = iDirectoryEntryOffset;
+    pstFile->stFileHandle.dwDirectoryClusterIndex = dwDirectoryClusterIndex;
+    kMemCpy(
+        pstFile->stFileHandle.vcFileName,
+        vcFileName,
+        FILESYSTEM_MAXFILENAMELENGTH
+    );
     pstFile->stFileHandle.dwFileSize = stEntry.dwFileSize;
     pstFile->stFileHandle.dwStartClusterIndex = stEntry.dwStartClusterIndex;
     pstFile->stFileHandle.dwCurrentClusterIndex = stEntry.dwStartClusterIndex;
     pstFile->stFileHandle.dwPreviousClusterIndex = stEntry.dwStartClusterIndex;
     pstFile->stFileHandle.dwCurrentOffset = 0;
+    pstFile->stFileHandle.dwReadAheadNextOffset = 0;
+    pstFile->stFileHandle.dwReadAheadWindow = 0;
+    pstFile->stFileHandle.dwReadAheadEndOffset = 0;
+
+    pstFile->stFileHandle.pstClusterMap =
+        kGetClusterMap(stEntry.dwStartClusterIndex);
+    if (pstFile->stFileHandle.pstClusterMap == NULL) {
+        kFreeFileDirectoryHandle(pstFile);
+        goto ERROR;
+    }
 
     // 'a' and 'a+' mode
     if (pcMode[0] == 'a')
@@ -935,6 +3297,7 @@ DWORD kReadFile(void *pvBuffer, DWORD dwSize, DWORD dwCount, FILE *pstFile) {
     DWORD dwCopySize;
     FILEHANDLE *pstFileHandle;
     DWORD dwNextClusterIndex;
+    DATACACHEENTRY *pstCacheEntry;
 
     if (pstFile == NULL || pstFile->bType != FILESYSTEM_TYPE_FILE)
         return -1;
@@ -962,12 +3325,15 @@ DWORD kReadFile(void *pvBuffer, DWORD dwSize, DWORD dwCount, FILE *pstFile) {
 
     dwReadCount = 0;
     while (dwReadCount != dwTotalCount) {
-        if (
-            kReadCluster(
-                pstFileHandle->dwCurrentClusterIndex,
-                gs_vbTempBuffer
-            ) == FALSE
-        )
+        // following clusters are read while this one is copied
+        kReadAhead(
+            pstFileHandle,
+            pstFileHandle->dwCurrentOffset / FILESYSTEM_CLUSTERSIZE
+        );
+
+        pstCacheEntry =
+            kGetCachedCluster(pstFileHandle->dwCurrentClusterIndex, TRUE);
+        if (pstCacheEntry == NULL)
             break;
 
         dwOffsetInCluster = 
@@ -982,7 +3348,7 @@ DWORD kReadFile(void *pvBuffer, DWORD dwSize, DWORD dwCount, FILE *pstFile) {
 
         kMemCpy(
             (char *) pvBuffer + dwReadCount,
-            gs_vbTempBuffer + dwOffsetInCluster, dwCopySize
+            pstCacheEntry->pbBuffer + dwOffsetInCluster, dwCopySize
         );
 
         dwReadCount += dwCopySize;
@@ -995,19 +3361,16 @@ DWORD kReadFile(void *pvBuffer, DWORD dwSize, DWORD dwCount, FILE *pstFile) {
         //   offset in cluster = 0, data to read = 5 bytes
         // in this case, next cluster is not needed.
         if ((pstFileHandle->dwCurrentOffset % FILESYSTEM_CLUSTERSIZE) == 0) {
-            
-            // temporary solution for giving weired cluster index
-            kSleep(300);
             if (
-                kGetClusterLinkData(
-                    pstFileHandle->dwCurrentClusterIndex,
+                kGetClusterFromMap(
+                    pstFileHandle->pstClusterMap,
+                    pstFileHandle->dwCurrentOffset / FILESYSTEM_CLUSTERSIZE,
+                    &(pstFileHandle->dwPreviousClusterIndex),
                     &dwNextClusterIndex
                 ) == FALSE
             )
                 break;
-            
-            pstFileHandle->dwPreviousClusterIndex =
-                pstFileHandle->dwCurrentClusterIndex;
+
             pstFileHandle->dwCurrentClusterIndex = dwNextClusterIndex;
         }
     }
@@ -1093,6 +3456,19 @@ DWORD kWriteFile(
 
             pstFileHandle->dwCurrentClusterIndex = dwAllocatedClusterIndex;
 
+            // new cluster is the next one of the last mapped cluster when
+            // the map has followed the whole chain. Otherwise it is added
+            // when the chain is followed later
+            if (
+                pstFileHandle->pstClusterMap->dwMappedCount ==
+                (pstFileHandle->dwCurrentOffset / FILESYSTEM_CLUSTERSIZE)
+            ) {
+                kAddClusterToMap(
+                    pstFileHandle->pstClusterMap,
+                    dwAllocatedClusterIndex
+                );
+            }
+
             // Since 1 cluster is the smallest unit to write at a time,
             // clear temp buffer before writing.
             kMemSet(gs_vbTempBuffer, 0, sizeof(gs_vbTempBuffer));
@@ -1153,8 +3529,10 @@ DWORD kWriteFile(
         if (pstFileHandle->dwCurrentOffset % FILESYSTEM_CLUSTERSIZE == 0)
         {
             if (
-                kGetClusterLinkData(
-                    pstFileHandle->dwCurrentClusterIndex,
+                kGetClusterFromMap(
+                    pstFileHandle->pstClusterMap,
+                    pstFileHandle->dwCurrentOffset / FILESYSTEM_CLUSTERSIZE,
+                    &(pstFileHandle->dwPreviousClusterIndex),
                     &dwNextClusterIndex
                 ) == FALSE
             ) {
@@ -1163,9 +3541,6 @@ DWORD kWriteFile(
                 break;
             }
 
-            pstFileHandle->dwPreviousClusterIndex =
-                pstFileHandle->dwCurrentClusterIndex;
-            
             pstFileHandle->dwCurrentClusterIndex = dwNextClusterIndex;
         }
     }
@@ -1197,14 +3572,7 @@ DWORD kWriteFile(
 //    FILESYSTEM_SEEK_END: move pointer from the end of the file
 int kSeekFile(FILE *pstFile, int iOffset, int iOrigin) {
     DWORD dwRealOffset;
-
     DWORD dwClusterOffsetToMove;
-    DWORD dwCurrentClusterOffset;
-    DWORD dwLastClusterOffset;
-    DWORD dwMoveCount;
-
-    DWORD i;
-    DWORD dwStartClusterIndex;
     DWORD dwPreviousClusterIndex;
     DWORD dwCurrentClusterIndex;
     
@@ -1249,78 +3617,44 @@ int kSeekFile(FILE *pstFile, int iOffset, int iOrigin) {
     }
 
 
-    /* calculate cluster index to be moved */
-
-    dwLastClusterOffset = pstFileHandle->dwFileSize / FILESYSTEM_CLUSTERSIZE;
-    dwClusterOffsetToMove = dwRealOffset / FILESYSTEM_CLUSTERSIZE;
-    dwCurrentClusterIndex =
-        pstFileHandle->dwCurrentOffset / FILESYSTEM_CLUSTERSIZE;
+    /* find cluster of the offset with cluster map */
 
     // ex:
-    // <s>    <c>    <e>   <d>
+    // <s>    <d>    <e>   <r>
     //  |------|------|00000|
     // <s>: start cluster idx
-    // <c>: current cluster idx
     // <d>: dest cluster idx
     // <e>: end cluster idx
-    if (dwLastClusterOffset < dwClusterOffsetToMove) {
-        // Although <d> beyond <e>, set the dest cluster index to the <e>
-        // the code at the last section will fill 0s and go to <d> 
-        dwMoveCount = dwLastClusterOffset - dwCurrentClusterOffset;
-        dwStartClusterIndex = pstFileHandle->dwCurrentClusterIndex;
-    }
-    // ex:
-    // <s>    <c>    <d>   <e>
-    //  |------|------|-----|
-    else if (dwCurrentClusterOffset <= dwClusterOffsetToMove) {
-        dwMoveCount = dwClusterOffsetToMove - dwCurrentClusterOffset;
-        dwStartClusterIndex = pstFileHandle->dwCurrentClusterIndex;
-    }
-    // ex:
-    // <s>    <d>    <c>   <e>
-    //  |------|------|-----|
-    else {
-        dwMoveCount = dwClusterOffsetToMove;
-        dwStartClusterIndex = pstFileHandle->dwStartClusterIndex;
-    }
+    // <r>: real offset
+    // when <r> is beyond <e>, move to <e> and the code at the last section
+    // fills 0s and goes to <r>
+    dwClusterOffsetToMove =
+        MIN(dwRealOffset, pstFileHandle->dwFileSize) / FILESYSTEM_CLUSTERSIZE;
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
-
-    /* iterate and find the cluster to be moved */
-
-    dwCurrentClusterIndex = dwStartClusterIndex;
-    for (i = 0; i < dwMoveCount; i++) {
-        dwPreviousClusterIndex = dwCurrentClusterIndex;
-
-        if (
-            kGetClusterLinkData(
-                dwPreviousClusterIndex,
-                &dwCurrentClusterIndex
-            ) == FALSE
-        ) {
-            kUnlock(&(gs_stFileSystemManager.stMutex));
-            return -1;
-        }
-    }
-       
-    if (dwMoveCount > 0) {
-        pstFileHandle->dwPreviousClusterIndex = dwPreviousClusterIndex;
-        pstFileHandle->dwCurrentClusterIndex = dwCurrentClusterIndex;
-    }
-    else if (dwStartClusterIndex == pstFileHandle->dwStartClusterIndex) {
-        pstFileHandle->dwPreviousClusterIndex =
-            pstFileHandle->dwStartClusterIndex;
-        
-        pstFileHandle->dwCurrentClusterIndex = 
-            pstFileHandle->dwStartClusterIndex;
+    // clusters that were followed once are found in memory
+    if (
+        kGetClusterFromMap(
+            pstFileHandle->pstClusterMap,
+            dwClusterOffsetToMove,
+            &dwPreviousClusterIndex,
+            &dwCurrentClusterIndex
+        ) == FALSE
+    ) {
+        kUnlock(&(gs_stFileSystemManager.stMutex));
+        return -1;
     }
 
-    // when <d> is beyond <e>
-    if (dwLastClusterOffset < dwClusterOffsetToMove) {
+    pstFileHandle->dwPreviousClusterIndex = dwPreviousClusterIndex;
+    pstFileHandle->dwCurrentClusterIndex = dwCurrentClusterIndex;
+
+    // when <r> is beyond <e>
+    if (pstFileHandle->dwFileSize < dwRealOffset) {
         pstFileHandle->dwCurrentOffset = pstFileHandle->dwFileSize;
         kUnlock(&(gs_stFileSystemManager.stMutex));
 
+        // kWriteFile moves file pointer to <r>
         if (
             kWriteZero(
                 pstFile,
@@ -1328,6 +3662,8 @@ int kSeekFile(FILE *pstFile, int iOffset, int iOrigin) {
             ) == FALSE
         )
             return -1;
+
+        return 0;
     }
 
     pstFileHandle->dwCurrentOffset = dwRealOffset;
@@ -1346,55 +3682,224 @@ int kCloseFile(FILE *pstFile) {
     if (pstFile == NULL || pstFile->bType != FILESYSTEM_TYPE_FILE)
         return -1;
 
+    kLock(&(gs_stFileSystemManager.stMutex));
+
+    kReleaseClusterMap(pstFile->stFileHandle.pstClusterMap);
     kFreeFileDirectoryHandle(pstFile);
+
+    kUnlock(&(gs_stFileSystemManager.stMutex));
     return 0;
 }
 
 
-// Remove a file from root directory
+// write modified data of a file and its directory entry back to disk
+// params:
+//   pstFile: pointer to a opened file to flush
+// return:
+//   0 on success
+//   -1 on failure
+// note:
+//   dirty clusters are not kept per file, so modified data of other files
+//   is written together
+int kFlushFile(FILE *pstFile) {
+    BOOL bResult;
+
+    if (pstFile == NULL || pstFile->bType != FILESYSTEM_TYPE_FILE)
+        return -1;
+
+    kLock(&(gs_stFileSystemManager.stMutex));
+    bResult = kFlushDataCache();
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+
+    return (bResult == TRUE) ? 0 : -1;
+}
+
+
+// Remove a file from its directory
 // params:
-//   pcFileName: string of a file to delete
+//   pcFileName: path of a file to delete
 // return:
 //   0 on Success
 //   -1 on Failure
 // notes:
 //   this function does not wipe data of a file in the storage. Instead,
-//   unlink all clusters in the link area.
+//   unlink all clusters in the link area. directory is not removed
 int kRemoveFile(const char *pcFileName) {
     DIRECTORYENTRY stEntry;
-    int iDirectoryEntryOffset;
-    int iFileNameLength;
-
-    iFileNameLength = kStrLen(pcFileName);
-
-    if (iFileNameLength > (sizeof(stEntry.vcFileName) - 1))
-        return -1;
-    if (iFileNameLength == 0)
-        return -1;
+    DWORD dwDirectoryClusterIndex;
+    char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
-    iDirectoryEntryOffset = kFindDirectoryEntry(pcFileName, &stEntry);
-    
+    if (
+        kFindParentDirectory(
+            pcFileName,
+            &dwDirectoryClusterIndex,
+            vcFileName
+        ) == FALSE
+    )
+        goto ERROR;
+
     // file does not exists
-    if (iDirectoryEntryOffset == -1)
+    if (
+        kFindDirectoryEntry(
+            dwDirectoryClusterIndex,
+            vcFileName,
+            &stEntry
+        ) == FALSE
+    )
+        goto ERROR;
+
+    // directory is removed by kRemoveDirectory
+    if ((stEntry.dwAttribute & FILESYSTEM_ATTRIBUTE_DIRECTORY) != 0)
         goto ERROR;
 
     // file is opened
     if (kIsFileOpened(&stEntry))
         goto ERROR;
     
-    
+
+    /* remove the directory entry */
+
+    if (
+        kRemoveDirectoryEntry(dwDirectoryClusterIndex, vcFileName) == FALSE
+    )
+        goto ERROR;
+
+
     /* unlick all clusters that consists of the file */
 
     if (kFreeClusterUntilEnd(stEntry.dwStartClusterIndex) == FALSE)
         goto ERROR;
 
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+    return 0;
+
+ERROR:
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+    return -1;
+}
+
+
+// create a directory
+// params:
+//   pcDirectoryName: path of a directory to create
+// return:
+//   0 on success
+//   -1 on failure
+int kMakeDirectory(const char *pcDirectoryName) {
+    DIRECTORYENTRY stEntry;
+    DIRECTORYNODE *pstNode;
+    DWORD dwDirectoryClusterIndex;
+    DWORD dwClusterIndex;
+    char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
+
+    kLock(&(gs_stFileSystemManager.stMutex));
+
+    if (
+        kFindParentDirectory(
+            pcDirectoryName,
+            &dwDirectoryClusterIndex,
+            vcFileName
+        ) == FALSE
+    )
+        goto ERROR;
+
+    // file or directory of the name exists
+    if (
+        kFindDirectoryEntry(
+            dwDirectoryClusterIndex,
+            vcFileName,
+            &stEntry
+        ) == TRUE
+    )
+        goto ERROR;
+
+
+    /* create root node of the directory */
+
+    if (kAllocateDirectoryNode(&dwClusterIndex) == FALSE)
+        goto ERROR;
+
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    kInitializeDirectoryNode(pstNode, dwDirectoryClusterIndex);
+    if (kWriteDirectoryNode(dwClusterIndex, pstNode) == FALSE)
+        goto FREE_NODE;
+
 
-    /* set the directory entry to free entry */
+    /* add it to parent directory */
 
     kMemSet(&stEntry, 0, sizeof(stEntry));
-    if (kSetDirectoryEntryData(iDirectoryEntryOffset, &stEntry) == FALSE)
+    kMemCpy(stEntry.vcFileName, vcFileName, FILESYSTEM_MAXFILENAMELENGTH);
+    stEntry.dwStartClusterIndex = dwClusterIndex;
+    stEntry.dwAttribute = FILESYSTEM_ATTRIBUTE_DIRECTORY;
+
+    if (kAddDirectoryEntry(dwDirectoryClusterIndex, &stEntry) == FALSE)
+        goto FREE_NODE;
+
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+    return 0;
+
+FREE_NODE:
+    kSetClusterLinkData(dwClusterIndex, FILESYSTEM_FREECLUSTER);
+
+ERROR:
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+    return -1;
+}
+
+
+// remove an empty directory
+// params:
+//   pcDirectoryName: path of a directory to remove
+// return:
+//   0 on success
+//   -1 if it is not empty, it is opened or on failure
+int kRemoveDirectory(const char *pcDirectoryName) {
+    DIRECTORYENTRY stEntry;
+    DIRECTORYNODE *pstNode;
+    DWORD dwDirectoryClusterIndex;
+    char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
+
+    kLock(&(gs_stFileSystemManager.stMutex));
+
+    if (
+        kFindParentDirectory(
+            pcDirectoryName,
+            &dwDirectoryClusterIndex,
+            vcFileName
+        ) == FALSE
+    )
+        goto ERROR;
+
+    if (
+        kFindDirectoryEntry(
+            dwDirectoryClusterIndex,
+            vcFileName,
+            &stEntry
+        ) == FALSE
+    )
+        goto ERROR;
+
+    if ((stEntry.dwAttribute & FILESYSTEM_ATTRIBUTE_DIRECTORY) == 0)
+        goto ERROR;
+
+    // empty directory has only its root node
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
+    if (kReadDirectoryNode(stEntry.dwStartClusterIndex, pstNode) == FALSE)
+        goto ERROR;
+    if (pstNode->dwEntryCount != 0)
+        goto ERROR;
+
+    if (kIsFileOpened(&stEntry))
+        goto ERROR;
+
+    if (
+        kRemoveDirectoryEntry(dwDirectoryClusterIndex, vcFileName) == FALSE
+    )
+        goto ERROR;
+
+    if (kFreeDirectoryTree(stEntry.dwStartClusterIndex) == FALSE)
         goto ERROR;
 
     kUnlock(&(gs_stFileSystemManager.stMutex));
@@ -1408,16 +3913,13 @@ ERROR:
 
 // Open a directory named pcDirectoryName
 // params:
-//   pcDirectoryName: name of a directory to open
+//   pcDirectoryName: path of a directory to open. "/" is root directory
 // return:
 //   NULL on failure
 //   pointer to a directory handle on success
-// notes:
-//   In MINT64OS, only root directory is supported, so whatever directory name
-//   is given, root directory will be opened.
 DIR *kOpenDirectory(const char *pcDirectoryName) {
     DIR *pstDirectory;
-    DIRECTORYENTRY *pstDirectoryBuffer;
+    DWORD dwClusterIndex;
 
     kLock(&(gs_stFileSystemManager.stMutex));
 
@@ -1426,28 +3928,23 @@ DIR *kOpenDirectory(const char *pcDirectoryName) {
     if (pstDirectory == NULL)
         goto UNLOCK;
 
-    // buffer for root directory cluster
-    // remember that a cluster is allocated to a directory
-    pstDirectoryBuffer = 
-        (DIRECTORYENTRY *) kAllocateMemory(FILESYSTEM_CLUSTERSIZE);
-    if (pstDirectoryBuffer == NULL)
+    // entries are read from nodes of the directory when they are iterated
+    if (
+        kFindDirectory(
+            pcDirectoryName,
+            kStrLen(pcDirectoryName),
+            &dwClusterIndex
+        ) == FALSE
+    )
         goto FREE_HANDLE;
 
-    // read root directory cluster
-    if (kReadCluster(0, (BYTE *) pstDirectoryBuffer) == FALSE)
-        goto FREE_BUFFER;
-
-
     pstDirectory->bType = FILESYSTEM_TYPE_DIRECTORY;
+    pstDirectory->stDirectoryHandle.dwDirectoryClusterIndex = dwClusterIndex;
     pstDirectory->stDirectoryHandle.iCurrentOffset = 0;
-    pstDirectory->stDirectoryHandle.pstDirectoryBuffer = pstDirectoryBuffer;
 
     kUnlock(&(gs_stFileSystemManager.stMutex));
     return pstDirectory;
 
-FREE_BUFFER:
-    kFreeMemory(pstDirectoryBuffer);
-
 FREE_HANDLE:
     kFreeFileDirectoryHandle(pstDirectory);
 
@@ -1465,9 +3962,18 @@ UNLOCK:
 //   NULL on failure
 //   NULL if there is no more dir entry to iterate
 //   dir entry if there is dir entry to iterate
+// info:
+//   entries are returned in key order of directory B+tree, which is order
+//   of FNV-1a hash of name. it is not order of name, so caller sorts them if
+//   it needs sorted names. the order is the same while the directory is not
+//   changed. returned entry is valid until the next call
 DIRECTORYENTRY *kReadDirectory(DIR *pstDirectory) {
     DIRECTORYHANDLE *pstDirectoryHandle;
-    DIRECTORYENTRY *pstEntry;
+    DIRECTORYNODE *pstNode;
+    DIRECTORYPATH stPath;
+    char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
+    DWORD dwHash;
+    int iIndex;
 
     if (pstDirectory == NULL)
         return NULL;
@@ -1475,34 +3981,71 @@ DIRECTORYENTRY *kReadDirectory(DIR *pstDirectory) {
         return NULL;
 
     pstDirectoryHandle = &(pstDirectory->stDirectoryHandle);
-
-    if (pstDirectoryHandle->iCurrentOffset < 0)
-        return NULL;
-    if (pstDirectoryHandle->iCurrentOffset >= FILESYSTEM_MAXDIRECTORYENTRYCOUNT)
-        return NULL;
+    pstNode = (DIRECTORYNODE *) gs_vbDirectoryNodeBuffer;
 
     
     kLock(&(gs_stFileSystemManager.stMutex));
 
 
-    /* iterate cluster 0 to return the next directory entry */ 
-    
-    pstEntry = pstDirectoryHandle->pstDirectoryBuffer;
-    while (
-        pstDirectoryHandle->iCurrentOffset < FILESYSTEM_MAXDIRECTORYENTRYCOUNT
-    ) {
-        if (
-            pstEntry[pstDirectoryHandle->iCurrentOffset].dwStartClusterIndex !=
-            FILESYSTEM_FREECLUSTER
-        ) {
-            kUnlock(&(gs_stFileSystemManager.stMutex));
-            return (pstEntry + pstDirectoryHandle->iCurrentOffset++);
-        }
+    /* find the first key after the entry returned last */
+
+    // no key is smaller than hash 0 and empty name
+    kMemSet(vcFileName, 0, sizeof(vcFileName));
+    dwHash = 0;
+    if (pstDirectoryHandle->iCurrentOffset != 0) {
+        kMemCpy(
+            vcFileName,
+            pstDirectoryHandle->stEntry.vcFileName,
+            FILESYSTEM_MAXFILENAMELENGTH
+        );
+        dwHash = kHashFileName(vcFileName);
+    }
+
+    if (
+        kFindDirectoryLeaf(
+            pstDirectoryHandle->dwDirectoryClusterIndex,
+            dwHash,
+            pstNode,
+            &stPath
+        ) == FALSE
+    )
+        goto ERROR;
+
+    iIndex = kSearchDirectoryLeaf(pstNode, dwHash, vcFileName);
+    if (
+        (pstDirectoryHandle->iCurrentOffset != 0) &&
+        (iIndex < pstNode->wCount) &&
+        (kCompareDirectoryKey(dwHash, vcFileName, pstNode->vstEntry + iIndex)
+            == 0)
+    )
+        iIndex++;
+
+
+    /* follow leaf chain. leaves can be empty, because they are not merged */
+
+    while (iIndex >= pstNode->wCount) {
+        // end of directory entry
+        if (pstNode->dwNextClusterIndex == FILESYSTEM_LASTCLUSTER)
+            goto ERROR;
 
-        pstDirectoryHandle->iCurrentOffset++;
+        if (
+            kReadDirectoryNode(pstNode->dwNextClusterIndex, pstNode) == FALSE
+        )
+            goto ERROR;
+        iIndex = 0;
     }
 
-    // end of directory entry
+    kMemCpy(
+        &(pstDirectoryHandle->stEntry),
+        pstNode->vstEntry + iIndex,
+        sizeof(DIRECTORYENTRY)
+    );
+    pstDirectoryHandle->iCurrentOffset++;
+
+    kUnlock(&(gs_stFileSystemManager.stMutex));
+    return &(pstDirectoryHandle->stEntry);
+
+ERROR:
     kUnlock(&(gs_stFileSystemManager.stMutex));
     return NULL;
 }
@@ -1538,20 +4081,13 @@ void kRewindDirectory(DIR *pstDirectory) {
 //  0 on success
 // -1 on failure
 int kCloseDirectory(DIR *pstDirectory) {
-    DIRECTORYHANDLE *pstDirectoryHandle;
-
     if (pstDirectory == NULL)
         return -1;
     if (pstDirectory->bType != FILESYSTEM_TYPE_DIRECTORY)
         return -1;
 
-    pstDirectoryHandle = &(pstDirectory->stDirectoryHandle);
-
     kLock(&(gs_stFileSystemManager.stMutex));
 
-    // free buffer  for cluster 0 (root directory entries) 
-    kFreeMemory(pstDirectoryHandle->pstDirectoryBuffer);
-
     // free directory handle
     kFreeFileDirectoryHandle(pstDirectory);
 
@@ -1602,7 +4138,7 @@ ERROR:
 }
 
 
-// Check whether an entry (file) in directory is open or not
+// Check whether an entry (file or directory) in directory is open or not
 // params:
 //   pstEntry: entry of a directory to check
 // return:
@@ -1617,15 +4153,20 @@ BOOL kIsFileOpened(const DIRECTORYENTRY *pstEntry) {
 
     pstFile = gs_stFileSystemManager.pstHandlePool;
     for (i = 0; i < FILESYSTEM_HANDLE_MAXCOUNT; i++) {
-        if (pstFile[i].bType != FILESYSTEM_TYPE_FILE)
-            continue;
         if (
-            pstFile[i].stFileHandle.dwStartClusterIndex !=
-            pstEntry->dwStartClusterIndex
+            (pstFile[i].bType == FILESYSTEM_TYPE_FILE) &&
+            (pstFile[i].stFileHandle.dwStartClusterIndex ==
+                pstEntry->dwStartClusterIndex)
         )
-            continue;
+            return TRUE;
 
-        return TRUE;
+        // root node of directory is its start cluster
+        if (
+            (pstFile[i].bType == FILESYSTEM_TYPE_DIRECTORY) &&
+            (pstFile[i].stDirectoryHandle.dwDirectoryClusterIndex ==
+                pstEntry->dwStartClusterIndex)
+        )
+            return TRUE;
     }
     return FALSE;
 }
\ No newline at end of file
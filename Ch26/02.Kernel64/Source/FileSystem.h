@@ -5,6 +5,7 @@
 #include "Types.h"
 #include "Synchronization.h"
 #include "HardDisk.h"
+#include "BlockDevice.h"
 #include "Task.h"
 
 
@@ -14,6 +15,40 @@
 // This information is recorded in the MBR and this method is not standard. 
 #define FILESYSTEM_SIGNATURE                0x7E38CF10
 
+// signature of MINT file system formatted in lazy mode. cluster link
+// sectors from dwInitializedClusterLinkSectorCount of MBR are not zeroed
+// yet, and they are zeroed when they are written the first time. it is
+// changed to FILESYSTEM_SIGNATURE when every link sector is zeroed
+#define FILESYSTEM_LAZYSIGNATURE            0x7E38CF11
+
+// reserved area after MBR is used as metadata journal (unit: sector).
+// file system formatted without reserved area is used without journal
+//
+//   sector 0 of journal: JOURNALHEADER
+//   sector 1 ~ 2       : JOURNALDESCRIPTOR
+//   sector 3 ~         : metadata sectors, JOURNALCOMMIT
+//
+// each commit writes the transaction from sector 1 in one command, and the
+// commit sector after it completes. metadata is written to its place after
+// that, and the header gets the next sequence, so a transaction whose
+// sequence is the same as the header is replayed at mount
+#define FILESYSTEM_JOURNAL_SECTORCOUNT      128
+
+// number of metadata sectors that a transaction can have. it is limited by
+// LBAs that a descriptor has and by size of journal. link sectors and
+// clusters of directory nodes share them, and a commit is forced when they
+// are full
+#define FILESYSTEM_JOURNAL_MAXSECTORCOUNT   124
+
+// size of JOURNALDESCRIPTOR (unit: sector). LBAs are 64 bits, so 124 of
+// them do not fit in one sector
+#define FILESYSTEM_JOURNAL_DESCRIPTORSECTORCOUNT    2
+
+// signatures of journal sectors
+#define FILESYSTEM_JOURNAL_HEADERSIGNATURE      0x4A4E4C48  // JNLH
+#define FILESYSTEM_JOURNAL_DESCRIPTORSIGNATURE  0x4A4E4C44  // JNLD
+#define FILESYSTEM_JOURNAL_COMMITSIGNATURE      0x4A4E4C43  // JNLC
+
 // size of cluster (unit: sector)
 // A cluster is the smallest unit of a file system that can be written
 // to or read by a user. 
@@ -21,16 +56,29 @@
 
 #define FILESYSTEM_LASTCLUSTER              0xFFFFFFFF
 
+// cluster indices and links are DWORD, so sectors after this many clusters
+// of a large disk are not used
+#define FILESYSTEM_MAXCLUSTERCOUNT          0xFFFFFFF0
+
 // sign of free cluster
 #define FILESYSTEM_FREECLUSTER              0x00
 
-// Maximum number of entries in the root directory
-// MINT64OS have only one directory, root. this means that MINT Filesystem 
-// do not support directories in directories and can only save files in the
-// root directory.  
-#define FILESYSTEM_MAXDIRECTORYENTRYCOUNT   ( \
-    FILESYSTEM_SECTORSPERCLUSTER * 512 / sizeof(DIRECTORYENTRY) \
-)
+// block device that is mounted at initialization. primary slave drive
+#define FILESYSTEM_DEFAULTDEVICE            "hdb"
+
+// root directory starts from the first cluster of data area
+#define FILESYSTEM_ROOTDIRECTORYCLUSTER     0
+
+// a directory is a B+tree of nodes and each node is a cluster. nodes are
+// keyed on hash of file name, so lookup reads one node per level. leaf
+// node has up to 113 entries and internal node has up to 509 keys, so two
+// levels hold tens of thousands of entries
+#define FILESYSTEM_DIRECTORYNODESIGNATURE       0x444E4F44  // DNOD
+#define FILESYSTEM_DIRECTORYNODE_MAXENTRYCOUNT  113
+#define FILESYSTEM_DIRECTORYNODE_MAXINDEXCOUNT  509
+
+// levels of B+tree that a directory can have
+#define FILESYSTEM_DIRECTORYNODE_MAXDEPTH       6
 
 // size of cluster (unit: byte)
 #define FILESYSTEM_CLUSTERSIZE              ( \
@@ -40,9 +88,44 @@
 // Maximum length of file name: 24 characters
 #define FILESYSTEM_MAXFILENAMELENGTH        24
 
+// Maximum length of path. directories are separated by '/'
+#define FILESYSTEM_MAXPATHLENGTH            128
+
+// attributes of directory entry
+#define FILESYSTEM_ATTRIBUTE_DIRECTORY      0x01
+
 // Maximum number of dir and file handlers in a pool
 #define FILESYSTEM_HANDLE_MAXCOUNT          (TASK_MAXCOUNT * 3) 
 
+// Maximum number of cluster maps. handles of the same file share a map, so
+// there can not be more maps than handles
+#define FILESYSTEM_CLUSTERMAP_MAXCOUNT      FILESYSTEM_HANDLE_MAXCOUNT
+
+// number of clusters that a new cluster map can hold. 1KB is the smallest
+// block of dynamic memory. the map grows twice when it is full
+#define FILESYSTEM_CLUSTERMAP_DEFAULTCOUNT  256
+
+// number of clusters in file data cache (256KB). it holds clusters that
+// are read ahead until readers use them and clusters that are written
+// until flush task writes them back
+#define FILESYSTEM_DATACACHE_COUNT          64
+
+// readahead window of a sequential reader (unit: cluster). it starts from
+// the minimum and doubles for each cluster while the stream continues.
+// the maximum is half of data cache, so it holds two streams, and one
+// window can be merged into one command of HDD_MAXBULKSECTORCOUNT sectors
+#define FILESYSTEM_READAHEAD_MINWINDOW      2
+#define FILESYSTEM_READAHEAD_MAXWINDOW      ( \
+    HDD_MAXBULKSECTORCOUNT / FILESYSTEM_SECTORSPERCLUSTER \
+)
+
+// flush task writes dirty clusters back when the oldest one is older than
+// the expire time or when this many clusters are dirty. it checks them
+// every interval
+#define FILESYSTEM_DIRTYEXPIRETIME          1000    // ms
+#define FILESYSTEM_DIRTYHIGHCOUNT           (FILESYSTEM_DATACACHE_COUNT / 2)
+#define FILESYSTEM_FLUSHINTERVAL            500     // ms
+
 
 // types of handlers
 
@@ -66,7 +149,10 @@
 #define fwrite                              kWriteFile
 #define fseek                               kSeekFile
 #define fclose                              kCloseFile
+#define fflush                              kFlushFile
 #define remove                              kRemoveFile
+#define mkdir                               kMakeDirectory
+#define rmdir                               kRemoveDirectory
 #define opendir                             kOpenDirectory
 #define readdir                             kReadDirectory
 #define rewinddir                           kRewindDirectory
@@ -87,30 +173,6 @@
 #define d_name                              vcFileName
 
 
-// function pointer types related to hard disk control 
-typedef BOOL (* fReadHDDInformation) (
-    BOOL bPrimary,
-    BOOL bMaster,
-    HDDINFORMATION *pstHDDInformation
-);
-
-typedef int (* fReadHDDSector) (
-    BOOL bPrimary,
-    BOOL bMaster,
-    DWORD dwLBA,
-    int iSectorCount,
-    char *pcBuffer
-);
-
-typedef int (* fWriteHDDSector) (
-    BOOL bPrimary,
-    BOOL bMaster,
-    DWORD dwLBA,
-    int iSectorCount,
-    char *pcBuffer
-);
-
-
 // structures aligned by one byte 
 
 #pragma pack(push, 1)
@@ -143,8 +205,12 @@ typedef struct kPartitionStruct {
 typedef struct kMBRStruct {
     // The area where the bootloader code is located
     // According to MBR, 446 bytes are used as bootloader.
-    // However, in MINT64OS the last 16 bytes are used for MINT file system. 
-    BYTE vbBootCode[430];
+    // However, in MINT64OS the last 20 bytes are used for MINT file system. 
+    BYTE vbBootCode[426];
+
+    // number of sectors from the start of cluster link table that are
+    // zeroed. it is valid only with FILESYSTEM_LAZYSIGNATURE
+    DWORD dwInitializedClusterLinkSectorCount;
 
     // signature of Mint file system, 0x7E38CF10
     DWORD dwSignature;
@@ -169,23 +235,169 @@ typedef struct kMBRStruct {
 } MBR;
 
 
+// the first sector of journal
+typedef struct kJournalHeaderStruct {
+    DWORD dwSignature;
+
+    // sequence of the transaction to replay. older transactions are written
+    // to their places already
+    DWORD dwSequence;
+
+    BYTE vbReserved[504];
+} JOURNALHEADER;
+
+
+// sectors before metadata sectors of a transaction
+typedef struct kJournalDescriptorStruct {
+    DWORD dwSignature;
+    DWORD dwSequence;
+    DWORD dwSectorCount;
+    DWORD dwReserved;
+
+    // LBAs where metadata sectors after descriptor are written
+    QWORD vqwLBA[FILESYSTEM_JOURNAL_MAXSECTORCOUNT];
+
+    BYTE vbReserved[16];
+} JOURNALDESCRIPTOR;
+
+
+// sector after metadata sectors of a transaction. transaction is valid
+// only if this sector is written and the checksum matches
+typedef struct kJournalCommitStruct {
+    DWORD dwSignature;
+    DWORD dwSequence;
+    DWORD dwSectorCount;
+
+    // checksum of descriptor and metadata sectors
+    DWORD dwChecksum;
+
+    BYTE vbReserved[496];
+} JOURNALCOMMIT;
+
+
 // data structure for directory entries
 typedef struct kDirectoryEntryStruct {
-    // file name
+    // file name. bytes after the name are 0
     char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
 
     // actual size of the file 
     DWORD dwFileSize;
     
-    // the cluster index where the file begins
+    // the cluster index where the file begins. root node of B+tree if the
+    // entry is a directory
     DWORD dwStartClusterIndex;
+
+    // FILESYSTEM_ATTRIBUTE_XXX
+    DWORD dwAttribute;
 } DIRECTORYENTRY;
 
 
+// key of internal directory node and its child. the child has entries
+// whose hash is the same or larger than dwHash
+typedef struct kDirectoryIndexStruct {
+    DWORD dwHash;
+    DWORD dwClusterIndex;
+} DIRECTORYINDEX;
+
+
+// a node of directory B+tree. it is a cluster
+// leaf node has entries sorted by hash of name and then by name. entries
+// that have the same hash are kept in the same leaf, so internal node
+// needs only hash as key
+typedef struct kDirectoryNodeStruct {
+    DWORD dwSignature;
+
+    // 0 for leaf node
+    WORD wLevel;
+
+    // number of entries of leaf node or keys of internal node
+    WORD wCount;
+
+    // next leaf node in key order. FILESYSTEM_LASTCLUSTER for the last one
+    DWORD dwNextClusterIndex;
+
+    // valid only in root node. number of entries of the directory and root
+    // node of parent directory. root directory is its own parent
+    DWORD dwEntryCount;
+    DWORD dwParentClusterIndex;
+
+    union {
+        DIRECTORYENTRY vstEntry[FILESYSTEM_DIRECTORYNODE_MAXENTRYCOUNT];
+
+        // child that has entries smaller than the first key, and keys
+        struct {
+            DWORD dwFirstClusterIndex;
+            DIRECTORYINDEX vstIndex[FILESYSTEM_DIRECTORYNODE_MAXINDEXCOUNT];
+        };
+    };
+} DIRECTORYNODE;
+
+
+// nodes from root to leaf that lookup of a hash went through
+typedef struct kDirectoryPathStruct {
+    int iDepth;
+    DWORD vdwClusterIndex[FILESYSTEM_DIRECTORYNODE_MAXDEPTH];
+
+    // child of each internal node that the lookup took. 0 is the first
+    // child, and i is child of the (i - 1)-th key
+    int viChildIndex[FILESYSTEM_DIRECTORYNODE_MAXDEPTH];
+} DIRECTORYPATH;
+
+
+// logical to physical cluster map of an opened file
+// pdwClusterIndex[i] is cluster index of the i-th cluster of the file, so
+// seeking does not follow the cluster link table from the start.
+// It is filled while cluster links are followed the first time and shared
+// by all handles that opened the same directory entry
+typedef struct kClusterMapStruct {
+    // number of handles that use this map. 0 means free map
+    int iReferenceCount;
+
+    // the cluster index where the file starts. it does not change while
+    // the file exists, so it identifies the file
+    DWORD dwStartClusterIndex;
+
+    // clusters from offset 0 to (dwMappedCount - 1) are in the map
+    DWORD *pdwClusterIndex;
+    DWORD dwMappedCount;
+    DWORD dwMaxCount;
+} CLUSTERMAP;
+
+
+// a cluster of data area in file data cache
+typedef struct kDataCacheEntryStruct {
+    // index of cached cluster. FILESYSTEM_LASTCLUSTER if the entry is free
+    DWORD dwClusterIndex;
+
+    // value of access counter when the entry was used last. the entry that
+    // was used least recently is replaced
+    QWORD qwAccessTime;
+
+    // TRUE if readahead read the cluster and no one has read it yet
+    BOOL bReadAhead;
+
+    // TRUE if the cluster is modified and not written back yet
+    BOOL bDirty;
+
+    // TRUE if the cluster is a directory node. it is written after data
+    // clusters, and committed to journal if file system has journal
+    BOOL bMetadata;
+
+    // read or write back of the cluster. data is valid when the status is
+    // done, and the entry can not be replaced while it is pending
+    BLOCKREQUEST stRequest;
+
+    // FILESYSTEM_CLUSTERSIZE bytes of the cluster
+    BYTE *pbBuffer;
+} DATACACHEENTRY;
+
+
 // File handler structure that manages a file
 typedef struct kFileHandleStruct {
-    // Offset of the directory entry where the file exists
-    int iDirectoryEntryOffset;
+    // directory that has the file and name of the file. entries move
+    // between nodes of directory, so the entry is found by name
+    DWORD dwDirectoryClusterIndex;
+    char vcFileName[FILESYSTEM_MAXFILENAMELENGTH];
     // actual size of the file
     DWORD dwFileSize;
     // The cluster index where the file starts
@@ -198,17 +410,30 @@ typedef struct kFileHandleStruct {
     DWORD dwPreviousClusterIndex;
     // Current position of the file pointer
     DWORD dwCurrentOffset;
+
+    // cluster map shared with other handles of the same file
+    CLUSTERMAP *pstClusterMap;
+
+    // readahead state. cluster offset that the next sequential read uses,
+    // readahead window and cluster offset up to which clusters are read
+    // ahead. window is 0 while the file is read randomly
+    DWORD dwReadAheadNextOffset;
+    DWORD dwReadAheadWindow;
+    DWORD dwReadAheadEndOffset;
 } FILEHANDLE;
 
 
 // Directory handlerstructure that manages a directory
 typedef struct kDirectoryHandleStruct {
-    // buffer that contains root directory entries (cluster 0 of data area)
-    DIRECTORYENTRY *pstDirectoryBuffer;
-
+    // root node of the directory
+    DWORD dwDirectoryClusterIndex;
     
-    // Current position of the directory pointer
+    // number of entries returned. 0 means the first entry is next
     int iCurrentOffset;
+
+    // entry returned last. the next entry is the one after its key, so
+    // entries that are added or removed meanwhile do not break iteration
+    DIRECTORYENTRY stEntry;
 } DIRECTORYHANDLE;
 
 
@@ -230,6 +455,9 @@ typedef struct kFileSystemManagerStruct {
     // Check whether kernel can use file system
     BOOL bMounted;
 
+    // drive that has the file system
+    BLOCKDEVICE *pstBlockDevice;
+
     // Number of sectors and starting LBA address in each area
     DWORD dwReservedSectorCount;
     DWORD dwClusterLinkAreaStartAddress;
@@ -240,6 +468,11 @@ typedef struct kFileSystemManagerStruct {
     // total number of clusters in data area
     DWORD dwTotalClusterCount;
 
+    // link sectors from this offset are not zeroed on disk and they are read
+    // as free links. it is the same as dwClusterLinkAreaSize unless the file
+    // system is formatted in lazy mode
+    DWORD dwInitializedClusterLinkSectorCount;
+
     // sector offset of the cluster link table to which the last
     // cluster was allocated.
     // this variable is used to efficitiently write file to clusters
@@ -251,6 +484,56 @@ typedef struct kFileSystemManagerStruct {
     // file/directory handle pool
     FILE *pstHandlePool;
 
+    // cluster maps of opened files
+    CLUSTERMAP *pstClusterMapPool;
+
+    // link sector that is kept in memory, because links of 128 clusters are
+    // read from the same sector. FILESYSTEM_LASTCLUSTER if there is none
+    DWORD dwCachedClusterLinkSectorOffset;
+
+    // file data cache and access counter of its entries
+    DATACACHEENTRY *pstDataCache;
+    QWORD qwDataCacheAccessTime;
+
+    // statistics of file data cache and readahead
+    QWORD qwDataCacheHitCount;
+    QWORD qwDataCacheMissCount;
+    QWORD qwReadAheadCount;
+    QWORD qwReadAheadHitCount;
+    QWORD qwReadAheadWaitCount;
+
+    // number of dirty clusters in file data cache and tick count when the
+    // oldest one became dirty. flush task waits for iDirtyClusterCount
+    int iDirtyClusterCount;
+    int iDirtyMetadataClusterCount;
+    QWORD qwDirtyTickCount;
+
+    // statistics of write back
+    QWORD qwWriteBackCount;
+    QWORD qwFlushCount;
+
+    // TRUE if the file system has journal. then link sectors and directory
+    // nodes are kept in running transaction until they are committed
+    BOOL bJournal;
+
+    // sequence of the next commit
+    DWORD dwJournalSequence;
+
+    // link sectors that running transaction modified and their data
+    int iJournalLinkSectorCount;
+    DWORD vdwJournalLinkSectorOffset[FILESYSTEM_JOURNAL_MAXSECTORCOUNT];
+    BYTE *pbJournalLinkSectorBuffer;
+
+    // descriptor, metadata sectors and commit sector of a transaction
+    BYTE *pbJournalBuffer;
+
+    // statistics of journal. metadata updates are counted before they are
+    // grouped into commits
+    QWORD qwMetadataUpdateCount;
+    QWORD qwJournalCommitCount;
+    QWORD qwJournalSectorCount;
+    QWORD qwJournalReplayCount;
+
 } FILESYSTEMMANAGER;
 
 
@@ -261,10 +544,11 @@ typedef struct kFileSystemManagerStruct {
 // return:
 //   True on success, False on failure
 // info:
-//   This function initialize HDD disk controller before initializing filesystem
+//   HDD must be initialized before initializing filesystem, so the drive
+//   is registered as FILESYSTEM_DEFAULTDEVICE
 //   
 //   possible failures:
-//     when HDD initialization failed
+//     when FILESYSTEM_DEFAULTDEVICE does not exist
 //     when mounting filesystem failed  
 BOOL kInitializeFileSystem(void);
 
@@ -274,13 +558,31 @@ BOOL kInitializeFileSystem(void);
 // related to the file system and inserts it into file system data structure.
 // return:
 //   TRUE on success and FALSE on failure
-BOOL kFormat(void);
+BOOL kMount(void);
+
+
+// mount file system on a block device
+// params:
+//   pcDeviceName: name of block device. ex) hdb
+// return:
+//   TRUE on success and FALSE on failure
+// info:
+//   device is selected even if it has no file system, so it can be
+//   formatted. it fails if a file or directory is open
+BOOL kMountBlockDevice(const char *pcDeviceName);
 
 
 // Create a file system on HDD
+// params:
+//   bLazy: TRUE to write only the first link sector and root directory.
+//          other link sectors are zeroed when they are written first time
 // return:
 //   TRUE on success, FALSE on failure
-BOOL kMount(void);
+// info:
+//   areas are zeroed with HDD_MAXBULKSECTORCOUNT sectors per command, and
+//   the file system is mounted again after formatting. reserved area has
+//   an empty journal
+BOOL kFormat(BOOL bLazy);
 
 
 // Return information on the hard disk connected to the file system
@@ -291,6 +593,23 @@ BOOL kMount(void);
 BOOL kGetHDDInformation(HDDINFORMATION *pstInformation);
 
 
+// write modified data of every file and directories back to disk
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   data that was written before it returns is on disk when it succeeds
+BOOL kSync(void);
+
+
+// task that writes dirty clusters back to disk
+// info:
+//   it wakes up every FILESYSTEM_FLUSHINTERVAL ms, or right away when
+//   FILESYSTEM_DIRTYHIGHCOUNT clusters are dirty, and writes every dirty
+//   cluster if the oldest one is older than FILESYSTEM_DIRTYEXPIRETIME ms.
+//   running transaction of journal is committed at the same time
+void kFileSystemFlushTask(void);
+
+
 /* low level functions */
 
 
@@ -309,15 +628,114 @@ static BOOL kReadClusterLinkTable(DWORD dwOffset, BYTE *pbBuffer);
 //   pbBuffer: A pointer to a variable that will be written to link area
 // return:
 //   TRUE on success, FALSE on failure
+// info:
+//   link sectors before dwOffset that are not zeroed yet are zeroed first.
+//   with journal, the sector is kept in running transaction and written to
+//   its place when the transaction is committed
 static BOOL kWriteClusterLinkTable(DWORD dwOffset, BYTE *pbBuffer);
 
 
+// keep a modified link sector in running transaction
+// params:
+//   dwOffset: Offset of the sector in cluster link table
+//   pbBuffer: data of the sector
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   transaction is committed first if it has no room for the sector
+static BOOL kAddJournalLinkSector(DWORD dwOffset, BYTE *pbBuffer);
+
+
+// commit running transaction if it has no room for sectors
+// params:
+//   iSectorCount: number of metadata sectors that will be modified
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   an operation reserves sectors it may modify before it starts, so it is
+//   committed in one transaction
+static BOOL kReserveJournalSpace(int iSectorCount);
+
+
+// get number of metadata sectors in running transaction
+// return:
+//   link sectors and sectors of dirty directory nodes
+static int kGetJournalSectorCount(void);
+
+
+// find a link sector in running transaction
+// params:
+//   dwOffset: Offset of the sector in cluster link table
+// return:
+//   data of the sector. NULL if transaction does not have it
+static BYTE *kFindJournalLinkSector(DWORD dwOffset);
+
+
+// write running transaction to journal and then metadata to its place
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   data clusters must be written before, so committed metadata never
+//   points to data that is not on disk. transaction is kept if it fails
+static BOOL kCommitJournal(void);
+
+
+// write transaction in journal to its place if it is committed
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   it is called at mount. bJournal is set if the file system has journal
+static BOOL kReplayJournal(void);
+
+
+// write journal header that has the sequence of the next transaction
+// params:
+//   dwSequence: sequence to replay at mount
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kWriteJournalHeader(DWORD dwSequence);
+
+
+// calculate checksum of journal sectors
+// params:
+//   pbBuffer: sectors
+//   dwSectorCount: number of sectors
+// return:
+//   checksum
+static DWORD kCalculateJournalChecksum(
+    const BYTE *pbBuffer,
+    DWORD dwSectorCount
+);
+
+
+// write 0 to sectors with HDD_MAXBULKSECTORCOUNT sectors per command
+// params:
+//   dwLBA: first sector to write
+//   dwSectorCount: number of sectors to write
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kWriteZeroSector(DWORD dwLBA, DWORD dwSectorCount);
+
+
+// save the number of zeroed link sectors to MBR
+// params:
+//   dwSectorCount: number of link sectors that are zeroed
+// return:
+//   TRUE on success, FALSE on failure
+// info:
+//   MBR gets FILESYSTEM_SIGNATURE when every link sector is zeroed
+static BOOL kUpdateInitializedClusterLinkSectorCount(DWORD dwSectorCount);
+
+
 // Read one cluster to the offset of the data area
 // params:
 //   dwOffset: Offset to read from data area
 //   pbBuffer: A pointer to a variable that will hold the data
 // return:
 //   TRUE on success, and FALSE on failure
+// info:
+//   cluster is copied from file data cache. it is read from disk if it is
+//   not cached
 static BOOL kReadCluster(DWORD dwOffset, BYTE *pbBuffer);
 
 
@@ -327,9 +745,99 @@ static BOOL kReadCluster(DWORD dwOffset, BYTE *pbBuffer);
 //   pbBuffer: A pointer to a variable that will be written to data area
 // return:
 //   TRUE on success, and FALSE on failure
+// info:
+//   cluster is copied to file data cache and written back to disk later by
+//   flush task, kFlushFile or kSync
 static BOOL kWriteCluster(DWORD dwOffset, BYTE *pbBuffer);
 
 
+// get the first sector of a cluster
+// params:
+//   dwClusterIndex: index to a cluster in data area
+// return:
+//   LBA of the cluster in block device
+static QWORD kGetClusterLBA(DWORD dwClusterIndex);
+
+
+// forget every cluster in file data cache, cached link sector and running
+// transaction of journal
+// info:
+//   it waits for clusters that are being read ahead. dirty clusters and
+//   link sectors are dropped, so they must be flushed first if they are
+//   needed
+static void kInvalidateDataCache(void);
+
+
+// find a cluster in file data cache
+// params:
+//   dwClusterIndex: index to a cluster in data area
+// return:
+//   entry of the cluster. NULL if it is not cached
+static DATACACHEENTRY *kFindDataCacheEntry(DWORD dwClusterIndex);
+
+
+// get an entry of file data cache for a cluster
+// params:
+//   dwClusterIndex: index to a cluster in data area
+// return:
+//   free entry or the least recently used one. NULL if a dirty entry can
+//   not be written back
+// info:
+//   clean entries are replaced before dirty ones. A dirty entry is written
+//   back before it is replaced, and if every entry is being read ahead, it
+//   waits for one. returned entry has no data and its request is done.
+//   dirty directory node is not replaced when file system has journal
+static DATACACHEENTRY *kAllocateDataCacheEntry(DWORD dwClusterIndex);
+
+
+// get a cluster in file data cache
+// params:
+//   dwClusterIndex: index to a cluster in data area
+//   bRead: TRUE to read the cluster from disk if it is not cached. FALSE
+//          if caller overwrites whole cluster
+// return:
+//   entry of the cluster. NULL on failure
+// info:
+//   it waits if the cluster is being read ahead. entry is valid until the
+//   next file system function is called
+static DATACACHEENTRY *kGetCachedCluster(DWORD dwClusterIndex, BOOL bRead);
+
+
+// mark a cluster in file data cache as modified
+// params:
+//   pstEntry: entry of the cluster
+//   bMetadata: TRUE if the cluster is a directory node
+// info:
+//   flush task is woken up if too many clusters are dirty
+static void kMarkDataCacheEntryDirty(
+    DATACACHEENTRY *pstEntry,
+    BOOL bMetadata
+);
+
+
+// write every dirty cluster in file data cache back to disk
+// return:
+//   TRUE on success, FALSE if a cluster can not be written
+// info:
+//   data clusters are written first and directory nodes are written after
+//   they complete, so directory entry never has size of data that is not
+//   on disk. with journal, directory nodes and link sectors are committed
+//   together after data clusters
+static BOOL kFlushDataCache(void);
+
+
+// write dirty data clusters or directory nodes back to disk
+// params:
+//   bMetadata: TRUE to write directory nodes only. FALSE to write data
+//              clusters only
+// return:
+//   TRUE on success, FALSE if a cluster can not be written
+// info:
+//   clusters are submitted together, so block layer merges them.
+//   clusters that fail stay dirty
+static BOOL kWriteBackDataCache(BOOL bMetadata);
+
+
 // Search for an empty cluster in the Cluster Links table area
 // return:
 //   index to empty cluster in data area
@@ -354,44 +862,223 @@ static BOOL kSetClusterLinkData(DWORD dwClusterIndex, DWORD dwData);
 static BOOL kGetClusterLinkData(DWORD dwClusterIndex, DWORD *pdwData);
 
 
-// get idex to empty entry in root directory
+// calculate hash of file name. directory B+tree is keyed on it
+// params:
+//   pcFileName: file name
 // return:
-//   index to free entry in root directory
-//   -1 on failure
-static int kFindFreeDirectoryEntry(void);
+//   FNV-1a hash of the name
+static DWORD kHashFileName(const char *pcFileName);
 
 
-// write directory entry to index of root directory
+// compare a key with key of a directory entry
 // params:
-//   iIndex: Directory entry index to set in the root directory
-//   pstEntry: pointer containing data to write to straoge
+//   dwHash: hash of pcFileName
+//   pcFileName: file name. bytes after the name must be 0
+//   pstEntry: directory entry
+// return:
+//   negative if the key is smaller, 0 if it is the same, positive if it is
+//   larger. keys are ordered by hash and then by name
+static int kCompareDirectoryKey(
+    DWORD dwHash,
+    const char *pcFileName,
+    const DIRECTORYENTRY *pstEntry
+);
+
+
+// read a directory node
+// params:
+//   dwClusterIndex: cluster of the node
+//   pstNode: buffer to save the node
+// return:
+//   TRUE on success, FALSE if it can not be read or it is not a node
+static BOOL kReadDirectoryNode(DWORD dwClusterIndex, DIRECTORYNODE *pstNode);
+
+
+// write a directory node
+// params:
+//   dwClusterIndex: cluster of the node
+//   pstNode: node to write
 // return:
 //   TRUE on success, FALSE on failure
-static BOOL kSetDirectoryEntryData(int iIndex, DIRECTORYENTRY *pstEntry);
+// info:
+//   node is written to file data cache as metadata
+static BOOL kWriteDirectoryNode(
+    DWORD dwClusterIndex,
+    const DIRECTORYNODE *pstNode
+);
+
+
+// make an empty leaf node that is root of a directory
+// params:
+//   pstNode: buffer of the node
+//   dwParentClusterIndex: root node of parent directory
+static void kInitializeDirectoryNode(
+    DIRECTORYNODE *pstNode,
+    DWORD dwParentClusterIndex
+);
+
+
+// allocate a cluster for a directory node
+// params:
+//   pdwClusterIndex: allocated cluster
+// return:
+//   TRUE on success, FALSE if there is no free cluster
+static BOOL kAllocateDirectoryNode(DWORD *pdwClusterIndex);
 
 
-// read directory entry at index of root directory
+// find the leaf node that has a hash
 // params:
-//   iIndex: Directory entry index to read in the root directory
-//   pstEntry: pointer that will contain the data 
+//   dwDirectoryClusterIndex: root node of directory
+//   dwHash: hash to look up
+//   pstNode: buffer to save the leaf node
+//   pstPath: nodes from root to the leaf
 // return:
 //   TRUE on success, FALSE on failure
-static BOOL kGetDirectoryEntryData(int iIndex, DIRECTORYENTRY *pstEntry);
+static BOOL kFindDirectoryLeaf(
+    DWORD dwDirectoryClusterIndex,
+    DWORD dwHash,
+    DIRECTORYNODE *pstNode,
+    DIRECTORYPATH *pstPath
+);
 
 
-// find an entry in the root directory with a matching file name
+// find position of a key in a leaf node
 // params:
-//   pcFileName: filename to search
+//   pstNode: leaf node
+//   dwHash: hash of pcFileName
+//   pcFileName: file name. bytes after the name must be 0
+// return:
+//   index of the first entry that is not smaller than the key
+static int kSearchDirectoryLeaf(
+    const DIRECTORYNODE *pstNode,
+    DWORD dwHash,
+    const char *pcFileName
+);
+
+
+// split a node that has one more entry or key than it can have
+// params:
+//   pstNode: node to split. it keeps the left half
+//   pstRightNode: buffer that gets the right half
+//   pdwSeparatorHash: the smallest hash of the right half
+// return:
+//   TRUE on success, FALSE if every entry of leaf has the same hash
+// info:
+//   entries that have the same hash are kept in the same node
+static BOOL kSplitDirectoryNode(
+    DIRECTORYNODE *pstNode,
+    DIRECTORYNODE *pstRightNode,
+    DWORD *pdwSeparatorHash
+);
+
+
+// find an entry in a directory with a matching file name
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   pcFileName: filename to search. bytes after the name must be 0
 //   pstEntry: pointer to a variable that will contain the found entry
 // return:
-//   index of found entry in root directory
-//   or -1 on failure 
-static int kFindDirectoryEntry(
+//   TRUE if it is found, FALSE otherwise
+static BOOL kFindDirectoryEntry(
+    DWORD dwDirectoryClusterIndex,
     const char *pcFileName,
     DIRECTORYENTRY *pstEntry
 );
 
 
+// overwrite an entry in a directory that has the same name
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   pstEntry: entry to write
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kSetDirectoryEntryData(
+    DWORD dwDirectoryClusterIndex,
+    const DIRECTORYENTRY *pstEntry
+);
+
+
+// add an entry to a directory
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   pstEntry: entry to add
+// return:
+//   TRUE on success, FALSE if the name exists or on failure
+// info:
+//   full nodes are split up to root. root node stays in its cluster and
+//   its entries move to new children, so directory entry of parent
+//   directory is not changed
+static BOOL kAddDirectoryEntry(
+    DWORD dwDirectoryClusterIndex,
+    const DIRECTORYENTRY *pstEntry
+);
+
+
+// remove an entry from a directory
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   pcFileName: name of entry. bytes after the name must be 0
+// return:
+//   TRUE on success, FALSE if the name does not exist or on failure
+// info:
+//   nodes are not merged. every node except root is freed when the
+//   directory becomes empty
+static BOOL kRemoveDirectoryEntry(
+    DWORD dwDirectoryClusterIndex,
+    const char *pcFileName
+);
+
+
+// change number of entries in root node of a directory
+// params:
+//   dwDirectoryClusterIndex: root node of directory
+//   iDelta: number of entries added. negative if they are removed
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kUpdateDirectoryEntryCount(
+    DWORD dwDirectoryClusterIndex,
+    int iDelta
+);
+
+
+// free a node and every node under it
+// params:
+//   dwClusterIndex: cluster of the node
+// return:
+//   TRUE on success, FALSE on failure
+static BOOL kFreeDirectoryTree(DWORD dwClusterIndex);
+
+
+// find a directory by path
+// params:
+//   pcPath: path from root directory. "." and ".." can be used
+//   iLength: length of path
+//   pdwClusterIndex: root node of the directory
+// return:
+//   TRUE on success, FALSE if a directory of path does not exist
+static BOOL kFindDirectory(
+    const char *pcPath,
+    int iLength,
+    DWORD *pdwClusterIndex
+);
+
+
+// split a path into its directory and the last name
+// params:
+//   pcPath: path from root directory
+//   pdwDirectoryClusterIndex: root node of directory of the last name
+//   pcFileName: buffer of FILESYSTEM_MAXFILENAMELENGTH bytes that gets the
+//               last name. bytes after the name are 0
+// return:
+//   TRUE on success, FALSE if the directory does not exist or the name is
+//   not valid
+static BOOL kFindParentDirectory(
+    const char *pcPath,
+    DWORD *pdwDirectoryClusterIndex,
+    char *pcFileName
+);
+
+
 // copy global file manager to pstManager
 // params:
 //   pstManager: pointer to a variable that will contain global file manager
@@ -404,7 +1091,7 @@ void kGetFileSystemInformation(FILESYSTEMMANAGER *pstManager);
 
 // open a FILE handle
 // params:
-//   pcFileName: name of a file to open
+//   pcFileName: path of a file to open. ex) /dir/file
 //   pcMode: mode of the file to open
 //           r  : read only
 //           w  : write only
@@ -476,27 +1163,54 @@ int kSeekFile(FILE *pstFile, int iOffset, int iOrigin);
 int kCloseFile(FILE *pstFile);
 
 
-// Remove a file from root directory
+// write modified data of a file and its directory entry back to disk
 // params:
-//   pcFileName: string of a file to delete
+//   pstFile: pointer to a opened file to flush
+// return:
+//   0 on success
+//   -1 on failure
+// note:
+//   dirty clusters are not kept per file, so modified data of other files
+//   is written together
+int kFlushFile(FILE *pstFile);
+
+
+// Remove a file from its directory
+// params:
+//   pcFileName: path of a file to delete
 // return:
 //   0 on Success
 //   -1 on Failure
 // notes:
 //   this function does not wipe data of a file in the storage. Instead,
-//   unlink all clusters in the link area.
+//   unlink all clusters in the link area. directory is not removed
 int kRemoveFile(const char *pcFileName);
 
 
+// create a directory
+// params:
+//   pcDirectoryName: path of a directory to create
+// return:
+//   0 on success
+//   -1 on failure
+int kMakeDirectory(const char *pcDirectoryName);
+
+
+// remove an empty directory
+// params:
+//   pcDirectoryName: path of a directory to remove
+// return:
+//   0 on success
+//   -1 if it is not empty, it is opened or on failure
+int kRemoveDirectory(const char *pcDirectoryName);
+
+
 // Open a directory named pcDirectoryName
 // params:
-//   pcDirectoryName: name of a directory to open
+//   pcDirectoryName: path of a directory to open. "/" is root directory
 // return:
 //   NULL on failure
 //   pointer to a directory handle on success
-// notes:
-//   In MINT64OS, only root directory is supported, so whatever directory name
-//   is given, root directory will be opened.
 DIR *kOpenDirectory(const char *pcDirectoryName);
 
 
@@ -507,6 +1221,11 @@ DIR *kOpenDirectory(const char *pcDirectoryName);
 //   NULL on failure
 //   NULL if there is no more dir entry to iterate
 //   dir entry if there is dir entry to iterate
+// info:
+//   entries are returned in key order of directory B+tree, which is order
+//   of FNV-1a hash of name. it is not order of name, so caller sorts them if
+//   it needs sorted names. the order is the same while the directory is not
+//   changed. returned entry is valid until the next call
 DIRECTORYENTRY *kReadDirectory(DIR *pstDirectory);
 
 
@@ -540,7 +1259,7 @@ int kCloseDirectory(DIR *pstDirectory);
 BOOL kWriteZero(FILE *pstFile, DWORD dwCount);
 
 
-// Check whether an entry (file) in directory is open or not
+// Check whether an entry (file or directory) in directory is open or not
 // params:
 //   pstEntry: entry of a directory to check
 // return:
@@ -565,18 +1284,18 @@ static void *kAllocateFileDirectoryHandle();
 static void kFreeFileDirectoryHandle(FILE *pstFile);
 
 
-// create a file and fill it to root directory entry.
+// create a file and add its entry to a directory
 // params:
-//   pcFileName: name of a file to create
+//   dwDirectoryClusterIndex: root node of directory
+//   pcFileName: name of a file to create. bytes after the name must be 0
 //   pstEntry: pointer to a directory entry that will have the file info
-//   piDirectoryEntryIndex: index of the entry in the root directory
 // return:
 //   TRUE on success
 //   FALSE on failure
 static BOOL kCreateFile(
+    DWORD dwDirectoryClusterIndex,
     const char *pcFileName,
-    DIRECTORYENTRY *pstEntry,
-    int *piDirectoryEntryIndex
+    DIRECTORYENTRY *pstEntry
 );
 
 
@@ -589,6 +1308,65 @@ static BOOL kCreateFile(
 static BOOL kFreeClusterUntilEnd(DWORD dwClusterIndex);
 
 
+// get cluster map of a file. the map is created if no handle opened the
+// file
+// params:
+//   dwStartClusterIndex: the cluster index where the file starts
+// return:
+//   cluster map on success
+//   NULL on failure
+static CLUSTERMAP *kGetClusterMap(DWORD dwStartClusterIndex);
+
+
+// release cluster map that a handle used. the map is freed when no handle
+// uses it
+// params:
+//   pstClusterMap: cluster map to release
+static void kReleaseClusterMap(CLUSTERMAP *pstClusterMap);
+
+
+// forget clusters after the first cluster of a file whose clusters are
+// freed
+// params:
+//   dwStartClusterIndex: the cluster index where the file starts
+// note:
+//   nothing happens if no handle opened the file
+static void kTruncateClusterMap(DWORD dwStartClusterIndex);
+
+
+// add a cluster to the end of cluster map
+// params:
+//   pstClusterMap: cluster map
+//   dwClusterIndex: index of the next cluster of the last mapped cluster
+// return:
+//   TRUE on success
+//   FALSE if memory for the map can not be allocated
+static BOOL kAddClusterToMap(CLUSTERMAP *pstClusterMap, DWORD dwClusterIndex);
+
+
+// find cluster at a cluster offset of a file
+// params:
+//   pstClusterMap: cluster map of the file
+//   dwClusterOffset: offset of cluster in the file (byte offset / cluster
+//                    size)
+//   pdwPreviousClusterIndex: cluster before the found cluster. it is the
+//                            start cluster when dwClusterOffset is 0
+//   pdwClusterIndex: found cluster. FILESYSTEM_LASTCLUSTER if the chain ends
+//                    right before dwClusterOffset
+// return:
+//   TRUE on success
+//   FALSE on failure
+// note:
+//   clusters in the map are found in memory. Otherwise links are followed
+//   from the last mapped cluster and added to the map
+static BOOL kGetClusterFromMap(
+    CLUSTERMAP *pstClusterMap,
+    DWORD dwClusterOffset,
+    DWORD *pdwPreviousClusterIndex,
+    DWORD *pdwClusterIndex
+);
+
+
 // flush meta data in FILE handle in memory to directory entry in storage
 // params:
 //   pstFileHandle: file handle
@@ -597,4 +1375,14 @@ static BOOL kFreeClusterUntilEnd(DWORD dwClusterIndex);
 //   FALSE on failure 
 static BOOL kUpdateDirectoryEntry(FILEHANDLE *pstFileHandle);
 
+
+// detect sequential read of a file and read clusters ahead of it
+// params:
+//   pstFileHandle: file handle to read
+//   dwClusterOffset: cluster offset in the file that is read now
+// info:
+//   clusters are read asynchronously into file data cache. they are read
+//   in batches of half window, so block layer merges them
+static void kReadAhead(FILEHANDLE *pstFileHandle, DWORD dwClusterOffset);
+
 #endif /* __FILESYSTEM_H__ */
\ No newline at end of file
@@ -0,0 +1,625 @@
+#include "Graphics.h"
+#include "VBE.h"
+#include "Page.h"
+#include "PageFrame.h"
+#include "Console.h"
+#include "Synchronization.h"
+#include "Utility.h"
+#include "AssemblyUtility.h"
+
+static GRAPHICSMANAGER gs_stGraphicsManager;
+
+
+/* rectangle related functions */
+
+// set coordinates of rectangle. points are sorted
+// params:
+//   pstRect: rectangle to set
+//   iX1, iY1: a point
+//   iX2, iY2: the other point
+void kSetRect(RECT *pstRect, int iX1, int iY1, int iX2, int iY2) {
+    pstRect->iX1 = MIN(iX1, iX2);
+    pstRect->iX2 = MAX(iX1, iX2);
+    pstRect->iY1 = MIN(iY1, iY2);
+    pstRect->iY2 = MAX(iY1, iY2);
+}
+
+
+// check whether two rectangles are overlapped
+// params:
+//   pstRect1, pstRect2: rectangles to check
+// return:
+//   True if they are overlapped. Otherwise False
+BOOL kIsRectOverlapped(const RECT *pstRect1, const RECT *pstRect2) {
+    if ((pstRect1->iX1 > pstRect2->iX2) || (pstRect1->iX2 < pstRect2->iX1) ||
+        (pstRect1->iY1 > pstRect2->iY2) || (pstRect1->iY2 < pstRect2->iY1)) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+// get area where two rectangles are overlapped
+// params:
+//   pstRect1, pstRect2: rectangles
+//   pstIntersection: rectangle to save overlapped area
+// return:
+//   True if they are overlapped. Otherwise False
+BOOL kGetOverlappedRect(
+    const RECT *pstRect1,
+    const RECT *pstRect2,
+    RECT *pstIntersection
+) {
+    if (kIsRectOverlapped(pstRect1, pstRect2) == FALSE) {
+        return FALSE;
+    }
+
+    pstIntersection->iX1 = MAX(pstRect1->iX1, pstRect2->iX1);
+    pstIntersection->iY1 = MAX(pstRect1->iY1, pstRect2->iY1);
+    pstIntersection->iX2 = MIN(pstRect1->iX2, pstRect2->iX2);
+    pstIntersection->iY2 = MIN(pstRect1->iY2, pstRect2->iY2);
+    return TRUE;
+}
+
+
+// get the smallest rectangle that has both rectangles
+// params:
+//   pstRect1, pstRect2: rectangles
+//   pstUnion: rectangle to save result
+void kGetUnionRect(const RECT *pstRect1, const RECT *pstRect2, RECT *pstUnion) {
+    pstUnion->iX1 = MIN(pstRect1->iX1, pstRect2->iX1);
+    pstUnion->iY1 = MIN(pstRect1->iY1, pstRect2->iY1);
+    pstUnion->iX2 = MAX(pstRect1->iX2, pstRect2->iX2);
+    pstUnion->iY2 = MAX(pstRect1->iY2, pstRect2->iY2);
+}
+
+
+// add a rectangle to a list of rectangles that will be redrawn
+// params:
+//   pstList: array of rectangles
+//   piCount: number of rectangles in the list. it is updated
+//   iMaxCount: size of array
+//   pstRect: rectangle to add
+// info:
+//   rectangle is merged with the first rectangle that it overlaps, so the
+//   overlapped area is not drawn twice. when the list is full, every
+//   rectangle becomes one
+void kAddRectToList(
+    RECT *pstList,
+    int *piCount,
+    int iMaxCount,
+    const RECT *pstRect
+) {
+    int i;
+
+    for (i = 0; i < *piCount; i++) {
+        if (kIsRectOverlapped(&(pstList[i]), pstRect) == TRUE) {
+            kGetUnionRect(&(pstList[i]), pstRect, &(pstList[i]));
+            return;
+        }
+    }
+
+    if (*piCount < iMaxCount) {
+        pstList[(*piCount)++] = *pstRect;
+        return;
+    }
+
+    for (i = 1; i < *piCount; i++) {
+        kGetUnionRect(&(pstList[0]), &(pstList[i]), &(pstList[0]));
+    }
+    kGetUnionRect(&(pstList[0]), pstRect, &(pstList[0]));
+    *piCount = 1;
+}
+
+
+/* drawing functions. all of them clip to buffer */
+
+// draw a pixel
+// params:
+//   pstBuffer: buffer to draw on
+//   iX, iY: location of pixel
+//   stColor: color of pixel
+void kDrawPixel(const GRAPHICSBUFFER *pstBuffer, int iX, int iY, COLOR stColor) {
+    if ((iX < 0) || (iX >= pstBuffer->iWidth) ||
+        (iY < 0) || (iY >= pstBuffer->iHeight)) {
+        return;
+    }
+    pstBuffer->pstBuffer[iY * pstBuffer->iWidth + iX] = stColor;
+}
+
+
+// draw a line with Bresenham's algorithm
+// params:
+//   pstBuffer: buffer to draw on
+//   iX1, iY1: start point
+//   iX2, iY2: end point
+//   stColor: color of line
+void kDrawLine(
+    const GRAPHICSBUFFER *pstBuffer,
+    int iX1,
+    int iY1,
+    int iX2,
+    int iY2,
+    COLOR stColor
+) {
+    int iDeltaX, iDeltaY;
+    int iStepX, iStepY;
+    int iError, iError2;
+
+    // horizontal line is the most common, so it is filled at once
+    if (iY1 == iY2) {
+        kDrawRect(pstBuffer, iX1, iY1, iX2, iY2, stColor, TRUE);
+        return;
+    }
+
+    iDeltaX = ABS(iX2 - iX1);
+    iDeltaY = -ABS(iY2 - iY1);
+    iStepX = (iX1 < iX2) ? 1 : -1;
+    iStepY = (iY1 < iY2) ? 1 : -1;
+
+    // error is (distance to the ideal line) * iDeltaX * iDeltaY
+    iError = iDeltaX + iDeltaY;
+    while (TRUE) {
+        kDrawPixel(pstBuffer, iX1, iY1, stColor);
+        if ((iX1 == iX2) && (iY1 == iY2)) {
+            break;
+        }
+
+        iError2 = iError * 2;
+        if (iError2 >= iDeltaY) {
+            iError += iDeltaY;
+            iX1 += iStepX;
+        }
+        if (iError2 <= iDeltaX) {
+            iError += iDeltaX;
+            iY1 += iStepY;
+        }
+    }
+}
+
+
+// draw a rectangle
+// params:
+//   pstBuffer: buffer to draw on
+//   iX1, iY1: a corner
+//   iX2, iY2: the opposite corner
+//   stColor: color of rectangle
+//   bFill: True to fill inside. Otherwise only border is drawn
+void kDrawRect(
+    const GRAPHICSBUFFER *pstBuffer,
+    int iX1,
+    int iY1,
+    int iX2,
+    int iY2,
+    COLOR stColor,
+    BOOL bFill
+) {
+    RECT stRect;
+    RECT stBufferArea;
+    RECT stDrawArea;
+
+    if (bFill == FALSE) {
+        kDrawRect(pstBuffer, iX1, iY1, iX2, iY1, stColor, TRUE);
+        kDrawRect(pstBuffer, iX1, iY2, iX2, iY2, stColor, TRUE);
+        kDrawRect(pstBuffer, iX1, iY1, iX1, iY2, stColor, TRUE);
+        kDrawRect(pstBuffer, iX2, iY1, iX2, iY2, stColor, TRUE);
+        return;
+    }
+
+    kSetRect(&stRect, iX1, iY1, iX2, iY2);
+    kSetRect(
+        &stBufferArea,
+        0,
+        0,
+        pstBuffer->iWidth - 1,
+        pstBuffer->iHeight - 1
+    );
+    if (kGetOverlappedRect(&stRect, &stBufferArea, &stDrawArea) == FALSE) {
+        return;
+    }
+
+    for (int iY = stDrawArea.iY1; iY <= stDrawArea.iY2; iY++) {
+        kFillColor(
+            pstBuffer->pstBuffer + iY * pstBuffer->iWidth + stDrawArea.iX1,
+            stColor,
+            stDrawArea.iX2 - stDrawArea.iX1 + 1
+        );
+    }
+}
+
+
+// draw text with 8x16 font of VGA BIOS
+// params:
+//   pstBuffer: buffer to draw on
+//   iX, iY: top left of the first character
+//   stTextColor: color of text
+//   stBackgroundColor: color of background
+//   pcString: text to draw
+//   iLength: number of characters to draw
+void kDrawText(
+    const GRAPHICSBUFFER *pstBuffer,
+    int iX,
+    int iY,
+    COLOR stTextColor,
+    COLOR stBackgroundColor,
+    const char *pcString,
+    int iLength
+) {
+    const BYTE *pbGlyph;
+    COLOR *pstLine;
+    int iCharacterX;
+    int iStartX, iEndX;
+    BYTE bBitmap;
+
+    for (int i = 0; i < iLength; i++) {
+        iCharacterX = iX + i * VBE_FONTWIDTH;
+        if ((iCharacterX >= pstBuffer->iWidth) ||
+            (iCharacterX + VBE_FONTWIDTH <= 0)) {
+            continue;
+        }
+
+        // columns of the character which are in buffer
+        iStartX = MAX(0, -iCharacterX);
+        iEndX = MIN(VBE_FONTWIDTH, pstBuffer->iWidth - iCharacterX);
+
+        pbGlyph = gs_stGraphicsManager.vbFont +
+            (BYTE) pcString[i] * VBE_FONTHEIGHT;
+        for (int j = 0; j < VBE_FONTHEIGHT; j++) {
+            if ((iY + j < 0) || (iY + j >= pstBuffer->iHeight)) {
+                continue;
+            }
+
+            // the most significant bit is the leftmost pixel
+            pstLine = pstBuffer->pstBuffer +
+                (iY + j) * pstBuffer->iWidth + iCharacterX;
+            bBitmap = pbGlyph[j];
+            for (int k = iStartX; k < iEndX; k++) {
+                if (bBitmap & (0x80 >> k)) {
+                    pstLine[k] = stTextColor;
+                }
+                else {
+                    pstLine[k] = stBackgroundColor;
+                }
+            }
+        }
+    }
+}
+
+
+// copy a buffer to another buffer
+// params:
+//   pstDestination: buffer to draw on
+//   iX, iY: location in pstDestination where top left of pstSource goes
+//   pstSource: buffer to copy
+void kBlitBuffer(
+    const GRAPHICSBUFFER *pstDestination,
+    int iX,
+    int iY,
+    const GRAPHICSBUFFER *pstSource
+) {
+    RECT stSourceArea;
+
+    kSetRect(
+        &stSourceArea,
+        0,
+        0,
+        pstSource->iWidth - 1,
+        pstSource->iHeight - 1
+    );
+    kBlitBufferArea(pstDestination, iX, iY, pstSource, &stSourceArea);
+}
+
+
+// copy an area of a buffer to another buffer
+// params:
+//   pstDestination: buffer to draw on
+//   iX, iY: location in pstDestination where top left of the area goes
+//   pstSource: buffer to copy
+//   pstSourceArea: area of pstSource to copy
+void kBlitBufferArea(
+    const GRAPHICSBUFFER *pstDestination,
+    int iX,
+    int iY,
+    const GRAPHICSBUFFER *pstSource,
+    const RECT *pstSourceArea
+) {
+    RECT stSourceArea;
+    RECT stDestinationArea;
+    RECT stDrawArea;
+    int iOffsetX, iOffsetY;
+
+    // clip the area to source first, and then to destination
+    kSetRect(
+        &stSourceArea,
+        0,
+        0,
+        pstSource->iWidth - 1,
+        pstSource->iHeight - 1
+    );
+    if (kGetOverlappedRect(pstSourceArea, &stSourceArea, &stSourceArea)
+            == FALSE) {
+        return;
+    }
+
+    // offset from source to destination
+    iOffsetX = iX - pstSourceArea->iX1;
+    iOffsetY = iY - pstSourceArea->iY1;
+    stSourceArea.iX1 += iOffsetX;
+    stSourceArea.iY1 += iOffsetY;
+    stSourceArea.iX2 += iOffsetX;
+    stSourceArea.iY2 += iOffsetY;
+
+    kSetRect(
+        &stDestinationArea,
+        0,
+        0,
+        pstDestination->iWidth - 1,
+        pstDestination->iHeight - 1
+    );
+    if (kGetOverlappedRect(&stSourceArea, &stDestinationArea, &stDrawArea)
+            == FALSE) {
+        return;
+    }
+
+    for (int j = stDrawArea.iY1; j <= stDrawArea.iY2; j++) {
+        kCopyColor(
+            pstDestination->pstBuffer + j * pstDestination->iWidth +
+                stDrawArea.iX1,
+            pstSource->pstBuffer + (j - iOffsetY) * pstSource->iWidth +
+                (stDrawArea.iX1 - iOffsetX),
+            stDrawArea.iX2 - stDrawArea.iX1 + 1
+        );
+    }
+}
+
+
+/* screen related functions */
+
+// map frame buffer as write-combining memory and allocate back buffer
+// return:
+//   True on success. Otherwise False
+// info:
+//   page frame allocator and page table manager must be initialized
+BOOL kInitializeGraphics(void) {
+    VBEMODEINFOBLOCK *pstModeInfo;
+    QWORD qwFrameBufferSize;
+    QWORD qwBackBufferSize;
+    void *pvBackBuffer;
+    const BYTE *pbFont;
+    RECT stScreenArea;
+
+    kMemSet(&gs_stGraphicsManager, 0, sizeof(gs_stGraphicsManager));
+
+    pstModeInfo = kGetVBEModeInfoBlock();
+    if ((kIsGraphicMode() == FALSE) ||
+        (pstModeInfo->bBitsPerPixel != GRAPHICS_BITSPERPIXEL)) {
+        return FALSE;
+    }
+
+    // VBE 3.0 has separate value for linear frame buffer
+    if (pstModeInfo->wLinearBytesPerScanLine != 0) {
+        gs_stGraphicsManager.iBytesPerScanLine =
+            pstModeInfo->wLinearBytesPerScanLine;
+    }
+    else {
+        gs_stGraphicsManager.iBytesPerScanLine = pstModeInfo->wBytesPerScanLine;
+    }
+    gs_stGraphicsManager.pbFrameBuffer =
+        (BYTE *) (QWORD) pstModeInfo->dwPhysicalBasePointer;
+
+
+    /* map frame buffer as write-combining memory */
+
+    qwFrameBufferSize = (QWORD) gs_stGraphicsManager.iBytesPerScanLine *
+        pstModeInfo->wYResolution;
+    qwFrameBufferSize = (qwFrameBufferSize + PAGE_SMALLSIZE - 1) &
+        ~(QWORD) (PAGE_SMALLSIZE - 1);
+    if (kSetPageAttribute(
+            (QWORD) gs_stGraphicsManager.pbFrameBuffer,
+            qwFrameBufferSize,
+            PAGE_FLAGS_RW | PAGE_FLAGS_WC) == FALSE) {
+        return FALSE;
+    }
+
+
+    /* allocate back buffer */
+
+    qwBackBufferSize = (QWORD) pstModeInfo->wXResolution *
+        pstModeInfo->wYResolution * sizeof(COLOR);
+    pvBackBuffer = kAllocatePageFrameRun(
+        (qwBackBufferSize + PAGEFRAME_SIZE - 1) / PAGEFRAME_SIZE,
+        PAGEFRAME_ZONE_NORMAL
+    );
+    if (pvBackBuffer == NULL) {
+        return FALSE;
+    }
+    kMemSet(pvBackBuffer, 0, qwBackBufferSize);
+
+    gs_stGraphicsManager.stBackBuffer.pstBuffer = (COLOR *) pvBackBuffer;
+    gs_stGraphicsManager.stBackBuffer.iWidth = pstModeInfo->wXResolution;
+    gs_stGraphicsManager.stBackBuffer.iHeight = pstModeInfo->wYResolution;
+
+
+    /* copy font from VGA BIOS */
+
+    pbFont = kGetVGAFont();
+    kMemCpy(
+        gs_stGraphicsManager.vbFont,
+        pbFont,
+        VBE_FONTCHARACTERCOUNT * VBE_FONTHEIGHT
+    );
+
+    gs_stGraphicsManager.bInitialized = TRUE;
+
+    // clear whole screen at the first frame
+    kSetRect(
+        &stScreenArea,
+        0,
+        0,
+        pstModeInfo->wXResolution - 1,
+        pstModeInfo->wYResolution - 1
+    );
+    kAddDirtyRect(&stScreenArea);
+    return TRUE;
+}
+
+
+// get back buffer of screen
+// return:
+//   back buffer. changes are shown after they are added as dirty rectangle
+const GRAPHICSBUFFER *kGetScreenBuffer(void) {
+    return &(gs_stGraphicsManager.stBackBuffer);
+}
+
+
+// add an area of back buffer that should be copied to frame buffer
+// params:
+//   pstRect: changed area. it is clipped to screen
+void kAddDirtyRect(const RECT *pstRect) {
+    RECT stScreenArea;
+    RECT stDirtyRect;
+    BOOL bPreviousFlag;
+
+    if (gs_stGraphicsManager.bInitialized == FALSE) {
+        return;
+    }
+
+    kSetRect(
+        &stScreenArea,
+        0,
+        0,
+        gs_stGraphicsManager.stBackBuffer.iWidth - 1,
+        gs_stGraphicsManager.stBackBuffer.iHeight - 1
+    );
+    if (kGetOverlappedRect(pstRect, &stScreenArea, &stDirtyRect) == FALSE) {
+        return;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+    kAddRectToList(
+        gs_stGraphicsManager.vstDirtyRect,
+        &(gs_stGraphicsManager.iDirtyRectCount),
+        GRAPHICS_MAXDIRTYRECTCOUNT,
+        &stDirtyRect
+    );
+    kUnlockForSystemData(bPreviousFlag);
+}
+
+
+// copy dirty rectangles of back buffer to frame buffer
+// info:
+//   it uses SSE registers, so it must not be called by interrupt handler
+void kFlushFrameBuffer(void) {
+    RECT vstDirtyRect[GRAPHICS_MAXDIRTYRECTCOUNT];
+    int iDirtyRectCount;
+    const GRAPHICSBUFFER *pstBackBuffer;
+    RECT *pstRect;
+    int iWidth;
+    BOOL bPreviousFlag;
+
+    if (gs_stGraphicsManager.bInitialized == FALSE) {
+        return;
+    }
+
+    // take the list, so drawing can go on while copying
+    bPreviousFlag = kLockForSystemData();
+    iDirtyRectCount = gs_stGraphicsManager.iDirtyRectCount;
+    kMemCpy(vstDirtyRect, gs_stGraphicsManager.vstDirtyRect,
+            iDirtyRectCount * sizeof(RECT));
+    gs_stGraphicsManager.iDirtyRectCount = 0;
+    kUnlockForSystemData(bPreviousFlag);
+
+    if (iDirtyRectCount == 0) {
+        return;
+    }
+
+    pstBackBuffer = &(gs_stGraphicsManager.stBackBuffer);
+    for (int i = 0; i < iDirtyRectCount; i++) {
+        pstRect = &(vstDirtyRect[i]);
+        iWidth = pstRect->iX2 - pstRect->iX1 + 1;
+
+        for (int iY = pstRect->iY1; iY <= pstRect->iY2; iY++) {
+            kCopyColor(
+                gs_stGraphicsManager.pbFrameBuffer +
+                    iY * gs_stGraphicsManager.iBytesPerScanLine +
+                    pstRect->iX1 * sizeof(COLOR),
+                pstBackBuffer->pstBuffer + iY * pstBackBuffer->iWidth +
+                    pstRect->iX1,
+                iWidth
+            );
+        }
+        gs_stGraphicsManager.qwCopiedPixelCount +=
+            (QWORD) iWidth * (pstRect->iY2 - pstRect->iY1 + 1);
+    }
+    gs_stGraphicsManager.qwFrameCount++;
+}
+
+
+// task that updates console and frame buffer once per frame
+void kFrameBufferTask(void) {
+    while (TRUE) {
+        kFlushConsole();
+        kFlushFrameBuffer();
+        kSleep(GRAPHICS_FRAMEINTERVAL);
+    }
+}
+
+
+// get graphics manager
+// return:
+//   pointer to graphics manager
+GRAPHICSMANAGER *kGetGraphicsManager(void) {
+    return &gs_stGraphicsManager;
+}
+
+
+// fill memory with a color. it uses SSE for the aligned part
+// params:
+//   pstDestination: first pixel
+//   stColor: color to fill
+//   iCount: number of pixels
+static void kFillColor(COLOR *pstDestination, COLOR stColor, int iCount) {
+    QWORD qwPattern;
+    int iBlockCount;
+
+    // pixels before 16 bytes boundary
+    while ((iCount > 0) && (((QWORD) pstDestination & 0xF) != 0)) {
+        *pstDestination++ = stColor;
+        iCount--;
+    }
+
+    // 8 pixels per 16 bytes
+    iBlockCount = iCount / 8;
+    if (iBlockCount > 0) {
+        qwPattern = stColor;
+        qwPattern |= qwPattern << 16;
+        qwPattern |= qwPattern << 32;
+        kFillMemorySSE(pstDestination, qwPattern, (QWORD) iBlockCount * 16);
+        pstDestination += iBlockCount * 8;
+        iCount -= iBlockCount * 8;
+    }
+
+    while (iCount > 0) {
+        *pstDestination++ = stColor;
+        iCount--;
+    }
+}
+
+
+// copy pixels. it uses SSE for multiple of 16 bytes
+// params:
+//   pvDestination: destination
+//   pvSource: source
+//   iCount: number of pixels
+static void kCopyColor(void *pvDestination, const void *pvSource, int iCount) {
+    QWORD qwSize = (QWORD) iCount * sizeof(COLOR);
+    QWORD qwBlockSize = qwSize & ~(QWORD) 0xF;
+
+    if (qwBlockSize > 0) {
+        kCopyMemorySSE(pvDestination, pvSource, qwBlockSize);
+    }
+    for (QWORD i = qwBlockSize; i < qwSize; i += sizeof(COLOR)) {
+        *(COLOR *) ((BYTE *) pvDestination + i) =
+            *(const COLOR *) ((const BYTE *) pvSource + i);
+    }
+}
@@ -0,0 +1,285 @@
+/*
+ * Graphics.h contains drawing library and frame buffer manager of VBE
+ * graphic mode.
+ *
+ * Everything is drawn to back buffer in RAM, and drawing functions do not
+ * touch frame buffer. Areas that changed are added as dirty rectangles.
+ * Frame buffer task copies the dirty rectangles to frame buffer once per
+ * frame. Frame buffer is mapped as write-combining memory, so the copy is
+ * done with full bus bursts instead of one write per pixel.
+ *
+ * Only 16 bits color (R5:G6:B5) mode is supported.
+ */
+
+#ifndef __GRAPHICS_H__
+#define __GRAPHICS_H__
+
+#include "Types.h"
+
+
+// 16 bits color. R5:G6:B5
+typedef WORD COLOR;
+
+#define RGB(r, g, b) ( \
+    ((((BYTE) (r)) >> 3) << 11) | \
+    ((((BYTE) (g)) >> 2) << 5) | \
+    (((BYTE) (b)) >> 3) \
+)
+
+#define GRAPHICS_BITSPERPIXEL   16
+
+// max number of dirty rectangles in a frame. when it is full, all
+// rectangles are merged into one
+#define GRAPHICS_MAXDIRTYRECTCOUNT  16
+
+// interval of copying back buffer to frame buffer
+#define GRAPHICS_FRAMEINTERVAL  16  // ms. about 60 frames per second
+
+
+#pragma pack(push, 1)
+
+// rectangle. (iX1, iY1) is top left and (iX2, iY2) is bottom right.
+// both points are included
+typedef struct kRectangleStruct {
+    int iX1;
+    int iY1;
+    int iX2;
+    int iY2;
+} RECT;
+
+
+// memory to draw on. pixels are saved line by line without padding
+typedef struct kGraphicsBufferStruct {
+    COLOR *pstBuffer;
+    int iWidth;
+    int iHeight;
+} GRAPHICSBUFFER;
+
+
+typedef struct kGraphicsManagerStruct {
+    // True if frame buffer and back buffer are ready
+    BOOL bInitialized;
+
+    // frame buffer of video card
+    BYTE *pbFrameBuffer;
+    int iBytesPerScanLine;
+
+    // back buffer which has the same size as screen
+    GRAPHICSBUFFER stBackBuffer;
+
+    // areas of back buffer which are not copied to frame buffer yet
+    RECT vstDirtyRect[GRAPHICS_MAXDIRTYRECTCOUNT];
+    int iDirtyRectCount;
+
+    // font copied from VGA BIOS because ROM is slow to read
+    BYTE vbFont[256 * 16];
+
+    // statistics
+    QWORD qwFrameCount;
+    QWORD qwCopiedPixelCount;
+} GRAPHICSMANAGER;
+
+#pragma pack(pop)
+
+
+/* rectangle related functions */
+
+// set coordinates of rectangle. points are sorted
+// params:
+//   pstRect: rectangle to set
+//   iX1, iY1: a point
+//   iX2, iY2: the other point
+void kSetRect(RECT *pstRect, int iX1, int iY1, int iX2, int iY2);
+
+
+// check whether two rectangles are overlapped
+// params:
+//   pstRect1, pstRect2: rectangles to check
+// return:
+//   True if they are overlapped. Otherwise False
+BOOL kIsRectOverlapped(const RECT *pstRect1, const RECT *pstRect2);
+
+
+// get area where two rectangles are overlapped
+// params:
+//   pstRect1, pstRect2: rectangles
+//   pstIntersection: rectangle to save overlapped area
+// return:
+//   True if they are overlapped. Otherwise False
+BOOL kGetOverlappedRect(
+    const RECT *pstRect1,
+    const RECT *pstRect2,
+    RECT *pstIntersection
+);
+
+
+// get the smallest rectangle that has both rectangles
+// params:
+//   pstRect1, pstRect2: rectangles
+//   pstUnion: rectangle to save result
+void kGetUnionRect(const RECT *pstRect1, const RECT *pstRect2, RECT *pstUnion);
+
+
+// add a rectangle to a list of rectangles that will be redrawn
+// params:
+//   pstList: array of rectangles
+//   piCount: number of rectangles in the list. it is updated
+//   iMaxCount: size of array
+//   pstRect: rectangle to add
+// info:
+//   rectangle is merged with the first rectangle that it overlaps, so the
+//   overlapped area is not drawn twice. when the list is full, every
+//   rectangle becomes one
+void kAddRectToList(
+    RECT *pstList,
+    int *piCount,
+    int iMaxCount,
+    const RECT *pstRect
+);
+
+
+/* drawing functions. all of them clip to buffer */
+
+// draw a pixel
+// params:
+//   pstBuffer: buffer to draw on
+//   iX, iY: location of pixel
+//   stColor: color of pixel
+void kDrawPixel(const GRAPHICSBUFFER *pstBuffer, int iX, int iY, COLOR stColor);
+
+
+// draw a line with Bresenham's algorithm
+// params:
+//   pstBuffer: buffer to draw on
+//   iX1, iY1: start point
+//   iX2, iY2: end point
+//   stColor: color of line
+void kDrawLine(
+    const GRAPHICSBUFFER *pstBuffer,
+    int iX1,
+    int iY1,
+    int iX2,
+    int iY2,
+    COLOR stColor
+);
+
+
+// draw a rectangle
+// params:
+//   pstBuffer: buffer to draw on
+//   iX1, iY1: a corner
+//   iX2, iY2: the opposite corner
+//   stColor: color of rectangle
+//   bFill: True to fill inside. Otherwise only border is drawn
+void kDrawRect(
+    const GRAPHICSBUFFER *pstBuffer,
+    int iX1,
+    int iY1,
+    int iX2,
+    int iY2,
+    COLOR stColor,
+    BOOL bFill
+);
+
+
+// draw text with 8x16 font of VGA BIOS
+// params:
+//   pstBuffer: buffer to draw on
+//   iX, iY: top left of the first character
+//   stTextColor: color of text
+//   stBackgroundColor: color of background
+//   pcString: text to draw
+//   iLength: number of characters to draw
+void kDrawText(
+    const GRAPHICSBUFFER *pstBuffer,
+    int iX,
+    int iY,
+    COLOR stTextColor,
+    COLOR stBackgroundColor,
+    const char *pcString,
+    int iLength
+);
+
+
+// copy a buffer to another buffer
+// params:
+//   pstDestination: buffer to draw on
+//   iX, iY: location in pstDestination where top left of pstSource goes
+//   pstSource: buffer to copy
+void kBlitBuffer(
+    const GRAPHICSBUFFER *pstDestination,
+    int iX,
+    int iY,
+    const GRAPHICSBUFFER *pstSource
+);
+
+
+// copy an area of a buffer to another buffer
+// params:
+//   pstDestination: buffer to draw on
+//   iX, iY: location in pstDestination where top left of the area goes
+//   pstSource: buffer to copy
+//   pstSourceArea: area of pstSource to copy
+void kBlitBufferArea(
+    const GRAPHICSBUFFER *pstDestination,
+    int iX,
+    int iY,
+    const GRAPHICSBUFFER *pstSource,
+    const RECT *pstSourceArea
+);
+
+
+/* screen related functions */
+
+// map frame buffer as write-combining memory and allocate back buffer
+// return:
+//   True on success. Otherwise False
+// info:
+//   page frame allocator and page table manager must be initialized
+BOOL kInitializeGraphics(void);
+
+
+// get back buffer of screen
+// return:
+//   back buffer. changes are shown after they are added as dirty rectangle
+const GRAPHICSBUFFER *kGetScreenBuffer(void);
+
+
+// add an area of back buffer that should be copied to frame buffer
+// params:
+//   pstRect: changed area. it is clipped to screen
+void kAddDirtyRect(const RECT *pstRect);
+
+
+// copy dirty rectangles of back buffer to frame buffer
+// info:
+//   it uses SSE registers, so it must not be called by interrupt handler
+void kFlushFrameBuffer(void);
+
+
+// task that updates console and frame buffer once per frame
+void kFrameBufferTask(void);
+
+
+// get graphics manager
+// return:
+//   pointer to graphics manager
+GRAPHICSMANAGER *kGetGraphicsManager(void);
+
+
+// fill memory with a color. it uses SSE for the aligned part
+// params:
+//   pstDestination: first pixel
+//   stColor: color to fill
+//   iCount: number of pixels
+static void kFillColor(COLOR *pstDestination, COLOR stColor, int iCount);
+
+
+// copy pixels. it uses SSE for multiple of 16 bytes
+// params:
+//   pvDestination: destination
+//   pvSource: source
+//   iCount: number of pixels
+static void kCopyColor(void *pvDestination, const void *pvSource, int iCount);
+
+#endif /* __GRAPHICS_H__ */
@@ -3,55 +3,95 @@
 #include "AssemblyUtility.h"
 #include "Utility.h"
 #include "Console.h"
+#include "Log.h"
+#include "BlockDevice.h"
 
 static HDDMANAGER gs_stHDDManager;
 
 
 // initialize hdd controller to ATA PIO MODE
 // return:
-//   True on success, False on failure (disk not exist)
+//   True if any drive is found, False if no disk exists
 // notes:
-//   OS must be in the primary master disk
+//   every drive that is found is registered as a block device. drives do
+//   not need a primary master, so hdb ~ hdd are used without hda
 BOOL kInitializeHDD(void) {
-    
-    kInitializeMutex(&gs_stHDDManager.stMutex);
+    HDDINFORMATION *pstHDDInformation;
+    BOOL bPrimary;
+    BOOL bMaster;
+    int iIndex;
+    char vcName[4] = "hd?";
+
+    kInitializeMutex(&(gs_stHDDManager.vstChannel[0].stMutex));
+    kInitializeMutex(&(gs_stHDDManager.vstChannel[1].stMutex));
+
+    gs_stHDDManager.vstChannel[0].bInterruptOccur = FALSE;
+    gs_stHDDManager.vstChannel[1].bInterruptOccur = FALSE;
 
-    gs_stHDDManager.bPrimaryInterruptOccur = FALSE;
-    gs_stHDDManager.bSecondaryInterruptOccur = FALSE;
+    gs_stHDDManager.bHDDDetected = FALSE;
+    gs_stHDDManager.bCanWrite = FALSE;
 
     // enable interrupts
     kOutPortByte(HDD_PORT_PRIMARYBASE + HDD_PORT_INDEX_DIGITALOUTPUT, 0);
     kOutPortByte(HDD_PORT_SECONDARYBASE + HDD_PORT_INDEX_DIGITALOUTPUT, 0);
 
-    // if disk does not exist
-    if (!kReadHDDInformation(TRUE, TRUE, &(gs_stHDDManager.stHDDInformation0))) {
-        gs_stHDDManager.bHDDDetected = FALSE;
-        gs_stHDDManager.bCanWrite = FALSE;
-        return FALSE;
-    }
 
-    /* get extra disk info */
+    /* get disk info of every drive */
 
-    kReadHDDInformation(TRUE, FALSE, &(gs_stHDDManager.stHDDInformation1));
-    // kReadHDDInformation(FALSE, TRUE, &(gs_stHDDManager.stHDDInformation2));
-    // kReadHDDInformation(FALSE, FALSE, &(gs_stHDDManager.stHDDInformation3));
-    
-    gs_stHDDManager.bHDDDetected = TRUE;
-    
-    // when disk is QEMU disk
-    if (
-        kMemCmp(
-            gs_stHDDManager.stHDDInformation0.vwModelNumber,
-            "QEMU",
-            4
-        ) == 0
-    ) {
-        gs_stHDDManager.bCanWrite = TRUE;
+    for (iIndex = 0; iIndex < 4; iIndex++) {
+        bPrimary = (iIndex < 2) ? TRUE : FALSE;
+        bMaster = ((iIndex & 1) == 0) ? TRUE : FALSE;
+        pstHDDInformation = kGetDriveInformation(bPrimary, bMaster);
+
+        gs_stHDDManager.vbDriveDetected[iIndex] =
+            kReadHDDInformation(bPrimary, bMaster, pstHDDInformation);
+        gs_stHDDManager.viMultipleSectorCount[iIndex] = 1;
+
+        if (gs_stHDDManager.vbDriveDetected[iIndex] == FALSE) {
+            kMemSet(pstHDDInformation, 0, sizeof(HDDINFORMATION));
+            continue;
+        }
+
+        // transfer several sectors per interrupt if drives support it
+        gs_stHDDManager.viMultipleSectorCount[iIndex] =
+            kSetHDDMultipleMode(bPrimary, bMaster, pstHDDInformation);
+
+        // hda, hdb, hdc and hdd
+        vcName[2] = 'a' + iIndex;
+        kRegisterBlockDevice(
+            vcName,
+            bPrimary,
+            bMaster,
+            kGetHDDTotalSectorCount(pstHDDInformation),
+            kReadHDDInformation,
+            kReadHDDSector,
+            kWriteHDDSector
+        );
+
+        if (gs_stHDDManager.bHDDDetected == TRUE)
+            continue;
+
+        // the first drive found decides if disks are QEMU disks
+        gs_stHDDManager.bHDDDetected = TRUE;
+        if (kMemCmp(pstHDDInformation->vwModelNumber, "QEMU", 4) == 0)
+            gs_stHDDManager.bCanWrite = TRUE;
     }
-    else {
-        gs_stHDDManager.bCanWrite = FALSE;
+
+    // if disk does not exist
+    return gs_stHDDManager.bHDDDetected;
+}
+
+
+// get state of an ATA channel
+// params:
+//   bPrimary: select primary controller or secondary controller
+// return:
+//   channel in hdd manager
+static HDDCHANNEL *kGetHDDChannel(BOOL bPrimary) {
+    if (bPrimary) {
+        return &(gs_stHDDManager.vstChannel[0]);
     }
-    return TRUE;
+    return &(gs_stHDDManager.vstChannel[1]);
 }
 
 
@@ -111,10 +151,7 @@ static BOOL kWaitForHDDReady(BOOL bPrimary) {
 //   bPrimary: select drive 0 of primary controller or secondary controller
 //   bFlag: flag to set
 void kSetHDDInterruptFlag(BOOL bPrimary, BOOL bFlag) {
-    if (bPrimary) {
-        gs_stHDDManager.bPrimaryInterruptOccur = bFlag;
-    }
-     gs_stHDDManager.bSecondaryInterruptOccur = bFlag;
+    kGetHDDChannel(bPrimary)->bInterruptOccur = bFlag;
 }
 
 
@@ -127,10 +164,7 @@ static BOOL kWaitForHDDInterrupt(BOOL bPrimary) {
     QWORD qwTickCount = kGetTickCount();
 
     while (kGetTickCount() - qwTickCount <= HDD_WAITTIME) {
-        if (bPrimary && gs_stHDDManager.bPrimaryInterruptOccur) {
-            return TRUE;
-        }
-        else if (!(bPrimary) && gs_stHDDManager.bSecondaryInterruptOccur) {
+        if (kGetHDDChannel(bPrimary)->bInterruptOccur) {
             return TRUE;
         }
         kSleep(1);
@@ -139,6 +173,289 @@ static BOOL kWaitForHDDInterrupt(BOOL bPrimary) {
 }
 
 
+// wait until drive requests the next block of data
+// params:
+//   bPrimary: select drive 0 of primary controller or secondary controller
+// return:
+//   True if data can be transferred. False on error or timeout
+// info:
+//   drive raises an interrupt when a block is ready, so status is checked
+//   again without sleeping when the interrupt flag is set
+static BOOL kWaitForHDDDataRequest(BOOL bPrimary) {
+    QWORD qwStartTickCount = kGetTickCount();
+    BYTE bStatus;
+
+    while (kGetTickCount() - qwStartTickCount <= HDD_WAITTIME) {
+        bStatus = kReadHDDStatus(bPrimary);
+        if (!(bStatus & HDD_STATUS_BUSY)) {
+            if (bStatus & (HDD_STATUS_ERROR | HDD_STATUS_WRITEFAULT)) {
+                return FALSE;
+            }
+            if (bStatus & HDD_STATUS_DATAREQUEST) {
+                return TRUE;
+            }
+        }
+
+        if (kGetHDDChannel(bPrimary)->bInterruptOccur) {
+            kSetHDDInterruptFlag(bPrimary, FALSE);
+        }
+        else {
+            kSleep(1);
+        }
+    }
+    return FALSE;
+}
+
+
+// enable multiple mode that transfers several sectors per data request
+// params:
+//   bPrimary: select primary controller or secondary controller
+//   bMaster: select master or slave drive
+//   pstHDDInformation: IDENTIFY data of the drive
+// return:
+//   number of sectors per data request. 1 if multiple mode is not
+//   supported or SET MULTIPLE MODE fails
+static int kSetHDDMultipleMode(
+    BOOL bPrimary,
+    BOOL bMaster,
+    const HDDINFORMATION *pstHDDInformation
+) {
+    HDDCHANNEL *pstChannel;
+    WORD wPortBase;
+    BYTE bDriveFlag;
+    BYTE bStatus;
+    BOOL bWaitResult;
+    int iMaxCount;
+    int iCount;
+
+    // drive that does not exist returns zeros
+    iMaxCount = MIN(
+        pstHDDInformation->wMaxMultipleSectorCount & 0xFF,
+        HDD_MAXMULTIPLESECTORCOUNT
+    );
+
+    // old drives accept only a power of 2
+    for (iCount = 1; (iCount << 1) <= iMaxCount; iCount <<= 1) {
+    }
+
+    if (iCount <= 1) {
+        return 1;
+    }
+
+    if (bPrimary) {
+        wPortBase = HDD_PORT_PRIMARYBASE;
+    }
+    else {
+        wPortBase = HDD_PORT_SECONDARYBASE;
+    }
+
+    if (bMaster) {
+        bDriveFlag = HDD_DRIVEANDHEAD_LBA;
+    }
+    else {
+        bDriveFlag = HDD_DRIVEANDHEAD_LBA | HDD_DRIVEANDHEAD_SLAVE;
+    }
+
+    pstChannel = kGetHDDChannel(bPrimary);
+    kLock(&(pstChannel->stMutex));
+
+    if (kWaitForHDDNoBusy(bPrimary) == FALSE) {
+        kUnlock(&(pstChannel->stMutex));
+        return 1;
+    }
+
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_DRIVEANDHEAD, bDriveFlag);
+
+    if (kWaitForHDDReady(bPrimary) == FALSE) {
+        kUnlock(&(pstChannel->stMutex));
+        return 1;
+    }
+
+    kSetHDDInterruptFlag(bPrimary, FALSE);
+
+    // sector count register has number of sectors per data request
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORCOUNT, iCount);
+    kOutPortByte(
+        wPortBase + HDD_PORT_INDEX_COMMAND,
+        HDD_COMMAND_SETMULTIPLEMODE
+    );
+
+    bWaitResult = kWaitForHDDInterrupt(bPrimary);
+    bStatus = kReadHDDStatus(bPrimary);
+
+    if (!bWaitResult || (bStatus & HDD_STATUS_ERROR)) {
+        kUnlock(&(pstChannel->stMutex));
+        return 1;
+    }
+
+    kUnlock(&(pstChannel->stMutex));
+    return iCount;
+}
+
+
+// get number of sectors per data request of a drive
+// params:
+//   bPrimary: select primary controller or secondary controller
+//   bMaster: select master or slave drive
+// return:
+//   number of sectors per data request
+static int kGetHDDMultipleSectorCount(BOOL bPrimary, BOOL bMaster) {
+    int iCount;
+
+    iCount = gs_stHDDManager.viMultipleSectorCount[
+        HDD_DRIVEINDEX(bPrimary, bMaster)
+    ];
+
+    if (iCount <= 1) {
+        return 1;
+    }
+    return iCount;
+}
+
+
+// get disk information of a drive that is read at initialization
+// params:
+//   bPrimary: select primary controller or secondary controller
+//   bMaster: select master or slave drive
+// return:
+//   disk information in hdd manager
+static HDDINFORMATION *kGetDriveInformation(BOOL bPrimary, BOOL bMaster) {
+    if (bPrimary && bMaster) {
+        return &(gs_stHDDManager.stHDDInformation0);
+    }
+    else if (bPrimary && !bMaster) {
+        return &(gs_stHDDManager.stHDDInformation1);
+    }
+    else if (!bPrimary && bMaster) {
+        return &(gs_stHDDManager.stHDDInformation2);
+    }
+    return &(gs_stHDDManager.stHDDInformation3);
+}
+
+
+// get total number of sectors from disk information
+// params:
+//   pstHDDInformation: IDENTIFY data of a drive
+// return:
+//   number of sectors. 48-bit count is used if drive supports 48-bit LBA
+QWORD kGetHDDTotalSectorCount(const HDDINFORMATION *pstHDDInformation) {
+    if (
+        (pstHDDInformation->wCommandSetSupport2 & HDD_COMMANDSET2_LBA48) &&
+        (pstHDDInformation->qwTotalSectors48 != 0)
+    ) {
+        return pstHDDInformation->qwTotalSectors48;
+    }
+    return pstHDDInformation->dwTotalSectors;
+}
+
+
+// check if sectors are in a drive and choose addressing mode
+// params:
+//   bPrimary: select primary controller or secondary controller
+//   bMaster: select master or slave drive
+//   qwLBA: first sector
+//   iSectorCount: number of sectors
+//   pbUseLBA48: True is saved if 48-bit LBA commands are needed
+// return:
+//   True if sectors can be accessed. Otherwise False
+// info:
+//   28-bit LBA commands are used if possible, because they need fewer
+//   port writes
+static BOOL kCheckHDDSectorRange(
+    BOOL bPrimary,
+    BOOL bMaster,
+    QWORD qwLBA,
+    int iSectorCount,
+    BOOL *pbUseLBA48
+) {
+    HDDINFORMATION *pstHDDInformation;
+    QWORD qwTotalSectorCount;
+    BOOL bSupportLBA48;
+
+    pstHDDInformation = kGetDriveInformation(bPrimary, bMaster);
+    qwTotalSectorCount = kGetHDDTotalSectorCount(pstHDDInformation);
+    bSupportLBA48 =
+        (pstHDDInformation->wCommandSetSupport2 & HDD_COMMANDSET2_LBA48) ?
+        TRUE : FALSE;
+
+    if (
+        (iSectorCount <= 0) ||
+        (qwLBA >= qwTotalSectorCount) ||
+        (qwTotalSectorCount - qwLBA < iSectorCount)
+    ) {
+        return FALSE;
+    }
+
+    if (
+        (iSectorCount <= HDD_MAXBULKSECTORCOUNT) &&
+        (qwLBA + iSectorCount <= HDD_MAXLBA28SECTORCOUNT)
+    ) {
+        *pbUseLBA48 = FALSE;
+        return TRUE;
+    }
+
+    if ((bSupportLBA48 == FALSE) || (iSectorCount > HDD_MAXEXTSECTORCOUNT)) {
+        return FALSE;
+    }
+
+    *pbUseLBA48 = TRUE;
+    return TRUE;
+}
+
+
+// set sector count, LBA and drive registers before a read or write command
+// params:
+//   wPortBase: port base of controller
+//   bMaster: select master or slave drive
+//   qwLBA: first sector
+//   iSectorCount: number of sectors. 256 or 65536 is written as 0
+//   bUseLBA48: True to write 48-bit LBA
+static void kWriteHDDAddress(
+    WORD wPortBase,
+    BOOL bMaster,
+    QWORD qwLBA,
+    int iSectorCount,
+    BOOL bUseLBA48
+) {
+    BYTE bDriveFlag;
+
+    if (bMaster) {
+        bDriveFlag = HDD_DRIVEANDHEAD_LBA;
+    }
+    else {
+        bDriveFlag = HDD_DRIVEANDHEAD_LBA | HDD_DRIVEANDHEAD_SLAVE;
+    }
+
+    // registers are FIFOs of two bytes in 48-bit mode, so upper bytes go
+    // first and lower bytes follow
+    if (bUseLBA48 == TRUE) {
+        kOutPortByte(
+            wPortBase + HDD_PORT_INDEX_SECTORCOUNT,
+            iSectorCount >> 8
+        );
+        kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORNUMBER, qwLBA >> 24);
+        kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERLSB, qwLBA >> 32);
+        kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERMSB, qwLBA >> 40);
+    }
+
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORCOUNT, iSectorCount);
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORNUMBER, qwLBA);
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERLSB, qwLBA >> 8);
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERMSB, qwLBA >> 16);
+
+    // bits 24 ~ 27 of LBA are in drive register only in 28-bit mode
+    if (bUseLBA48 == TRUE) {
+        kOutPortByte(wPortBase + HDD_PORT_INDEX_DRIVEANDHEAD, bDriveFlag);
+    }
+    else {
+        kOutPortByte(
+            wPortBase + HDD_PORT_INDEX_DRIVEANDHEAD,
+            bDriveFlag | ((qwLBA >> 24) & 0x0F)
+        );
+    }
+}
+
+
 // read disk information
 // params:
 //   bPrimary: select primary controller or secondary controller
@@ -151,6 +468,7 @@ BOOL kReadHDDInformation(
     BOOL bMaster,
     HDDINFORMATION *pstHDDInformation
 ) {
+    HDDCHANNEL *pstChannel;
     WORD wPortBase;
     QWORD qwLastTIckCount;
     BYTE bStatus;
@@ -169,13 +487,20 @@ BOOL kReadHDDInformation(
         wPortBase = HDD_PORT_SECONDARYBASE;
     }
 
-    // lock hdd manager for futher use
-    kLock(&(gs_stHDDManager.stMutex));
+    // lock channel for futher use
+    pstChannel = kGetHDDChannel(bPrimary);
+    kLock(&(pstChannel->stMutex));
 
+    // floating bus reads 0xFF when controller does not exist. it is checked
+    // first not to wait for timeout
+    if (kReadHDDStatus(bPrimary) == 0xFF) {
+        kUnlock(&(pstChannel->stMutex));
+        return FALSE;
+    }
 
     // wait for previous command to end
     if (kWaitForHDDNoBusy(bPrimary) == FALSE) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return FALSE;
     }
 
@@ -190,11 +515,17 @@ BOOL kReadHDDInformation(
 
     kOutPortByte(wPortBase + HDD_PORT_INDEX_DRIVEANDHEAD, bDriveFlag);
 
+    // status of drive that does not exist is 0
+    if (kReadHDDStatus(bPrimary) == 0x00) {
+        kUnlock(&(pstChannel->stMutex));
+        return FALSE;
+    }
+
     /* send command and wait for hdd interrupt */
 
     // wait for controller to be ready to accept command
     if (kWaitForHDDReady(bPrimary) == FALSE) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return FALSE;
     }
 
@@ -209,7 +540,7 @@ BOOL kReadHDDInformation(
 
     // interrupt timeout means that error occurred or something is wrong
     if (!bWaitResult || (bStatus & HDD_STATUS_ERROR)) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return FALSE;
     }
 
@@ -231,7 +562,7 @@ BOOL kReadHDDInformation(
         pstHDDInformation->vwSerialNumber,
         sizeof(pstHDDInformation->vwSerialNumber) / 2
     );
-    kUnlock(&(gs_stHDDManager.stMutex));
+    kUnlock(&(pstChannel->stMutex));
     return TRUE;
 }
 
@@ -255,59 +586,47 @@ static void kSwapByteInWord(WORD *pwData, int iWordCount) {
 // params:
 //   bPrimary: select primary controller or secondary controller
 //   bMaster: select master or slave drive
-//   dwLBA: logical block address
+//   qwLBA: logical block address
 //   iSectorCount: number of sectors to read
 //   pcBuffer: pointer to buffer which saves the data from hdd
 // info:
-//   can read up to 256 sectors
+//   can read up to 65536 sectors if drive supports 48-bit LBA.
+//   Otherwise up to 256 sectors
 // return:
 //   number of sectors actually read
 int kReadHDDSector(
     BOOL bPrimary,
     BOOL bMaster,
-    DWORD dwLBA,
+    QWORD qwLBA,
     int iSectorCount,
     char *pcBuffer
 ) {
-    int sectorDest;
+    HDDCHANNEL *pstChannel;
     WORD wPortBase;
-    int i, j;
-    BYTE bDriveFlag;
-    BYTE bStatus;
-    long lReadCount = 0;
-    BOOL bWaitResult;
-
+    int i;
+    BOOL bUseLBA48;
+    BYTE bCommand;
+    int iMultipleSectorCount;
+    int iBlockSectorCount;
 
-    /* check if parameters are valid */
 
-    sectorDest = dwLBA + iSectorCount;
+    /* check if disk has enough area to read */
 
     if (
-        (gs_stHDDManager.bHDDDetected == FALSE) ||
-        (iSectorCount <= 0) || (256 < iSectorCount)
+        (gs_stHDDManager.vbDriveDetected[
+            HDD_DRIVEINDEX(bPrimary, bMaster)
+        ] == FALSE) ||
+        (kCheckHDDSectorRange(
+            bPrimary,
+            bMaster,
+            qwLBA,
+            iSectorCount,
+            &bUseLBA48
+        ) == FALSE)
     ) {
         return 0;
     }
 
-    /* check if disk has enough area to write */
-
-    if (bPrimary && bMaster) {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation0.dwTotalSectors)
-            return 0;
-    }
-    else if (bPrimary && !bMaster) {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation1.dwTotalSectors)
-            return 0;
-    }
-    else if (!bPrimary && bMaster) {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation2.dwTotalSectors)
-            return 0;
-    }
-    else {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation3.dwTotalSectors)
-            return 0;
-    }
-
 
     if (bPrimary) {
         wPortBase = HDD_PORT_PRIMARYBASE;
@@ -316,78 +635,61 @@ int kReadHDDSector(
         wPortBase = HDD_PORT_SECONDARYBASE;
     }
 
-    kLock(&(gs_stHDDManager.stMutex));
+    pstChannel = kGetHDDChannel(bPrimary);
+    kLock(&(pstChannel->stMutex));
 
     if (kWaitForHDDNoBusy(bPrimary) == FALSE) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return 0;
     }
 
-    
-    /* set registers for LBA */
-
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORCOUNT, iSectorCount);
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORNUMBER, dwLBA);
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERLSB, dwLBA >> 8);
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERMSB, dwLBA >> 16);
-    
-    if (bMaster) {
-        bDriveFlag = HDD_DRIVEANDHEAD_LBA;
-    }
-    else {
-        bDriveFlag = HDD_DRIVEANDHEAD_LBA | HDD_DRIVEANDHEAD_SLAVE;
-    }
-
-    kOutPortByte(
-        wPortBase + HDD_PORT_INDEX_DRIVEANDHEAD,
-        bDriveFlag | ((dwLBA >> 24) & 0x0F)
-    );
+    kWriteHDDAddress(wPortBase, bMaster, qwLBA, iSectorCount, bUseLBA48);
 
 
     /* send read command */
 
     if (kWaitForHDDReady(bPrimary) == FALSE) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return 0;
     }
 
     kSetHDDInterruptFlag(bPrimary, FALSE);
 
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_COMMAND, HDD_COMMAND_READ);
+    iMultipleSectorCount = kGetHDDMultipleSectorCount(bPrimary, bMaster);
+    if (bUseLBA48 == TRUE) {
+        bCommand = (iMultipleSectorCount > 1) ?
+            HDD_COMMAND_READMULTIPLEEXT : HDD_COMMAND_READEXT;
+    }
+    else {
+        bCommand = (iMultipleSectorCount > 1) ?
+            HDD_COMMAND_READMULTIPLE : HDD_COMMAND_READ;
+    }
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_COMMAND, bCommand);
 
 
     /* copy data to buffer */
 
-    for (i = 0; i < iSectorCount; i++) {
-        bStatus = kReadHDDStatus(bPrimary);
-        if ((bStatus & HDD_STATUS_ERROR) == HDD_STATUS_ERROR) {
-            kPrintf("HardDisk: Error Occur\n");
-            kUnlock(&(gs_stHDDManager.stMutex));
-            return i;
+    // drive requests data once per block of iMultipleSectorCount sectors,
+    // and the last block can be smaller
+    for (i = 0; i < iSectorCount; i += iBlockSectorCount) {
+        if (kWaitForHDDDataRequest(bPrimary) == FALSE) {
+            kLog(LOG_LEVEL_ERROR, "HardDisk: Error Occur");
+            break;
         }
 
-        if ((bStatus & HDD_STATUS_DATAREQUEST) != HDD_STATUS_DATAREQUEST) {
-            bWaitResult = kWaitForHDDInterrupt(bPrimary);
-            kSetHDDInterruptFlag(bPrimary, FALSE);
+        iBlockSectorCount = MIN(iSectorCount - i, iMultipleSectorCount);
 
-            if (bWaitResult == FALSE) {
-                continue;
-                
-                // note: reading hdd disk really fast sometimes causes error
-
-                // kPrintf("HardDisk: Interrupt not occurred\n");
-                // kUnlock(&(gs_stHDDManager.stMutex));
-                // return i;
-            }
-        }
-
-        for (j = 0; j < 512 / 2; j++) {
-            ((WORD *) pcBuffer)[lReadCount++] =
-                kInPortWord(wPortBase + HDD_PORT_INDEX_DATA);
-        }
+        // clear flag before the transfer, because the drive raises the
+        // interrupt of the next block after this block is read
+        kSetHDDInterruptFlag(bPrimary, FALSE);
+        kInPortWordString(
+            wPortBase + HDD_PORT_INDEX_DATA,
+            pcBuffer + (i * 512),
+            iBlockSectorCount * 512 / 2
+        );
     }
 
-    kUnlock(&(gs_stHDDManager.stMutex));
+    kUnlock(&(pstChannel->stMutex));
     return i;
 }
 
@@ -396,58 +698,46 @@ int kReadHDDSector(
 // params:
 //   bPrimary: select primary controller or secondary controller
 //   bMaster: select master or slave drive
-//   dwLBA: logical block address
+//   qwLBA: logical block address
 //   iSectorCount: number of sectors to read
 //   pcBuffer: pointer to buffer which have data to write
 // info:
-//   can write up to 256 sectors
+//   can write up to 65536 sectors if drive supports 48-bit LBA.
+//   Otherwise up to 256 sectors
 // return:
 //   number of sectors actually written
 int kWriteHDDSector(
     BOOL bPrimary,
     BOOL bMaster,
-    DWORD dwLBA,
+    QWORD qwLBA,
     int iSectorCount,
     char *pcBuffer
 ) {
-
-    int sectorDest;
+    HDDCHANNEL *pstChannel;
     WORD wPortBase;
-    WORD wTemp;
-    int i, j;
-    BYTE bDriveFlag;
+    int i;
     BYTE bStatus;
-    long lWriteCount = 0;
-    BOOL bWaitResult;
-
-    // ERROR: dwTotalSectors contains only number of sectors of primary master 
-    if (
-        (gs_stHDDManager.bHDDDetected == FALSE) ||
-        (iSectorCount <= 0) || (256 < iSectorCount)
-    ) {
-        return 0;
-    }
+    BOOL bUseLBA48;
+    BYTE bCommand;
+    int iMultipleSectorCount;
+    int iBlockSectorCount = 0;
 
 
     /* check if disk has enough area to write */
 
-    sectorDest = dwLBA + iSectorCount;
-
-    if (bPrimary && bMaster) {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation0.dwTotalSectors)
-            return 0;
-    }
-    else if (bPrimary && !bMaster) {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation1.dwTotalSectors)
-            return 0;
-    }
-    else if (!bPrimary && bMaster) {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation2.dwTotalSectors)
-            return 0;
-    }
-    else {
-        if (sectorDest >= gs_stHDDManager.stHDDInformation3.dwTotalSectors)
-            return 0;
+    if (
+        (gs_stHDDManager.vbDriveDetected[
+            HDD_DRIVEINDEX(bPrimary, bMaster)
+        ] == FALSE) ||
+        (kCheckHDDSectorRange(
+            bPrimary,
+            bMaster,
+            qwLBA,
+            iSectorCount,
+            &bUseLBA48
+        ) == FALSE)
+    ) {
+        return 0;
     }
 
 
@@ -458,92 +748,70 @@ int kWriteHDDSector(
         wPortBase = HDD_PORT_SECONDARYBASE;
     }
 
-    kLock(&(gs_stHDDManager.stMutex));
+    pstChannel = kGetHDDChannel(bPrimary);
+    kLock(&(pstChannel->stMutex));
 
     if (kWaitForHDDNoBusy(bPrimary) == FALSE) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return 0;
     }
 
-    
-    /* set registers for LBA */
-
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORCOUNT, iSectorCount);
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_SECTORNUMBER, dwLBA);
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERLSB, dwLBA >> 8);
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_CYLINDERMSB, dwLBA >> 16);
-    
-    if (bMaster) {
-        bDriveFlag = HDD_DRIVEANDHEAD_LBA;
-    }
-    else {
-        bDriveFlag = HDD_DRIVEANDHEAD_LBA | HDD_DRIVEANDHEAD_SLAVE;
-    }
-
-    kOutPortByte(
-        wPortBase + HDD_PORT_INDEX_DRIVEANDHEAD,
-        bDriveFlag | ((dwLBA >> 24) & 0x0F)
-    );
+    kWriteHDDAddress(wPortBase, bMaster, qwLBA, iSectorCount, bUseLBA48);
 
 
     /* send write command */
 
     if (kWaitForHDDReady(bPrimary) == FALSE) {
-        kUnlock(&(gs_stHDDManager.stMutex));
+        kUnlock(&(pstChannel->stMutex));
         return 0;
     }
 
-    kOutPortByte(wPortBase + HDD_PORT_INDEX_COMMAND, HDD_COMMAND_WRITE);
-
-    // wait until sending data is possible
-    while (TRUE) {
-        bStatus = kReadHDDStatus(bPrimary);
-    
-        if (bStatus & HDD_STATUS_ERROR) {
-            kUnlock(&(gs_stHDDManager.stMutex));
-            return 0;
-        }
-
-        if (bStatus & HDD_STATUS_DATAREQUEST) {
-            break;
-        }
+    kSetHDDInterruptFlag(bPrimary, FALSE);
 
-        kSleep(1);
+    iMultipleSectorCount = kGetHDDMultipleSectorCount(bPrimary, bMaster);
+    if (bUseLBA48 == TRUE) {
+        bCommand = (iMultipleSectorCount > 1) ?
+            HDD_COMMAND_WRITEMULTIPLEEXT : HDD_COMMAND_WRITEEXT;
     }
+    else {
+        bCommand = (iMultipleSectorCount > 1) ?
+            HDD_COMMAND_WRITEMULTIPLE : HDD_COMMAND_WRITE;
+    }
+    kOutPortByte(wPortBase + HDD_PORT_INDEX_COMMAND, bCommand);
 
 
-    // send data to hdd
-    for (i = 0; i < iSectorCount; i++) {
-        kSetHDDInterruptFlag(bPrimary, FALSE);
-        for (j = 0; j < 512 / 2; j++) {
-            kOutPortWord(
-                wPortBase + HDD_PORT_INDEX_DATA,
-                ((WORD *) pcBuffer)[lWriteCount++]
-            );
-        }
+    /* send data to hdd */
 
-        bStatus = kReadHDDStatus(bPrimary);
-        if (bStatus & HDD_STATUS_ERROR) {
-            kUnlock(&(gs_stHDDManager.stMutex));
+    // the first data request comes without an interrupt, and the others
+    // come with an interrupt after the previous block is written
+    for (i = 0; i < iSectorCount; i += iBlockSectorCount) {
+        if (kWaitForHDDDataRequest(bPrimary) == FALSE) {
+            kLog(LOG_LEVEL_ERROR, "HardDisk: Error Occur");
+            kUnlock(&(pstChannel->stMutex));
             return i;
         }
 
-        if ((bStatus & HDD_STATUS_DATAREQUEST) != HDD_STATUS_DATAREQUEST) {
-            
-            bWaitResult = kWaitForHDDInterrupt(bPrimary);
-            // debug
-            // when j = 256, something wrong happens
-            while (!bWaitResult)
-                bWaitResult = kWaitForHDDInterrupt(bPrimary);
+        iBlockSectorCount = MIN(iSectorCount - i, iMultipleSectorCount);
 
-            kSetHDDInterruptFlag(bPrimary, FALSE);
-            if (!bWaitResult) {
-                kUnlock(&(gs_stHDDManager.stMutex));
-                return i;
-            }
+        kSetHDDInterruptFlag(bPrimary, FALSE);
+        kOutPortWordString(
+            wPortBase + HDD_PORT_INDEX_DATA,
+            pcBuffer + (i * 512),
+            iBlockSectorCount * 512 / 2
+        );
+    }
+
+    // the last block is written when drive is not busy
+    if (kWaitForHDDNoBusy(bPrimary) == FALSE) {
+        i -= iBlockSectorCount;
+    }
+    else {
+        bStatus = kReadHDDStatus(bPrimary);
+        if (bStatus & (HDD_STATUS_ERROR | HDD_STATUS_WRITEFAULT)) {
+            i -= iBlockSectorCount;
         }
     }
 
-    kUnlock(&(gs_stHDDManager.stMutex));
+    kUnlock(&(pstChannel->stMutex));
     return i;
 }
\ No newline at end of file
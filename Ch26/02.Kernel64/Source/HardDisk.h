@@ -33,6 +33,17 @@
 #define HDD_COMMAND_WRITE       0x30
 #define HDD_COMMAND_IDENTIFY    0xEC
 
+// transfer a block of sectors per data request instead of one sector
+#define HDD_COMMAND_READMULTIPLE    0xC4
+#define HDD_COMMAND_WRITEMULTIPLE   0xC5
+#define HDD_COMMAND_SETMULTIPLEMODE 0xC6
+
+// 48-bit LBA versions. they take 16-bit sector count and 48-bit LBA
+#define HDD_COMMAND_READEXT             0x24
+#define HDD_COMMAND_READMULTIPLEEXT     0x29
+#define HDD_COMMAND_WRITEEXT            0x34
+#define HDD_COMMAND_WRITEMULTIPLEEXT    0x39
+
 
 /* macros for status register */
 
@@ -63,9 +74,30 @@
 // time to wait for harddisk response (millisecond)
 #define HDD_WAITTIME        700
 
-// maximum number of sectors to read or write
+// maximum number of sectors to read or write with 28-bit LBA
 #define HDD_MAXBULKSECTORCOUNT  256
 
+// maximum number of sectors to read or write with 48-bit LBA
+#define HDD_MAXEXTSECTORCOUNT   65536
+
+// sectors after this can be accessed only with 48-bit LBA
+#define HDD_MAXLBA28SECTORCOUNT 0x0FFFFFFF
+
+// bit of wCommandSetSupport2 in IDENTIFY data that shows 48-bit LBA support
+#define HDD_COMMANDSET2_LBA48   0x0400
+
+// upper limit of sectors per data request in multiple mode. IDENTIFY data
+// can report less
+#define HDD_MAXMULTIPLESECTORCOUNT  16
+
+// valid bit of wMultipleSectorSetting in IDENTIFY data
+#define HDD_MULTIPLESETTING_VALID   0x0100
+
+
+// index of per-drive arrays of hdd manager
+#define HDD_DRIVEINDEX(bPrimary, bMaster) \
+    ((((bPrimary) ? 0 : 1) << 1) | ((bMaster) ? 0 : 1))
+
 
 /* structs for managing harddisk */ 
 
@@ -108,29 +140,53 @@ typedef struct kHDDInformationStruct {
     /* harddisk model number */
 
     WORD vwModelNumber[20];
-    WORD vwReserved2[13];
+
+    /* multiple sector transfer */
+
+    // lower byte is max number of sectors per data request of
+    // READ/WRITE MULTIPLE
+    WORD wMaxMultipleSectorCount;
+    WORD vwReserved2[11];
+    // lower byte is current number of sectors per data request and it is
+    // valid if HDD_MULTIPLESETTING_VALID is set
+    WORD wMultipleSectorSetting;
 
     /* total number of sectors */
+    // sectors that 28-bit LBA can access
     DWORD dwTotalSectors;
-    WORD vwReserved3[196];
+    WORD vwReserved3[21];
+
+    // HDD_COMMANDSET2_LBA48 is set if 48-bit LBA is supported
+    WORD wCommandSetSupport2;
+    WORD vwReserved4[16];
+
+    // sectors that 48-bit LBA can access
+    QWORD qwTotalSectors48;
+    WORD vwReserved5[154];
 
 } HDDINFORMATION;
 
 #pragma pack(pop)
 
 
+// state of an ATA channel. primary and secondary channels have their own
+// ports and IRQ, so drives on different channels work at the same time
+typedef struct kHDDChannelStruct {
+    // sync object for one process to access drives of channel at time
+    MUTEX stMutex;
+
+    // check if interrupt occurs
+    volatile BOOL bInterruptOccur;
+} HDDCHANNEL;
+
+
 // struct for managing harddisks
 typedef struct kHDDMamagerStruct {
-    BOOL bHDDDetected; // check if hdd exist
+    BOOL bHDDDetected; // check if any hdd exists
     BOOL bCanWrite;    // help to write only on QEMU disk
 
-    /* check if interrupt occurs */
-
-    volatile BOOL bPrimaryInterruptOccur;
-    volatile BOOL bSecondaryInterruptOccur;
-
-    // sync object for one process to access hdd at time
-    MUTEX stMutex;
+    // index 0 is primary channel and 1 is secondary channel
+    HDDCHANNEL vstChannel[2];
 
     // primary master
     HDDINFORMATION stHDDInformation0;
@@ -140,6 +196,13 @@ typedef struct kHDDMamagerStruct {
     HDDINFORMATION stHDDInformation2;
     // secondary slave
     HDDINFORMATION stHDDInformation3;
+
+    // True if drive answered IDENTIFY. index is HDD_DRIVEINDEX()
+    BOOL vbDriveDetected[4];
+
+    // sectors per data request of each drive, which is set by SET MULTIPLE
+    // MODE. 1 means READ/WRITE SECTOR is used. index is HDD_DRIVEINDEX()
+    int viMultipleSectorCount[4];
 } HDDMANAGER;
 
 
@@ -148,7 +211,7 @@ typedef struct kHDDMamagerStruct {
 
 // initialize hdd controller to ATA PIO MODE
 // return:
-//   True on success, False on failure (disk not exist)
+//   True if any drive is found, False if no disk exists
 BOOL kInitializeHDD(void);
 
 
@@ -166,21 +229,30 @@ BOOL kReadHDDInformation(
 );
 
 
+// get total number of sectors from disk information
+// params:
+//   pstHDDInformation: IDENTIFY data of a drive
+// return:
+//   number of sectors. 48-bit count is used if drive supports 48-bit LBA
+QWORD kGetHDDTotalSectorCount(const HDDINFORMATION *pstHDDInformation);
+
+
 // read hard disk sectors
 // params:
 //   bPrimary: select primary controller or secondary controller
 //   bMaster: select master or slave drive
-//   dwLBA: logical block address
+//   qwLBA: logical block address
 //   iSectorCount: number of sectors to read
 //   pcBuffer: pointer to buffer which saves the data from hdd
 // info:
-//   can read up to 256 sectors
+//   can read up to 65536 sectors if drive supports 48-bit LBA.
+//   Otherwise up to 256 sectors
 // return:
 //   number of sectors actually read
 int kReadHDDSector(
     BOOL bPrimary,
     BOOL bMaster,
-    DWORD dwLBA,
+    QWORD qwLBA,
     int iSectorCount,
     char *pcBuffer
 );
@@ -190,17 +262,18 @@ int kReadHDDSector(
 // params:
 //   bPrimary: select primary controller or secondary controller
 //   bMaster: select master or slave drive
-//   dwLBA: logical block address
+//   qwLBA: logical block address
 //   iSectorCount: number of sectors to read
 //   pcBuffer: pointer to buffer which have data to write
 // info:
-//   can write up to 256 sectors
+//   can write up to 65536 sectors if drive supports 48-bit LBA.
+//   Otherwise up to 256 sectors
 // return:
 //   number of sectors actually written
 int kWriteHDDSector(
     BOOL bPrimary,
     BOOL bMaster,
-    DWORD dwLBA,
+    QWORD qwLBA,
     int iSectorCount,
     char *pcBuffer
 );
@@ -213,11 +286,6 @@ int kWriteHDDSector(
 void kSetHDDInterruptFlag(BOOL bPrimary, BOOL bFlag);
 
 
-// set interrupt flag of hdd manager
-// params:
-//   bPrimary: select drive 0 of primary controller or secondary controller
-//   bFlag: flag to set
-void kSetHDDInterruptFlagclear(BOOL bPrimary, BOOL bFlag);
 
 static void kSwapByteInWord(WORD *pwData, int iWordCount);
 static BYTE kReadHDDStatus(BOOL bPrimary);
@@ -226,5 +294,28 @@ static BOOL kIsHDDReady(BOOL bPrimary);
 static BOOL kWaitForHDDNoBusy(BOOL bPrimary);
 static BOOL kWaitForHDDReady(BOOL bPrimary);
 static BOOL kWaitForHDDInterrupt(BOOL bPrimary);
+static BOOL kWaitForHDDDataRequest(BOOL bPrimary);
+static int kSetHDDMultipleMode(
+    BOOL bPrimary,
+    BOOL bMaster,
+    const HDDINFORMATION *pstHDDInformation
+);
+static int kGetHDDMultipleSectorCount(BOOL bPrimary, BOOL bMaster);
+static HDDINFORMATION *kGetDriveInformation(BOOL bPrimary, BOOL bMaster);
+static HDDCHANNEL *kGetHDDChannel(BOOL bPrimary);
+static BOOL kCheckHDDSectorRange(
+    BOOL bPrimary,
+    BOOL bMaster,
+    QWORD qwLBA,
+    int iSectorCount,
+    BOOL *pbUseLBA48
+);
+static void kWriteHDDAddress(
+    WORD wPortBase,
+    BOOL bMaster,
+    QWORD qwLBA,
+    int iSectorCount,
+    BOOL bUseLBA48
+);
 
 #endif /* __HARDDISK_H__ */
\ No newline at end of file
@@ -6,7 +6,8 @@
 SECTION .text
 
 extern kCommonExceptionHandler, kCommonInterruptHandler, kKeyboardHandler
-extern kTimerHandler, kDeviceNotAvailableHandler, kHDDHandler
+extern kTimerHandler, kDeviceNotAvailableHandler, kHDDHandler, kSerialHandler
+extern kMouseHandler
 
 
 ;; 0 to 19, reserved exception/interrupt ISRs
@@ -37,6 +38,32 @@ global kISRMouse, kISRCoprocessor, kISRHDD1, kISRHDD2
 global kISRETCInterrupt
 
 
+;; macro that loads kernel data segment to a segment register
+;; only if the register has other selector. rax is used as temp register
+
+%macro KSETKERNELSEGMENT 1
+    mov ax, %1
+    cmp ax, 0x10    ; 0x10: kernel data segment descriptor offset
+    je %%SameSelector
+    mov ax, 0x10
+    mov %1, ax
+%%SameSelector:
+%endmacro
+
+
+;; macro that restores a segment selector popped from stack only if it
+;; differs from the current one. rax and rbx are used as temp registers
+
+%macro KRESTORESEGMENT 1
+    pop rax
+    mov bx, %1
+    cmp ax, bx
+    je %%SameSelector
+    mov %1, ax
+%%SameSelector:
+%endmacro
+
+
 ;; macro that switch context
 ;; every ISR uses this macro
 
@@ -70,12 +97,13 @@ global kISRETCInterrupt
 
 
     ;; siwtch segment selector
+    ;; in most cases, interrupted code already uses kernel data segment.
+    ;; loading a selector is slow, so skip it when it does not change
 
-    mov ax, 0x10    ; 0x10: kernel data segment descriptor offset
-    mov ds, ax
-    mov es, ax
-    mov gs, ax
-    mov fs, ax
+    KSETKERNELSEGMENT ds
+    KSETKERNELSEGMENT es
+    KSETKERNELSEGMENT gs
+    KSETKERNELSEGMENT fs
 %endmacro
 
 
@@ -84,12 +112,11 @@ global kISRETCInterrupt
 
 %macro KLOADCONTEXT 0
     ;; restore all segment selectors
-    pop gs
-    pop fs
-    pop rax
-    mov es, ax
-    pop rax
-    mov ds, ax
+
+    KRESTORESEGMENT gs
+    KRESTORESEGMENT fs
+    KRESTORESEGMENT es
+    KRESTORESEGMENT ds
 
     
     ;; restore all general registers
@@ -311,10 +338,15 @@ kISRETCException:
 ;; 32 to 47, PIC interrupt ISRs
 
 ; #32, Timer ISR
+; this ISR does not use IST. context is saved on the stack of current task
+; and the handler returns context of the task to run. Switching task is just
+; loading the returned context address to rsp
 kISRTimer:
     KSAVECONTEXT
     mov rdi, 32
+    mov rsi, rsp    ; context of current task as second parameter
     call kTimerHandler
+    mov rsp, rax    ; context of next task or current task
     KLOADCONTEXT
     iretq
 
@@ -346,7 +378,7 @@ kISRSerial2:
 kISRSerial1:
     KSAVECONTEXT
     mov rdi, 36
-    call kCommonInterruptHandler
+    call kSerialHandler
     KLOADCONTEXT
     iretq
 
@@ -410,7 +442,7 @@ kISRNotUsed2:
 kISRMouse:
     KSAVECONTEXT
     mov rdi, 44
-    call kCommonInterruptHandler
+    call kMouseHandler
     KLOADCONTEXT
     iretq
 
@@ -6,6 +6,9 @@
 #include "Utility.h"
 #include "AssemblyUtility.h"
 #include "HardDisk.h"
+#include "VBE.h"
+#include "Graphics.h"
+#include "Mouse.h"
 
 // common exception handler for exceptions that do not have handler
 // info:
@@ -25,6 +28,13 @@ void kCommonExceptionHandler(int iVectorNumber, QWORD qwErrorCode) {
     kPrintStringXY(0, 2, "                    Vector:                       ");
     kPrintStringXY(27, 2, vcBuffer);
     kPrintStringXY(0, 3, "==================================================");
+    kFlushConsole();
+
+    // frame buffer task does not run anymore. SSE registers can be used here
+    // because the system stops
+    if (kIsGraphicMode() == TRUE) {
+        kFlushFrameBuffer();
+    }
 
     while (1);
 }
@@ -75,8 +85,14 @@ void kKeyboardHandler(int iVectorNumber) {
     kPrintStringXY(59, 0, vcBuffer);
 
     if (kIsOutputBufferFull()) {
-        bTemp = kGetKeyboardScanCode();
-        kConvertScanCodeAndPutQueue(bTemp);
+        // a mouse byte can arrive before IRQ12 is handled
+        if (kIsMouseDataInOutputBuffer()) {
+            kAccumulateMouseDataAndPutQueue(kInPortByte(0x60));
+        }
+        else {
+            bTemp = kGetKeyboardScanCode();
+            kConvertScanCodeAndPutQueue(bTemp);
+        }
     }
 
     // send EOI to PIC controller
@@ -87,10 +103,35 @@ void kKeyboardHandler(int iVectorNumber) {
 }
 
 
+// mouse interrupt handler
+// params:
+//   iVectorNumber: IDT gate descriptor index number
+// info:
+//   every byte in output buffer is processed, so a packet is usually
+//   assembled in one interrupt
+void kMouseHandler(int iVectorNumber) {
+    while (kIsOutputBufferFull()) {
+        // a key can arrive before IRQ1 is handled
+        if (kIsMouseDataInOutputBuffer()) {
+            kAccumulateMouseDataAndPutQueue(kInPortByte(0x60));
+        }
+        else {
+            kConvertScanCodeAndPutQueue(kInPortByte(0x60));
+        }
+    }
+
+    kSendEOIToPIC(iVectorNumber - PIC_IRQSTARTVECTOR);
+}
+
+
 // PIT counter0 Interrupt Handler. This function calls task scheduler
 // params:
 //   iVectorNumber: IDT gate descriptor index number
-void kTimerHandler(int iVectorNumber) {
+//   pstContext: context of current task saved on its stack by ISR
+// return:
+//   context that ISR restores. if processor time of current task is
+//   expired, it is context of the next task
+CONTEXT *kTimerHandler(int iVectorNumber, CONTEXT *pstContext) {
     char vcBuffer[] = "[INT:  , ]";
 	// count how many interrupt occurs
 	static int g_iCommonInterruptCount = 0;
@@ -112,10 +153,23 @@ void kTimerHandler(int iVectorNumber) {
 
     g_qwTickCount++;
 
+    // tasks whose sleep or wait timed out become ready
+    kWakeUpTimedOutTasks();
+
+    // movements of a mouse that stopped are not kept pending
+    kFlushMouseData();
+
+    // show what tasks printed during the last tick. in graphic mode, frame
+    // buffer task draws console
+    if (kIsGraphicMode() == FALSE) {
+        kFlushConsole();
+    }
+
     kDecreaseProcessorTime();
     if (kIsProcessorTimeExpired()) {
-        kScheduleInInterrupt();
+        return kScheduleInInterrupt(pstContext);
     }
+    return pstContext;
 }
 
 
@@ -2,6 +2,7 @@
 #define __INTERRUPTHANDLER_H__
 
 #include "Types.h"
+#include "Task.h"
 
 // common exception handler for exceptions that do not have handler
 // info:
@@ -25,10 +26,23 @@ void kCommonInterruptHandler(int iVectorNumber);
 void kKeyboardHandler(int iVectorNumber);
 
 
+// mouse interrupt handler
+// params:
+//   iVectorNumber: IDT gate descriptor index number
+// info:
+//   every byte in output buffer is processed, so a packet is usually
+//   assembled in one interrupt
+void kMouseHandler(int iVectorNumber);
+
+
 // PIT counter0 Interrupt Handler. This function calls task scheduler
 // params:
 //   iVectorNumber: IDT gate descriptor index number
-void kTimerHandler(int iVectorNumber);
+//   pstContext: context of current task saved on its stack by ISR
+// return:
+//   context that ISR restores. if processor time of current task is
+//   expired, it is context of the next task
+CONTEXT *kTimerHandler(int iVectorNumber, CONTEXT *pstContext);
 
 
 // FPU device-not-available exception handler
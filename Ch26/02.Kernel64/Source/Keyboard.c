@@ -4,6 +4,8 @@
 #include "Queue.h"
 #include "Utility.h"
 #include "Synchronization.h"
+#include "Mouse.h"
+#include "Task.h"
 
 // function that checks if output buffer of PS/2 Controller is full.
 // return:
@@ -63,6 +65,12 @@ BOOL kWaitForACKAndPutOtherScanCode(void) {
             }
 		}
 
+		// mouse shares output buffer with keyboard
+		if (kIsMouseDataInOutputBuffer()) {
+			kAccumulateMouseDataAndPutQueue(kInPortByte(0x60));
+			continue;
+		}
+
 		bData = kInPortByte(0x60);
 		// if data is ACK
 		if (bData == 0xFA) {
@@ -611,6 +619,10 @@ BOOL kConvertScanCodeAndPutQueue(BYTE bScanCode) {
 		// disable interrupt
 		bPreviousInterrupt = kLockForSystemData();
 		bResult = kPutQueue(&gs_stKeyQueue, &stData);
+		// tasks that wait for keys become ready
+		if (bResult == TRUE) {
+			kWakeUpTasks(&gs_stKeyQueue);
+		}
 		// restore previous interrupt
 		kUnlockForSystemData(bPreviousInterrupt);
 	}
@@ -638,3 +650,65 @@ BOOL kGetKeyFromKeyQueue(KEYDATA *pstData) {
 	kUnlockForSystemData(bPreviousInterrupt);
 	return bResult;
 }
+
+
+// wait until a key is in keyboard buffer and get it
+// params:
+//   pstData: pointer to variable will hold the data from the buffer
+//   qwMillisecond: time to wait. TASK_WAITFOREVER waits until a key comes
+// return:
+//   True if a key is received. False if time is over
+// info:
+//   task is blocked while it waits and keyboard interrupt wakes it up
+BOOL kWaitForKeyFromKeyQueue(KEYDATA *pstData, QWORD qwMillisecond) {
+	QWORD qwStartTickCount;
+	QWORD qwElapsedTime;
+	BOOL bResult;
+	BOOL bPreviousInterrupt;
+
+	qwStartTickCount = kGetTickCount();
+
+	// queue is checked and task is blocked while interrupt is disabled,
+	// so a key that comes between them is not missed
+	bPreviousInterrupt = kLockForSystemData();
+	while ((bResult = kGetQueue(&gs_stKeyQueue, pstData)) == FALSE) {
+		if (qwMillisecond == TASK_WAITFOREVER) {
+			kBlockTask(&gs_stKeyQueue, TASK_WAITFOREVER);
+			continue;
+		}
+
+		qwElapsedTime = kGetTickCount() - qwStartTickCount;
+		if (qwElapsedTime >= qwMillisecond) {
+			break;
+		}
+		kBlockTask(&gs_stKeyQueue, qwMillisecond - qwElapsedTime);
+	}
+	kUnlockForSystemData(bPreviousInterrupt);
+	return bResult;
+}
+
+
+// get every key in keyboard buffer at once without waiting
+// params:
+//   pstBuffer: array that will hold the data from the buffer
+//   iMaxCount: number of entries of the array
+// return:
+//   number of keys that are copied. 0 if the buffer is empty
+int kGetKeysFromKeyQueue(KEYDATA *pstBuffer, int iMaxCount) {
+	BOOL bPreviousInterrupt;
+	int i;
+
+	if (kIsQueueEmpty(&gs_stKeyQueue) == TRUE) {
+		return 0;
+	}
+
+	// keys are taken under one lock instead of one lock per key
+	bPreviousInterrupt = kLockForSystemData();
+	for (i = 0; i < iMaxCount; i++) {
+		if (kGetQueue(&gs_stKeyQueue, &(pstBuffer[i])) == FALSE) {
+			break;
+		}
+	}
+	kUnlockForSystemData(bPreviousInterrupt);
+	return i;
+}
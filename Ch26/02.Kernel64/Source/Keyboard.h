@@ -214,6 +214,26 @@ BOOL kInitializeKeyboard(void);
 BOOL kGetKeyFromKeyQueue(KEYDATA *pstData);
 
 
+// wait until a key is in keyboard buffer and get it
+// params:
+//   pstData: pointer to variable will hold the data from the buffer
+//   qwMillisecond: time to wait. TASK_WAITFOREVER waits until a key comes
+// return:
+//   True if a key is received. False if time is over
+// info:
+//   task is blocked while it waits and keyboard interrupt wakes it up
+BOOL kWaitForKeyFromKeyQueue(KEYDATA *pstData, QWORD qwMillisecond);
+
+
+// get every key in keyboard buffer at once without waiting
+// params:
+//   pstBuffer: array that will hold the data from the buffer
+//   iMaxCount: number of entries of the array
+// return:
+//   number of keys that are copied. 0 if the buffer is empty
+int kGetKeysFromKeyQueue(KEYDATA *pstBuffer, int iMaxCount);
+
+
 // wait until keyboard gives ACK signal. if the data in output buffer is not
 // ACK signal, put the scan code into queue and keep waiting for ACK signal
 // return:
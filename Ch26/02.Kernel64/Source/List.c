@@ -48,9 +48,10 @@ void kAddListToTail(LIST *pstList, void *pvItem) {
 //   pstList: list to have the item
 //   pvItem: item to add
 void kAddListToHeader(LIST *pstList, void *pvItem) {
-    LISTLINK *pstLink = (LISTLINK *) pstLink;
+    LISTLINK *pstLink = (LISTLINK *) pvItem;
 
     if (!pstList->pvHeader) {
+        pstLink->pvNext = NULL;
         pstList->pvHeader = pvItem;
         pstList->pvTail = pvItem;
         pstList->iItemCount = 1;
@@ -0,0 +1,239 @@
+#include "Log.h"
+#include "Utility.h"
+#include "Console.h"
+#include "AssemblyUtility.h"
+#include "SerialPort.h"
+
+static LOGMANAGER gs_stLogManager;
+
+// name of each level which is printed before message
+static const char *gs_vpcLogLevelName[LOG_LEVELCOUNT] = {
+    "ERROR", "WARN", "INFO", "DEBUG"
+};
+
+
+// initialize log ring buffer
+void kInitializeLog(void) {
+    kMemSet(&gs_stLogManager, 0, sizeof(gs_stLogManager));
+    gs_stLogManager.iConsoleLevel = LOG_DEFAULTCONSOLELEVEL;
+    gs_stLogManager.iSerialLevel = LOG_DEFAULTSERIALLEVEL;
+}
+
+
+// save a formatted message to log ring buffer
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+//   pcFormatString: a string with format. same format as kPrintf
+//   ...: variables that will fill the template
+// info:
+//   it does not wait and does not print. message is printed by drain task
+//   when its level is not higher than console level. line feed at the end of
+//   message is removed
+//
+//  overall length of formatted message should be less than 1024 bytes, as
+//  kPrintf. kVSPrintf has no bound, so a longer one overflows the stack.
+//  message is cut to LOG_MESSAGEMAXLENGTH after formatting
+void kLog(int iLevel, const char *pcFormatString, ...) {
+    va_list ap;
+
+    va_start(ap, pcFormatString);
+    kVLog(iLevel, pcFormatString, ap);
+    va_end(ap);
+}
+
+
+// same as kLog with va_list
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+//   pcFormatString: a string with format
+//   ap: variables that will fill the template
+void kVLog(int iLevel, const char *pcFormatString, va_list ap) {
+    char vcBuffer[LOG_FORMATBUFFERSIZE];
+    LOGRECORD *pstRecord;
+    QWORD qwSequence;
+    int iLength;
+
+    // format before reserving a record, so the record is not committed
+    // late because of slow formatting
+    iLength = kVSPrintf(vcBuffer, pcFormatString, ap);
+    if ((iLength > 0) && (vcBuffer[iLength - 1] == '\n')) {
+        iLength--;
+    }
+    iLength = MIN(iLength, LOG_MESSAGEMAXLENGTH - 1);
+
+    iLevel = MAX(iLevel, LOG_LEVEL_ERROR);
+    iLevel = MIN(iLevel, LOG_LEVEL_DEBUG);
+
+    qwSequence = kAtomicFetchAndAdd(&(gs_stLogManager.qwWriteSequence), 1);
+    pstRecord = &(gs_stLogManager.vstRecord[qwSequence % LOG_RECORDCOUNT]);
+
+    // readers ignore the record while it is being written. kMemCpy is in
+    // another file, so compiler does not move stores across it
+    pstRecord->qwSequence = 0;
+    pstRecord->qwTickCount = kGetTickCount();
+    pstRecord->bLevel = iLevel;
+    pstRecord->bLength = iLength;
+    kMemCpy(pstRecord->vcMessage, vcBuffer, iLength);
+    pstRecord->vcMessage[iLength] = '\0';
+
+    // commit
+    pstRecord->qwSequence = qwSequence + 1;
+}
+
+
+// copy a committed record from ring buffer
+// params:
+//   qwSequence: sequence number of record
+//   pstRecord: buffer to copy record
+// return:
+//   True if the record is copied. False if the record is not committed yet
+//   or is overwritten by newer one
+BOOL kReadLogRecord(QWORD qwSequence, LOGRECORD *pstRecord) {
+    LOGRECORD *pstSource;
+
+    pstSource = &(gs_stLogManager.vstRecord[qwSequence % LOG_RECORDCOUNT]);
+    if (pstSource->qwSequence != qwSequence + 1) {
+        return FALSE;
+    }
+
+    kMemCpy(pstRecord, pstSource, sizeof(LOGRECORD));
+
+    // writer may have reused the record while copying
+    if (pstSource->qwSequence != qwSequence + 1) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+// format a record with its time and level
+// params:
+//   pstRecord: record to format
+//   pcBuffer: buffer whose size is LOG_RECORDSTRINGSIZE
+// return:
+//   length of formatted string
+int kFormatLogRecord(const LOGRECORD *pstRecord, char *pcBuffer) {
+    QWORD qwMillisecond;
+    char vcFraction[4];
+
+    // kSPrintf does not pad numbers, so milliseconds are made by hand
+    qwMillisecond = pstRecord->qwTickCount % 1000;
+    vcFraction[0] = '0' + qwMillisecond / 100;
+    vcFraction[1] = '0' + (qwMillisecond / 10) % 10;
+    vcFraction[2] = '0' + qwMillisecond % 10;
+    vcFraction[3] = '\0';
+
+    return kSPrintf(
+        pcBuffer,
+        "[%d.%s] %s: %s\n",
+        (int) (pstRecord->qwTickCount / 1000),
+        vcFraction,
+        gs_vpcLogLevelName[pstRecord->bLevel],
+        pstRecord->vcMessage
+    );
+}
+
+
+// print a record to console with its time and level
+// params:
+//   pstRecord: record to print
+void kPrintLogRecord(const LOGRECORD *pstRecord) {
+    char vcBuffer[LOG_RECORDSTRINGSIZE];
+
+    kFormatLogRecord(pstRecord, vcBuffer);
+    kPrintf("%s", vcBuffer);
+}
+
+
+// task that prints new records to console and sends them to COM1
+// info:
+//   it runs with the lowest priority, so logging does not delay the writer
+void kLogDrainTask(void) {
+    while (TRUE) {
+        if (kDrainLog() == FALSE) {
+            kSleep(LOG_DRAININTERVAL);
+        }
+    }
+}
+
+
+// print new records whose level is not higher than console level and send
+// records whose level is not higher than serial level to COM1
+// return:
+//   True if a record is printed or sent. Otherwise False
+static BOOL kDrainLog(void) {
+    LOGRECORD stRecord;
+    char vcBuffer[LOG_RECORDSTRINGSIZE];
+    BOOL bSentToSerial;
+    QWORD qwWriteSequence;
+    BOOL bPrinted = FALSE;
+
+    qwWriteSequence = gs_stLogManager.qwWriteSequence;
+
+    // skip records that writers already overwrote
+    if (qwWriteSequence - gs_stLogManager.qwReadSequence > LOG_RECORDCOUNT) {
+        gs_stLogManager.qwDroppedCount +=
+            qwWriteSequence - gs_stLogManager.qwReadSequence - LOG_RECORDCOUNT;
+        gs_stLogManager.qwReadSequence = qwWriteSequence - LOG_RECORDCOUNT;
+    }
+
+    while (gs_stLogManager.qwReadSequence < qwWriteSequence) {
+        if (kReadLogRecord(gs_stLogManager.qwReadSequence, &stRecord) == FALSE) {
+            // the record is not committed yet. wait for the writer
+            if (gs_stLogManager.vstRecord[
+                    gs_stLogManager.qwReadSequence % LOG_RECORDCOUNT
+                ].qwSequence <= gs_stLogManager.qwReadSequence) {
+                break;
+            }
+
+            // the record is overwritten
+            gs_stLogManager.qwDroppedCount++;
+            gs_stLogManager.qwReadSequence++;
+            continue;
+        }
+
+        // kPrintf sends record to COM1 too when serial console is enabled
+        bSentToSerial = FALSE;
+        if (stRecord.bLevel <= gs_stLogManager.iConsoleLevel) {
+            kPrintLogRecord(&stRecord);
+            bSentToSerial = kIsSerialConsoleEnabled();
+            bPrinted = TRUE;
+        }
+        if ((bSentToSerial == FALSE) &&
+            (stRecord.bLevel <= gs_stLogManager.iSerialLevel) &&
+            (kIsSerialPortInitialized() == TRUE)) {
+            kFormatLogRecord(&stRecord, vcBuffer);
+            kSendSerialString(vcBuffer);
+            bPrinted = TRUE;
+        }
+        gs_stLogManager.qwReadSequence++;
+    }
+
+    return bPrinted;
+}
+
+
+// set the highest level that drain task prints
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+void kSetLogConsoleLevel(int iLevel) {
+    iLevel = MAX(iLevel, LOG_LEVEL_ERROR);
+    gs_stLogManager.iConsoleLevel = MIN(iLevel, LOG_LEVEL_DEBUG);
+}
+
+
+// set the highest level that drain task sends to COM1
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+void kSetLogSerialLevel(int iLevel) {
+    iLevel = MAX(iLevel, LOG_LEVEL_ERROR);
+    gs_stLogManager.iSerialLevel = MIN(iLevel, LOG_LEVEL_DEBUG);
+}
+
+
+// get log manager
+// return:
+//   pointer to log manager
+LOGMANAGER *kGetLogManager(void) {
+    return &gs_stLogManager;
+}
@@ -0,0 +1,177 @@
+/*
+ * Log.h contains kernel log ring buffer.
+ *
+ * kLog formats a message into a record of the ring buffer and returns
+ * without touching the screen, so it can be called from interrupt handlers
+ * and while system lock is held. A low priority task prints records to
+ * console later.
+ *
+ * Writers do not take a lock. Each writer reserves a sequence number with
+ * an atomic add, and the record of the number is ring[sequence % count].
+ * When the record is filled, its qwSequence is set to (sequence + 1) to
+ * commit it. A reader checks qwSequence before and after copying a record,
+ * so a record which is overwritten while copying is detected.
+ */
+
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdarg.h>
+
+#include "Types.h"
+
+
+/* log levels. smaller value is more important */
+
+#define LOG_LEVEL_ERROR     0
+#define LOG_LEVEL_WARNING   1
+#define LOG_LEVEL_INFO      2
+#define LOG_LEVEL_DEBUG     3
+#define LOG_LEVELCOUNT      4
+
+// records whose level is higher than this are kept only in ring buffer
+#define LOG_DEFAULTCONSOLELEVEL LOG_LEVEL_INFO
+
+// COM1 is not shown to user, so every record is sent there by default
+#define LOG_DEFAULTSERIALLEVEL  LOG_LEVEL_DEBUG
+
+
+/* ring buffer related constants */
+
+// number of records. older records are overwritten
+#define LOG_RECORDCOUNT     256
+
+// max length of a message including null character. longer messages are cut
+#define LOG_MESSAGEMAXLENGTH 110
+
+// formatted message must be shorter than this. same size as kPrintf buffer
+#define LOG_FORMATBUFFERSIZE 1024
+
+// size of a record formatted with time and level
+#define LOG_RECORDSTRINGSIZE (LOG_MESSAGEMAXLENGTH + 30)
+
+// interval that drain task checks new records when there is no record
+#define LOG_DRAININTERVAL   10  // ms
+
+
+#pragma pack(push, 1)
+
+// a record of ring buffer. 128 bytes
+typedef struct kLogRecordStruct {
+    // (sequence number + 1) when committed. 0 while it is being written
+    volatile QWORD qwSequence;
+
+    // tick count when the message is logged
+    QWORD qwTickCount;
+
+    BYTE bLevel;
+    BYTE bLength;
+    char vcMessage[LOG_MESSAGEMAXLENGTH];
+} LOGRECORD;
+
+
+typedef struct kLogManagerStruct {
+    LOGRECORD vstRecord[LOG_RECORDCOUNT];
+
+    // sequence number which is given to the next writer
+    volatile QWORD qwWriteSequence;
+
+    // sequence number of the next record that drain task prints
+    QWORD qwReadSequence;
+
+    // number of records that are overwritten before drain task prints them
+    QWORD qwDroppedCount;
+
+    int iConsoleLevel;
+    int iSerialLevel;
+} LOGMANAGER;
+
+#pragma pack(pop)
+
+
+/* log related functions */
+
+// initialize log ring buffer
+void kInitializeLog(void);
+
+
+// save a formatted message to log ring buffer
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+//   pcFormatString: a string with format. same format as kPrintf
+//   ...: variables that will fill the template
+// info:
+//   it does not wait and does not print. message is printed by drain task
+//   when its level is not higher than console level. line feed at the end of
+//   message is removed
+//
+//  overall length of formatted message should be less than 1024 bytes, as
+//  kPrintf. kVSPrintf has no bound, so a longer one overflows the stack.
+//  message is cut to LOG_MESSAGEMAXLENGTH after formatting
+void kLog(int iLevel, const char *pcFormatString, ...);
+
+
+// same as kLog with va_list
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+//   pcFormatString: a string with format
+//   ap: variables that will fill the template
+void kVLog(int iLevel, const char *pcFormatString, va_list ap);
+
+
+// copy a committed record from ring buffer
+// params:
+//   qwSequence: sequence number of record
+//   pstRecord: buffer to copy record
+// return:
+//   True if the record is copied. False if the record is not committed yet
+//   or is overwritten by newer one
+BOOL kReadLogRecord(QWORD qwSequence, LOGRECORD *pstRecord);
+
+
+// format a record with its time and level
+// params:
+//   pstRecord: record to format
+//   pcBuffer: buffer whose size is LOG_RECORDSTRINGSIZE
+// return:
+//   length of formatted string
+int kFormatLogRecord(const LOGRECORD *pstRecord, char *pcBuffer);
+
+
+// print a record to console with its time and level
+// params:
+//   pstRecord: record to print
+void kPrintLogRecord(const LOGRECORD *pstRecord);
+
+
+// task that prints new records to console and sends them to COM1
+// info:
+//   it runs with the lowest priority, so logging does not delay the writer
+void kLogDrainTask(void);
+
+
+// set the highest level that drain task prints
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+void kSetLogConsoleLevel(int iLevel);
+
+
+// set the highest level that drain task sends to COM1
+// params:
+//   iLevel: LOG_LEVEL_ERROR ~ LOG_LEVEL_DEBUG
+void kSetLogSerialLevel(int iLevel);
+
+
+// get log manager
+// return:
+//   pointer to log manager
+LOGMANAGER *kGetLogManager(void);
+
+
+// print new records whose level is not higher than console level and send
+// records whose level is not higher than serial level to COM1
+// return:
+//   True if a record is printed or sent. Otherwise False
+static BOOL kDrainLog(void);
+
+#endif /* __LOG_H__ */
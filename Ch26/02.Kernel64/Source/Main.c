@@ -10,12 +10,28 @@
 #include "PIT.h"
 #include "DynamicMemory.h"
 #include "HardDisk.h"
+#include "BlockDevice.h"
 #include "FileSystem.h"
+#include "Page.h"
+#include "PageFrame.h"
+#include "Log.h"
+#include "SerialPort.h"
+#include "VBE.h"
+#include "Graphics.h"
+#include "Window.h"
+#include "Mouse.h"
+#include "BootInfo.h"
+#include "BootTime.h"
 
 
 void Main(void) {
     /* Initialize Console Shell */
     int iCursorX, iCursorY;
+    KERNEL64IMAGEINFO *pstImageInfo;
+
+    // every stage from here is recorded in boot timeline. boottime command
+    // shows it
+    kInitializeBootTime();
     kInitializeConsole(0, 10);
 
 
@@ -28,6 +44,38 @@ void Main(void) {
 
     kPrintf("Initialize Console..........................[Pass]\n");
 
+    /* how 01.Kernel32 loaded this kernel */
+
+    // boot loader read dwImageSize bytes instead of dwKernelSize bytes, and
+    // 01.Kernel32 spent dwLoadCycles to inflate or copy them
+    pstImageInfo = (KERNEL64IMAGEINFO *) BOOTINFO_KERNEL64IMAGEINFOADDRESS;
+    kPrintf("Kernel64 Image %s, %d -> %d Bytes, %d Sectors Saved, "
+            "Load %d Cycles\n",
+            pstImageInfo->dwCompressed ? "Compressed" : "Raw",
+            pstImageInfo->dwKernelSize, pstImageInfo->dwImageSize,
+            (pstImageInfo->dwKernelSize + 511) / 512 -
+            (pstImageInfo->dwImageSize + 511) / 512,
+            pstImageInfo->dwLoadCycles);
+
+
+    /* initialize kernel log ring buffer */
+
+    kInitializeLog();
+    kPrintf("Kernel Log Initialize.......................[Pass]\n");
+
+
+    /* initialize COM1 and use it as console too */
+
+    // messages after this are sent to COM1, so QEMU with -serial stdio
+    // shows them on host
+    if (kInitializeSerialPort(SERIAL_DEFAULTBAUDRATE) == TRUE) {
+        kSetSerialConsole(TRUE);
+        kPrintf("Serial Port Initialize......................[Pass]\n");
+    }
+    else {
+        kPrintf("Serial Port Initialize......................[Fail]\n");
+    }
+
 
     /* 
      * load GDT again and load IDT for handling interrupts 
@@ -35,6 +83,7 @@ void Main(void) {
      * TSS descriptor is for offering stack to interrupt handler
      */ 
 
+    kRecordBootStage("GDT, TSS");
     kGetCursor(&iCursorX, &iCursorY);
     kPrintf("GDT Switch For IA-32e Mode..................[    ]");
     kInitializeGDTTableAndTSS();
@@ -47,6 +96,7 @@ void Main(void) {
     kSetCursor(45, iCursorY++);
     kPrintf("PASS\n");
 
+    kRecordBootStage("IDT");
     kPrintf("IDT Initialization..........................[    ]");
     kInitializeIDTTables();
     kLoadIDTR(IDTR_STARTADDRESS);
@@ -56,6 +106,7 @@ void Main(void) {
 
     /* check total ram size of the computer */
     
+    kRecordBootStage("RAM Size Check");
     kPrintf("Total RAM Size Check........................[    ]");
     kCheckTotalRAMSize();
     kSetCursor(45, iCursorY++);
@@ -64,24 +115,71 @@ void Main(void) {
 
     /* Initialize TCB pool and task scheduler */
 
+    kRecordBootStage("Scheduler");
     kPrintf("TCB Pool And Scheduler Initialize...........[Pass]\n");
     iCursorY++;
     kInitializeScheduler();
 
 
+    /* Initialize Page Frame Allocator */
+
+    kRecordBootStage("Page Frame Allocator");
+    kPrintf("Page Frame Allocator Initialize.............[Pass]\n");
+    iCursorY++;
+    kInitializePageFrameAllocator();
+
+
     /* Initialize Dynamic Memory Manager */
 
+    kRecordBootStage("Dynamic Memory");
     kPrintf("Dynamic Memory initialize...................[Pass]\n");
     iCursorY++;
     kInitializeDynamicMemory();
 
+
+    /* Initialize Page Table Manager */
+
+    kRecordBootStage("Page Table Manager");
+    kPrintf("Page Table Manager Initialize...............[Pass]\n");
+    iCursorY++;
+    kInitializePageManager();
+
+
+    /* Initialize frame buffer of graphic mode */
+
+    kRecordBootStage("Graphics, Window Manager");
+    if (kIsGraphicMode() == TRUE) {
+        iCursorY++;
+        if (kInitializeGraphics() == TRUE) {
+            kPrintf("Graphic Mode Initialize.....................[Pass]\n");
+        }
+        else {
+            kPrintf("Graphic Mode Initialize.....................[Fail]\n");
+        }
+    }
+
+    /* start window manager and move console to a window */
+
+    if (kGetGraphicsManager()->bInitialized == TRUE) {
+        iCursorY++;
+        if ((kInitializeWindowManager() == TRUE) &&
+            (kCreateConsoleWindow() == TRUE)) {
+            kPrintf("Window Manager Initialize...................[Pass]\n");
+        }
+        else {
+            kPrintf("Window Manager Initialize...................[Fail]\n");
+        }
+    }
+
     /* Initialize Programmable Interrupt Timer */
 
+    kRecordBootStage("PIT");
     kInitializePIT(MSTOCOUNT(1), 1);
 
 
     /* Activate Keyboard and initialize keyboard buffer */
 
+    kRecordBootStage("Keyboard");
     kPrintf("Keyboard Activate And Queue Initialize......[    ]");
 
     if (kInitializeKeyboard()) {
@@ -97,15 +195,29 @@ void Main(void) {
     }
 
 
+    /* Activate mouse. it shares PS/2 controller with keyboard */
+
+    kRecordBootStage("Mouse");
+    iCursorY++;
+    if (kInitializeMouse() == TRUE) {
+        kPrintf("Mouse Activate And Queue Initialize.........[Pass]\n");
+    }
+    else {
+        kPrintf("Mouse Activate And Queue Initialize.........[Fail]\n");
+    }
+
+
     /* Initialize PIC controller */
 
+    kRecordBootStage("PIC");
     kPrintf("PIC Controller And Interrupt Initialize.....[    ]");
     kInitializePIC();
     
-    // unmask all interrupts except HDD2 and NotUsed2 signals
-    // My acer laptop keep sending the two signals
-    // Ill keep this code before fixing the problem. 
-    kMaskPICInterrupt(0b1000100000000000);
+    // unmask all interrupts except NotUsed2 signal (IRQ11)
+    // My acer laptop keep sending the signal
+    // Ill keep this code before fixing the problem. HDD2 (IRQ15) is not
+    // masked, because drives of the secondary channel wait for it
+    kMaskPICInterrupt(0b0000100000000000);
     // interrupt was deactivated in 01.Kernel32/EntryPoint.s 
     kEnableInterrupt();
     kSetCursor(45, iCursorY++);
@@ -114,7 +226,11 @@ void Main(void) {
 
     /* initialize HDD */
 
+    kRecordBootStage("HDD");
     kPrintf("HDD Initialize..............................[    ]");
+
+    // drives are registered as block devices
+    kInitializeBlockDeviceManager();
     if (kInitializeHDD() == TRUE) {
         kSetCursor(45, iCursorY++);
         kPrintf("Pass\n");
@@ -127,6 +243,7 @@ void Main(void) {
     
     /* initialize file system */
 
+    kRecordBootStage("File System");
     kPrintf("File System Initialize......................[    ]");
     if (kInitializeFileSystem() == TRUE) {
         kSetCursor(45, iCursorY++);
@@ -139,6 +256,8 @@ void Main(void) {
 
     /* create IDLE task */
 
+    kRecordBootStage("System Tasks");
+
     // flag: lowest priority and idle task
     kCreateTask(
         (
@@ -152,7 +271,49 @@ void Main(void) {
         (QWORD) kIdleTask
     );
 
+    /* create task that prints kernel log */
+
+    kCreateTask(
+        TASK_FLAGS_LOWEST | TASK_FLAGS_SYSTEM | TASK_FLAGS_THREAD,
+        0,
+        0,
+        (QWORD) kLogDrainTask
+    );
+
+    /* create tasks that dispatch block device requests */
+
+    kStartBlockDeviceTask();
+
+    /* create task that writes modified file data back to disk */
+
+    kCreateTask(
+        TASK_FLAGS_LOW | TASK_FLAGS_SYSTEM | TASK_FLAGS_THREAD,
+        0,
+        0,
+        (QWORD) kFileSystemFlushTask
+    );
+
+    /* create task that draws console and updates frame buffer */
+
+    if (kGetWindowManager()->bInitialized == TRUE) {
+        kCreateTask(
+            TASK_FLAGS_LOW | TASK_FLAGS_SYSTEM | TASK_FLAGS_THREAD,
+            0,
+            0,
+            (QWORD) kWindowManagerTask
+        );
+    }
+    else if (kGetGraphicsManager()->bInitialized == TRUE) {
+        kCreateTask(
+            TASK_FLAGS_LOW | TASK_FLAGS_SYSTEM | TASK_FLAGS_THREAD,
+            0,
+            0,
+            (QWORD) kFrameBufferTask
+        );
+    }
+
     /* simple shell */
     
+    kRecordBootStage("Console Shell");
     kStartConsoleShell();
 }
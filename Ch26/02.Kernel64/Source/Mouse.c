@@ -0,0 +1,340 @@
+#include "Mouse.h"
+#include "Keyboard.h"
+#include "AssemblyUtility.h"
+#include "Utility.h"
+
+
+/* singleton data structure of mouse manager */
+
+static MOUSEMANAGER gs_stMouseManager = {0, };
+
+
+/* mouse related functions */
+
+// activate mouse and turn on its interrupt
+// return:
+//   True on success. Otherwise False
+// info:
+//   keyboard must be activated first
+BOOL kInitializeMouse(void) {
+    BOOL bPreviousInterrupt;
+    BYTE bCommandByte;
+    BYTE bDeviceID;
+    int i;
+
+    kMemSet(&gs_stMouseManager, 0, sizeof(gs_stMouseManager));
+    gs_stMouseManager.iPacketSize = 3;
+
+    // disable interrupts while talking to PS/2 controller
+    bPreviousInterrupt = kSetInterruptFlag(FALSE);
+
+    // activate mouse feature of PS/2 controller
+    kOutPortByte(0x64, 0xA8);
+
+
+    /* turn on IRQ12 with command byte of PS/2 controller */
+
+    // read command byte
+    kOutPortByte(0x64, 0x20);
+    for (i = 0; i < 0xFFFF; i++) {
+        if (kIsOutputBufferFull()) {
+            break;
+        }
+    }
+    bCommandByte = kInPortByte(0x60);
+
+    // bit 1 enables mouse interrupt
+    bCommandByte |= 0x02;
+    kOutPortByte(0x64, 0x60);
+    for (i = 0; i < 0xFFFF; i++) {
+        if (!kIsInputBufferFull()) {
+            break;
+        }
+    }
+    kOutPortByte(0x60, bCommandByte);
+
+
+    /* enable wheel */
+
+    // IntelliMouse changes its ID to 3 after sample rates 200, 100 and 80
+    // are set in order. after that, it sends 4 bytes packets
+    if ((kSendMouseCommand(0xF3) == TRUE) &&
+        (kSendMouseCommand(200) == TRUE) &&
+        (kSendMouseCommand(0xF3) == TRUE) &&
+        (kSendMouseCommand(100) == TRUE) &&
+        (kSendMouseCommand(0xF3) == TRUE) &&
+        (kSendMouseCommand(80) == TRUE) &&
+        (kSendMouseCommand(0xF2) == TRUE) &&
+        (kReadMouseReply(&bDeviceID) == TRUE)) {
+        gs_stMouseManager.bDeviceID = bDeviceID;
+        if (bDeviceID == MOUSE_DEVICEID_WHEEL) {
+            gs_stMouseManager.iPacketSize = 4;
+        }
+    }
+
+    // fewer packets mean fewer interrupts. movements are coalesced anyway
+    kSendMouseCommand(0xF3);
+    kSendMouseCommand(MOUSE_SAMPLERATE);
+
+    // mouse starts to send packets
+    gs_stMouseManager.bInitialized = kSendMouseCommand(0xF4);
+
+    kSetInterruptFlag(bPreviousInterrupt);
+    return gs_stMouseManager.bInitialized;
+}
+
+
+// check whether the byte in output buffer came from mouse
+// return:
+//   True if output buffer has mouse data. Otherwise False
+BOOL kIsMouseDataInOutputBuffer(void) {
+    // bit 5 of status register is set when data is from auxiliary device
+    if (kInPortByte(0x64) & 0x20) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+
+// assemble a byte into packet and coalesce complete packet
+// params:
+//   bData: a byte from mouse
+// return:
+//   True if a packet is complete. Otherwise False
+// info:
+//   it must be called while interrupts are disabled
+BOOL kAccumulateMouseDataAndPutQueue(BYTE bData) {
+    MOUSEMANAGER *pstManager = &gs_stMouseManager;
+    BYTE bStatus;
+    BYTE bButtonStatus;
+    int iXMovement, iYMovement, iZMovement;
+
+    // bit 3 of the first byte is always 1. a byte lost by the controller
+    // is recovered at the next first byte
+    if ((pstManager->iByteCount == 0) && ((bData & MOUSE_ALWAYSONE) == 0)) {
+        pstManager->qwSyncErrorCount++;
+        return FALSE;
+    }
+
+    pstManager->vbPacket[pstManager->iByteCount++] = bData;
+    if (pstManager->iByteCount < pstManager->iPacketSize) {
+        return FALSE;
+    }
+    pstManager->iByteCount = 0;
+    pstManager->qwPacketCount++;
+
+
+    /* decode packet */
+
+    bStatus = pstManager->vbPacket[0];
+    bButtonStatus = bStatus & MOUSE_BUTTONMASK;
+
+    // movements are 9 bits two's complement. sign bits are in the first byte
+    iXMovement = pstManager->vbPacket[1];
+    if (bStatus & MOUSE_XSIGN) {
+        iXMovement -= 0x100;
+    }
+    iYMovement = pstManager->vbPacket[2];
+    if (bStatus & MOUSE_YSIGN) {
+        iYMovement -= 0x100;
+    }
+    if (bStatus & (MOUSE_XOVERFLOW | MOUSE_YOVERFLOW)) {
+        iXMovement = 0;
+        iYMovement = 0;
+    }
+
+    // wheel is 4 bits two's complement
+    iZMovement = 0;
+    if (pstManager->iPacketSize == 4) {
+        iZMovement = pstManager->vbPacket[3] & 0x0F;
+        if (iZMovement & 0x08) {
+            iZMovement -= 0x10;
+        }
+    }
+
+
+    /* coalesce with pending movements */
+
+    if ((pstManager->bPending == TRUE) &&
+        (pstManager->stPendingData.bButtonStatus == bButtonStatus) &&
+        (pstManager->stPendingData.iZMovement == 0) &&
+        (iZMovement == 0)) {
+        pstManager->stPendingData.iXMovement += iXMovement;
+        pstManager->stPendingData.iYMovement += iYMovement;
+        pstManager->qwCoalescedCount++;
+    }
+    else {
+        kPutPendingMouseData();
+        pstManager->stPendingData.bButtonStatus = bButtonStatus;
+        pstManager->stPendingData.iXMovement = iXMovement;
+        pstManager->stPendingData.iYMovement = iYMovement;
+        pstManager->stPendingData.iZMovement = iZMovement;
+        pstManager->bPending = TRUE;
+    }
+
+    // clicks and wheel are not delayed
+    if ((bButtonStatus != pstManager->bLastButtonStatus) ||
+        (iZMovement != 0) ||
+        ((kGetTickCount() - pstManager->qwLastPutTickCount) >=
+            MOUSE_BATCHINTERVAL)) {
+        kPutPendingMouseData();
+    }
+    return TRUE;
+}
+
+
+// put pending movements into queue when batch interval passed
+// info:
+//   called by timer interrupt handler, so the last movements of a mouse
+//   that stopped are not kept pending
+void kFlushMouseData(void) {
+    if ((gs_stMouseManager.bPending == TRUE) &&
+        ((kGetTickCount() - gs_stMouseManager.qwLastPutTickCount) >=
+            MOUSE_BATCHINTERVAL)) {
+        kPutPendingMouseData();
+    }
+}
+
+
+// get coalesced mouse data from queue
+// params:
+//   pstData: buffer to save data
+// return:
+//   True if data is received. Otherwise False
+// info:
+//   only one task may call this function
+BOOL kGetMouseDataFromMouseQueue(MOUSEDATA *pstData) {
+    DWORD dwGetIndex = gs_stMouseManager.dwGetIndex;
+
+    if (dwGetIndex == gs_stMouseManager.dwPutIndex) {
+        return FALSE;
+    }
+
+    *pstData = gs_stMouseManager.vstQueue[dwGetIndex % MOUSE_MAXQUEUECOUNT];
+
+    // entry can be reused by interrupt handler after this
+    gs_stMouseManager.dwGetIndex = dwGetIndex + 1;
+    return TRUE;
+}
+
+
+// get mouse manager
+// return:
+//   pointer to mouse manager
+MOUSEMANAGER *kGetMouseManager(void) {
+    return &gs_stMouseManager;
+}
+
+
+// send a command to mouse and wait for ACK
+// params:
+//   bCommand: mouse command
+// return:
+//   True if ACK is received. Otherwise False
+static BOOL kSendMouseCommand(BYTE bCommand) {
+    int i;
+
+    // next byte written to 0x60 goes to mouse instead of keyboard
+    for (i = 0; i < 0xFFFF; i++) {
+        if (!kIsInputBufferFull()) {
+            break;
+        }
+    }
+    kOutPortByte(0x64, 0xD4);
+
+    for (i = 0; i < 0xFFFF; i++) {
+        if (!kIsInputBufferFull()) {
+            break;
+        }
+    }
+    kOutPortByte(0x60, bCommand);
+
+    return kWaitForMouseACK();
+}
+
+
+// wait until mouse gives ACK. other bytes are processed as usual
+// return:
+//   True if ACK is received. Otherwise False after timeout
+static BOOL kWaitForMouseACK(void) {
+    BYTE bData;
+    int i, j;
+
+    // same as keyboard, up to 100 bytes are checked
+    for (j = 0; j < 100; j++) {
+        for (i = 0; i < 0xFFFF; i++) {
+            if (kIsOutputBufferFull()) {
+                break;
+            }
+        }
+        if (kIsOutputBufferFull() == FALSE) {
+            continue;
+        }
+
+        if (kIsMouseDataInOutputBuffer() == FALSE) {
+            kConvertScanCodeAndPutQueue(kInPortByte(0x60));
+            continue;
+        }
+
+        bData = kInPortByte(0x60);
+        if (bData == 0xFA) {
+            return TRUE;
+        }
+        kAccumulateMouseDataAndPutQueue(bData);
+    }
+    return FALSE;
+}
+
+
+// read a byte that mouse sent as reply of a command
+// params:
+//   pbData: buffer to save the byte
+// return:
+//   True if a byte is read. Otherwise False after timeout
+static BOOL kReadMouseReply(BYTE *pbData) {
+    int i, j;
+
+    for (j = 0; j < 100; j++) {
+        for (i = 0; i < 0xFFFF; i++) {
+            if (kIsOutputBufferFull()) {
+                break;
+            }
+        }
+        if (kIsOutputBufferFull() == FALSE) {
+            continue;
+        }
+
+        if (kIsMouseDataInOutputBuffer() == TRUE) {
+            *pbData = kInPortByte(0x60);
+            return TRUE;
+        }
+        kConvertScanCodeAndPutQueue(kInPortByte(0x60));
+    }
+    return FALSE;
+}
+
+
+// put pending movements into queue
+static void kPutPendingMouseData(void) {
+    MOUSEMANAGER *pstManager = &gs_stMouseManager;
+    DWORD dwPutIndex;
+
+    if (pstManager->bPending == FALSE) {
+        return;
+    }
+    pstManager->bPending = FALSE;
+    pstManager->bLastButtonStatus = pstManager->stPendingData.bButtonStatus;
+    pstManager->qwLastPutTickCount = kGetTickCount();
+
+    dwPutIndex = pstManager->dwPutIndex;
+    if ((dwPutIndex - pstManager->dwGetIndex) >= MOUSE_MAXQUEUECOUNT) {
+        pstManager->qwDroppedCount++;
+        return;
+    }
+
+    // entry is filled before put index shows it to consumer
+    pstManager->vstQueue[dwPutIndex % MOUSE_MAXQUEUECOUNT] =
+        pstManager->stPendingData;
+    pstManager->dwPutIndex = dwPutIndex + 1;
+    pstManager->qwQueuedCount++;
+}
@@ -0,0 +1,172 @@
+/*
+ * Mouse.h contains PS/2 mouse driver.
+ *
+ * Mouse is the auxiliary device of PS/2 controller, so it shares data port
+ * 0x60 with keyboard. Bit 5 of status register tells whether a byte came
+ * from mouse. Mouse sends 3 bytes packets, or 4 bytes packets when it
+ * supports wheel (IntelliMouse).
+ *
+ * Interrupt handler assembles packets and coalesces movements whose button
+ * state does not change into a pending data. The pending data is put into
+ * the queue when buttons or wheel change, or once per batch interval, so a
+ * fast moving mouse adds a few entries instead of one entry per packet.
+ *
+ * The queue is a single producer (interrupt handler) and single consumer
+ * (window manager task) ring buffer. Producer only moves put index and
+ * consumer only moves get index, so no lock is needed.
+ */
+
+#ifndef __MOUSE_H__
+#define __MOUSE_H__
+
+#include "Types.h"
+
+
+/* mouse related constants */
+
+// number of entries in mouse queue. must be a power of 2
+#define MOUSE_MAXQUEUECOUNT     128
+
+// pending movement is put into queue at least once per this interval
+#define MOUSE_BATCHINTERVAL     10  // ms
+
+// packets per second
+#define MOUSE_SAMPLERATE        100
+
+// device ID that mouse sends after wheel is enabled
+#define MOUSE_DEVICEID_WHEEL    0x03
+
+// bits of the first byte of packet
+#define MOUSE_LBUTTONDOWN       0x01
+#define MOUSE_RBUTTONDOWN       0x02
+#define MOUSE_MBUTTONDOWN       0x04
+#define MOUSE_BUTTONMASK        0x07
+#define MOUSE_ALWAYSONE         0x08
+#define MOUSE_XSIGN             0x10
+#define MOUSE_YSIGN             0x20
+#define MOUSE_XOVERFLOW         0x40
+#define MOUSE_YOVERFLOW         0x80
+
+
+#pragma pack(push, 1)
+
+// movements that are coalesced from one or more packets
+typedef struct kMouseDataStruct {
+    BYTE bButtonStatus;
+
+    // positive X is right and positive Y is up
+    int iXMovement;
+    int iYMovement;
+
+    // wheel. positive value is toward user
+    int iZMovement;
+} MOUSEDATA;
+
+
+typedef struct kMouseManagerStruct {
+    // True if mouse is activated
+    BOOL bInitialized;
+
+    // packet being assembled
+    BYTE vbPacket[4];
+    int iByteCount;
+    int iPacketSize;
+    BYTE bDeviceID;
+
+    // movements which are not put into queue yet
+    MOUSEDATA stPendingData;
+    BOOL bPending;
+    BYTE bLastButtonStatus;
+    QWORD qwLastPutTickCount;
+
+    // lock-free ring buffer. indexes only increase
+    MOUSEDATA vstQueue[MOUSE_MAXQUEUECOUNT];
+    volatile DWORD dwPutIndex;
+    volatile DWORD dwGetIndex;
+
+    // statistics
+    QWORD qwPacketCount;
+    QWORD qwQueuedCount;
+    QWORD qwCoalescedCount;
+    QWORD qwDroppedCount;
+    QWORD qwSyncErrorCount;
+} MOUSEMANAGER;
+
+#pragma pack(pop)
+
+
+/* mouse related functions */
+
+// activate mouse and turn on its interrupt
+// return:
+//   True on success. Otherwise False
+// info:
+//   keyboard must be activated first
+BOOL kInitializeMouse(void);
+
+
+// check whether the byte in output buffer came from mouse
+// return:
+//   True if output buffer has mouse data. Otherwise False
+BOOL kIsMouseDataInOutputBuffer(void);
+
+
+// assemble a byte into packet and coalesce complete packet
+// params:
+//   bData: a byte from mouse
+// return:
+//   True if a packet is complete. Otherwise False
+// info:
+//   it must be called while interrupts are disabled
+BOOL kAccumulateMouseDataAndPutQueue(BYTE bData);
+
+
+// put pending movements into queue when batch interval passed
+// info:
+//   called by timer interrupt handler, so the last movements of a mouse
+//   that stopped are not kept pending
+void kFlushMouseData(void);
+
+
+// get coalesced mouse data from queue
+// params:
+//   pstData: buffer to save data
+// return:
+//   True if data is received. Otherwise False
+// info:
+//   only one task may call this function
+BOOL kGetMouseDataFromMouseQueue(MOUSEDATA *pstData);
+
+
+// get mouse manager
+// return:
+//   pointer to mouse manager
+MOUSEMANAGER *kGetMouseManager(void);
+
+
+// send a command to mouse and wait for ACK
+// params:
+//   bCommand: mouse command
+// return:
+//   True if ACK is received. Otherwise False
+static BOOL kSendMouseCommand(BYTE bCommand);
+
+
+// wait until mouse gives ACK. other bytes are processed as usual
+// return:
+//   True if ACK is received. Otherwise False after timeout
+static BOOL kWaitForMouseACK(void);
+
+
+// read a byte that mouse sent as reply of a command
+// params:
+//   pbData: buffer to save the byte
+// return:
+//   True if a byte is read. Otherwise False after timeout
+static BOOL kReadMouseReply(BYTE *pbData);
+
+
+// put pending movements into queue
+static void kPutPendingMouseData(void);
+
+#endif /* __MOUSE_H__ */
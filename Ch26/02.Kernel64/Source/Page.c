@@ -0,0 +1,722 @@
+#include "Page.h"
+#include "Utility.h"
+#include "AssemblyUtility.h"
+#include "Synchronization.h"
+
+static PAGEMANAGER gs_stPageManager;
+
+
+/* page manager related functions */
+
+// initialize page table manager and activate NX, WP, global page and
+// write-combining features if processor supports them
+void kInitializePageManager(void) {
+    DWORD dwEAX, dwEBX, dwECX, dwEDX;
+    QWORD qwPAT;
+
+    kMemSet(&gs_stPageManager, 0, sizeof(gs_stPageManager));
+
+    gs_stPageManager.pstPML4Table = (PML4ENTRY *) (
+        kReadCR3() & PAGE_ADDRESSMASK
+    );
+    gs_stPageManager.qwFreeTableList = NULL;
+    gs_stPageManager.iUnusedTableIndex = 0;
+    gs_stPageManager.iMaxTableCount = PAGE_TABLEPOOLSIZE / PAGE_TABLE_SIZE;
+    gs_stPageManager.iUsedTableCount = 0;
+
+
+    /* check processor features */
+
+    // bit 20 of EDX: execute disable bit
+    kReadCPUID(0x80000001, &dwEAX, &dwEBX, &dwECX, &dwEDX);
+    gs_stPageManager.bNXSupported = (dwEDX & (1 << 20)) ? TRUE : FALSE;
+
+    // bit 13 of EDX: global page, bit 16 of EDX: page attribute table
+    kReadCPUID(0x00000001, &dwEAX, &dwEBX, &dwECX, &dwEDX);
+    gs_stPageManager.bGlobalPageSupported = (dwEDX & (1 << 13)) ? TRUE : FALSE;
+    gs_stPageManager.bPATSupported = (dwEDX & (1 << 16)) ? TRUE : FALSE;
+
+
+    /* activate features */
+
+    // without NXE bit, NX flag in entries is a reserved bit
+    if (gs_stPageManager.bNXSupported) {
+        kWriteMSR(
+            PAGE_MSR_IA32EFER,
+            kReadMSR(PAGE_MSR_IA32EFER) | PAGE_EFER_NXE
+        );
+    }
+
+    // kernel cannot write to read-only pages either
+    kWriteCR0(kReadCR0() | PAGE_CR0_WP);
+
+    if (gs_stPageManager.bGlobalPageSupported) {
+        kWriteCR4(kReadCR4() | PAGE_CR4_PGE);
+    }
+
+    // PAT entry 1 is write-through by default. MINT64OS does not use
+    // write-through, so change it to write-combining for frame buffer
+    if (gs_stPageManager.bPATSupported) {
+        qwPAT = kReadMSR(PAGE_MSR_IA32PAT);
+        qwPAT = (qwPAT & ~PAGE_PAT_ENTRY1MASK) | PAGE_PAT_WRITECOMBINING;
+        kWriteMSR(PAGE_MSR_IA32PAT, qwPAT);
+    }
+
+    // memory type of pages can be changed, so flush all
+    kWriteCR3(kReadCR3());
+}
+
+
+// map a 4KB page
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwPhysicalAddress: 4KB aligned physical address
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags. present flag is set by default
+// return:
+//   True on success. Otherwise False
+// info:
+//   if a 2MB page covers the address, the 2MB page is split
+BOOL kMapPage(QWORD qwVirtualAddress, QWORD qwPhysicalAddress, QWORD qwFlags) {
+    PTENTRY *pstEntry;
+    BOOL bPreviousFlag;
+
+    if (
+        (qwVirtualAddress & (PAGE_SMALLSIZE - 1)) ||
+        (qwPhysicalAddress & (PAGE_SMALLSIZE - 1))
+    ) {
+        return FALSE;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstEntry = kGetPageTableEntry(qwVirtualAddress, TRUE);
+    if (pstEntry == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    pstEntry->qwAttributeAndAddress = (
+        (qwPhysicalAddress & PAGE_ADDRESSMASK) |
+        kGetValidPageFlags(qwFlags) |
+        PAGE_FLAGS_P
+    );
+    kInvalidatePage(qwVirtualAddress);
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// map a 2MB page
+// params:
+//   qwVirtualAddress: 2MB aligned virtual address
+//   qwPhysicalAddress: 2MB aligned physical address
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags. present flag is set by default
+// return:
+//   True on success. Otherwise False
+// info:
+//   if a page table covers the address, the page table is freed
+BOOL kMapLargePage(
+    QWORD qwVirtualAddress,
+    QWORD qwPhysicalAddress,
+    QWORD qwFlags
+) {
+    PDENTRY *pstEntry;
+    QWORD qwOldEntry;
+    BOOL bPreviousFlag;
+
+    if (
+        (qwVirtualAddress & (PAGE_DEFAULTSIZE - 1)) ||
+        (qwPhysicalAddress & (PAGE_DEFAULTSIZE - 1))
+    ) {
+        return FALSE;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstEntry = kGetPageDirectoryEntry(qwVirtualAddress, TRUE);
+    if (pstEntry == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    qwOldEntry = pstEntry->qwAttributeAndAddress;
+    pstEntry->qwAttributeAndAddress = (
+        (qwPhysicalAddress & PAGE_ADDRESSMASK) |
+        kGetValidPageFlags(qwFlags) |
+        PAGE_FLAGS_PS |
+        PAGE_FLAGS_P
+    );
+
+    // page table that was used for 4KB pages is not necessary anymore
+    if ((qwOldEntry & PAGE_FLAGS_P) && !(qwOldEntry & PAGE_FLAGS_PS)) {
+        kFreePageTable((void *) (qwOldEntry & PAGE_ADDRESSMASK));
+    }
+    kFlushTLB(qwVirtualAddress, PAGE_DEFAULTSIZE);
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// unmap a 4KB page
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+// return:
+//   True on success. Otherwise False
+BOOL kUnmapPage(QWORD qwVirtualAddress) {
+    PDENTRY *pstDirectoryEntry;
+    PTENTRY *pstTable;
+    PTENTRY *pstEntry;
+    BOOL bPreviousFlag;
+    int i;
+
+    if (qwVirtualAddress & (PAGE_SMALLSIZE - 1)) {
+        return FALSE;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstDirectoryEntry = kGetPageDirectoryEntry(qwVirtualAddress, FALSE);
+    if (
+        (pstDirectoryEntry == NULL) ||
+        !(pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_P)
+    ) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    // 2MB page is split, so other 4KB pages in it remain mapped
+    pstEntry = kGetPageTableEntry(qwVirtualAddress, TRUE);
+    if (pstEntry == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    pstEntry->qwAttributeAndAddress = 0;
+    kInvalidatePage(qwVirtualAddress);
+
+    // if every page in the page table is unmapped, give the table back to
+    // pool
+    pstTable = (PTENTRY *) (
+        pstDirectoryEntry->qwAttributeAndAddress & PAGE_ADDRESSMASK
+    );
+    for (i = 0; i < PAGE_MAXENTRYCOUNT; i++) {
+        if (pstTable[i].qwAttributeAndAddress & PAGE_FLAGS_P) {
+            break;
+        }
+    }
+    if (i == PAGE_MAXENTRYCOUNT) {
+        pstDirectoryEntry->qwAttributeAndAddress = 0;
+        kFreePageTable(pstTable);
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// unmap a 2MB page or all 4KB pages in the 2MB area
+// params:
+//   qwVirtualAddress: 2MB aligned virtual address
+// return:
+//   True on success. Otherwise False
+BOOL kUnmapLargePage(QWORD qwVirtualAddress) {
+    PDENTRY *pstEntry;
+    QWORD qwOldEntry;
+    BOOL bPreviousFlag;
+
+    if (qwVirtualAddress & (PAGE_DEFAULTSIZE - 1)) {
+        return FALSE;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstEntry = kGetPageDirectoryEntry(qwVirtualAddress, FALSE);
+    if (pstEntry == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    qwOldEntry = pstEntry->qwAttributeAndAddress;
+    pstEntry->qwAttributeAndAddress = 0;
+
+    if ((qwOldEntry & PAGE_FLAGS_P) && !(qwOldEntry & PAGE_FLAGS_PS)) {
+        kFreePageTable((void *) (qwOldEntry & PAGE_ADDRESSMASK));
+    }
+    kFlushTLB(qwVirtualAddress, PAGE_DEFAULTSIZE);
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// map an area with 2MB pages where possible and with 4KB pages elsewhere
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwPhysicalAddress: 4KB aligned physical address
+//   qwSize: size of the area. it is rounded up to 4KB
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags
+// return:
+//   True on success. Otherwise False
+BOOL kMapRange(
+    QWORD qwVirtualAddress,
+    QWORD qwPhysicalAddress,
+    QWORD qwSize,
+    QWORD qwFlags
+) {
+    QWORD qwEndAddress;
+    BOOL bResult;
+
+    qwEndAddress = qwVirtualAddress + (
+        (qwSize + PAGE_SMALLSIZE - 1) & ~((QWORD) PAGE_SMALLSIZE - 1)
+    );
+
+    while (qwVirtualAddress < qwEndAddress) {
+        // both addresses are aligned by 2MB and 2MB is left
+        if (
+            ((qwVirtualAddress & (PAGE_DEFAULTSIZE - 1)) == 0) &&
+            ((qwPhysicalAddress & (PAGE_DEFAULTSIZE - 1)) == 0) &&
+            ((qwEndAddress - qwVirtualAddress) >= PAGE_DEFAULTSIZE)
+        ) {
+            bResult = kMapLargePage(
+                qwVirtualAddress,
+                qwPhysicalAddress,
+                qwFlags
+            );
+            qwVirtualAddress += PAGE_DEFAULTSIZE;
+            qwPhysicalAddress += PAGE_DEFAULTSIZE;
+        }
+        else {
+            bResult = kMapPage(qwVirtualAddress, qwPhysicalAddress, qwFlags);
+            qwVirtualAddress += PAGE_SMALLSIZE;
+            qwPhysicalAddress += PAGE_SMALLSIZE;
+        }
+
+        if (bResult == FALSE) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+// unmap an area
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwSize: size of the area. it is rounded up to 4KB
+// return:
+//   True on success. Otherwise False
+BOOL kUnmapRange(QWORD qwVirtualAddress, QWORD qwSize) {
+    QWORD qwEndAddress;
+    BOOL bResult;
+
+    qwEndAddress = qwVirtualAddress + (
+        (qwSize + PAGE_SMALLSIZE - 1) & ~((QWORD) PAGE_SMALLSIZE - 1)
+    );
+
+    while (qwVirtualAddress < qwEndAddress) {
+        if (
+            ((qwVirtualAddress & (PAGE_DEFAULTSIZE - 1)) == 0) &&
+            ((qwEndAddress - qwVirtualAddress) >= PAGE_DEFAULTSIZE)
+        ) {
+            bResult = kUnmapLargePage(qwVirtualAddress);
+            qwVirtualAddress += PAGE_DEFAULTSIZE;
+        }
+        else {
+            bResult = kUnmapPage(qwVirtualAddress);
+            qwVirtualAddress += PAGE_SMALLSIZE;
+        }
+
+        if (bResult == FALSE) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+// change attributes of mapped pages without changing physical addresses
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwSize: size of the area. it is rounded up to 4KB
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags
+// return:
+//   True on success. Otherwise False
+// info:
+//   2MB pages that are partially covered by the area are split
+BOOL kSetPageAttribute(QWORD qwVirtualAddress, QWORD qwSize, QWORD qwFlags) {
+    QWORD qwStartAddress;
+    QWORD qwEndAddress;
+    PDENTRY *pstDirectoryEntry;
+    PTENTRY *pstEntry;
+    QWORD qwValidFlags;
+    BOOL bPreviousFlag;
+
+    if (qwVirtualAddress & (PAGE_SMALLSIZE - 1)) {
+        return FALSE;
+    }
+
+    qwStartAddress = qwVirtualAddress;
+    qwEndAddress = qwVirtualAddress + (
+        (qwSize + PAGE_SMALLSIZE - 1) & ~((QWORD) PAGE_SMALLSIZE - 1)
+    );
+    qwValidFlags = kGetValidPageFlags(qwFlags);
+
+    bPreviousFlag = kLockForSystemData();
+
+    while (qwVirtualAddress < qwEndAddress) {
+        pstDirectoryEntry = kGetPageDirectoryEntry(qwVirtualAddress, FALSE);
+        if (
+            (pstDirectoryEntry == NULL) ||
+            !(pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_P)
+        ) {
+            kUnlockForSystemData(bPreviousFlag);
+            return FALSE;
+        }
+
+        // whole 2MB page is in the area. no need to split
+        if (
+            (pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_PS) &&
+            ((qwVirtualAddress & (PAGE_DEFAULTSIZE - 1)) == 0) &&
+            ((qwEndAddress - qwVirtualAddress) >= PAGE_DEFAULTSIZE)
+        ) {
+            pstDirectoryEntry->qwAttributeAndAddress = (
+                (pstDirectoryEntry->qwAttributeAndAddress &
+                    PAGE_ADDRESSMASK & ~PAGE_FLAGS_PAT2MB) |
+                qwValidFlags |
+                PAGE_FLAGS_PS |
+                PAGE_FLAGS_P
+            );
+            qwVirtualAddress += PAGE_DEFAULTSIZE;
+            continue;
+        }
+
+        pstEntry = kGetPageTableEntry(qwVirtualAddress, TRUE);
+        if (
+            (pstEntry == NULL) ||
+            !(pstEntry->qwAttributeAndAddress & PAGE_FLAGS_P)
+        ) {
+            kUnlockForSystemData(bPreviousFlag);
+            return FALSE;
+        }
+        pstEntry->qwAttributeAndAddress = (
+            (pstEntry->qwAttributeAndAddress & PAGE_ADDRESSMASK) |
+            qwValidFlags |
+            PAGE_FLAGS_P
+        );
+        qwVirtualAddress += PAGE_SMALLSIZE;
+    }
+
+    kFlushTLB(qwStartAddress, qwEndAddress - qwStartAddress);
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// translate virtual address to physical address
+// params:
+//   qwVirtualAddress: virtual address
+//   pqwPhysicalAddress: address to save physical address
+//   pqwFlags: address to save flags of the page. it can be NULL
+//   pqwPageSize: address to save size of the page. it can be NULL
+// return:
+//   True if the address is mapped. Otherwise False
+BOOL kGetPhysicalAddress(
+    QWORD qwVirtualAddress,
+    QWORD *pqwPhysicalAddress,
+    QWORD *pqwFlags,
+    QWORD *pqwPageSize
+) {
+    PDENTRY *pstDirectoryEntry;
+    PTENTRY *pstEntry;
+    QWORD qwEntry;
+    QWORD qwPageSize;
+
+    pstDirectoryEntry = kGetPageDirectoryEntry(qwVirtualAddress, FALSE);
+    if (
+        (pstDirectoryEntry == NULL) ||
+        !(pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_P)
+    ) {
+        return FALSE;
+    }
+
+    if (pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_PS) {
+        qwEntry = pstDirectoryEntry->qwAttributeAndAddress;
+        qwPageSize = PAGE_DEFAULTSIZE;
+    }
+    else {
+        pstEntry = kGetPageTableEntry(qwVirtualAddress, FALSE);
+        if (
+            (pstEntry == NULL) ||
+            !(pstEntry->qwAttributeAndAddress & PAGE_FLAGS_P)
+        ) {
+            return FALSE;
+        }
+        qwEntry = pstEntry->qwAttributeAndAddress;
+        qwPageSize = PAGE_SMALLSIZE;
+    }
+
+    *pqwPhysicalAddress = (
+        (qwEntry & PAGE_ADDRESSMASK & ~(qwPageSize - 1)) |
+        (qwVirtualAddress & (qwPageSize - 1))
+    );
+    if (pqwFlags != NULL) {
+        *pqwFlags = qwEntry & ~PAGE_ADDRESSMASK;
+    }
+    if (pqwPageSize != NULL) {
+        *pqwPageSize = qwPageSize;
+    }
+    return TRUE;
+}
+
+
+// invalidate TLB entries of an area whose mapping changed
+// params:
+//   qwVirtualAddress: start address of the area
+//   qwSize: size of the area
+// info:
+//   MINT64OS runs only on one core, so shootdown is just invalidating
+//   TLB of the current core. When other cores are activated, they should
+//   be notified here
+void kFlushTLB(QWORD qwVirtualAddress, QWORD qwSize) {
+    QWORD qwEndAddress;
+    QWORD qwCR4;
+
+    qwEndAddress = qwVirtualAddress + qwSize;
+
+    // invalidating each page is cheaper for a few pages
+    // invlpg of a 4KB page also invalidates 2MB page that covers it
+    if ((qwSize / PAGE_SMALLSIZE) <= PAGE_TLBFLUSHTHRESHOLD) {
+        qwVirtualAddress &= ~((QWORD) PAGE_SMALLSIZE - 1);
+        while (qwVirtualAddress < qwEndAddress) {
+            kInvalidatePage(qwVirtualAddress);
+            qwVirtualAddress += PAGE_SMALLSIZE;
+        }
+        return;
+    }
+
+    // writing CR3 does not flush global pages. toggling PGE flushes them
+    if (gs_stPageManager.bGlobalPageSupported) {
+        qwCR4 = kReadCR4();
+        kWriteCR4(qwCR4 & ~PAGE_CR4_PGE);
+        kWriteCR4(qwCR4);
+    }
+    else {
+        kWriteCR3(kReadCR3());
+    }
+}
+
+
+// get page manager
+// return:
+//   pointer to page manager
+PAGEMANAGER *kGetPageManager(void) {
+    return &gs_stPageManager;
+}
+
+
+/* page table pool related functions */
+
+// allocate a zeroed page table from pool
+// return:
+//   address of page table. if pool is full, NULL is returned
+static void *kAllocatePageTable(void) {
+    QWORD *pqwTable;
+
+    // reuse freed table first
+    if (gs_stPageManager.qwFreeTableList != NULL) {
+        pqwTable = (QWORD *) gs_stPageManager.qwFreeTableList;
+        gs_stPageManager.qwFreeTableList = pqwTable[0];
+    }
+    else if (
+        gs_stPageManager.iUnusedTableIndex < gs_stPageManager.iMaxTableCount
+    ) {
+        pqwTable = (QWORD *) (
+            (QWORD) PAGE_TABLEPOOLADDRESS +
+            PAGE_TABLE_SIZE * gs_stPageManager.iUnusedTableIndex
+        );
+        gs_stPageManager.iUnusedTableIndex++;
+    }
+    else {
+        return NULL;
+    }
+
+    kMemSet(pqwTable, 0, PAGE_TABLE_SIZE);
+    gs_stPageManager.iUsedTableCount++;
+    return pqwTable;
+}
+
+
+// return a page table to pool
+// params:
+//   pvTable: page table to free
+static void kFreePageTable(void *pvTable) {
+    QWORD qwTable = (QWORD) pvTable;
+
+    // tables built by 01.Kernel32 are not in pool. they are never freed
+    if (
+        (qwTable < PAGE_TABLEPOOLADDRESS) ||
+        (qwTable >= (PAGE_TABLEPOOLADDRESS + PAGE_TABLEPOOLSIZE))
+    ) {
+        return;
+    }
+
+    ((QWORD *) pvTable)[0] = gs_stPageManager.qwFreeTableList;
+    gs_stPageManager.qwFreeTableList = qwTable;
+    gs_stPageManager.iUsedTableCount--;
+}
+
+
+// get page directory entry of virtual address
+// params:
+//   qwVirtualAddress: virtual address
+//   bCreate: True to create missing PDPT and PD
+// return:
+//   page directory entry. if table does not exist, NULL is returned
+static PDENTRY *kGetPageDirectoryEntry(QWORD qwVirtualAddress, BOOL bCreate) {
+    PML4ENTRY *pstPML4Entry;
+    PDPTENTRY *pstPDPTEntry;
+    PDENTRY *pstPDTable;
+    void *pvTable;
+
+    pstPML4Entry = &(
+        gs_stPageManager.pstPML4Table[PAGE_PML4INDEX(qwVirtualAddress)]
+    );
+    if (!(pstPML4Entry->qwAttributeAndAddress & PAGE_FLAGS_P)) {
+        if (bCreate == FALSE) {
+            return NULL;
+        }
+        pvTable = kAllocatePageTable();
+        if (pvTable == NULL) {
+            return NULL;
+        }
+        pstPML4Entry->qwAttributeAndAddress = (QWORD) pvTable | PAGE_FLAGS_TABLE;
+    }
+
+    pstPDPTEntry = (PDPTENTRY *) (
+        pstPML4Entry->qwAttributeAndAddress & PAGE_ADDRESSMASK
+    );
+    pstPDPTEntry += PAGE_PDPTINDEX(qwVirtualAddress);
+
+    // MINT64OS does not use 1GB pages
+    if (pstPDPTEntry->qwAttributeAndAddress & PAGE_FLAGS_PS) {
+        return NULL;
+    }
+    if (!(pstPDPTEntry->qwAttributeAndAddress & PAGE_FLAGS_P)) {
+        if (bCreate == FALSE) {
+            return NULL;
+        }
+        pvTable = kAllocatePageTable();
+        if (pvTable == NULL) {
+            return NULL;
+        }
+        pstPDPTEntry->qwAttributeAndAddress = (QWORD) pvTable | PAGE_FLAGS_TABLE;
+    }
+
+    pstPDTable = (PDENTRY *) (
+        pstPDPTEntry->qwAttributeAndAddress & PAGE_ADDRESSMASK
+    );
+    return &(pstPDTable[PAGE_PDINDEX(qwVirtualAddress)]);
+}
+
+
+// get page table entry of virtual address
+// params:
+//   qwVirtualAddress: virtual address
+//   bCreate: True to create missing tables and split 2MB page
+// return:
+//   page table entry. if table does not exist, NULL is returned
+static PTENTRY *kGetPageTableEntry(QWORD qwVirtualAddress, BOOL bCreate) {
+    PDENTRY *pstDirectoryEntry;
+    PTENTRY *pstTable;
+
+    pstDirectoryEntry = kGetPageDirectoryEntry(qwVirtualAddress, bCreate);
+    if (pstDirectoryEntry == NULL) {
+        return NULL;
+    }
+
+    if (pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_PS) {
+        if ((bCreate == FALSE) || (kSplitLargePage(pstDirectoryEntry) == FALSE)) {
+            return NULL;
+        }
+    }
+    else if (!(pstDirectoryEntry->qwAttributeAndAddress & PAGE_FLAGS_P)) {
+        if (bCreate == FALSE) {
+            return NULL;
+        }
+        pstTable = kAllocatePageTable();
+        if (pstTable == NULL) {
+            return NULL;
+        }
+        pstDirectoryEntry->qwAttributeAndAddress = (
+            (QWORD) pstTable | PAGE_FLAGS_TABLE
+        );
+    }
+
+    pstTable = (PTENTRY *) (
+        pstDirectoryEntry->qwAttributeAndAddress & PAGE_ADDRESSMASK
+    );
+    return &(pstTable[PAGE_PTINDEX(qwVirtualAddress)]);
+}
+
+
+// split a 2MB page into a page table of 512 4KB pages with same attributes
+// params:
+//   pstEntry: page directory entry that maps 2MB page
+// return:
+//   True on success. Otherwise False
+static BOOL kSplitLargePage(PDENTRY *pstEntry) {
+    PTENTRY *pstTable;
+    QWORD qwPhysicalAddress;
+    QWORD qwFlags;
+    int i;
+
+    pstTable = kAllocatePageTable();
+    if (pstTable == NULL) {
+        return FALSE;
+    }
+
+    // PAT bit moves from bit 12 to bit 7 and PS bit is not used in 4KB entry
+    qwPhysicalAddress = (
+        pstEntry->qwAttributeAndAddress &
+        PAGE_ADDRESSMASK &
+        ~((QWORD) PAGE_DEFAULTSIZE - 1)
+    );
+    qwFlags = pstEntry->qwAttributeAndAddress & ~PAGE_ADDRESSMASK;
+    qwFlags &= ~PAGE_FLAGS_PS;
+    if (pstEntry->qwAttributeAndAddress & PAGE_FLAGS_PAT2MB) {
+        qwFlags |= PAGE_FLAGS_PAT4KB;
+    }
+
+    for (i = 0; i < PAGE_MAXENTRYCOUNT; i++) {
+        pstTable[i].qwAttributeAndAddress = (
+            (qwPhysicalAddress + i * PAGE_SMALLSIZE) | qwFlags
+        );
+    }
+
+    // same mappings with same attributes. TLB entry of 2MB page is still
+    // valid until caller changes a 4KB page and invalidates it
+    pstEntry->qwAttributeAndAddress = (QWORD) pstTable | PAGE_FLAGS_TABLE;
+    return TRUE;
+}
+
+
+// make flags of entry valid for current processor
+// params:
+//   qwFlags: flags given by caller
+// return:
+//   flags that can be written to entry
+static QWORD kGetValidPageFlags(QWORD qwFlags) {
+    qwFlags &= PAGE_FLAGS_ATTRIBUTEMASK;
+
+    // these bits are reserved if processor does not support them
+    if (gs_stPageManager.bNXSupported == FALSE) {
+        qwFlags &= ~PAGE_FLAGS_NX;
+    }
+    if (gs_stPageManager.bGlobalPageSupported == FALSE) {
+        qwFlags &= ~PAGE_FLAGS_G;
+    }
+    return qwFlags;
+}
@@ -0,0 +1,308 @@
+/*
+ * Page.h contains page table manager of IA-32e mode kernel.
+ *
+ * 01.Kernel32 builds page tables at 0x100000 (1MB) that identity-map the
+ * first 64GB with 2MB pages. This module changes the tables at runtime.
+ * It can map and unmap 4KB and 2MB pages, change attributes of pages and
+ * invalidate TLB entries of the changed pages.
+ *
+ * When a 4KB page is mapped in an area covered by a 2MB page, the 2MB page
+ * is split into a page table that has 512 4KB pages with the same
+ * attributes. Page tables made at runtime come from page table pool.
+ *
+ * reference a picture, IA-32e paging structure entries, in 9-1.md
+ */
+
+#ifndef __PAGE_H__
+#define __PAGE_H__
+
+#include "Types.h"
+
+
+/* page entry flags */
+
+// common in all entries
+#define PAGE_FLAGS_P     0x0000000000000001   // Present
+#define PAGE_FLAGS_RW    0x0000000000000002   // Read/Write
+#define PAGE_FLAGS_US    0x0000000000000004   // User/Supervisor ; 1=user level
+#define PAGE_FLAGS_PWT   0x0000000000000008   // Page Level Write-through
+#define PAGE_FLAGS_PCD   0x0000000000000010   // PAGE Level Cache Disable
+#define PAGE_FLAGS_A     0x0000000000000020   // Accessed
+#define PAGE_FLAGS_NX    0x8000000000000000   // Execute Disable bit
+
+// only for entry that has addr to page frame
+#define PAGE_FLAGS_D     0x0000000000000040   // Dirty
+#define PAGE_FLAGS_PS    0x0000000000000080   // Page Size
+#define PAGE_FLAGS_G     0x0000000000000100   // Global
+
+// PAT bit is at different location in 4KB and 2MB entries
+#define PAGE_FLAGS_PAT4KB   0x0000000000000080
+#define PAGE_FLAGS_PAT2MB   0x0000000000001000
+
+// write-combining memory type
+// kInitializePageManager changes PAT entry 1 (PWT = 1, PCD = 0, PAT = 0)
+// from write-through to write-combining
+#define PAGE_FLAGS_WC    PAGE_FLAGS_PWT
+
+// uncacheable memory type for MMIO area
+#define PAGE_FLAGS_UC    (PAGE_FLAGS_PCD | PAGE_FLAGS_PWT)
+
+// flags that caller can change
+#define PAGE_FLAGS_ATTRIBUTEMASK ( \
+    PAGE_FLAGS_RW | PAGE_FLAGS_US | PAGE_FLAGS_PWT | PAGE_FLAGS_PCD | \
+    PAGE_FLAGS_G | PAGE_FLAGS_NX \
+)
+
+// flags of entries that point to next level table
+// access rights are checked by entries that point to page frames
+#define PAGE_FLAGS_TABLE   (PAGE_FLAGS_P | PAGE_FLAGS_RW | PAGE_FLAGS_US)
+
+#define PAGE_FLAGS_DEFAULT (PAGE_FLAGS_P | PAGE_FLAGS_RW)
+
+// bits of entry that hold address of page frame or next level table
+#define PAGE_ADDRESSMASK    0x000FFFFFFFFFF000
+
+
+/* page size and table layout */
+
+#define PAGE_TABLE_SIZE     0x1000  // each table size (8 bytes * 512)
+#define PAGE_MAXENTRYCOUNT  512     // max number of entries in a table
+
+#define PAGE_SMALLSIZE      0x1000      // size of small page frame: 4KB
+#define PAGE_DEFAULTSIZE    0x200000    // size of page frame: 2MB
+
+// index of each table for a virtual address
+#define PAGE_PML4INDEX(x)   (((x) >> 39) & 0x1FF)
+#define PAGE_PDPTINDEX(x)   (((x) >> 30) & 0x1FF)
+#define PAGE_PDINDEX(x)     (((x) >> 21) & 0x1FF)
+#define PAGE_PTINDEX(x)     (((x) >> 12) & 0x1FF)
+
+
+/* page table pool */
+
+// page tables made at runtime live between IDT and 64 bit kernel
+// 1.5MB ~ 2MB, 128 tables
+#define PAGE_TABLEPOOLADDRESS   0x180000
+#define PAGE_TABLEPOOLSIZE      0x80000
+
+
+/* TLB related constants */
+
+// if more pages than this value changes, whole TLB is flushed instead of
+// invalidating each page
+#define PAGE_TLBFLUSHTHRESHOLD  32
+
+
+/* processor features related constants */
+
+#define PAGE_MSR_IA32EFER   0xC0000080
+#define PAGE_MSR_IA32PAT    0x277
+
+#define PAGE_EFER_NXE       0x800       // bit 11
+#define PAGE_CR0_WP         0x10000     // bit 16
+#define PAGE_CR4_PGE        0x80        // bit 7
+
+// PAT entry 1 (bits 8 ~ 15) and its write-combining type
+#define PAGE_PAT_ENTRY1MASK     0xFF00
+#define PAGE_PAT_WRITECOMBINING 0x0100
+
+
+#pragma pack(push, 1)
+
+// base structure for all entries
+typedef struct kPageTableEntryStruct {
+    QWORD qwAttributeAndAddress;
+} PML4ENTRY, PDPTENTRY, PDENTRY, PTENTRY;
+
+
+// manages the state of page tables and page table pool
+typedef struct kPageManagerStruct {
+    // PML4 table that CR3 points to
+    PML4ENTRY *pstPML4Table;
+
+    // free tables in pool are linked by their first entry
+    QWORD qwFreeTableList;
+
+    // number of tables which have never been used in pool
+    int iUnusedTableIndex;
+    int iMaxTableCount;
+    int iUsedTableCount;
+
+    // processor features
+    BOOL bNXSupported;
+    BOOL bGlobalPageSupported;
+    BOOL bPATSupported;
+} PAGEMANAGER;
+
+#pragma pack(pop)
+
+
+/* page manager related functions */
+
+// initialize page table manager and activate NX, WP, global page and
+// write-combining features if processor supports them
+void kInitializePageManager(void);
+
+
+// map a 4KB page
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwPhysicalAddress: 4KB aligned physical address
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags. present flag is set by default
+// return:
+//   True on success. Otherwise False
+// info:
+//   if a 2MB page covers the address, the 2MB page is split
+BOOL kMapPage(QWORD qwVirtualAddress, QWORD qwPhysicalAddress, QWORD qwFlags);
+
+
+// map a 2MB page
+// params:
+//   qwVirtualAddress: 2MB aligned virtual address
+//   qwPhysicalAddress: 2MB aligned physical address
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags. present flag is set by default
+// return:
+//   True on success. Otherwise False
+// info:
+//   if a page table covers the address, the page table is freed
+BOOL kMapLargePage(
+    QWORD qwVirtualAddress,
+    QWORD qwPhysicalAddress,
+    QWORD qwFlags
+);
+
+
+// unmap a 4KB page
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+// return:
+//   True on success. Otherwise False
+BOOL kUnmapPage(QWORD qwVirtualAddress);
+
+
+// unmap a 2MB page or all 4KB pages in the 2MB area
+// params:
+//   qwVirtualAddress: 2MB aligned virtual address
+// return:
+//   True on success. Otherwise False
+BOOL kUnmapLargePage(QWORD qwVirtualAddress);
+
+
+// map an area with 2MB pages where possible and with 4KB pages elsewhere
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwPhysicalAddress: 4KB aligned physical address
+//   qwSize: size of the area. it is rounded up to 4KB
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags
+// return:
+//   True on success. Otherwise False
+BOOL kMapRange(
+    QWORD qwVirtualAddress,
+    QWORD qwPhysicalAddress,
+    QWORD qwSize,
+    QWORD qwFlags
+);
+
+
+// unmap an area
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwSize: size of the area. it is rounded up to 4KB
+// return:
+//   True on success. Otherwise False
+BOOL kUnmapRange(QWORD qwVirtualAddress, QWORD qwSize);
+
+
+// change attributes of mapped pages without changing physical addresses
+// params:
+//   qwVirtualAddress: 4KB aligned virtual address
+//   qwSize: size of the area. it is rounded up to 4KB
+//   qwFlags: PAGE_FLAGS_ATTRIBUTEMASK flags
+// return:
+//   True on success. Otherwise False
+// info:
+//   2MB pages that are partially covered by the area are split
+BOOL kSetPageAttribute(QWORD qwVirtualAddress, QWORD qwSize, QWORD qwFlags);
+
+
+// translate virtual address to physical address
+// params:
+//   qwVirtualAddress: virtual address
+//   pqwPhysicalAddress: address to save physical address
+//   pqwFlags: address to save flags of the page. it can be NULL
+//   pqwPageSize: address to save size of the page. it can be NULL
+// return:
+//   True if the address is mapped. Otherwise False
+BOOL kGetPhysicalAddress(
+    QWORD qwVirtualAddress,
+    QWORD *pqwPhysicalAddress,
+    QWORD *pqwFlags,
+    QWORD *pqwPageSize
+);
+
+
+// invalidate TLB entries of an area whose mapping changed
+// params:
+//   qwVirtualAddress: start address of the area
+//   qwSize: size of the area
+// info:
+//   MINT64OS runs only on one core, so shootdown is just invalidating
+//   TLB of the current core. When other cores are activated, they should
+//   be notified here
+void kFlushTLB(QWORD qwVirtualAddress, QWORD qwSize);
+
+
+// get page manager
+// return:
+//   pointer to page manager
+PAGEMANAGER *kGetPageManager(void);
+
+
+/* page table pool related functions */
+
+// allocate a zeroed page table from pool
+// return:
+//   address of page table. if pool is full, NULL is returned
+static void *kAllocatePageTable(void);
+
+
+// return a page table to pool
+// params:
+//   pvTable: page table to free
+static void kFreePageTable(void *pvTable);
+
+
+// get page directory entry of virtual address
+// params:
+//   qwVirtualAddress: virtual address
+//   bCreate: True to create missing PDPT and PD
+// return:
+//   page directory entry. if table does not exist, NULL is returned
+static PDENTRY *kGetPageDirectoryEntry(QWORD qwVirtualAddress, BOOL bCreate);
+
+
+// get page table entry of virtual address
+// params:
+//   qwVirtualAddress: virtual address
+//   bCreate: True to create missing tables and split 2MB page
+// return:
+//   page table entry. if table does not exist, NULL is returned
+static PTENTRY *kGetPageTableEntry(QWORD qwVirtualAddress, BOOL bCreate);
+
+
+// split a 2MB page into a page table of 512 4KB pages with same attributes
+// params:
+//   pstEntry: page directory entry that maps 2MB page
+// return:
+//   True on success. Otherwise False
+static BOOL kSplitLargePage(PDENTRY *pstEntry);
+
+
+// make flags of entry valid for current processor
+// params:
+//   qwFlags: flags given by caller
+// return:
+//   flags that can be written to entry
+static QWORD kGetValidPageFlags(QWORD qwFlags);
+
+#endif /* __PAGE_H__ */
@@ -0,0 +1,641 @@
+#include "PageFrame.h"
+#include "Utility.h"
+#include "Synchronization.h"
+
+static PAGEFRAMEMANAGER gs_stPageFrameManager;
+
+
+/* page frame allocator related functions */
+
+// initialize page frame allocator with usable areas of E820 memory map
+void kInitializePageFrameAllocator(void) {
+    SMAP_entry_t *pstEntry = (SMAP_entry_t *) SMAP_START_ADDRESS;
+    DWORD dwEntryCount = *(DWORD *) SMAP_COUNT_ADDRESS;
+    QWORD qwStartAddress;
+    QWORD qwEndAddress;
+    QWORD qwHighestAddress;
+    QWORD qwStartIndex;
+    QWORD qwEndIndex;
+    QWORD i;
+    int iZone;
+    int j;
+
+    kMemSet(&gs_stPageFrameManager, 0, sizeof(gs_stPageFrameManager));
+    for (iZone = 0; iZone < PAGEFRAME_ZONECOUNT; iZone++) {
+        for (j = 0; j < PAGEFRAME_MAXORDER; j++) {
+            kInitializeList(&(gs_stPageFrameManager.vstZone[iZone].vstFreeList[j]));
+        }
+    }
+
+
+    /* size of state array */
+
+    qwHighestAddress = 0;
+    for (j = 0; j < dwEntryCount; j++) {
+        if (pstEntry[j].Type != 1) {
+            continue;
+        }
+        qwEndAddress = MIN(
+            pstEntry[j].Base + pstEntry[j].Length,
+            PAGEFRAME_MAX_ADDRESS
+        );
+        qwHighestAddress = MAX(qwHighestAddress, qwEndAddress);
+    }
+
+    gs_stPageFrameManager.qwFrameCount = qwHighestAddress / PAGEFRAME_SIZE;
+    gs_stPageFrameManager.qwMetaDataSize = (
+        (gs_stPageFrameManager.qwFrameCount + PAGEFRAME_SIZE - 1) &
+        ~((QWORD) PAGEFRAME_SIZE - 1)
+    );
+    gs_stPageFrameManager.pbFrameState = kFindPageFrameMetaDataArea(
+        gs_stPageFrameManager.qwMetaDataSize
+    );
+    if (gs_stPageFrameManager.pbFrameState == NULL) {
+        gs_stPageFrameManager.qwFrameCount = 0;
+        return;
+    }
+    kMemSet(
+        gs_stPageFrameManager.pbFrameState,
+        PAGEFRAME_STATE_RESERVED,
+        gs_stPageFrameManager.qwMetaDataSize
+    );
+
+
+    /* state of each frame */
+
+    // usable areas shrink to page boundaries
+    for (j = 0; j < dwEntryCount; j++) {
+        if (pstEntry[j].Type != 1) {
+            continue;
+        }
+        qwStartAddress = (pstEntry[j].Base + PAGEFRAME_SIZE - 1) &
+            ~((QWORD) PAGEFRAME_SIZE - 1);
+        qwEndAddress = (pstEntry[j].Base + pstEntry[j].Length) &
+            ~((QWORD) PAGEFRAME_SIZE - 1);
+        kSetPageFrameState(
+            MAX(qwStartAddress, PAGEFRAME_START_ADDRESS),
+            qwEndAddress,
+            PAGEFRAME_STATE_USABLE
+        );
+    }
+
+    // some BIOSes report overlapped areas. reserved area wins, so it grows
+    // to page boundaries
+    for (j = 0; j < dwEntryCount; j++) {
+        if (pstEntry[j].Type == 1) {
+            continue;
+        }
+        qwStartAddress = pstEntry[j].Base & ~((QWORD) PAGEFRAME_SIZE - 1);
+        qwEndAddress = (
+            pstEntry[j].Base + pstEntry[j].Length + PAGEFRAME_SIZE - 1
+        ) & ~((QWORD) PAGEFRAME_SIZE - 1);
+        kSetPageFrameState(qwStartAddress, qwEndAddress, PAGEFRAME_STATE_RESERVED);
+    }
+
+    // state array itself
+    kSetPageFrameState(
+        (QWORD) gs_stPageFrameManager.pbFrameState,
+        (QWORD) gs_stPageFrameManager.pbFrameState +
+            gs_stPageFrameManager.qwMetaDataSize,
+        PAGEFRAME_STATE_RESERVED
+    );
+
+
+    /* free lists */
+
+    // consecutive usable frames of the same zone become blocks
+    for (i = 0; i < gs_stPageFrameManager.qwFrameCount;) {
+        if (gs_stPageFrameManager.pbFrameState[i] != PAGEFRAME_STATE_USABLE) {
+            i++;
+            continue;
+        }
+
+        qwStartIndex = i;
+        iZone = kGetPageFrameZone(qwStartIndex * PAGEFRAME_SIZE);
+        for (
+            qwEndIndex = qwStartIndex;
+            qwEndIndex < gs_stPageFrameManager.qwFrameCount;
+            qwEndIndex++
+        ) {
+            if (
+                (gs_stPageFrameManager.pbFrameState[qwEndIndex] !=
+                    PAGEFRAME_STATE_USABLE) ||
+                (kGetPageFrameZone(qwEndIndex * PAGEFRAME_SIZE) != iZone)
+            ) {
+                break;
+            }
+        }
+
+        kAddPageFrameArea(qwStartIndex, qwEndIndex, iZone);
+        i = qwEndIndex;
+    }
+}
+
+
+// allocate 2^iOrder contiguous page frames
+// params:
+//   iOrder: order of block
+//   iZone: the highest zone which frames can be allocated from. if the zone
+//          does not have free frames, lower zones are searched
+// return:
+//   address of the first frame. if there is no block, NULL is returned
+void *kAllocatePageFrames(int iOrder, int iZone) {
+    PAGEFRAMEZONE *pstZone;
+    PAGEFRAMEBLOCK *pstBlock;
+    QWORD qwAddress;
+    QWORD qwBuddyAddress;
+    BOOL bPreviousFlag;
+    int iBlockOrder;
+
+    if (
+        (iOrder < 0) || (iOrder >= PAGEFRAME_MAXORDER) ||
+        (iZone < 0) || (iZone >= PAGEFRAME_ZONECOUNT)
+    ) {
+        return NULL;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    // higher zone first to save low memory for devices
+    for (; iZone >= 0; iZone--) {
+        pstZone = &(gs_stPageFrameManager.vstZone[iZone]);
+
+        for (iBlockOrder = iOrder; iBlockOrder < PAGEFRAME_MAXORDER; iBlockOrder++) {
+            if (kGetListCount(&(pstZone->vstFreeList[iBlockOrder])) > 0) {
+                break;
+            }
+        }
+        if (iBlockOrder == PAGEFRAME_MAXORDER) {
+            continue;
+        }
+
+        pstBlock = kRemoveListFromHeader(&(pstZone->vstFreeList[iBlockOrder]));
+        qwAddress = (QWORD) pstBlock;
+
+        // give upper half back to free list until the block is as small as
+        // requested
+        while (iBlockOrder > iOrder) {
+            iBlockOrder--;
+            qwBuddyAddress = qwAddress + ((QWORD) PAGEFRAME_SIZE << iBlockOrder);
+
+            gs_stPageFrameManager.pbFrameState[qwBuddyAddress / PAGEFRAME_SIZE] =
+                PAGEFRAME_STATE_FREE | iBlockOrder;
+            pstBlock = (PAGEFRAMEBLOCK *) qwBuddyAddress;
+            pstBlock->stLink.qwID = qwBuddyAddress;
+            kAddListToHeader(&(pstZone->vstFreeList[iBlockOrder]), pstBlock);
+        }
+
+        gs_stPageFrameManager.pbFrameState[qwAddress / PAGEFRAME_SIZE] =
+            PAGEFRAME_STATE_ALLOCATED | iOrder;
+        pstZone->qwFreeFrameCount -= ((QWORD) 1 << iOrder);
+
+        kUnlockForSystemData(bPreviousFlag);
+        return (void *) qwAddress;
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+    return NULL;
+}
+
+
+// allocate qwFrameCount contiguous page frames without rounding up to
+// power of two
+// params:
+//   qwFrameCount: number of frames
+//   iZone: the highest zone which frames can be allocated from
+// return:
+//   address of the first frame. if there is no run, NULL is returned
+// info:
+//   a block of the next order is allocated and frames after the run are
+//   given back to free lists
+void *kAllocatePageFrameRun(QWORD qwFrameCount, int iZone) {
+    void *pvAddress;
+    QWORD qwIndex;
+    QWORD qwBlockFrameCount;
+    BOOL bPreviousFlag;
+    int iOrder;
+
+    if (qwFrameCount == 0) {
+        return NULL;
+    }
+
+    iOrder = kGetPageFrameOrder(qwFrameCount * PAGEFRAME_SIZE);
+    if (iOrder == -1) {
+        return NULL;
+    }
+
+    pvAddress = kAllocatePageFrames(iOrder, iZone);
+    if (pvAddress == NULL) {
+        return NULL;
+    }
+
+    qwBlockFrameCount = (QWORD) 1 << iOrder;
+    if (qwFrameCount == qwBlockFrameCount) {
+        return pvAddress;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    qwIndex = (QWORD) pvAddress / PAGEFRAME_SIZE;
+    gs_stPageFrameManager.pbFrameState[qwIndex] = PAGEFRAME_STATE_RUN;
+    kFreePageFrameRange(
+        qwIndex + qwFrameCount,
+        qwBlockFrameCount - qwFrameCount
+    );
+
+    kUnlockForSystemData(bPreviousFlag);
+    return pvAddress;
+}
+
+
+// free page frames allocated by kAllocatePageFrames or kAllocatePageFrameRun
+// params:
+//   pvAddress: address returned by the allocation functions
+// return:
+//   True on success. Otherwise False
+BOOL kFreePageFrames(void *pvAddress) {
+    QWORD qwIndex;
+    QWORD qwFrameCount;
+    BYTE bState;
+    BOOL bPreviousFlag;
+
+    qwIndex = (QWORD) pvAddress / PAGEFRAME_SIZE;
+    if (
+        ((QWORD) pvAddress & (PAGEFRAME_SIZE - 1)) ||
+        (qwIndex >= gs_stPageFrameManager.qwFrameCount)
+    ) {
+        return FALSE;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    // if pvAddress was not allocated
+    qwFrameCount = kGetAllocatedFrameCount(qwIndex);
+    if (qwFrameCount == 0) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    bState = gs_stPageFrameManager.pbFrameState[qwIndex];
+    if (bState == PAGEFRAME_STATE_RUN) {
+        kFreePageFrameRange(qwIndex, qwFrameCount);
+    }
+    else {
+        kFreePageFrameBlock(qwIndex, bState & PAGEFRAME_STATE_ORDERMASK);
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// extend allocated block or run in place with free frames right after it
+// params:
+//   pvAddress: address returned by the allocation functions
+//   qwFrameCount: number of frames after extension
+// return:
+//   True on success. Otherwise False and the block is not changed
+// info:
+//   the block becomes a run
+BOOL kExtendPageFrames(void *pvAddress, QWORD qwFrameCount) {
+    PAGEFRAMEZONE *pstZone;
+    BYTE *pbFrameState;
+    QWORD qwIndex;
+    QWORD qwEndIndex;
+    QWORD qwBlockEndIndex;
+    QWORD qwCurrentFrameCount;
+    QWORD i;
+    BOOL bPreviousFlag;
+    int iOrder;
+    int iZone;
+
+    qwIndex = (QWORD) pvAddress / PAGEFRAME_SIZE;
+    qwEndIndex = qwIndex + qwFrameCount;
+    pbFrameState = gs_stPageFrameManager.pbFrameState;
+    if (
+        ((QWORD) pvAddress & (PAGEFRAME_SIZE - 1)) ||
+        (qwEndIndex > gs_stPageFrameManager.qwFrameCount)
+    ) {
+        return FALSE;
+    }
+
+    // frames of another zone cannot be added
+    iZone = kGetPageFrameZone(qwIndex * PAGEFRAME_SIZE);
+    if (kGetPageFrameZone((qwEndIndex - 1) * PAGEFRAME_SIZE) != iZone) {
+        return FALSE;
+    }
+    pstZone = &(gs_stPageFrameManager.vstZone[iZone]);
+
+    bPreviousFlag = kLockForSystemData();
+
+    qwCurrentFrameCount = kGetAllocatedFrameCount(qwIndex);
+    if (qwCurrentFrameCount == 0) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+    if (qwFrameCount <= qwCurrentFrameCount) {
+        kUnlockForSystemData(bPreviousFlag);
+        return TRUE;
+    }
+
+    // every frame up to qwEndIndex must be in free blocks
+    for (i = qwIndex + qwCurrentFrameCount; i < qwEndIndex;) {
+        if (!(pbFrameState[i] & PAGEFRAME_STATE_FREE)) {
+            kUnlockForSystemData(bPreviousFlag);
+            return FALSE;
+        }
+        i += (QWORD) 1 << (pbFrameState[i] & PAGEFRAME_STATE_ORDERMASK);
+    }
+
+    // take the free blocks. frames beyond qwEndIndex are given back
+    for (i = qwIndex + qwCurrentFrameCount; i < qwEndIndex;) {
+        iOrder = pbFrameState[i] & PAGEFRAME_STATE_ORDERMASK;
+        qwBlockEndIndex = i + ((QWORD) 1 << iOrder);
+
+        kRemoveList(&(pstZone->vstFreeList[iOrder]), i * PAGEFRAME_SIZE);
+        pstZone->qwFreeFrameCount -= ((QWORD) 1 << iOrder);
+        pbFrameState[i] = PAGEFRAME_STATE_TAIL;
+
+        if (qwBlockEndIndex > qwEndIndex) {
+            kFreePageFrameRange(qwEndIndex, qwBlockEndIndex - qwEndIndex);
+        }
+        i = qwBlockEndIndex;
+    }
+    pbFrameState[qwIndex] = PAGEFRAME_STATE_RUN;
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// get the smallest order of block in which qwSize fits
+// params:
+//   qwSize: requested memory size
+// return:
+//   order of block. if qwSize is bigger than the biggest block, -1
+int kGetPageFrameOrder(QWORD qwSize) {
+    int i;
+
+    for (i = 0; i < PAGEFRAME_MAXORDER; i++) {
+        if (qwSize <= ((QWORD) PAGEFRAME_SIZE << i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// get size of block or run which is allocated by the allocation functions
+// params:
+//   pvAddress: address returned by the allocation functions
+// return:
+//   size of block. if pvAddress is not allocated, 0
+QWORD kGetPageFrameBlockSize(const void *pvAddress) {
+    QWORD qwIndex;
+
+    qwIndex = (QWORD) pvAddress / PAGEFRAME_SIZE;
+    if (qwIndex >= gs_stPageFrameManager.qwFrameCount) {
+        return 0;
+    }
+    return kGetAllocatedFrameCount(qwIndex) * PAGEFRAME_SIZE;
+}
+
+
+// get page frame manager
+// return:
+//   pointer to page frame manager
+PAGEFRAMEMANAGER *kGetPageFrameManager(void) {
+    return &gs_stPageFrameManager;
+}
+
+
+// get zone to which a physical address belongs
+// params:
+//   qwAddress: physical address
+// return:
+//   PAGEFRAME_ZONE_DMA, PAGEFRAME_ZONE_DMA32 or PAGEFRAME_ZONE_NORMAL
+static int kGetPageFrameZone(QWORD qwAddress) {
+    if (qwAddress < PAGEFRAME_DMA_END_ADDRESS) {
+        return PAGEFRAME_ZONE_DMA;
+    }
+    if (qwAddress < PAGEFRAME_DMA32_END_ADDRESS) {
+        return PAGEFRAME_ZONE_DMA32;
+    }
+    return PAGEFRAME_ZONE_NORMAL;
+}
+
+
+// find usable area for state array of page frames
+// params:
+//   qwSize: size of state array
+// return:
+//   address of the area. if there is no area, NULL is returned
+static BYTE *kFindPageFrameMetaDataArea(QWORD qwSize) {
+    SMAP_entry_t *pstEntry = (SMAP_entry_t *) SMAP_START_ADDRESS;
+    DWORD dwEntryCount = *(DWORD *) SMAP_COUNT_ADDRESS;
+    QWORD qwStartAddress;
+    QWORD qwEndAddress;
+    int i;
+
+    // the first usable area above kernel data structures that is big enough
+    for (i = 0; i < dwEntryCount; i++) {
+        if (pstEntry[i].Type != 1) {
+            continue;
+        }
+        qwStartAddress = (pstEntry[i].Base + PAGEFRAME_SIZE - 1) &
+            ~((QWORD) PAGEFRAME_SIZE - 1);
+        qwStartAddress = MAX(qwStartAddress, PAGEFRAME_START_ADDRESS);
+        qwEndAddress = MIN(
+            pstEntry[i].Base + pstEntry[i].Length,
+            PAGEFRAME_MAX_ADDRESS
+        );
+
+        if ((qwStartAddress < qwEndAddress) &&
+            ((qwEndAddress - qwStartAddress) >= qwSize)) {
+            return (BYTE *) qwStartAddress;
+        }
+    }
+    return NULL;
+}
+
+
+// set state of page frames in an area
+// params:
+//   qwStartAddress: start address of area
+//   qwEndAddress: end address of area
+//   bState: state to set
+static void kSetPageFrameState(
+    QWORD qwStartAddress,
+    QWORD qwEndAddress,
+    BYTE bState
+) {
+    QWORD qwStartIndex;
+    QWORD qwEndIndex;
+    QWORD i;
+
+    qwStartIndex = qwStartAddress / PAGEFRAME_SIZE;
+    qwEndIndex = MIN(
+        qwEndAddress / PAGEFRAME_SIZE,
+        gs_stPageFrameManager.qwFrameCount
+    );
+
+    for (i = qwStartIndex; i < qwEndIndex; i++) {
+        gs_stPageFrameManager.pbFrameState[i] = bState;
+    }
+}
+
+
+// put a block back to free list and merge it with its buddies
+// params:
+//   qwIndex: index of the first frame of block
+//   iOrder: order of block
+// info:
+//   caller must hold lock
+static void kFreePageFrameBlock(QWORD qwIndex, int iOrder) {
+    PAGEFRAMEZONE *pstZone;
+    PAGEFRAMEBLOCK *pstBlock;
+    BYTE *pbFrameState;
+    QWORD qwAddress;
+    QWORD qwBuddyAddress;
+    QWORD qwBuddyIndex;
+    int iZone;
+
+    pbFrameState = gs_stPageFrameManager.pbFrameState;
+    qwAddress = qwIndex * PAGEFRAME_SIZE;
+    iZone = kGetPageFrameZone(qwAddress);
+    pstZone = &(gs_stPageFrameManager.vstZone[iZone]);
+    pstZone->qwFreeFrameCount += ((QWORD) 1 << iOrder);
+
+    // merge with buddy while buddy is free block of the same order
+    for (; iOrder < (PAGEFRAME_MAXORDER - 1); iOrder++) {
+        qwBuddyAddress = qwAddress ^ ((QWORD) PAGEFRAME_SIZE << iOrder);
+        qwBuddyIndex = qwBuddyAddress / PAGEFRAME_SIZE;
+
+        if (
+            (qwBuddyIndex >= gs_stPageFrameManager.qwFrameCount) ||
+            (pbFrameState[qwBuddyIndex] != (PAGEFRAME_STATE_FREE | iOrder)) ||
+            (kGetPageFrameZone(qwBuddyAddress) != iZone)
+        ) {
+            break;
+        }
+
+        kRemoveList(&(pstZone->vstFreeList[iOrder]), qwBuddyAddress);
+        pbFrameState[qwBuddyIndex] = PAGEFRAME_STATE_TAIL;
+        pbFrameState[qwIndex] = PAGEFRAME_STATE_TAIL;
+
+        qwAddress = MIN(qwAddress, qwBuddyAddress);
+        qwIndex = qwAddress / PAGEFRAME_SIZE;
+    }
+
+    pbFrameState[qwIndex] = PAGEFRAME_STATE_FREE | iOrder;
+    pstBlock = (PAGEFRAMEBLOCK *) qwAddress;
+    pstBlock->stLink.qwID = qwAddress;
+    kAddListToHeader(&(pstZone->vstFreeList[iOrder]), pstBlock);
+}
+
+
+// put frames to free lists as biggest aligned blocks
+// params:
+//   qwIndex: index of the first frame
+//   qwFrameCount: number of frames
+// info:
+//   caller must hold lock. frames must be in a zone
+static void kFreePageFrameRange(QWORD qwIndex, QWORD qwFrameCount) {
+    QWORD qwFrameCountOfBlock;
+    int iOrder;
+
+    while (qwFrameCount > 0) {
+        for (iOrder = PAGEFRAME_MAXORDER - 1; iOrder > 0; iOrder--) {
+            qwFrameCountOfBlock = (QWORD) 1 << iOrder;
+            if (
+                ((qwIndex & (qwFrameCountOfBlock - 1)) == 0) &&
+                (qwFrameCountOfBlock <= qwFrameCount)
+            ) {
+                break;
+            }
+        }
+        qwFrameCountOfBlock = (QWORD) 1 << iOrder;
+
+        kFreePageFrameBlock(qwIndex, iOrder);
+        qwIndex += qwFrameCountOfBlock;
+        qwFrameCount -= qwFrameCountOfBlock;
+    }
+}
+
+
+// get number of frames of allocated block or run
+// params:
+//   qwIndex: index of the first frame
+// return:
+//   number of frames. if block is not allocated, 0
+static QWORD kGetAllocatedFrameCount(QWORD qwIndex) {
+    BYTE *pbFrameState;
+    QWORD qwFrameCount;
+
+    pbFrameState = gs_stPageFrameManager.pbFrameState;
+
+    if (pbFrameState[qwIndex] == PAGEFRAME_STATE_RUN) {
+        // the frame after run is the first frame of another block
+        for (
+            qwFrameCount = 1;
+            (qwIndex + qwFrameCount) < gs_stPageFrameManager.qwFrameCount;
+            qwFrameCount++
+        ) {
+            if (pbFrameState[qwIndex + qwFrameCount] != PAGEFRAME_STATE_TAIL) {
+                break;
+            }
+        }
+        return qwFrameCount;
+    }
+
+    if (pbFrameState[qwIndex] & PAGEFRAME_STATE_ALLOCATED) {
+        return (QWORD) 1 << (pbFrameState[qwIndex] & PAGEFRAME_STATE_ORDERMASK);
+    }
+    return 0;
+}
+
+
+// put usable frames between qwStartIndex and qwEndIndex to free lists as
+// biggest aligned blocks
+// params:
+//   qwStartIndex: index of first frame
+//   qwEndIndex: index after last frame
+//   iZone: zone of frames
+static void kAddPageFrameArea(QWORD qwStartIndex, QWORD qwEndIndex, int iZone) {
+    PAGEFRAMEZONE *pstZone;
+    PAGEFRAMEBLOCK *pstBlock;
+    QWORD qwFrameCountOfBlock;
+    QWORD i;
+    int iOrder;
+
+    pstZone = &(gs_stPageFrameManager.vstZone[iZone]);
+    pstZone->qwTotalFrameCount += qwEndIndex - qwStartIndex;
+    pstZone->qwFreeFrameCount += qwEndIndex - qwStartIndex;
+
+    while (qwStartIndex < qwEndIndex) {
+        // block must be aligned on its size and must be in the area
+        for (iOrder = PAGEFRAME_MAXORDER - 1; iOrder > 0; iOrder--) {
+            qwFrameCountOfBlock = (QWORD) 1 << iOrder;
+            if (
+                ((qwStartIndex & (qwFrameCountOfBlock - 1)) == 0) &&
+                ((qwStartIndex + qwFrameCountOfBlock) <= qwEndIndex)
+            ) {
+                break;
+            }
+        }
+        qwFrameCountOfBlock = (QWORD) 1 << iOrder;
+
+        gs_stPageFrameManager.pbFrameState[qwStartIndex] =
+            PAGEFRAME_STATE_FREE | iOrder;
+        for (i = 1; i < qwFrameCountOfBlock; i++) {
+            gs_stPageFrameManager.pbFrameState[qwStartIndex + i] =
+                PAGEFRAME_STATE_TAIL;
+        }
+
+        pstBlock = (PAGEFRAMEBLOCK *) (qwStartIndex * PAGEFRAME_SIZE);
+        pstBlock->stLink.qwID = qwStartIndex * PAGEFRAME_SIZE;
+        kAddListToTail(&(pstZone->vstFreeList[iOrder]), pstBlock);
+
+        qwStartIndex += qwFrameCountOfBlock;
+    }
+}
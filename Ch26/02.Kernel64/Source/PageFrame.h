@@ -0,0 +1,246 @@
+/*
+ * PageFrame.h contains physical page frame allocator.
+ *
+ * Every usable area in memory map of E820 BIOS service is managed as 4KB
+ * page frames. Free frames are grouped into blocks of 2^order frames and
+ * each order has its own free list (buddy system).
+ *
+ * Memory is divided into zones because some devices can access only low
+ * memory. A block never crosses boundary of a zone.
+ *   - DMA zone: below 16MB. for ISA DMA controller
+ *   - DMA32 zone: below 4GB. for devices that use 32 bit address
+ *   - NORMAL zone: the rest
+ *
+ * Physical addresses are identity-mapped up to 64GB by 01.Kernel32, so
+ * address of a page frame can be used as pointer directly.
+ */
+
+#ifndef __PAGEFRAME_H__
+#define __PAGEFRAME_H__
+
+#include "Types.h"
+#include "List.h"
+#include "Task.h"
+
+
+// lowest address of page frames. below this address, there are page tables,
+// kernel, TCB pool and stack pool. aligned on 1MB boundaries
+#define PAGEFRAME_START_ADDRESS ( \
+    (TASK_STACKPOOLADDRESS + (TASK_STACKSIZE * TASK_MAXCOUNT) + 0xFFFFF) & \
+    0xFFFFFFFFFFF00000 \
+)
+
+// highest address that 01.Kernel32 maps. 64GB
+#define PAGEFRAME_MAX_ADDRESS   0x1000000000
+
+#define PAGEFRAME_SIZE      0x1000  // 4KB
+
+// number of orders. the biggest block is 2^18 frames (1GB)
+#define PAGEFRAME_MAXORDER  19
+
+
+/* zones */
+
+#define PAGEFRAME_ZONE_DMA      0
+#define PAGEFRAME_ZONE_DMA32    1
+#define PAGEFRAME_ZONE_NORMAL   2
+#define PAGEFRAME_ZONECOUNT     3
+
+// end address of each zone
+#define PAGEFRAME_DMA_END_ADDRESS   0x1000000       // 16MB
+#define PAGEFRAME_DMA32_END_ADDRESS 0x100000000     // 4GB
+
+
+/* state of each page frame */
+
+// frame that cannot be allocated. hole, reserved area and meta data
+#define PAGEFRAME_STATE_RESERVED    0x00
+
+// usable frame which is not put into free list yet. only used while
+// initializing
+#define PAGEFRAME_STATE_USABLE      0x10
+
+// frame in a block except the first frame
+#define PAGEFRAME_STATE_TAIL        0x20
+
+// first frame of allocated block. order is saved in lower bits
+#define PAGEFRAME_STATE_ALLOCATED   0x40
+
+// first frame of free block. order is saved in lower bits
+#define PAGEFRAME_STATE_FREE        0x80
+
+#define PAGEFRAME_STATE_ORDERMASK   0x1F
+
+// first frame of allocated run whose size is not a power of two.
+// order field is not used, so it is filled with ones.
+// size of run is 1 + number of following tail frames
+#define PAGEFRAME_STATE_RUN ( \
+    PAGEFRAME_STATE_ALLOCATED | PAGEFRAME_STATE_ORDERMASK \
+)
+
+
+#pragma pack(push, 1)
+
+// free block. it is saved in the first frame of the block itself
+// qwID of stLink is address of the block
+typedef struct kPageFrameBlockStruct {
+    LISTLINK stLink;
+} PAGEFRAMEBLOCK;
+
+
+// free lists and statistics of a zone
+typedef struct kPageFrameZoneStruct {
+    LIST vstFreeList[PAGEFRAME_MAXORDER];
+
+    QWORD qwTotalFrameCount;
+    QWORD qwFreeFrameCount;
+} PAGEFRAMEZONE;
+
+
+// manages every page frame in memory
+typedef struct kPageFrameManagerStruct {
+    // state of each page frame. index is (physical address / 4KB)
+    BYTE *pbFrameState;
+    QWORD qwFrameCount;
+    QWORD qwMetaDataSize;
+
+    PAGEFRAMEZONE vstZone[PAGEFRAME_ZONECOUNT];
+} PAGEFRAMEMANAGER;
+
+#pragma pack(pop)
+
+
+/* page frame allocator related functions */
+
+// initialize page frame allocator with usable areas of E820 memory map
+void kInitializePageFrameAllocator(void);
+
+
+// allocate 2^iOrder contiguous page frames
+// params:
+//   iOrder: order of block
+//   iZone: the highest zone which frames can be allocated from. if the zone
+//          does not have free frames, lower zones are searched
+// return:
+//   address of the first frame. if there is no block, NULL is returned
+void *kAllocatePageFrames(int iOrder, int iZone);
+
+
+// allocate qwFrameCount contiguous page frames without rounding up to
+// power of two
+// params:
+//   qwFrameCount: number of frames
+//   iZone: the highest zone which frames can be allocated from
+// return:
+//   address of the first frame. if there is no run, NULL is returned
+// info:
+//   a block of the next order is allocated and frames after the run are
+//   given back to free lists
+void *kAllocatePageFrameRun(QWORD qwFrameCount, int iZone);
+
+
+// free page frames allocated by kAllocatePageFrames or kAllocatePageFrameRun
+// params:
+//   pvAddress: address returned by the allocation functions
+// return:
+//   True on success. Otherwise False
+BOOL kFreePageFrames(void *pvAddress);
+
+
+// extend allocated block or run in place with free frames right after it
+// params:
+//   pvAddress: address returned by the allocation functions
+//   qwFrameCount: number of frames after extension
+// return:
+//   True on success. Otherwise False and the block is not changed
+// info:
+//   the block becomes a run
+BOOL kExtendPageFrames(void *pvAddress, QWORD qwFrameCount);
+
+
+// get the smallest order of block in which qwSize fits
+// params:
+//   qwSize: requested memory size
+// return:
+//   order of block. if qwSize is bigger than the biggest block, -1
+int kGetPageFrameOrder(QWORD qwSize);
+
+
+// get size of block or run which is allocated by the allocation functions
+// params:
+//   pvAddress: address returned by the allocation functions
+// return:
+//   size of block. if pvAddress is not allocated, 0
+QWORD kGetPageFrameBlockSize(const void *pvAddress);
+
+
+// get page frame manager
+// return:
+//   pointer to page frame manager
+PAGEFRAMEMANAGER *kGetPageFrameManager(void);
+
+
+// get zone to which a physical address belongs
+// params:
+//   qwAddress: physical address
+// return:
+//   PAGEFRAME_ZONE_DMA, PAGEFRAME_ZONE_DMA32 or PAGEFRAME_ZONE_NORMAL
+static int kGetPageFrameZone(QWORD qwAddress);
+
+
+// find usable area for state array of page frames
+// params:
+//   qwSize: size of state array
+// return:
+//   address of the area. if there is no area, NULL is returned
+static BYTE *kFindPageFrameMetaDataArea(QWORD qwSize);
+
+
+// set state of page frames in an area
+// params:
+//   qwStartAddress: start address of area
+//   qwEndAddress: end address of area
+//   bState: state to set
+static void kSetPageFrameState(
+    QWORD qwStartAddress,
+    QWORD qwEndAddress,
+    BYTE bState
+);
+
+
+// put a block back to free list and merge it with its buddies
+// params:
+//   qwIndex: index of the first frame of block
+//   iOrder: order of block
+// info:
+//   caller must hold lock
+static void kFreePageFrameBlock(QWORD qwIndex, int iOrder);
+
+
+// put frames to free lists as biggest aligned blocks
+// params:
+//   qwIndex: index of the first frame
+//   qwFrameCount: number of frames
+// info:
+//   caller must hold lock. frames must be in a zone
+static void kFreePageFrameRange(QWORD qwIndex, QWORD qwFrameCount);
+
+
+// get number of frames of allocated block or run
+// params:
+//   qwIndex: index of the first frame
+// return:
+//   number of frames. if block is not allocated, 0
+static QWORD kGetAllocatedFrameCount(QWORD qwIndex);
+
+
+// put usable frames between qwStartIndex and qwEndIndex to free lists as
+// biggest aligned blocks
+// params:
+//   qwStartIndex: index of first frame
+//   qwEndIndex: index after last frame
+//   iZone: zone of frames
+static void kAddPageFrameArea(QWORD qwStartIndex, QWORD qwEndIndex, int iZone);
+
+
+#endif /* __PAGEFRAME_H__ */
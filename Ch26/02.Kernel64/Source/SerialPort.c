@@ -0,0 +1,312 @@
+#include "SerialPort.h"
+#include "AssemblyUtility.h"
+#include "Synchronization.h"
+#include "Utility.h"
+#include "PIC.h"
+
+static SERIALMANAGER gs_stSerialManager;
+
+
+// initialize COM1 with baud rate, 8 data bits, no parity and 1 stop bit
+// params:
+//   dwBaudRate: baud rate. 115200 must be divisible by it
+// return:
+//   True on success. False if UART does not exist or baud rate is invalid
+// info:
+//   it can be called again to change baud rate
+BOOL kInitializeSerialPort(DWORD dwBaudRate) {
+    WORD wPortBase = SERIAL_PORT_COM1;
+    WORD wDivisor;
+    BOOL bPreviousFlag;
+
+    if ((dwBaudRate == 0) || ((SERIAL_MAXBAUDRATE % dwBaudRate) != 0)) {
+        return FALSE;
+    }
+    wDivisor = SERIAL_MAXBAUDRATE / dwBaudRate;
+
+    bPreviousFlag = kLockForSystemData();
+
+    // send data left in queue with old baud rate
+    if (gs_stSerialManager.bInitialized == TRUE) {
+        kFlushSerialTransmitQueue();
+    }
+    else {
+        kMemSet(&gs_stSerialManager, 0, sizeof(gs_stSerialManager));
+        kInitializeQueue(
+            &(gs_stSerialManager.stTransmitQueue),
+            gs_stSerialManager.vbTransmitBuffer,
+            SERIAL_TRANSMITQUEUESIZE,
+            sizeof(BYTE)
+        );
+        kInitializeQueue(
+            &(gs_stSerialManager.stReceiveQueue),
+            gs_stSerialManager.vbReceiveBuffer,
+            SERIAL_RECEIVEQUEUESIZE,
+            sizeof(BYTE)
+        );
+    }
+
+    // UART does not exist if scratch register does not keep value
+    kOutPortByte(wPortBase + SERIAL_PORT_INDEX_SCRATCH, 0xAE);
+    if (kInPortByte(wPortBase + SERIAL_PORT_INDEX_SCRATCH) != 0xAE) {
+        gs_stSerialManager.bInitialized = FALSE;
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    // disable all interrupts of UART while changing settings
+    kOutPortByte(wPortBase + SERIAL_PORT_INDEX_INTERRUPTENABLE, 0x00);
+
+    // set divisor of baud rate. DLAB bit changes the first two registers
+    // to divisor latch
+    kOutPortByte(
+        wPortBase + SERIAL_PORT_INDEX_LINECONTROL,
+        SERIAL_LINECONTROL_DLAB
+    );
+    kOutPortByte(wPortBase + SERIAL_PORT_INDEX_DIVISORLATCHLSB, wDivisor);
+    kOutPortByte(wPortBase + SERIAL_PORT_INDEX_DIVISORLATCHMSB, wDivisor >> 8);
+
+    // 8 bits, no parity, 1 stop bit. DLAB bit is cleared
+    kOutPortByte(
+        wPortBase + SERIAL_PORT_INDEX_LINECONTROL,
+        SERIAL_LINECONTROL_8BIT | SERIAL_LINECONTROL_NOPARITY |
+        SERIAL_LINECONTROL_1BITSTOP
+    );
+
+    // enable FIFO and interrupt when receive FIFO has 14 bytes
+    kOutPortByte(
+        wPortBase + SERIAL_PORT_INDEX_FIFOCONTROL,
+        SERIAL_FIFOCONTROL_FIFOENABLE | SERIAL_FIFOCONTROL_CLEARRECEIVEFIFO |
+        SERIAL_FIFOCONTROL_CLEARTRANSMITFIFO | SERIAL_FIFOCONTROL_14BYTEFIFO
+    );
+
+    kOutPortByte(
+        wPortBase + SERIAL_PORT_INDEX_MODEMCONTROL,
+        SERIAL_MODEMCONTROL_DTR | SERIAL_MODEMCONTROL_RTS |
+        SERIAL_MODEMCONTROL_OUT2
+    );
+
+    // transmit interrupt is enabled only while transmit queue has data
+    kOutPortByte(
+        wPortBase + SERIAL_PORT_INDEX_INTERRUPTENABLE,
+        SERIAL_INTERRUPTENABLE_RECEIVEBUFFERFULL |
+        SERIAL_INTERRUPTENABLE_LINESTATUS
+    );
+
+    gs_stSerialManager.dwBaudRate = dwBaudRate;
+    gs_stSerialManager.bInitialized = TRUE;
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// send data through COM1
+// params:
+//   pbBuffer: data to send
+//   iSize: size of data
+// info:
+//   data is put into transmit queue and sent by interrupt handler. if
+//   interrupt is disabled, it waits until data is sent
+void kSendSerialData(const BYTE *pbBuffer, int iSize) {
+    BOOL bPreviousFlag;
+    BYTE bInterruptEnable;
+
+    if (gs_stSerialManager.bInitialized == FALSE) {
+        return;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+
+    for (int i = 0; i < iSize; i++) {
+        // interrupt handler cannot run while lock is held, so queue is
+        // emptied by polling when it is full
+        while (kPutQueue(&(gs_stSerialManager.stTransmitQueue), pbBuffer + i)
+                == FALSE) {
+            kFillSerialTransmitFIFO();
+        }
+    }
+    gs_stSerialManager.qwTransmitCount += iSize;
+
+    // caller disabled interrupt. no interrupt will send data
+    if (bPreviousFlag == FALSE) {
+        kFlushSerialTransmitQueue();
+    }
+    // start sending. interrupt handler sends the rest
+    else if (kFillSerialTransmitFIFO() == TRUE) {
+        bInterruptEnable = kInPortByte(
+            SERIAL_PORT_COM1 + SERIAL_PORT_INDEX_INTERRUPTENABLE
+        );
+        kOutPortByte(
+            SERIAL_PORT_COM1 + SERIAL_PORT_INDEX_INTERRUPTENABLE,
+            bInterruptEnable | SERIAL_INTERRUPTENABLE_TRANSMITBUFFEREMPTY
+        );
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+}
+
+
+// send string through COM1 changing \n to \r\n for terminal
+// params:
+//   pcString: string to send
+void kSendSerialString(const char *pcString) {
+    int iStart = 0;
+    int i;
+
+    for (i = 0; pcString[i] != '\0'; i++) {
+        if (pcString[i] == '\n') {
+            kSendSerialData((const BYTE *) pcString + iStart, i - iStart);
+            kSendSerialData((const BYTE *) "\r\n", 2);
+            iStart = i + 1;
+        }
+    }
+    kSendSerialData((const BYTE *) pcString + iStart, i - iStart);
+}
+
+
+// get data which COM1 received
+// params:
+//   pbBuffer: buffer to copy data
+//   iSize: size of buffer
+// return:
+//   size of copied data
+int kReceiveSerialData(BYTE *pbBuffer, int iSize) {
+    BOOL bPreviousFlag;
+    int i;
+
+    if ((gs_stSerialManager.bInitialized == FALSE) ||
+        (kIsQueueEmpty(&(gs_stSerialManager.stReceiveQueue)) == TRUE)) {
+        return 0;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+    for (i = 0; i < iSize; i++) {
+        if (kGetQueue(&(gs_stSerialManager.stReceiveQueue), pbBuffer + i)
+                == FALSE) {
+            break;
+        }
+    }
+    kUnlockForSystemData(bPreviousFlag);
+    return i;
+}
+
+
+// COM1 interrupt handler
+// params:
+//   iVectorNumber: IDT gate descriptor index number
+void kSerialHandler(int iVectorNumber) {
+    WORD wPortBase = SERIAL_PORT_COM1;
+    BYTE bIdentification;
+    BYTE bInterruptEnable;
+    BYTE bData;
+
+    // handle every pending interrupt of UART
+    while (TRUE) {
+        bIdentification = kInPortByte(
+            wPortBase + SERIAL_PORT_INDEX_INTERRUPTIDENTIFICATION
+        );
+        if (bIdentification & SERIAL_INTERRUPTIDENTIFICATION_NOTPENDING) {
+            break;
+        }
+
+        switch (bIdentification & SERIAL_INTERRUPTIDENTIFICATION_TYPEMASK) {
+            // receive FIFO reached trigger level or has data for a while
+            case SERIAL_INTERRUPTIDENTIFICATION_RECEIVE:
+            case SERIAL_INTERRUPTIDENTIFICATION_TIMEOUT:
+                while (kInPortByte(wPortBase + SERIAL_PORT_INDEX_LINESTATUS) &
+                       SERIAL_LINESTATUS_RECEIVEDDATAREADY) {
+                    bData = kInPortByte(
+                        wPortBase + SERIAL_PORT_INDEX_RECEIVEBUFFER
+                    );
+                    if (kPutQueue(&(gs_stSerialManager.stReceiveQueue), &bData)
+                            == TRUE) {
+                        gs_stSerialManager.qwReceiveCount++;
+                    }
+                    else {
+                        gs_stSerialManager.qwReceiveDropCount++;
+                    }
+                }
+                break;
+
+            // transmit FIFO is empty
+            case SERIAL_INTERRUPTIDENTIFICATION_TRANSMIT:
+                if (kFillSerialTransmitFIFO() == FALSE) {
+                    bInterruptEnable = kInPortByte(
+                        wPortBase + SERIAL_PORT_INDEX_INTERRUPTENABLE
+                    );
+                    kOutPortByte(
+                        wPortBase + SERIAL_PORT_INDEX_INTERRUPTENABLE,
+                        bInterruptEnable &
+                        ~SERIAL_INTERRUPTENABLE_TRANSMITBUFFEREMPTY
+                    );
+                }
+                break;
+
+            // reading the status register clears the interrupt
+            case SERIAL_INTERRUPTIDENTIFICATION_LINESTATUS:
+                kInPortByte(wPortBase + SERIAL_PORT_INDEX_LINESTATUS);
+                break;
+
+            default:
+                kInPortByte(wPortBase + SERIAL_PORT_INDEX_MODEMSTATUS);
+                break;
+        }
+    }
+
+    kSendEOIToPIC(iVectorNumber - PIC_IRQSTARTVECTOR);
+}
+
+
+// check whether COM1 is initialized
+// return:
+//   True if COM1 is initialized. Otherwise False
+BOOL kIsSerialPortInitialized(void) {
+    return gs_stSerialManager.bInitialized;
+}
+
+
+// get serial manager
+// return:
+//   pointer to serial manager
+SERIALMANAGER *kGetSerialManager(void) {
+    return &gs_stSerialManager;
+}
+
+
+// move data from transmit queue to transmit FIFO if FIFO is empty
+// return:
+//   True if transmit queue still has data. Otherwise False
+// info:
+//   caller must hold lock
+static BOOL kFillSerialTransmitFIFO(void) {
+    BYTE bData;
+
+    if ((kInPortByte(SERIAL_PORT_COM1 + SERIAL_PORT_INDEX_LINESTATUS) &
+         SERIAL_LINESTATUS_TRANSMITBUFFEREMPTY) == 0) {
+        return !kIsQueueEmpty(&(gs_stSerialManager.stTransmitQueue));
+    }
+
+    for (int i = 0; i < SERIAL_FIFOMAXSIZE; i++) {
+        if (kGetQueue(&(gs_stSerialManager.stTransmitQueue), &bData) == FALSE) {
+            return FALSE;
+        }
+        kOutPortByte(SERIAL_PORT_COM1 + SERIAL_PORT_INDEX_TRANSMITBUFFER, bData);
+    }
+    return !kIsQueueEmpty(&(gs_stSerialManager.stTransmitQueue));
+}
+
+
+// send all data in transmit queue by polling
+// info:
+//   caller must hold lock
+static void kFlushSerialTransmitQueue(void) {
+    while (kFillSerialTransmitFIFO() == TRUE) {
+        ;
+    }
+
+    // wait until the last data leaves FIFO
+    while ((kInPortByte(SERIAL_PORT_COM1 + SERIAL_PORT_INDEX_LINESTATUS) &
+            SERIAL_LINESTATUS_TRANSMITBUFFEREMPTY) == 0) {
+        ;
+    }
+}
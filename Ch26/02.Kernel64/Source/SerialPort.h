@@ -0,0 +1,181 @@
+/*
+ * SerialPort.h contains 16550 UART driver for COM1.
+ *
+ * Data to send is put into a transmit queue and sent by interrupt handler
+ * 16 bytes at a time, which is size of transmit FIFO. Received data is put
+ * into a receive queue by interrupt handler. When interrupt is disabled,
+ * data is sent by polling, so output is not lost before PIC is initialized
+ * or while system lock is held.
+ *
+ * QEMU connects COM1 to host with -serial stdio option.
+ */
+
+#ifndef __SERIALPORT_H__
+#define __SERIALPORT_H__
+
+#include "Types.h"
+#include "Queue.h"
+
+
+/* I/O port of serial port */
+
+#define SERIAL_PORT_COM1    0x3F8
+#define SERIAL_IRQ_COM1     4
+
+// offset of each register from port base
+#define SERIAL_PORT_INDEX_RECEIVEBUFFER             0x00
+#define SERIAL_PORT_INDEX_TRANSMITBUFFER            0x00
+#define SERIAL_PORT_INDEX_INTERRUPTENABLE           0x01
+#define SERIAL_PORT_INDEX_DIVISORLATCHLSB           0x00
+#define SERIAL_PORT_INDEX_DIVISORLATCHMSB           0x01
+#define SERIAL_PORT_INDEX_INTERRUPTIDENTIFICATION   0x02
+#define SERIAL_PORT_INDEX_FIFOCONTROL               0x02
+#define SERIAL_PORT_INDEX_LINECONTROL               0x03
+#define SERIAL_PORT_INDEX_MODEMCONTROL              0x04
+#define SERIAL_PORT_INDEX_LINESTATUS                0x05
+#define SERIAL_PORT_INDEX_MODEMSTATUS               0x06
+#define SERIAL_PORT_INDEX_SCRATCH                   0x07
+
+
+/* register bits */
+
+// interrupt enable register
+#define SERIAL_INTERRUPTENABLE_RECEIVEBUFFERFULL    0x01
+#define SERIAL_INTERRUPTENABLE_TRANSMITBUFFEREMPTY  0x02
+#define SERIAL_INTERRUPTENABLE_LINESTATUS           0x04
+
+// interrupt identification register. bits 1 ~ 3 are interrupt type
+#define SERIAL_INTERRUPTIDENTIFICATION_NOTPENDING   0x01
+#define SERIAL_INTERRUPTIDENTIFICATION_TYPEMASK     0x0E
+#define SERIAL_INTERRUPTIDENTIFICATION_MODEMSTATUS  0x00
+#define SERIAL_INTERRUPTIDENTIFICATION_TRANSMIT     0x02
+#define SERIAL_INTERRUPTIDENTIFICATION_RECEIVE      0x04
+#define SERIAL_INTERRUPTIDENTIFICATION_LINESTATUS   0x06
+#define SERIAL_INTERRUPTIDENTIFICATION_TIMEOUT      0x0C
+
+// FIFO control register
+#define SERIAL_FIFOCONTROL_FIFOENABLE       0x01
+#define SERIAL_FIFOCONTROL_CLEARRECEIVEFIFO 0x02
+#define SERIAL_FIFOCONTROL_CLEARTRANSMITFIFO 0x04
+#define SERIAL_FIFOCONTROL_14BYTEFIFO       0xC0
+
+// line control register
+#define SERIAL_LINECONTROL_8BIT             0x03
+#define SERIAL_LINECONTROL_1BITSTOP         0x00
+#define SERIAL_LINECONTROL_NOPARITY         0x00
+#define SERIAL_LINECONTROL_DLAB             0x80
+
+// modem control register. OUT2 connects interrupt of UART to PIC
+#define SERIAL_MODEMCONTROL_DTR             0x01
+#define SERIAL_MODEMCONTROL_RTS             0x02
+#define SERIAL_MODEMCONTROL_OUT2            0x08
+
+// line status register
+#define SERIAL_LINESTATUS_RECEIVEDDATAREADY     0x01
+#define SERIAL_LINESTATUS_TRANSMITBUFFEREMPTY   0x20
+
+
+/* baud rate */
+
+// divisor of baud rate = 115200 / baud rate
+#define SERIAL_MAXBAUDRATE      115200
+#define SERIAL_DEFAULTBAUDRATE  115200
+
+
+/* buffer related constants */
+
+#define SERIAL_FIFOMAXSIZE          16
+#define SERIAL_TRANSMITQUEUESIZE    4096
+#define SERIAL_RECEIVEQUEUESIZE     256
+
+
+#pragma pack(push, 1)
+
+typedef struct kSerialManagerStruct {
+    QUEUE stTransmitQueue;
+    QUEUE stReceiveQueue;
+    BYTE vbTransmitBuffer[SERIAL_TRANSMITQUEUESIZE];
+    BYTE vbReceiveBuffer[SERIAL_RECEIVEQUEUESIZE];
+
+    // True if UART exists and is initialized
+    BOOL bInitialized;
+    DWORD dwBaudRate;
+
+    // statistics
+    QWORD qwTransmitCount;
+    QWORD qwReceiveCount;
+    QWORD qwReceiveDropCount;
+} SERIALMANAGER;
+
+#pragma pack(pop)
+
+
+/* serial port related functions */
+
+// initialize COM1 with baud rate, 8 data bits, no parity and 1 stop bit
+// params:
+//   dwBaudRate: baud rate. 115200 must be divisible by it
+// return:
+//   True on success. False if UART does not exist or baud rate is invalid
+// info:
+//   it can be called again to change baud rate
+BOOL kInitializeSerialPort(DWORD dwBaudRate);
+
+
+// send data through COM1
+// params:
+//   pbBuffer: data to send
+//   iSize: size of data
+// info:
+//   data is put into transmit queue and sent by interrupt handler. if
+//   interrupt is disabled, it waits until data is sent
+void kSendSerialData(const BYTE *pbBuffer, int iSize);
+
+
+// send string through COM1 changing \n to \r\n for terminal
+// params:
+//   pcString: string to send
+void kSendSerialString(const char *pcString);
+
+
+// get data which COM1 received
+// params:
+//   pbBuffer: buffer to copy data
+//   iSize: size of buffer
+// return:
+//   size of copied data
+int kReceiveSerialData(BYTE *pbBuffer, int iSize);
+
+
+// COM1 interrupt handler
+// params:
+//   iVectorNumber: IDT gate descriptor index number
+void kSerialHandler(int iVectorNumber);
+
+
+// check whether COM1 is initialized
+// return:
+//   True if COM1 is initialized. Otherwise False
+BOOL kIsSerialPortInitialized(void);
+
+
+// get serial manager
+// return:
+//   pointer to serial manager
+SERIALMANAGER *kGetSerialManager(void);
+
+
+// move data from transmit queue to transmit FIFO if FIFO is empty
+// return:
+//   True if transmit queue still has data. Otherwise False
+// info:
+//   caller must hold lock
+static BOOL kFillSerialTransmitFIFO(void);
+
+
+// send all data in transmit queue by polling
+// info:
+//   caller must hold lock
+static void kFlushSerialTransmitQueue(void);
+
+#endif /* __SERIALPORT_H__ */
@@ -4,6 +4,7 @@
 #include "AssemblyUtility.h"
 #include "Console.h"
 #include "Synchronization.h"
+#include "Log.h"
 
 
 /* singleton data structure of Scheduler and Task pool manager */
@@ -78,11 +79,7 @@ void kFreeTCB(QWORD qwID) {
     // get index of task pool
     int i = GETTCBOFFSET(qwID);
 
-    kMemSet(
-        &(gs_stTCBPoolManager.pstStartAddress[i].stContext),
-        0,
-        sizeof(CONTEXT)
-    );
+    gs_stTCBPoolManager.pstStartAddress[i].pstContext = NULL;
     gs_stTCBPoolManager.pstStartAddress[i].stLink.qwID = i;
     
     gs_stTCBPoolManager.iUseCount--;
@@ -188,12 +185,15 @@ void kSetUpTask(
     void *pvStackAddress,
     QWORD qwStackSize
 ) {
-    // initialize TCB struct
-    kMemSet(
-        pstTCB->stContext.vqRegister,
-        0,
-        sizeof(pstTCB->stContext.vqRegister)
+    CONTEXT *pstContext;
+
+    // initial context is put on the top of the task's stack, right below
+    // the return address. The first context switch pops it as if the task
+    // had been interrupted before executing its first instruction
+    pstContext = (CONTEXT *) (
+        pvStackAddress + qwStackSize - 8 - sizeof(CONTEXT)
     );
+    kMemSet(pstContext->vqRegister, 0, sizeof(pstContext->vqRegister));
 
 
     /* set rsp and rbp */
@@ -202,34 +202,36 @@ void kSetUpTask(
     // so kExitTask is run after command is run
     *(QWORD *)(pvStackAddress + qwStackSize - 8) = (QWORD) kExitTask;
 
-    pstTCB->stContext.vqRegister[TASK_RSPOFFSET] = 
+    pstContext->vqRegister[TASK_RSPOFFSET] = 
         (QWORD) pvStackAddress + qwStackSize - 8;
     
-    pstTCB->stContext.vqRegister[TASK_RBPOFFSET] = 
+    pstContext->vqRegister[TASK_RBPOFFSET] = 
         (QWORD) pvStackAddress + qwStackSize - 8;
 
 
     /* set segment selectors */
 
-    pstTCB->stContext.vqRegister[TASK_CSOFFSET] = GDT_KERNELCODESEGMENT;
+    pstContext->vqRegister[TASK_CSOFFSET] = GDT_KERNELCODESEGMENT;
 
-    pstTCB->stContext.vqRegister[TASK_DSOFFSET] = GDT_KERNELDATASEGMENT;
-    pstTCB->stContext.vqRegister[TASK_ESOFFSET] = GDT_KERNELDATASEGMENT;
-    pstTCB->stContext.vqRegister[TASK_FSOFFSET] = GDT_KERNELDATASEGMENT;
-    pstTCB->stContext.vqRegister[TASK_GSOFFSET] = GDT_KERNELDATASEGMENT;
-    pstTCB->stContext.vqRegister[TASK_SSOFFSET] = GDT_KERNELDATASEGMENT;
+    pstContext->vqRegister[TASK_DSOFFSET] = GDT_KERNELDATASEGMENT;
+    pstContext->vqRegister[TASK_ESOFFSET] = GDT_KERNELDATASEGMENT;
+    pstContext->vqRegister[TASK_FSOFFSET] = GDT_KERNELDATASEGMENT;
+    pstContext->vqRegister[TASK_GSOFFSET] = GDT_KERNELDATASEGMENT;
+    pstContext->vqRegister[TASK_SSOFFSET] = GDT_KERNELDATASEGMENT;
 
 
     /* set IP */
     
-    pstTCB->stContext.vqRegister[TASK_RIPOFFSET] = qwEntryPointAddress;
+    pstContext->vqRegister[TASK_RIPOFFSET] = qwEntryPointAddress;
 
 
     /* set interrupt flag in RFLAGS by default */
 
-    pstTCB->stContext.vqRegister[TASK_RFLAGSOFFSET] |= 0x200;
+    pstContext->vqRegister[TASK_RFLAGSOFFSET] |= 0x200;
+
+    /*  context, stack, and flag */
 
-    /*  stack, and flag */
+    pstTCB->pstContext = pstContext;
 
     pstTCB->pvStackAddress = pvStackAddress;
     pstTCB->qwStackSize = qwStackSize;
@@ -256,6 +258,8 @@ void kInitializeScheduler(void) {
         gs_stScheduler.viExecuteCount[i] = 0;
     }
     kInitializeList(&(gs_stScheduler.stWaitList));
+    kInitializeList(&(gs_stScheduler.stBlockedList));
+    gs_stScheduler.qwNextWakeUpTickCount = TASK_WAITFOREVER;
  
     // the empty TCB is for code that executed booting
     // when context switch happens, the empty TCB will
@@ -411,12 +415,18 @@ void kSchedule(void) {
     // when current task is finished
     if (pstRunningTask->qwFlags & TASK_FLAGS_ENDTASK) {
         kAddListToTail(&gs_stScheduler.stWaitList, pstRunningTask);
-        kSwitchContext(NULL, &(pstNextTask->stContext));
+        kSwitchContext(NULL, pstNextTask->pstContext);
+    }
+    // when current task waits for an object. it is not scheduled until
+    // it is woken up
+    else if (pstRunningTask->qwFlags & TASK_FLAGS_BLOCKED) {
+        kAddListToTail(&gs_stScheduler.stBlockedList, pstRunningTask);
+        kSwitchContext(&(pstRunningTask->pstContext), pstNextTask->pstContext);
     }
     // when current task is just yielding CPU
     else {
         kAddTaskToReadyList(pstRunningTask);
-        kSwitchContext(&(pstRunningTask->stContext), &(pstNextTask->stContext));
+        kSwitchContext(&(pstRunningTask->pstContext), pstNextTask->pstContext);
     }
 
     // If the current task is scheduled to run again by kernel, code is executed
@@ -426,31 +436,28 @@ void kSchedule(void) {
 
 
 // schedule a task to run now
+// params:
+//   pstCurrentContext: context that interrupt handler saved on the stack of
+//                      current task
 // return:
-//   True if another task will be running. Otherwise False 
+//   context of the task to run. if there is no next task, pstCurrentContext
+//   is returned
 // info:
-//    this function must be only called by interrupt or exception handler
-//    because it contains code that handles IST stack. If this is called
-//    outside interrupt handler, current task will not work properly when
-//    it is scheduled again later
+//    this function must be only called by interrupt handler that does not
+//    use IST because the saved context must be on the task's own stack.
+//    If this is called outside interrupt handler, current task will not
+//    work properly when it is scheduled again later
 //
-//    This function returns because it expects interrupt handler to restore
-//    context of the next task
-BOOL kScheduleInInterrupt(void) {
+//    This function returns because it expects interrupt handler to load
+//    the returned context into rsp and restore it
+CONTEXT *kScheduleInInterrupt(CONTEXT *pstCurrentContext) {
     TCB *pstRunningTask = gs_stScheduler.pstRunningTask;
     TCB *pstNextTask = kGetNextTaskToRun();
 
     if (!pstNextTask) {
-        return FALSE;
+        return pstCurrentContext;
     }
 
-    // IST start address of context
-    // When interrupt happens, ISR kSAVECONTEXT macro stores context of current
-    // task to IST stack
-    char *pcContextAddress = (
-        (char *) IST_STARTADDRESS + IST_SIZE - sizeof(CONTEXT)
-    );
-
 
     /* calculate Idle task related statistics */
 
@@ -483,23 +490,14 @@ BOOL kScheduleInInterrupt(void) {
         kAddListToTail(&gs_stScheduler.stWaitList, pstRunningTask);
     }
     // when current task is just yielding CPU
+    // its context stays on its own stack. just remember where it is
     else {
-        kMemCpy(
-            &(pstRunningTask->stContext.vqRegister),
-            pcContextAddress,
-            sizeof(CONTEXT)
-        );
+        pstRunningTask->pstContext = pstCurrentContext;
         kAddTaskToReadyList(pstRunningTask);
     }
 
-    // switch to next task
-    kMemCpy(
-        pcContextAddress,
-        &(pstNextTask->stContext.vqRegister),
-        sizeof(CONTEXT)
-    );
-
-    return TRUE;
+    // interrupt handler switches rsp to the context of next task
+    return pstNextTask->pstContext;
 }
 
 
@@ -640,6 +638,19 @@ BOOL kEndTask(QWORD qwTaskID) {
         return TRUE;
     }
 
+
+    /* when qwTaskID is waiting for an object */
+
+    pstTarget = kRemoveList(&(gs_stScheduler.stBlockedList), qwTaskID);
+    if (pstTarget) {
+        pstTarget->qwFlags &= ~TASK_FLAGS_BLOCKED;
+        pstTarget->qwFlags |= TASK_FLAGS_ENDTASK;
+        SETPRIORITY(pstTarget->qwFlags, TASK_FLAGS_WAIT);
+        kAddListToTail(&(gs_stScheduler.stWaitList), pstTarget);
+        kUnlockForSystemData(bPreviousFlag);
+        return TRUE;
+    }
+
     /* when qwTaskID is inside task pool
      * 
      * if task is not in the ready queues, it means that
@@ -699,8 +710,9 @@ int kGetTaskCount(void) {
 
     bPreviousFlag = kLockForSystemData();
 
-    // wait list + current task
-    iTotalCount += kGetListCount(&(gs_stScheduler.stWaitList)) + 1;
+    // wait list + blocked list + current task
+    iTotalCount += kGetListCount(&(gs_stScheduler.stWaitList)) +
+        kGetListCount(&(gs_stScheduler.stBlockedList)) + 1;
 
     kUnlockForSystemData(bPreviousFlag);
     return iTotalCount;
@@ -744,6 +756,146 @@ QWORD kGetProcessorLoad(void) {
 }
 
 
+/* blocking related functions */
+
+
+// take current task out of ready lists until an object is signaled or
+// timeout expires
+// params:
+//   pvWaitObject: object to wait for. NULL waits only for timeout
+//   qwMillisecond: timeout. TASK_WAITFOREVER waits without timeout
+// info:
+//   the caller must check its condition and call this function while
+//   system data is locked, and check the condition again after this
+//   function returns. Otherwise a wake-up between the check and blocking
+//   is lost
+//
+//   if there is no other task to run, this function returns right away
+//   after letting pending interrupts be handled
+void kBlockTask(void *pvWaitObject, QWORD qwMillisecond) {
+    TCB *pstRunningTask;
+    QWORD qwTickCount;
+    BOOL bPreviousFlag;
+
+    bPreviousFlag = kLockForSystemData();
+
+    // nothing can run instead of current task, e.g. before idle task is
+    // created. interrupt handlers still have to change the condition
+    if (kGetReadyTaskCount() < 1) {
+        kEnableInterrupt();
+        kDisableInterrupt();
+        kUnlockForSystemData(bPreviousFlag);
+        return;
+    }
+
+    pstRunningTask = gs_stScheduler.pstRunningTask;
+    pstRunningTask->pvWaitObject = pvWaitObject;
+
+    qwTickCount = kGetTickCount();
+    if (qwMillisecond >= TASK_WAITFOREVER - qwTickCount) {
+        pstRunningTask->qwWakeUpTickCount = TASK_WAITFOREVER;
+    }
+    else {
+        pstRunningTask->qwWakeUpTickCount = qwTickCount + qwMillisecond;
+        if (pstRunningTask->qwWakeUpTickCount <
+                gs_stScheduler.qwNextWakeUpTickCount) {
+            gs_stScheduler.qwNextWakeUpTickCount =
+                pstRunningTask->qwWakeUpTickCount;
+        }
+    }
+
+    // scheduler puts this task into blocked list instead of ready lists
+    pstRunningTask->qwFlags |= TASK_FLAGS_BLOCKED;
+    kSchedule();
+
+    // flag is still set only if scheduler did not switch to other task
+    pstRunningTask->qwFlags &= ~TASK_FLAGS_BLOCKED;
+    kUnlockForSystemData(bPreviousFlag);
+}
+
+
+// move tasks that wait for an object to ready lists
+// params:
+//   pvWaitObject: object that is signaled
+// return:
+//   number of tasks that are woken up
+// info:
+//   it can be called by interrupt handler
+int kWakeUpTasks(void *pvWaitObject) {
+    int iCount;
+    BOOL bPreviousFlag;
+
+    // every key and event signals its queue, and usually nobody waits
+    if ((pvWaitObject == NULL) ||
+        (kGetListCount(&(gs_stScheduler.stBlockedList)) == 0)) {
+        return 0;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+    iCount = kWakeUpBlockedTasks(pvWaitObject, 0);
+    kUnlockForSystemData(bPreviousFlag);
+    return iCount;
+}
+
+
+// move tasks whose timeout expired to ready lists
+// info:
+//   called by timer interrupt handler every tick
+void kWakeUpTimedOutTasks(void) {
+    BOOL bPreviousFlag;
+
+    // blocked list is not searched until the earliest timeout
+    if (kGetTickCount() < gs_stScheduler.qwNextWakeUpTickCount) {
+        return;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+    kWakeUpBlockedTasks(NULL, kGetTickCount());
+    kUnlockForSystemData(bPreviousFlag);
+}
+
+
+// move blocked tasks that wait for an object or whose timeout expired to
+// ready lists
+// params:
+//   pvWaitObject: object that is signaled. NULL matches no task
+//   qwTickCount: tasks whose wake-up tick count is not later than this are
+//                woken up
+// return:
+//   number of tasks that are woken up
+// info:
+//   system data must be locked. the earliest timeout of remaining tasks is
+//   calculated again
+static int kWakeUpBlockedTasks(void *pvWaitObject, QWORD qwTickCount) {
+    TCB *pstTask;
+    TCB *pstNextTask;
+    QWORD qwNextWakeUpTickCount = TASK_WAITFOREVER;
+    int iCount = 0;
+
+    pstTask = kGetHeaderFromList(&(gs_stScheduler.stBlockedList));
+    while (pstTask != NULL) {
+        pstNextTask = kGetNextFromList(pstTask);
+
+        if (((pvWaitObject != NULL) &&
+             (pstTask->pvWaitObject == pvWaitObject)) ||
+            (pstTask->qwWakeUpTickCount <= qwTickCount)) {
+            kRemoveList(&(gs_stScheduler.stBlockedList), pstTask->stLink.qwID);
+            pstTask->qwFlags &= ~TASK_FLAGS_BLOCKED;
+            kAddTaskToReadyList(pstTask);
+            iCount++;
+        }
+        else if (pstTask->qwWakeUpTickCount < qwNextWakeUpTickCount) {
+            qwNextWakeUpTickCount = pstTask->qwWakeUpTickCount;
+        }
+
+        pstTask = pstNextTask;
+    }
+
+    gs_stScheduler.qwNextWakeUpTickCount = qwNextWakeUpTickCount;
+    return iCount;
+}
+
+
 /* Thread related functions */
 
 
@@ -869,8 +1021,10 @@ void kIdleTask(void) {
                     }
                 }
 
-                kPrintf(
-                    "IDLE: Task ID[0x%q] is completely ended\n",
+                // logged, not printed, because system is locked here
+                kLog(
+                    LOG_LEVEL_INFO,
+                    "IDLE: Task ID[0x%q] is completely ended",
                     pstTask->stLink.qwID
                 );
                 kFreeTCB(pstTask->stLink.qwID);
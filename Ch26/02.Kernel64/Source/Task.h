@@ -90,6 +90,12 @@
 // flag to show that a task is a idle task
 #define TASK_FLAGS_IDLE     0x0800000000000000
 
+// flag to show that a task is in blocked list, not in ready lists
+#define TASK_FLAGS_BLOCKED  0x0400000000000000
+
+// timeout of kBlockTask that never expires
+#define TASK_WAITFOREVER    0xFFFFFFFFFFFFFFFF
+
 // macros to get scheduler related flags
 #define GETPRIORITY(x) ((x) & 0xFF)
 
@@ -105,6 +111,9 @@
 #pragma pack(push, 1)
 
 // context to save or restore when context switch happens
+// info:
+//   the context is not stored in TCB. Interrupt handler or kSwitchContext
+//   pushes it on the stack of the task, and TCB only keeps its address
 typedef struct kContextStruct {
     QWORD vqRegister[TASK_REGISTERCOUNT];
 } CONTEXT;
@@ -144,15 +153,22 @@ typedef struct kTaskControlBlockStruct {
     // only parent process or process representative manages threads
     LIST stChildThreadList;
 
-    CONTEXT stContext;
+    // address of the context saved on the task's own stack
+    // context switch only exchanges this pointer and rsp
+    CONTEXT *pstContext;
 
     // stack start address
     void *pvStackAddress;
     // stack size
     QWORD qwStackSize;
 
+    // object that blocked task waits for and tick count when it is woken
+    // up anyway. TASK_WAITFOREVER means no timeout
+    void *pvWaitObject;
+    QWORD qwWakeUpTickCount;
+
     // padding for FPU context alignment
-    BYTE padding[11];
+    BYTE padding[3];
 } TCB;
 
 
@@ -195,6 +211,13 @@ typedef struct kSchedulerStruct {
     // wait task queue that have tasks ready to end
     LIST stWaitList;
 
+    // tasks that wait for an object or timeout. they are not scheduled
+    // until kWakeUpTasks or timer interrupt moves them to ready lists
+    LIST stBlockedList;
+
+    // the earliest tick count of timeouts in blocked list
+    QWORD qwNextWakeUpTickCount;
+
     // ID of the last task that used FPU device
     QWORD qwLastFPUUsedTaskID;    
 } SCHEDULER;
@@ -303,17 +326,21 @@ void kSchedule(void);
 
 
 // schedule a task to run now
+// params:
+//   pstCurrentContext: context that interrupt handler saved on the stack of
+//                      current task
 // return:
-//   True if another task will be running. Otherwise False 
+//   context of the task to run. if there is no next task, pstCurrentContext
+//   is returned
 // info:
-//    this function must be only called by interrupt or exception handler
-//    because it contains code that handles IST stack. If this is called
-//    outside interrupt handler, current task will not work properly when
-//    it is scheduled again later
+//    this function must be only called by interrupt handler that does not
+//    use IST because the saved context must be on the task's own stack.
+//    If this is called outside interrupt handler, current task will not
+//    work properly when it is scheduled again later
 //
-//    This function returns because it expects interrupt handler to restore
-//    context of the next task
-BOOL kScheduleInInterrupt(void);
+//    This function returns because it expects interrupt handler to load
+//    the returned context into rsp and restore it
+CONTEXT *kScheduleInInterrupt(CONTEXT *pstCurrentContext);
 
 
 // decrease processor time of current task
@@ -396,6 +423,41 @@ BOOL kIsTaskExist(QWORD qwID);
 QWORD kGetProcessorLoad(void);
 
 
+/* blocking related functions */
+
+
+// take current task out of ready lists until an object is signaled or
+// timeout expires
+// params:
+//   pvWaitObject: object to wait for. NULL waits only for timeout
+//   qwMillisecond: timeout. TASK_WAITFOREVER waits without timeout
+// info:
+//   the caller must check its condition and call this function while
+//   system data is locked, and check the condition again after this
+//   function returns. Otherwise a wake-up between the check and blocking
+//   is lost
+//
+//   if there is no other task to run, this function returns right away
+//   after letting pending interrupts be handled
+void kBlockTask(void *pvWaitObject, QWORD qwMillisecond);
+
+
+// move tasks that wait for an object to ready lists
+// params:
+//   pvWaitObject: object that is signaled
+// return:
+//   number of tasks that are woken up
+// info:
+//   it can be called by interrupt handler
+int kWakeUpTasks(void *pvWaitObject);
+
+
+// move tasks whose timeout expired to ready lists
+// info:
+//   called by timer interrupt handler every tick
+void kWakeUpTimedOutTasks(void);
+
+
 /* IDLE task related functions */
 
 
@@ -434,4 +496,18 @@ QWORD kGetLastFPUUsedTaskID(void);
 //   process iD
 void kSetLastFPUUsedTaskID(QWORD qwTaskID); 
 
+
+// move blocked tasks that wait for an object or whose timeout expired to
+// ready lists
+// params:
+//   pvWaitObject: object that is signaled. NULL matches no task
+//   qwTickCount: tasks whose wake-up tick count is not later than this are
+//                woken up
+// return:
+//   number of tasks that are woken up
+// info:
+//   system data must be locked. the earliest timeout of remaining tasks is
+//   calculated again
+static int kWakeUpBlockedTasks(void *pvWaitObject, QWORD qwTickCount);
+
 #endif /* __TAsK_H__ */
\ No newline at end of file
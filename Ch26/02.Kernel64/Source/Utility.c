@@ -445,12 +445,15 @@ QWORD kGetTickCount(void) {
 // stop executing instructions for qwMillisecond
 // params:
 //   qwMillisecond: time to sleep
+// info:
+//   sleeping task is blocked, so it does not take processor time
 void kSleep(QWORD qwMillisecond) {
     QWORD qwLastTickCount;
+    QWORD qwElapsedTime;
 
     qwLastTickCount = g_qwTickCount;
 
-    while ((g_qwTickCount - qwLastTickCount) <= qwMillisecond) {
-        kSchedule();
+    while ((qwElapsedTime = g_qwTickCount - qwLastTickCount) <= qwMillisecond) {
+        kBlockTask(NULL, qwMillisecond - qwElapsedTime + 1);
     }
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 
 #define MIN(x, y)   (((x) < (y)) ? (x) : (y))
 #define MAX(x, y)   (((x) > (y)) ? (x) : (y))
+#define ABS(x)      (((x) >= 0) ? (x) : -(x))
 
 
 /* memory related structures and functions */
@@ -180,6 +181,8 @@ QWORD kGetTickCount(void);
 // stop executing instructions for qwMillisecond
 // params:
 //   qwMillisecond: time to sleep
+// info:
+//   sleeping task is blocked, so it does not take processor time
 void kSleep(QWORD qwMillisecond) ;
 
 #endif /* __UTILITY_H__ */
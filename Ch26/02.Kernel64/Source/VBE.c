@@ -0,0 +1,31 @@
+#include "VBE.h"
+
+
+// get mode information block which 01.Kernel32 saved
+// return:
+//   pointer to mode information block
+VBEMODEINFOBLOCK *kGetVBEModeInfoBlock(void) {
+    return (VBEMODEINFOBLOCK *) VBE_MODEINFOBLOCKADDRESS;
+}
+
+
+// check whether screen is in VBE graphic mode
+// return:
+//   True if 01.Kernel32 switched to graphic mode. Otherwise False
+BOOL kIsGraphicMode(void) {
+    if (*(BYTE *) VBE_STARTGRAPHICMODEFLAGADDRESS == 0x00) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+// get 8x16 font of VGA BIOS
+// return:
+//   address of font. 16 bytes per character, 1 bit per pixel
+const BYTE *kGetVGAFont(void) {
+    WORD *pwFontPointer = (WORD *) VBE_FONTPOINTERADDRESS;
+
+    // segment * 16 + offset
+    return (const BYTE *) (((QWORD) pwFontPointer[1] << 4) + pwFontPointer[0]);
+}
@@ -0,0 +1,118 @@
+/*
+ * VBE.h contains information of VBE graphic mode that 01.Kernel32 set.
+ *
+ * Boot loader has a flag that asks for graphic mode. 01.Kernel32 gets mode
+ * information block of mode 0x117 (1024 x 768, 16 bits color) with BIOS,
+ * switches to the mode with linear frame buffer and clears the flag if it
+ * fails. It also saves far pointer of 8x16 font in VGA BIOS because BIOS
+ * cannot be called in IA-32e mode.
+ */
+
+#ifndef __VBE_H__
+#define __VBE_H__
+
+#include "Types.h"
+
+
+/* addresses that boot loader and 01.Kernel32 use */
+
+// STARTGRAPHICMODE flag of boot loader
+#define VBE_STARTGRAPHICMODEFLAGADDRESS 0x7C09
+
+#define VBE_MODEINFOBLOCKADDRESS        0x7E00
+
+// far pointer (offset, segment) of 8x16 font
+#define VBE_FONTPOINTERADDRESS          0x7F00
+
+
+/* font of VGA BIOS */
+
+#define VBE_FONTWIDTH           8
+#define VBE_FONTHEIGHT          16
+#define VBE_FONTCHARACTERCOUNT  256
+
+
+#pragma pack(push, 1)
+
+// VBE mode information block. reference VBE 3.0 specification
+typedef struct kVBEModeInfoBlockStruct {
+    /* for all VBE versions */
+    WORD wModeAttribute;
+    BYTE bWinAAttribute;
+    BYTE bWinBAttribute;
+    WORD wWinGranulity;
+    WORD wWinSize;
+    WORD wWinASegment;
+    WORD wWinBSegment;
+    DWORD dwWinFuncPtr;
+    WORD wBytesPerScanLine;
+
+    /* VBE 1.2 or above */
+    WORD wXResolution;
+    WORD wYResolution;
+    BYTE bXCharSize;
+    BYTE bYCharSize;
+    BYTE bNumberOfPlane;
+    BYTE bBitsPerPixel;
+    BYTE bNumberOfBanks;
+    BYTE bMemoryModel;
+    BYTE bBankSize;
+    BYTE bNumberOfImagePages;
+    BYTE bReserved;
+
+    // direct color fields
+    BYTE bRedMaskSize;
+    BYTE bRedFieldPosition;
+    BYTE bGreenMaskSize;
+    BYTE bGreenFieldPosition;
+    BYTE bBlueMaskSize;
+    BYTE bBlueFieldPosition;
+    BYTE bReservedMaskSize;
+    BYTE bReservedFieldPosition;
+    BYTE bDirectColorModeInfo;
+
+    /* VBE 2.0 or above */
+    DWORD dwPhysicalBasePointer;
+    DWORD dwReserved1;
+    WORD wReserved2;
+
+    /* VBE 3.0 or above */
+    WORD wLinearBytesPerScanLine;
+    BYTE bBankNumberOfImagePages;
+    BYTE bLinearNumberOfImagePages;
+    BYTE bLinearRedMaskSize;
+    BYTE bLinearRedFieldPosition;
+    BYTE bLinearGreenMaskSize;
+    BYTE bLinearGreenFieldPosition;
+    BYTE bLinearBlueMaskSize;
+    BYTE bLinearBlueFieldPosition;
+    BYTE bLinearReservedMaskSize;
+    BYTE bLinearReservedFieldPosition;
+    DWORD dwMaxPixelClock;
+
+    BYTE vbReserved[190];
+} VBEMODEINFOBLOCK;
+
+#pragma pack(pop)
+
+
+/* VBE related functions */
+
+// get mode information block which 01.Kernel32 saved
+// return:
+//   pointer to mode information block
+VBEMODEINFOBLOCK *kGetVBEModeInfoBlock(void);
+
+
+// check whether screen is in VBE graphic mode
+// return:
+//   True if 01.Kernel32 switched to graphic mode. Otherwise False
+BOOL kIsGraphicMode(void);
+
+
+// get 8x16 font of VGA BIOS
+// return:
+//   address of font. 16 bytes per character, 1 bit per pixel
+const BYTE *kGetVGAFont(void);
+
+#endif /* __VBE_H__ */
@@ -0,0 +1,1151 @@
+#include "Window.h"
+#include "Task.h"
+#include "Console.h"
+#include "DynamicMemory.h"
+#include "Utility.h"
+#include "Mouse.h"
+
+
+/* singleton data structure of window manager */
+
+static WINDOWMANAGER gs_stWindowManager;
+
+// arrow cursor. 0 is transparent, 1 is outline and 2 is inside
+static const BYTE gs_vbMouseCursor[
+    WINDOW_MOUSECURSORWIDTH * WINDOW_MOUSECURSORHEIGHT
+] = {
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0,
+    1, 2, 2, 2, 1, 0, 0, 0, 0, 0, 0,
+    1, 2, 2, 2, 2, 1, 0, 0, 0, 0, 0,
+    1, 2, 2, 2, 2, 2, 1, 0, 0, 0, 0,
+    1, 2, 2, 2, 2, 2, 2, 1, 0, 0, 0,
+    1, 2, 2, 2, 2, 2, 2, 2, 1, 0, 0,
+    1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 0,
+    1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1,
+    1, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1,
+    1, 2, 2, 2, 1, 2, 2, 1, 0, 0, 0,
+    1, 2, 2, 1, 0, 1, 2, 2, 1, 0, 0,
+    1, 2, 1, 0, 0, 1, 2, 2, 1, 0, 0,
+    1, 1, 0, 0, 0, 0, 1, 2, 2, 1, 0,
+    0, 0, 0, 0, 0, 0, 1, 2, 2, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0
+};
+
+
+/* window manager related functions */
+
+// initialize window manager and create background window
+// return:
+//   True on success. Otherwise False
+// info:
+//   graphics must be initialized
+BOOL kInitializeWindowManager(void) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    const GRAPHICSBUFFER *pstBuffer;
+    QWORD qwWindowID;
+
+    if (kGetGraphicsManager()->bInitialized == FALSE) {
+        return FALSE;
+    }
+
+    kMemSet(&gs_stWindowManager, 0, sizeof(gs_stWindowManager));
+    kInitializeMutex(&(gs_stWindowManager.stLock));
+
+    // like task pool, window whose upper 32 bits of ID is zero is free
+    for (int i = 0; i < WINDOW_MAXCOUNT; i++) {
+        gs_stWindowManager.vstWindow[i].stLink.qwID = i;
+    }
+    gs_stWindowManager.iAllocatedCount = 1;
+
+    kInitializeList(&(gs_stWindowManager.stWindowList));
+    gs_stWindowManager.qwBackgroundWindowID = WINDOW_INVALIDID;
+    gs_stWindowManager.qwActiveWindowID = WINDOW_INVALIDID;
+    gs_stWindowManager.qwDragWindowID = WINDOW_INVALIDID;
+
+
+    /* background window covers the whole screen under every window */
+
+    pstScreenBuffer = kGetScreenBuffer();
+    gs_stWindowManager.iMouseX = pstScreenBuffer->iWidth / 2;
+    gs_stWindowManager.iMouseY = pstScreenBuffer->iHeight / 2;
+
+    qwWindowID = kCreateWindow(
+        0,
+        0,
+        pstScreenBuffer->iWidth,
+        pstScreenBuffer->iHeight,
+        WINDOW_FLAGS_SHOW,
+        "System Background"
+    );
+    if (qwWindowID == WINDOW_INVALIDID) {
+        return FALSE;
+    }
+
+    pstBuffer = kGetWindowBuffer(qwWindowID);
+    kDrawRect(
+        pstBuffer,
+        0,
+        0,
+        pstBuffer->iWidth - 1,
+        pstBuffer->iHeight - 1,
+        WINDOW_COLOR_SYSTEMBACKGROUND,
+        TRUE
+    );
+
+    // background never receives keys
+    gs_stWindowManager.qwBackgroundWindowID = qwWindowID;
+    gs_stWindowManager.qwActiveWindowID = WINDOW_INVALIDID;
+    gs_stWindowManager.bInitialized = TRUE;
+    return TRUE;
+}
+
+
+// task that sends keys and mouse events to windows and composites damaged
+// areas
+// info:
+//   it also draws console and updates frame buffer
+void kWindowManagerTask(void) {
+    while (TRUE) {
+        kDispatchKeyEvent();
+        kDispatchMouseEvent();
+
+        // console draws on its window, so it is composited in this frame
+        kFlushConsole();
+        kCompositeDamagedArea();
+        kFlushFrameBuffer();
+
+        kSleep(WINDOW_MANAGERINTERVAL);
+    }
+}
+
+
+// get window manager
+// return:
+//   pointer to window manager
+WINDOWMANAGER *kGetWindowManager(void) {
+    return &gs_stWindowManager;
+}
+
+
+/* window related functions */
+
+// create a window and make it active
+// params:
+//   iX, iY: top left of window on screen
+//   iWidth, iHeight: size of window including frame
+//   dwFlags: WINDOW_FLAGS_XXX
+//   pcTitle: title shown on title bar
+// return:
+//   ID of window. WINDOW_INVALIDID if there is no window or memory left
+QWORD kCreateWindow(
+    int iX,
+    int iY,
+    int iWidth,
+    int iHeight,
+    DWORD dwFlags,
+    const char *pcTitle
+) {
+    WINDOW *pstWindow = NULL;
+    COLOR *pstBuffer;
+    QWORD qwWindowID;
+    int iTitleLength;
+
+    if ((iWidth <= 0) || (iHeight <= 0)) {
+        return WINDOW_INVALIDID;
+    }
+
+    pstBuffer = (COLOR *) kAllocateMemory(
+        (QWORD) iWidth * iHeight * sizeof(COLOR)
+    );
+    if (pstBuffer == NULL) {
+        return WINDOW_INVALIDID;
+    }
+
+    kLock(&(gs_stWindowManager.stLock));
+
+
+    /* allocate window from pool */
+
+    if (gs_stWindowManager.iUseCount < WINDOW_MAXCOUNT) {
+        for (int i = 0; i < WINDOW_MAXCOUNT; i++) {
+            if ((gs_stWindowManager.vstWindow[i].stLink.qwID >> 32) == 0) {
+                pstWindow = &(gs_stWindowManager.vstWindow[i]);
+                break;
+            }
+        }
+    }
+    if (pstWindow == NULL) {
+        kUnlock(&(gs_stWindowManager.stLock));
+        kFreeMemory(pstBuffer);
+        return WINDOW_INVALIDID;
+    }
+    pstWindow->stLink.qwID |=
+        ((QWORD) gs_stWindowManager.iAllocatedCount) << 32;
+    gs_stWindowManager.iUseCount++;
+    gs_stWindowManager.iAllocatedCount++;
+    qwWindowID = pstWindow->stLink.qwID;
+
+
+    /* set up window */
+
+    kSetRect(&(pstWindow->stArea), iX, iY, iX + iWidth - 1, iY + iHeight - 1);
+    pstWindow->stBuffer.pstBuffer = pstBuffer;
+    pstWindow->stBuffer.iWidth = iWidth;
+    pstWindow->stBuffer.iHeight = iHeight;
+    pstWindow->qwTaskID = kGetRunningTask()->stLink.qwID;
+    pstWindow->dwFlags = dwFlags;
+
+    iTitleLength = MIN(kStrLen(pcTitle), WINDOW_TITLEMAXLENGTH);
+    kMemCpy(pstWindow->vcTitle, pcTitle, iTitleLength);
+    pstWindow->vcTitle[iTitleLength] = '\0';
+
+    kInitializeQueue(
+        &(pstWindow->stEventQueue),
+        pstWindow->vstEventBuffer,
+        WINDOW_MAXEVENTCOUNT,
+        sizeof(EVENT)
+    );
+
+    kDrawRect(
+        &(pstWindow->stBuffer),
+        0,
+        0,
+        iWidth - 1,
+        iHeight - 1,
+        WINDOW_COLOR_BACKGROUND,
+        TRUE
+    );
+    if (dwFlags & WINDOW_FLAGS_DRAWFRAME) {
+        kDrawWindowFrame(pstWindow, FALSE);
+    }
+
+    // new window is on the top
+    kAddListToTail(&(gs_stWindowManager.stWindowList), pstWindow);
+
+    kUnlock(&(gs_stWindowManager.stLock));
+
+    if (dwFlags & WINDOW_FLAGS_SHOW) {
+        kAddDamageRect(&(pstWindow->stArea));
+    }
+    kSetActiveWindow(qwWindowID);
+    return qwWindowID;
+}
+
+
+// delete a window
+// params:
+//   qwWindowID: window to delete
+// return:
+//   True on success. Otherwise False
+BOOL kDeleteWindow(QWORD qwWindowID) {
+    WINDOW *pstWindow;
+    WINDOW *pstTopWindow;
+    COLOR *pstBuffer;
+    RECT stArea;
+    BOOL bShown;
+    BOOL bActive;
+
+    kLock(&(gs_stWindowManager.stLock));
+
+    pstWindow = kGetWindow(qwWindowID);
+    if ((pstWindow == NULL) ||
+        (qwWindowID == gs_stWindowManager.qwBackgroundWindowID)) {
+        kUnlock(&(gs_stWindowManager.stLock));
+        return FALSE;
+    }
+
+    kRemoveList(&(gs_stWindowManager.stWindowList), qwWindowID);
+
+    stArea = pstWindow->stArea;
+    bShown = (pstWindow->dwFlags & WINDOW_FLAGS_SHOW) ? TRUE : FALSE;
+    pstBuffer = pstWindow->stBuffer.pstBuffer;
+
+    // give window back to pool
+    pstWindow->stLink.qwID = GETWINDOWOFFSET(qwWindowID);
+    gs_stWindowManager.iUseCount--;
+
+    // task waiting for events finds that the window is gone
+    kWakeUpTasks(&(pstWindow->stEventQueue));
+
+    bActive = (gs_stWindowManager.qwActiveWindowID == qwWindowID);
+    if (bActive == TRUE) {
+        gs_stWindowManager.qwActiveWindowID = WINDOW_INVALIDID;
+    }
+    pstTopWindow = kGetTailFromList(&(gs_stWindowManager.stWindowList));
+
+    kUnlock(&(gs_stWindowManager.stLock));
+
+    kFreeMemory(pstBuffer);
+    if (bShown == TRUE) {
+        kAddDamageRect(&stArea);
+    }
+
+    // the next window on the top receives keys
+    if ((bActive == TRUE) && (pstTopWindow != NULL)) {
+        kSetActiveWindow(pstTopWindow->stLink.qwID);
+    }
+    return TRUE;
+}
+
+
+// show or hide a window
+// params:
+//   qwWindowID: window to show or hide
+//   bShow: True to show. Otherwise False
+// return:
+//   True on success. Otherwise False
+BOOL kShowWindow(QWORD qwWindowID, BOOL bShow) {
+    WINDOW *pstWindow;
+    RECT stArea;
+
+    kLock(&(gs_stWindowManager.stLock));
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        kUnlock(&(gs_stWindowManager.stLock));
+        return FALSE;
+    }
+
+    if (bShow == TRUE) {
+        pstWindow->dwFlags |= WINDOW_FLAGS_SHOW;
+    }
+    else {
+        pstWindow->dwFlags &= ~WINDOW_FLAGS_SHOW;
+    }
+    stArea = pstWindow->stArea;
+
+    kUnlock(&(gs_stWindowManager.stLock));
+
+    kAddDamageRect(&stArea);
+    return TRUE;
+}
+
+
+// move a window
+// params:
+//   qwWindowID: window to move
+//   iX, iY: new top left of window on screen
+// return:
+//   True on success. Otherwise False
+BOOL kMoveWindow(QWORD qwWindowID, int iX, int iY) {
+    WINDOW *pstWindow;
+    RECT stPreviousArea;
+    RECT stArea;
+    BOOL bPreviousFlag;
+
+    kLock(&(gs_stWindowManager.stLock));
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        kUnlock(&(gs_stWindowManager.stLock));
+        return FALSE;
+    }
+
+    stPreviousArea = pstWindow->stArea;
+    kSetRect(
+        &stArea,
+        iX,
+        iY,
+        iX + pstWindow->stBuffer.iWidth - 1,
+        iY + pstWindow->stBuffer.iHeight - 1
+    );
+
+    // kUpdateWindowArea reads area without mutex
+    bPreviousFlag = kLockForSystemData();
+    pstWindow->stArea = stArea;
+    kUnlockForSystemData(bPreviousFlag);
+
+    kUnlock(&(gs_stWindowManager.stLock));
+
+    // windows under the old area are shown again
+    if (pstWindow->dwFlags & WINDOW_FLAGS_SHOW) {
+        kAddDamageRect(&stPreviousArea);
+        kAddDamageRect(&stArea);
+    }
+    return TRUE;
+}
+
+
+// bring a window to the top and send it keys
+// params:
+//   qwWindowID: window to activate
+// return:
+//   True on success. Otherwise False
+BOOL kSetActiveWindow(QWORD qwWindowID) {
+    WINDOW *pstWindow;
+    WINDOW *pstPreviousWindow;
+    QWORD qwPreviousWindowID;
+    EVENT stEvent;
+
+    kLock(&(gs_stWindowManager.stLock));
+
+    pstWindow = kGetWindow(qwWindowID);
+    if ((pstWindow == NULL) ||
+        (qwWindowID == gs_stWindowManager.qwBackgroundWindowID)) {
+        kUnlock(&(gs_stWindowManager.stLock));
+        return FALSE;
+    }
+
+    // move to the top
+    if (kGetTailFromList(&(gs_stWindowManager.stWindowList)) != pstWindow) {
+        kRemoveList(&(gs_stWindowManager.stWindowList), qwWindowID);
+        kAddListToTail(&(gs_stWindowManager.stWindowList), pstWindow);
+        if (pstWindow->dwFlags & WINDOW_FLAGS_SHOW) {
+            kAddDamageRect(&(pstWindow->stArea));
+        }
+    }
+
+    qwPreviousWindowID = gs_stWindowManager.qwActiveWindowID;
+    if (qwPreviousWindowID == qwWindowID) {
+        kUnlock(&(gs_stWindowManager.stLock));
+        return TRUE;
+    }
+    gs_stWindowManager.qwActiveWindowID = qwWindowID;
+
+    // only title bars change color
+    pstPreviousWindow = kGetWindow(qwPreviousWindowID);
+    if ((pstPreviousWindow != NULL) &&
+        (pstPreviousWindow->dwFlags & WINDOW_FLAGS_DRAWFRAME)) {
+        kDrawWindowFrame(pstPreviousWindow, FALSE);
+        if (pstPreviousWindow->dwFlags & WINDOW_FLAGS_SHOW) {
+            kAddDamageRect(&(pstPreviousWindow->stArea));
+        }
+    }
+    if (pstWindow->dwFlags & WINDOW_FLAGS_DRAWFRAME) {
+        kDrawWindowFrame(pstWindow, TRUE);
+        if (pstWindow->dwFlags & WINDOW_FLAGS_SHOW) {
+            kAddDamageRect(&(pstWindow->stArea));
+        }
+    }
+
+    kUnlock(&(gs_stWindowManager.stLock));
+
+
+    /* let tasks know it */
+
+    if (pstPreviousWindow != NULL) {
+        stEvent.qwType = EVENT_WINDOW_DESELECT;
+        stEvent.stWindowEvent.qwWindowID = qwPreviousWindowID;
+        kSendEventToWindow(qwPreviousWindowID, &stEvent);
+    }
+    stEvent.qwType = EVENT_WINDOW_SELECT;
+    stEvent.stWindowEvent.qwWindowID = qwWindowID;
+    kSendEventToWindow(qwWindowID, &stEvent);
+    return TRUE;
+}
+
+
+// get window that receives keys
+// return:
+//   ID of active window
+QWORD kGetActiveWindowID(void) {
+    return gs_stWindowManager.qwActiveWindowID;
+}
+
+
+// get window that fills the screen under every window
+// return:
+//   ID of background window
+QWORD kGetBackgroundWindowID(void) {
+    return gs_stWindowManager.qwBackgroundWindowID;
+}
+
+
+// get buffer of a window
+// params:
+//   qwWindowID: window
+// return:
+//   buffer that has the same size as the window. NULL if ID is wrong
+// info:
+//   changes are shown after kUpdateWindowArea is called
+const GRAPHICSBUFFER *kGetWindowBuffer(QWORD qwWindowID) {
+    WINDOW *pstWindow;
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        return NULL;
+    }
+    return &(pstWindow->stBuffer);
+}
+
+
+// get area inside frame of a window
+// params:
+//   qwWindowID: window
+//   pstArea: rectangle to save the area. it is in window coordinates
+// return:
+//   True on success. Otherwise False
+BOOL kGetWindowClientArea(QWORD qwWindowID, RECT *pstArea) {
+    WINDOW *pstWindow;
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        return FALSE;
+    }
+
+    if (pstWindow->dwFlags & WINDOW_FLAGS_DRAWFRAME) {
+        kSetRect(
+            pstArea,
+            WINDOW_BORDERWIDTH,
+            WINDOW_TITLEBARHEIGHT,
+            pstWindow->stBuffer.iWidth - 1 - WINDOW_BORDERWIDTH,
+            pstWindow->stBuffer.iHeight - 1 - WINDOW_BORDERWIDTH
+        );
+    }
+    else {
+        kSetRect(
+            pstArea,
+            0,
+            0,
+            pstWindow->stBuffer.iWidth - 1,
+            pstWindow->stBuffer.iHeight - 1
+        );
+    }
+    return TRUE;
+}
+
+
+// report an area of window that changed
+// params:
+//   qwWindowID: window that changed
+//   pstArea: changed area in window coordinates
+// return:
+//   True on success. Otherwise False
+BOOL kUpdateWindowArea(QWORD qwWindowID, const RECT *pstArea) {
+    WINDOW *pstWindow;
+    RECT stScreenArea;
+    BOOL bPreviousFlag;
+
+    // mutex is not used because console calls this while interrupts are
+    // disabled
+    bPreviousFlag = kLockForSystemData();
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+
+    // hidden window does not change screen
+    if ((pstWindow->dwFlags & WINDOW_FLAGS_SHOW) == 0) {
+        kUnlockForSystemData(bPreviousFlag);
+        return TRUE;
+    }
+
+    kSetRect(
+        &stScreenArea,
+        pstWindow->stArea.iX1 + pstArea->iX1,
+        pstWindow->stArea.iY1 + pstArea->iY1,
+        pstWindow->stArea.iX1 + pstArea->iX2,
+        pstWindow->stArea.iY1 + pstArea->iY2
+    );
+
+    // changes outside window are not shown
+    if (kGetOverlappedRect(&stScreenArea, &(pstWindow->stArea), &stScreenArea)
+            == TRUE) {
+        kAddDamageRect(&stScreenArea);
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+    return TRUE;
+}
+
+
+// send an event to event queue of a window
+// params:
+//   qwWindowID: window to receive event
+//   pstEvent: event to send
+// return:
+//   True on success. False if ID is wrong or queue is full
+BOOL kSendEventToWindow(QWORD qwWindowID, const EVENT *pstEvent) {
+    WINDOW *pstWindow;
+    BOOL bResult;
+    BOOL bPreviousFlag;
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+    bResult = kPutQueue(&(pstWindow->stEventQueue), pstEvent);
+    if (bResult == TRUE) {
+        kWakeUpTasks(&(pstWindow->stEventQueue));
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+    return bResult;
+}
+
+
+// get an event from event queue of a window
+// params:
+//   qwWindowID: window
+//   pstEvent: buffer to save event
+// return:
+//   True if an event is received. Otherwise False
+BOOL kReceiveEventFromWindowQueue(QWORD qwWindowID, EVENT *pstEvent) {
+    WINDOW *pstWindow;
+    BOOL bResult;
+    BOOL bPreviousFlag;
+
+    bPreviousFlag = kLockForSystemData();
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        kUnlockForSystemData(bPreviousFlag);
+        return FALSE;
+    }
+    bResult = kGetQueue(&(pstWindow->stEventQueue), pstEvent);
+
+    kUnlockForSystemData(bPreviousFlag);
+    return bResult;
+}
+
+
+// wait until an event is in event queue of a window and get it
+// params:
+//   qwWindowID: window
+//   pstEvent: buffer to save event
+//   qwMillisecond: time to wait. TASK_WAITFOREVER waits until an event comes
+// return:
+//   True if an event is received. False if time is over or window is
+//   deleted
+// info:
+//   task is blocked while it waits and kSendEventToWindow wakes it up
+BOOL kWaitEventFromWindowQueue(
+    QWORD qwWindowID,
+    EVENT *pstEvent,
+    QWORD qwMillisecond
+) {
+    WINDOW *pstWindow;
+    QWORD qwStartTickCount;
+    QWORD qwElapsedTime;
+    BOOL bResult = FALSE;
+    BOOL bPreviousFlag;
+
+    qwStartTickCount = kGetTickCount();
+
+    // queue is checked and task is blocked while system data is locked, so
+    // an event that comes between them is not missed
+    bPreviousFlag = kLockForSystemData();
+    while (TRUE) {
+        pstWindow = kGetWindow(qwWindowID);
+        if (pstWindow == NULL) {
+            break;
+        }
+
+        bResult = kGetQueue(&(pstWindow->stEventQueue), pstEvent);
+        if (bResult == TRUE) {
+            break;
+        }
+
+        if (qwMillisecond == TASK_WAITFOREVER) {
+            kBlockTask(&(pstWindow->stEventQueue), TASK_WAITFOREVER);
+            continue;
+        }
+
+        qwElapsedTime = kGetTickCount() - qwStartTickCount;
+        if (qwElapsedTime >= qwMillisecond) {
+            break;
+        }
+        kBlockTask(&(pstWindow->stEventQueue), qwMillisecond - qwElapsedTime);
+    }
+
+    kUnlockForSystemData(bPreviousFlag);
+    return bResult;
+}
+
+
+// get window structure of an ID
+// params:
+//   qwWindowID: window
+// return:
+//   window. NULL if window of the ID does not exist
+static WINDOW *kGetWindow(QWORD qwWindowID) {
+    WINDOW *pstWindow;
+    QWORD qwIndex;
+
+    qwIndex = GETWINDOWOFFSET(qwWindowID);
+    if (qwIndex >= WINDOW_MAXCOUNT) {
+        return NULL;
+    }
+
+    // deleted window has a different allocation count
+    pstWindow = &(gs_stWindowManager.vstWindow[qwIndex]);
+    if (((qwWindowID >> 32) == 0) || (pstWindow->stLink.qwID != qwWindowID)) {
+        return NULL;
+    }
+    return pstWindow;
+}
+
+
+// draw frame and title bar to buffer of a window
+// params:
+//   pstWindow: window to draw
+//   bActive: True if window is active
+static void kDrawWindowFrame(WINDOW *pstWindow, BOOL bActive) {
+    const GRAPHICSBUFFER *pstBuffer = &(pstWindow->stBuffer);
+    COLOR stTitleBarColor;
+
+    stTitleBarColor = (bActive == TRUE) ?
+        WINDOW_COLOR_TITLEBARACTIVE : WINDOW_COLOR_TITLEBARINACTIVE;
+
+    kDrawRect(
+        pstBuffer,
+        0,
+        0,
+        pstBuffer->iWidth - 1,
+        pstBuffer->iHeight - 1,
+        WINDOW_COLOR_FRAME,
+        FALSE
+    );
+    kDrawRect(
+        pstBuffer,
+        WINDOW_BORDERWIDTH,
+        WINDOW_BORDERWIDTH,
+        pstBuffer->iWidth - 1 - WINDOW_BORDERWIDTH,
+        WINDOW_TITLEBARHEIGHT - 1,
+        stTitleBarColor,
+        TRUE
+    );
+    kDrawText(
+        pstBuffer,
+        WINDOW_BORDERWIDTH + 6,
+        (WINDOW_TITLEBARHEIGHT - 16) / 2,
+        WINDOW_COLOR_TITLEBARTEXT,
+        stTitleBarColor,
+        pstWindow->vcTitle,
+        kStrLen(pstWindow->vcTitle)
+    );
+}
+
+
+// add an area of screen that windows have to be composited again
+// params:
+//   pstArea: area in screen coordinates
+static void kAddDamageRect(const RECT *pstArea) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    RECT stScreenArea;
+    RECT stDamageRect;
+    BOOL bPreviousFlag;
+
+    pstScreenBuffer = kGetScreenBuffer();
+    kSetRect(
+        &stScreenArea,
+        0,
+        0,
+        pstScreenBuffer->iWidth - 1,
+        pstScreenBuffer->iHeight - 1
+    );
+    if (kGetOverlappedRect(pstArea, &stScreenArea, &stDamageRect) == FALSE) {
+        return;
+    }
+
+    bPreviousFlag = kLockForSystemData();
+    kAddRectToList(
+        gs_stWindowManager.vstDamageRect,
+        &(gs_stWindowManager.iDamageRectCount),
+        WINDOW_MAXDAMAGERECTCOUNT,
+        &stDamageRect
+    );
+    kUnlockForSystemData(bPreviousFlag);
+}
+
+
+// send keys in keyboard queue to the active window
+static void kDispatchKeyEvent(void) {
+    KEYDATA stKeyData;
+    EVENT stEvent;
+    WINDOW *pstBackgroundWindow;
+    WINDOW *pstBottomWindow;
+    QWORD qwActiveWindowID;
+
+    while (kGetKeyFromKeyQueue(&stKeyData) == TRUE) {
+        // switch key is not sent to windows
+        if (stKeyData.bASCIICode == WINDOW_SWITCHKEY) {
+            if ((stKeyData.bFlags & KEY_FLAGS_DOWN) == 0) {
+                continue;
+            }
+
+            // bottom window except background becomes the top
+            kLock(&(gs_stWindowManager.stLock));
+            pstBackgroundWindow =
+                kGetWindow(gs_stWindowManager.qwBackgroundWindowID);
+            pstBottomWindow = kGetNextFromList(pstBackgroundWindow);
+            if (pstBottomWindow != NULL) {
+                kSetActiveWindow(pstBottomWindow->stLink.qwID);
+            }
+            kUnlock(&(gs_stWindowManager.stLock));
+            continue;
+        }
+
+        qwActiveWindowID = gs_stWindowManager.qwActiveWindowID;
+        if (qwActiveWindowID == WINDOW_INVALIDID) {
+            continue;
+        }
+
+        if (stKeyData.bFlags & KEY_FLAGS_DOWN) {
+            stEvent.qwType = EVENT_KEY_DOWN;
+        }
+        else {
+            stEvent.qwType = EVENT_KEY_UP;
+        }
+        stEvent.stKeyEvent.qwWindowID = qwActiveWindowID;
+        stEvent.stKeyEvent.bASCIICode = stKeyData.bASCIICode;
+        stEvent.stKeyEvent.bScanCode = stKeyData.bScanCode;
+        stEvent.stKeyEvent.bFlags = stKeyData.bFlags;
+
+        // key is lost when the task does not read its queue
+        kSendEventToWindow(qwActiveWindowID, &stEvent);
+    }
+}
+
+
+// move mouse cursor and send mouse data in mouse queue to windows
+// info:
+//   left button activates the window under cursor, and dragging title bar
+//   moves the window
+static void kDispatchMouseEvent(void) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    MOUSEDATA stData;
+    WINDOW *pstWindow;
+    QWORD qwWindowID;
+    RECT stCursorArea;
+    RECT stWindowArea;
+    BOOL bMoved;
+    BOOL bTitleBar;
+    BYTE bChangedButton;
+    int iPreviousX, iPreviousY;
+
+    pstScreenBuffer = kGetScreenBuffer();
+    while (kGetMouseDataFromMouseQueue(&stData) == TRUE) {
+        /* move cursor. Y of mouse increases upward */
+
+        iPreviousX = gs_stWindowManager.iMouseX;
+        iPreviousY = gs_stWindowManager.iMouseY;
+        gs_stWindowManager.iMouseX = MIN(
+            MAX(iPreviousX + stData.iXMovement, 0),
+            pstScreenBuffer->iWidth - 1
+        );
+        gs_stWindowManager.iMouseY = MIN(
+            MAX(iPreviousY - stData.iYMovement, 0),
+            pstScreenBuffer->iHeight - 1
+        );
+        bMoved = (gs_stWindowManager.iMouseX != iPreviousX) ||
+            (gs_stWindowManager.iMouseY != iPreviousY);
+
+        if (bMoved == TRUE) {
+            kSetRect(
+                &stCursorArea,
+                iPreviousX,
+                iPreviousY,
+                iPreviousX + WINDOW_MOUSECURSORWIDTH - 1,
+                iPreviousY + WINDOW_MOUSECURSORHEIGHT - 1
+            );
+            kAddDamageRect(&stCursorArea);
+            kGetMouseCursorArea(&stCursorArea);
+            kAddDamageRect(&stCursorArea);
+
+            // window follows cursor while its title bar is dragged
+            pstWindow = kGetWindow(gs_stWindowManager.qwDragWindowID);
+            if (pstWindow != NULL) {
+                kMoveWindow(
+                    gs_stWindowManager.qwDragWindowID,
+                    pstWindow->stArea.iX1 +
+                        gs_stWindowManager.iMouseX - iPreviousX,
+                    pstWindow->stArea.iY1 +
+                        gs_stWindowManager.iMouseY - iPreviousY
+                );
+            }
+        }
+
+        bChangedButton =
+            stData.bButtonStatus ^ gs_stWindowManager.bMouseButtonStatus;
+        gs_stWindowManager.bMouseButtonStatus = stData.bButtonStatus;
+
+
+        /* find window under cursor */
+
+        kLock(&(gs_stWindowManager.stLock));
+        pstWindow = kGetWindowAtPoint(
+            gs_stWindowManager.iMouseX,
+            gs_stWindowManager.iMouseY
+        );
+        qwWindowID = pstWindow->stLink.qwID;
+        stWindowArea = pstWindow->stArea;
+        bTitleBar = ((pstWindow->dwFlags & WINDOW_FLAGS_DRAWFRAME) != 0) &&
+            (gs_stWindowManager.iMouseY <
+                stWindowArea.iY1 + WINDOW_TITLEBARHEIGHT);
+        kUnlock(&(gs_stWindowManager.stLock));
+
+
+        /* send events */
+
+        if (bChangedButton & MOUSE_LBUTTONDOWN) {
+            if (stData.bButtonStatus & MOUSE_LBUTTONDOWN) {
+                kSetActiveWindow(qwWindowID);
+                if (bTitleBar == TRUE) {
+                    gs_stWindowManager.qwDragWindowID = qwWindowID;
+                }
+                kSendMouseEventToWindow(
+                    EVENT_MOUSE_LBUTTONDOWN,
+                    qwWindowID,
+                    stData.bButtonStatus,
+                    0
+                );
+            }
+            else {
+                gs_stWindowManager.qwDragWindowID = WINDOW_INVALIDID;
+                kSendMouseEventToWindow(
+                    EVENT_MOUSE_LBUTTONUP,
+                    qwWindowID,
+                    stData.bButtonStatus,
+                    0
+                );
+            }
+        }
+
+        if (bChangedButton & MOUSE_RBUTTONDOWN) {
+            kSendMouseEventToWindow(
+                (stData.bButtonStatus & MOUSE_RBUTTONDOWN) ?
+                    EVENT_MOUSE_RBUTTONDOWN : EVENT_MOUSE_RBUTTONUP,
+                qwWindowID,
+                stData.bButtonStatus,
+                0
+            );
+        }
+
+        if (stData.iZMovement != 0) {
+            kSendMouseEventToWindow(
+                EVENT_MOUSE_WHEEL,
+                qwWindowID,
+                stData.bButtonStatus,
+                stData.iZMovement
+            );
+        }
+
+        // movements are already coalesced by mouse driver
+        if ((bMoved == TRUE) && (bChangedButton == 0)) {
+            kSendMouseEventToWindow(
+                EVENT_MOUSE_MOVE,
+                qwWindowID,
+                stData.bButtonStatus,
+                0
+            );
+        }
+    }
+}
+
+
+// send a mouse event to a window
+// params:
+//   qwType: EVENT_MOUSE_XXX
+//   qwWindowID: window to receive event
+//   bButtonStatus: button state
+//   iZMovement: wheel movement
+static void kSendMouseEventToWindow(
+    QWORD qwType,
+    QWORD qwWindowID,
+    BYTE bButtonStatus,
+    int iZMovement
+) {
+    WINDOW *pstWindow;
+    EVENT stEvent;
+
+    // no task reads events of background
+    if (qwWindowID == gs_stWindowManager.qwBackgroundWindowID) {
+        return;
+    }
+
+    pstWindow = kGetWindow(qwWindowID);
+    if (pstWindow == NULL) {
+        return;
+    }
+
+    stEvent.qwType = qwType;
+    stEvent.stMouseEvent.qwWindowID = qwWindowID;
+    stEvent.stMouseEvent.iX =
+        gs_stWindowManager.iMouseX - pstWindow->stArea.iX1;
+    stEvent.stMouseEvent.iY =
+        gs_stWindowManager.iMouseY - pstWindow->stArea.iY1;
+    stEvent.stMouseEvent.bButtonStatus = bButtonStatus;
+    stEvent.stMouseEvent.iZMovement = iZMovement;
+    kSendEventToWindow(qwWindowID, &stEvent);
+}
+
+
+// get the top window at a point
+// params:
+//   iX, iY: point on screen
+// return:
+//   window. it is background window if no other window is there
+// info:
+//   mutex of window manager must be held
+static WINDOW *kGetWindowAtPoint(int iX, int iY) {
+    WINDOW *pstWindow;
+    WINDOW *pstFoundWindow;
+
+    // background covers the whole screen
+    pstFoundWindow = kGetHeaderFromList(&(gs_stWindowManager.stWindowList));
+    for (pstWindow = pstFoundWindow; pstWindow != NULL;
+         pstWindow = kGetNextFromList(pstWindow)) {
+        if (((pstWindow->dwFlags & WINDOW_FLAGS_SHOW) != 0) &&
+            (pstWindow->stArea.iX1 <= iX) && (iX <= pstWindow->stArea.iX2) &&
+            (pstWindow->stArea.iY1 <= iY) && (iY <= pstWindow->stArea.iY2)) {
+            pstFoundWindow = pstWindow;
+        }
+    }
+    return pstFoundWindow;
+}
+
+
+// get area of mouse cursor on screen
+// params:
+//   pstArea: rectangle to save the area
+static void kGetMouseCursorArea(RECT *pstArea) {
+    kSetRect(
+        pstArea,
+        gs_stWindowManager.iMouseX,
+        gs_stWindowManager.iMouseY,
+        gs_stWindowManager.iMouseX + WINDOW_MOUSECURSORWIDTH - 1,
+        gs_stWindowManager.iMouseY + WINDOW_MOUSECURSORHEIGHT - 1
+    );
+}
+
+
+// draw mouse cursor on back buffer of screen
+static void kDrawMouseCursor(void) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    const BYTE *pbPixel;
+    RECT stCursorArea;
+
+    if (kGetMouseManager()->bInitialized == FALSE) {
+        return;
+    }
+
+    pstScreenBuffer = kGetScreenBuffer();
+    pbPixel = gs_vbMouseCursor;
+    for (int j = 0; j < WINDOW_MOUSECURSORHEIGHT; j++) {
+        for (int i = 0; i < WINDOW_MOUSECURSORWIDTH; i++, pbPixel++) {
+            if (*pbPixel == 0) {
+                continue;
+            }
+            kDrawPixel(
+                pstScreenBuffer,
+                gs_stWindowManager.iMouseX + i,
+                gs_stWindowManager.iMouseY + j,
+                (*pbPixel == 1) ?
+                    WINDOW_COLOR_MOUSEOUTLINE : WINDOW_COLOR_MOUSEINSIDE
+            );
+        }
+    }
+
+    kGetMouseCursorArea(&stCursorArea);
+    kAddDirtyRect(&stCursorArea);
+}
+
+
+// composite windows in damaged areas to back buffer of screen
+static void kCompositeDamagedArea(void) {
+    RECT vstDamageRect[WINDOW_MAXDAMAGERECTCOUNT];
+    int iDamageRectCount;
+    RECT stCursorArea;
+    BOOL bPreviousFlag;
+
+    // take the list, so tasks can go on drawing while compositing
+    bPreviousFlag = kLockForSystemData();
+    iDamageRectCount = gs_stWindowManager.iDamageRectCount;
+    kMemCpy(vstDamageRect, gs_stWindowManager.vstDamageRect,
+            iDamageRectCount * sizeof(RECT));
+    gs_stWindowManager.iDamageRectCount = 0;
+    kUnlockForSystemData(bPreviousFlag);
+
+    if (iDamageRectCount == 0) {
+        return;
+    }
+
+    kLock(&(gs_stWindowManager.stLock));
+    for (int i = 0; i < iDamageRectCount; i++) {
+        kCompositeArea(&(vstDamageRect[i]));
+    }
+    gs_stWindowManager.qwCompositeCount++;
+    kUnlock(&(gs_stWindowManager.stLock));
+
+    // cursor is on the top of every window
+    kGetMouseCursorArea(&stCursorArea);
+    for (int i = 0; i < iDamageRectCount; i++) {
+        if (kIsRectOverlapped(&(vstDamageRect[i]), &stCursorArea) == TRUE) {
+            kDrawMouseCursor();
+            break;
+        }
+    }
+
+    for (int i = 0; i < iDamageRectCount; i++) {
+        kAddDirtyRect(&(vstDamageRect[i]));
+    }
+}
+
+
+// composite windows in an area from the bottom to the top
+// params:
+//   pstArea: area in screen coordinates
+// info:
+//   windows under a window which covers the whole area are skipped
+static void kCompositeArea(const RECT *pstArea) {
+    const GRAPHICSBUFFER *pstScreenBuffer;
+    WINDOW *pstWindow;
+    WINDOW *pstStartWindow;
+    RECT stOverlappedArea;
+    RECT stSourceArea;
+
+    pstScreenBuffer = kGetScreenBuffer();
+
+    // find the highest window that covers the whole area
+    pstStartWindow = kGetHeaderFromList(&(gs_stWindowManager.stWindowList));
+    for (pstWindow = pstStartWindow; pstWindow != NULL;
+         pstWindow = kGetNextFromList(pstWindow)) {
+        if (((pstWindow->dwFlags & WINDOW_FLAGS_SHOW) != 0) &&
+            (pstWindow->stArea.iX1 <= pstArea->iX1) &&
+            (pstWindow->stArea.iY1 <= pstArea->iY1) &&
+            (pstWindow->stArea.iX2 >= pstArea->iX2) &&
+            (pstWindow->stArea.iY2 >= pstArea->iY2)) {
+            pstStartWindow = pstWindow;
+        }
+    }
+
+    for (pstWindow = pstStartWindow; pstWindow != NULL;
+         pstWindow = kGetNextFromList(pstWindow)) {
+        if ((pstWindow->dwFlags & WINDOW_FLAGS_SHOW) == 0) {
+            continue;
+        }
+        if (kGetOverlappedRect(&(pstWindow->stArea), pstArea,
+                               &stOverlappedArea) == FALSE) {
+            continue;
+        }
+
+        // area in window coordinates
+        kSetRect(
+            &stSourceArea,
+            stOverlappedArea.iX1 - pstWindow->stArea.iX1,
+            stOverlappedArea.iY1 - pstWindow->stArea.iY1,
+            stOverlappedArea.iX2 - pstWindow->stArea.iX1,
+            stOverlappedArea.iY2 - pstWindow->stArea.iY1
+        );
+        kBlitBufferArea(
+            pstScreenBuffer,
+            stOverlappedArea.iX1,
+            stOverlappedArea.iY1,
+            &(pstWindow->stBuffer),
+            &stSourceArea
+        );
+
+        gs_stWindowManager.qwComposedPixelCount +=
+            (QWORD) (stOverlappedArea.iX2 - stOverlappedArea.iX1 + 1) *
+            (stOverlappedArea.iY2 - stOverlappedArea.iY1 + 1);
+    }
+}
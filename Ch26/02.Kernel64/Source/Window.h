@@ -0,0 +1,436 @@
+/*
+ * Window.h contains window manager of graphic mode.
+ *
+ * Window manager task owns the screen. Each window has its own buffer that
+ * its task draws on, and windows are kept in a list ordered from the bottom
+ * to the top. When a task changes its window, it reports the changed area
+ * with kUpdateWindowArea, and the area is added to the damage list of
+ * screen. Window manager task composites only damaged areas from the
+ * windows into the back buffer of screen, so windows that do not change are
+ * not redrawn every frame.
+ *
+ * Keys and mouse data are read by window manager task only. Keys are sent
+ * to the event queue of the active window and mouse events are sent to the
+ * window under mouse cursor.
+ */
+
+#ifndef __WINDOW_H__
+#define __WINDOW_H__
+
+#include "Types.h"
+#include "List.h"
+#include "Queue.h"
+#include "Synchronization.h"
+#include "Keyboard.h"
+#include "Graphics.h"
+
+
+/* window related constants */
+
+#define WINDOW_MAXCOUNT         64
+#define WINDOW_INVALIDID        0xFFFFFFFFFFFFFFFF
+
+// index of window pool from ID
+#define GETWINDOWOFFSET(x)      ((x) & 0xFFFFFFFF)
+
+// number of events that a window can hold
+#define WINDOW_MAXEVENTCOUNT    64
+
+#define WINDOW_TITLEMAXLENGTH   40
+
+// max number of damaged rectangles of screen
+#define WINDOW_MAXDAMAGERECTCOUNT   32
+
+// interval that window manager task checks keys and damaged areas
+#define WINDOW_MANAGERINTERVAL  4   // ms
+
+// key that brings the bottom window to the top
+#define WINDOW_SWITCHKEY        KEY_F12
+
+// size of mouse cursor
+#define WINDOW_MOUSECURSORWIDTH     11
+#define WINDOW_MOUSECURSORHEIGHT    18
+
+// console scrolls this many lines per wheel step
+#define WINDOW_WHEELSCROLLLINES     3
+
+
+/* window flags */
+
+#define WINDOW_FLAGS_SHOW       0x00000001
+#define WINDOW_FLAGS_DRAWFRAME  0x00000002
+#define WINDOW_FLAGS_DEFAULT    (WINDOW_FLAGS_SHOW | WINDOW_FLAGS_DRAWFRAME)
+
+
+/* size of frame */
+
+#define WINDOW_TITLEBARHEIGHT   21
+#define WINDOW_BORDERWIDTH      1
+
+
+/* colors */
+
+#define WINDOW_COLOR_BACKGROUND         RGB(255, 255, 255)
+#define WINDOW_COLOR_FRAME              RGB(60, 60, 60)
+#define WINDOW_COLOR_TITLEBARACTIVE     RGB(40, 90, 160)
+#define WINDOW_COLOR_TITLEBARINACTIVE   RGB(150, 150, 150)
+#define WINDOW_COLOR_TITLEBARTEXT       RGB(255, 255, 255)
+#define WINDOW_COLOR_SYSTEMBACKGROUND   RGB(0, 84, 84)
+#define WINDOW_COLOR_MOUSEOUTLINE       RGB(0, 0, 0)
+#define WINDOW_COLOR_MOUSEINSIDE        RGB(255, 255, 255)
+
+
+/* event types */
+
+#define EVENT_UNKNOWN           0
+
+// key events. stKeyEvent is valid
+#define EVENT_KEY_DOWN          1
+#define EVENT_KEY_UP            2
+
+// window events. stWindowEvent is valid
+#define EVENT_WINDOW_SELECT     3
+#define EVENT_WINDOW_DESELECT   4
+
+// mouse events. stMouseEvent is valid and they go to the window under
+// mouse cursor
+#define EVENT_MOUSE_MOVE        5
+#define EVENT_MOUSE_LBUTTONDOWN 6
+#define EVENT_MOUSE_LBUTTONUP   7
+#define EVENT_MOUSE_RBUTTONDOWN 8
+#define EVENT_MOUSE_RBUTTONUP   9
+#define EVENT_MOUSE_WHEEL       10
+
+
+#pragma pack(push, 1)
+
+typedef struct kKeyEventStruct {
+    QWORD qwWindowID;
+
+    BYTE bASCIICode;
+    BYTE bScanCode;
+    BYTE bFlags;
+} KEYEVENT;
+
+
+typedef struct kWindowEventStruct {
+    QWORD qwWindowID;
+} WINDOWEVENT;
+
+
+typedef struct kMouseEventStruct {
+    QWORD qwWindowID;
+
+    // location of cursor in window coordinates
+    int iX;
+    int iY;
+
+    // MOUSE_XBUTTONDOWN bits
+    BYTE bButtonStatus;
+
+    // wheel. positive value is toward user
+    int iZMovement;
+} MOUSEEVENT;
+
+
+typedef struct kEventStruct {
+    QWORD qwType;
+
+    union {
+        KEYEVENT stKeyEvent;
+        WINDOWEVENT stWindowEvent;
+        MOUSEEVENT stMouseEvent;
+    };
+} EVENT;
+
+
+typedef struct kWindowStruct {
+    // ID and link of window list. lower 32 bits are index of window pool
+    // and upper 32 bits are allocation count
+    LISTLINK stLink;
+
+    // area of window on screen
+    RECT stArea;
+
+    // pixels of window including frame
+    GRAPHICSBUFFER stBuffer;
+
+    // task that created this window
+    QWORD qwTaskID;
+
+    DWORD dwFlags;
+    char vcTitle[WINDOW_TITLEMAXLENGTH + 1];
+
+    QUEUE stEventQueue;
+    EVENT vstEventBuffer[WINDOW_MAXEVENTCOUNT];
+} WINDOW;
+
+
+typedef struct kWindowManagerStruct {
+    // True if background window is created
+    BOOL bInitialized;
+
+    // protects window list while windows are created, moved or composited
+    MUTEX stLock;
+
+    // window pool
+    WINDOW vstWindow[WINDOW_MAXCOUNT];
+    int iUseCount;
+    int iAllocatedCount;
+
+    // shown order of windows. header is the bottom and tail is the top
+    LIST stWindowList;
+
+    QWORD qwBackgroundWindowID;
+    QWORD qwActiveWindowID;
+
+    // mouse cursor location on screen and button state
+    int iMouseX;
+    int iMouseY;
+    BYTE bMouseButtonStatus;
+
+    // window whose title bar is being dragged
+    QWORD qwDragWindowID;
+
+    // areas of screen that windows have to be composited again
+    RECT vstDamageRect[WINDOW_MAXDAMAGERECTCOUNT];
+    int iDamageRectCount;
+
+    // statistics
+    QWORD qwCompositeCount;
+    QWORD qwComposedPixelCount;
+} WINDOWMANAGER;
+
+#pragma pack(pop)
+
+
+/* window manager related functions */
+
+// initialize window manager and create background window
+// return:
+//   True on success. Otherwise False
+// info:
+//   graphics must be initialized
+BOOL kInitializeWindowManager(void);
+
+
+// task that sends keys and mouse events to windows and composites damaged
+// areas
+// info:
+//   it also draws console and updates frame buffer
+void kWindowManagerTask(void);
+
+
+// get window manager
+// return:
+//   pointer to window manager
+WINDOWMANAGER *kGetWindowManager(void);
+
+
+/* window related functions */
+
+// create a window and make it active
+// params:
+//   iX, iY: top left of window on screen
+//   iWidth, iHeight: size of window including frame
+//   dwFlags: WINDOW_FLAGS_XXX
+//   pcTitle: title shown on title bar
+// return:
+//   ID of window. WINDOW_INVALIDID if there is no window or memory left
+QWORD kCreateWindow(
+    int iX,
+    int iY,
+    int iWidth,
+    int iHeight,
+    DWORD dwFlags,
+    const char *pcTitle
+);
+
+
+// delete a window
+// params:
+//   qwWindowID: window to delete
+// return:
+//   True on success. Otherwise False
+BOOL kDeleteWindow(QWORD qwWindowID);
+
+
+// show or hide a window
+// params:
+//   qwWindowID: window to show or hide
+//   bShow: True to show. Otherwise False
+// return:
+//   True on success. Otherwise False
+BOOL kShowWindow(QWORD qwWindowID, BOOL bShow);
+
+
+// move a window
+// params:
+//   qwWindowID: window to move
+//   iX, iY: new top left of window on screen
+// return:
+//   True on success. Otherwise False
+BOOL kMoveWindow(QWORD qwWindowID, int iX, int iY);
+
+
+// bring a window to the top and send it keys
+// params:
+//   qwWindowID: window to activate
+// return:
+//   True on success. Otherwise False
+BOOL kSetActiveWindow(QWORD qwWindowID);
+
+
+// get window that receives keys
+// return:
+//   ID of active window
+QWORD kGetActiveWindowID(void);
+
+
+// get window that fills the screen under every window
+// return:
+//   ID of background window
+QWORD kGetBackgroundWindowID(void);
+
+
+// get buffer of a window
+// params:
+//   qwWindowID: window
+// return:
+//   buffer that has the same size as the window. NULL if ID is wrong
+// info:
+//   changes are shown after kUpdateWindowArea is called
+const GRAPHICSBUFFER *kGetWindowBuffer(QWORD qwWindowID);
+
+
+// get area inside frame of a window
+// params:
+//   qwWindowID: window
+//   pstArea: rectangle to save the area. it is in window coordinates
+// return:
+//   True on success. Otherwise False
+BOOL kGetWindowClientArea(QWORD qwWindowID, RECT *pstArea);
+
+
+// report an area of window that changed
+// params:
+//   qwWindowID: window that changed
+//   pstArea: changed area in window coordinates
+// return:
+//   True on success. Otherwise False
+BOOL kUpdateWindowArea(QWORD qwWindowID, const RECT *pstArea);
+
+
+// send an event to event queue of a window
+// params:
+//   qwWindowID: window to receive event
+//   pstEvent: event to send
+// return:
+//   True on success. False if ID is wrong or queue is full
+BOOL kSendEventToWindow(QWORD qwWindowID, const EVENT *pstEvent);
+
+
+// get an event from event queue of a window
+// params:
+//   qwWindowID: window
+//   pstEvent: buffer to save event
+// return:
+//   True if an event is received. Otherwise False
+BOOL kReceiveEventFromWindowQueue(QWORD qwWindowID, EVENT *pstEvent);
+
+
+// wait until an event is in event queue of a window and get it
+// params:
+//   qwWindowID: window
+//   pstEvent: buffer to save event
+//   qwMillisecond: time to wait. TASK_WAITFOREVER waits until an event comes
+// return:
+//   True if an event is received. False if time is over or window is
+//   deleted
+// info:
+//   task is blocked while it waits and kSendEventToWindow wakes it up
+BOOL kWaitEventFromWindowQueue(
+    QWORD qwWindowID,
+    EVENT *pstEvent,
+    QWORD qwMillisecond
+);
+
+
+// get window structure of an ID
+// params:
+//   qwWindowID: window
+// return:
+//   window. NULL if window of the ID does not exist
+static WINDOW *kGetWindow(QWORD qwWindowID);
+
+
+// draw frame and title bar to buffer of a window
+// params:
+//   pstWindow: window to draw
+//   bActive: True if window is active
+static void kDrawWindowFrame(WINDOW *pstWindow, BOOL bActive);
+
+
+// add an area of screen that windows have to be composited again
+// params:
+//   pstArea: area in screen coordinates
+static void kAddDamageRect(const RECT *pstArea);
+
+
+// send keys in keyboard queue to the active window
+static void kDispatchKeyEvent(void);
+
+
+// move mouse cursor and send mouse data in mouse queue to windows
+// info:
+//   left button activates the window under cursor, and dragging title bar
+//   moves the window
+static void kDispatchMouseEvent(void);
+
+
+// send a mouse event to a window
+// params:
+//   qwType: EVENT_MOUSE_XXX
+//   qwWindowID: window to receive event
+//   bButtonStatus: button state
+//   iZMovement: wheel movement
+static void kSendMouseEventToWindow(
+    QWORD qwType,
+    QWORD qwWindowID,
+    BYTE bButtonStatus,
+    int iZMovement
+);
+
+
+// get the top window at a point
+// params:
+//   iX, iY: point on screen
+// return:
+//   window. it is background window if no other window is there
+// info:
+//   mutex of window manager must be held
+static WINDOW *kGetWindowAtPoint(int iX, int iY);
+
+
+// get area of mouse cursor on screen
+// params:
+//   pstArea: rectangle to save the area
+static void kGetMouseCursorArea(RECT *pstArea);
+
+
+// draw mouse cursor on back buffer of screen
+static void kDrawMouseCursor(void);
+
+
+// composite windows in damaged areas to back buffer of screen
+static void kCompositeDamagedArea(void);
+
+
+// composite windows in an area from the bottom to the top
+// params:
+//   pstArea: area in screen coordinates
+// info:
+//   windows under a window which covers the whole area are skipped
+static void kCompositeArea(const RECT *pstArea);
+
+#endif /* __WINDOW_H__ */
@@ -8,10 +8,13 @@
  * TOTALSECTORCOUNT in BootLoader.asm manually every time I add more C code.
  * Actually, I cannot expect how many bytes the c code will occupy in Disk.img
  * before compiling.
+ * Kernel64.bin is compressed into LZ4 block format when it gets smaller, so
+ * the boot loader reads fewer sectors. 01.Kernel32 inflates it to 2MB.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -19,6 +22,27 @@
 
 #define BYTESOFSECTOR 512
 
+// same values as 01.Kernel32/Source/Decompress.h
+#define KERNEL64_COMPRESSEDSIGNATURE 0x4B345A4C
+#define KERNEL64_MAXSIZE 0x400000
+
+// LZ4 block format rules. a match is 4 bytes at least and its offset fits
+// in 2 bytes. the last 5 bytes are always literals and no match starts in
+// the last 12 bytes
+#define LZ4_MINMATCH 4
+#define LZ4_MAXOFFSET 65535
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT 12
+#define LZ4_HASHBITS 16
+
+// header in front of compressed Kernel64.bin
+typedef struct kKernel64HeaderStruct {
+    unsigned int uiSignature;
+    unsigned int uiCompressedSize;
+    unsigned int uiUncompressedSize;
+    unsigned int uiReserved;
+} KERNEL64HEADER;
+
 int AdjustInSectorSize(int iFD, int iSourceSize);
 void WriteKernelInformation(
     int iTargetFd,
@@ -26,6 +50,13 @@ void WriteKernelInformation(
     int iKernel32SectorCount
 );
 int ConcatenateFile(int iSourceFd, int iTargetFd);
+int ConcatenateKernel64File(int iSourceFd, int iTargetFd, int *piKernelSize);
+int CompressLZ4Block(
+    const unsigned char *pbSource,
+    int iSourceSize,
+    unsigned char *pbDestination
+);
+unsigned char *WriteLZ4Length(unsigned char *pbOutput, int iLength);
 
 int main(int argc, char* argv[]) {
     int iSourceFd;
@@ -34,6 +65,7 @@ int main(int argc, char* argv[]) {
     int iKernel32SectorCount;
     int iKernel64SectorCount;
     int iSourceSize;
+    int iKernel64Size;
 
     if (argc < 4) {
     	fprintf(
@@ -102,9 +134,9 @@ int main(int argc, char* argv[]) {
     	exit(-1);
     }
 
-    // copy Kernel64.bin to Disk.img
-    // ISourceSize is size of Kernel64.bin
-    iSourceSize = ConcatenateFile(iSourceFd, iTargetFd);
+    // copy Kernel64.bin to Disk.img. it is compressed if it gets smaller
+    // ISourceSize is size of Kernel64.bin in Disk.img
+    iSourceSize = ConcatenateKernel64File(iSourceFd, iTargetFd, &iKernel64Size);
     close(iSourceFd);
 
     // add padding
@@ -113,6 +145,13 @@ int main(int argc, char* argv[]) {
     iKernel64SectorCount = AdjustInSectorSize(iTargetFd, iSourceSize);
     printf("[INFO] %s size = [%d] and sector count = [%d]\n",
     		argv[3], iSourceSize, iKernel64SectorCount);
+    if (iSourceSize != iKernel64Size) {
+        printf("[INFO] %s is compressed [%d] -> [%d] (%d%%), "
+                "[%d] sectors saved\n", argv[3], iKernel64Size, iSourceSize,
+                (int) ((long) iSourceSize * 100 / iKernel64Size),
+                (iKernel64Size + BYTESOFSECTOR - 1) / BYTESOFSECTOR -
+                iKernel64SectorCount);
+    }
 
 
     // Section 4
@@ -223,3 +262,189 @@ int ConcatenateFile(int iSourceFd, int iTargetFd) {
 	}
     return iSourceFileSize;
 }
+
+
+// compress Kernel64.bin and write it to the end of Target file
+// iSourceFd: Kernel64.bin
+// iTargetFd: target file
+// piKernelSize: size of Kernel64.bin before compression is saved here
+// return: number of bytes written
+// the header and compressed block are written only when they are smaller
+// than Kernel64.bin. Otherwise Kernel64.bin is written as it is and
+// 01.Kernel32 copies it without inflating
+int ConcatenateKernel64File(int iSourceFd, int iTargetFd, int *piKernelSize) {
+    unsigned char *pbKernel;
+    unsigned char *pbCompressed;
+    KERNEL64HEADER stHeader;
+    int iKernelSize;
+    int iCompressedSize;
+    int iRead;
+
+    // Kernel64.bin is inflated to [2MB, 6MB), so it can not be bigger
+    pbKernel = (unsigned char *) malloc(KERNEL64_MAXSIZE + 1);
+    if (pbKernel == NULL) {
+        fprintf(stderr, "[ERROR] Memory allocation fail\n");
+        exit(-1);
+    }
+
+    iKernelSize = 0;
+    while ((iRead = read(iSourceFd, pbKernel + iKernelSize,
+            KERNEL64_MAXSIZE + 1 - iKernelSize)) > 0) {
+        iKernelSize += iRead;
+    }
+    if ((iRead == -1) || (iKernelSize > KERNEL64_MAXSIZE)) {
+        fprintf(stderr, "[ERROR] Kernel64 read fail or it is over %d bytes\n",
+                KERNEL64_MAXSIZE);
+        exit(-1);
+    }
+    *piKernelSize = iKernelSize;
+
+    // incompressible data grows by 1 byte per 255 bytes at most
+    pbCompressed = (unsigned char *) malloc(
+        iKernelSize + (iKernelSize / 255) + 16);
+    if (pbCompressed == NULL) {
+        fprintf(stderr, "[ERROR] Memory allocation fail\n");
+        exit(-1);
+    }
+    iCompressedSize = CompressLZ4Block(pbKernel, iKernelSize, pbCompressed);
+
+    if ((int) sizeof(stHeader) + iCompressedSize < iKernelSize) {
+        stHeader.uiSignature = KERNEL64_COMPRESSEDSIGNATURE;
+        stHeader.uiCompressedSize = iCompressedSize;
+        stHeader.uiUncompressedSize = iKernelSize;
+        stHeader.uiReserved = 0;
+
+        if ((write(iTargetFd, &stHeader, sizeof(stHeader)) !=
+                sizeof(stHeader)) ||
+            (write(iTargetFd, pbCompressed, iCompressedSize) !=
+                iCompressedSize)) {
+            fprintf(stderr, "[ERROR] Kernel64 write fail\n");
+            exit(-1);
+        }
+        iKernelSize = sizeof(stHeader) + iCompressedSize;
+    }
+    else {
+        printf("[INFO] Kernel64 is not compressed because it does not get "
+                "smaller\n");
+        if (write(iTargetFd, pbKernel, iKernelSize) != iKernelSize) {
+            fprintf(stderr, "[ERROR] Kernel64 write fail\n");
+            exit(-1);
+        }
+    }
+
+    free(pbCompressed);
+    free(pbKernel);
+    return iKernelSize;
+}
+
+// compress data into LZ4 block format
+// pbSource: data to compress
+// iSourceSize: size of data
+// pbDestination: buffer for compressed block. it needs
+//                iSourceSize + iSourceSize / 255 + 16 bytes
+// return: size of compressed block
+// a hash table keeps the last position of each 4 byte sequence, and a
+// match found there is taken greedily and extended as far as it goes.
+// it does not search other candidates, so ratio is a bit lower than lz4 -9
+int CompressLZ4Block(
+    const unsigned char *pbSource,
+    int iSourceSize,
+    unsigned char *pbDestination
+) {
+    int *piHashTable;
+    unsigned char *pbOutput;
+    unsigned char *pbToken;
+    unsigned int uiSequence;
+    unsigned int uiHash;
+    int iAnchor;
+    int iPosition;
+    int iCandidate;
+    int iMatchLimit;
+    int iMatchLength;
+    int iLiteralLength;
+
+    piHashTable = (int *) malloc(sizeof(int) * (1 << LZ4_HASHBITS));
+    if (piHashTable == NULL) {
+        fprintf(stderr, "[ERROR] Memory allocation fail\n");
+        exit(-1);
+    }
+    memset(piHashTable, 0xFF, sizeof(int) * (1 << LZ4_HASHBITS));
+
+    pbOutput = pbDestination;
+    iAnchor = 0;
+    iPosition = 0;
+
+    // matches must end before the last literals
+    iMatchLimit = iSourceSize - LZ4_LASTLITERALS;
+
+    while (iPosition < iSourceSize - LZ4_MFLIMIT) {
+        memcpy(&uiSequence, pbSource + iPosition, sizeof(uiSequence));
+        uiHash = (uiSequence * 2654435761U) >> (32 - LZ4_HASHBITS);
+        iCandidate = piHashTable[uiHash];
+        piHashTable[uiHash] = iPosition;
+
+        if ((iCandidate < 0) ||
+            (iPosition - iCandidate > LZ4_MAXOFFSET) ||
+            (memcmp(pbSource + iCandidate, pbSource + iPosition,
+                LZ4_MINMATCH) != 0)) {
+            iPosition++;
+            continue;
+        }
+
+        iMatchLength = LZ4_MINMATCH;
+        while ((iPosition + iMatchLength < iMatchLimit) &&
+               (pbSource[iCandidate + iMatchLength] ==
+                pbSource[iPosition + iMatchLength])) {
+            iMatchLength++;
+        }
+
+        // token, literals, offset and match length
+        iLiteralLength = iPosition - iAnchor;
+        pbToken = pbOutput++;
+        *pbToken = (iLiteralLength >= 15 ? 15 : iLiteralLength) << 4;
+        if (iLiteralLength >= 15) {
+            pbOutput = WriteLZ4Length(pbOutput, iLiteralLength - 15);
+        }
+        memcpy(pbOutput, pbSource + iAnchor, iLiteralLength);
+        pbOutput += iLiteralLength;
+
+        *pbOutput++ = (iPosition - iCandidate) & 0xFF;
+        *pbOutput++ = (iPosition - iCandidate) >> 8;
+
+        iMatchLength -= LZ4_MINMATCH;
+        *pbToken |= (iMatchLength >= 15 ? 15 : iMatchLength);
+        if (iMatchLength >= 15) {
+            pbOutput = WriteLZ4Length(pbOutput, iMatchLength - 15);
+        }
+
+        iPosition += iMatchLength + LZ4_MINMATCH;
+        iAnchor = iPosition;
+    }
+
+    // the last sequence has literals only
+    iLiteralLength = iSourceSize - iAnchor;
+    pbToken = pbOutput++;
+    *pbToken = (iLiteralLength >= 15 ? 15 : iLiteralLength) << 4;
+    if (iLiteralLength >= 15) {
+        pbOutput = WriteLZ4Length(pbOutput, iLiteralLength - 15);
+    }
+    memcpy(pbOutput, pbSource + iAnchor, iLiteralLength);
+    pbOutput += iLiteralLength;
+
+    free(piHashTable);
+    return (int) (pbOutput - pbDestination);
+}
+
+// write extra bytes of literal or match length
+// pbOutput: where to write
+// iLength: length - 15
+// return: position after the written bytes
+// 255 is written while the length is 255 or more, and the rest follows
+unsigned char *WriteLZ4Length(unsigned char *pbOutput, int iLength) {
+    while (iLength >= 255) {
+        *pbOutput++ = 255;
+        iLength -= 255;
+    }
+    *pbOutput++ = (unsigned char) iLength;
+    return pbOutput;
+}